@@ -0,0 +1,824 @@
+// Host benchmark: boots a representative device set on RAM-disk volumes
+// and drives Z80 I/O workloads through BusSim. Every workload checks the
+// bytes it reads back, so a run doubles as a regression check for the
+// handler and ByteSource paths; the exit code is non-zero on a mismatch.
+//
+//   mzpico_host_bench [--ports]
+//
+// --ports adds the per-port breakdown to the per-device summary. The boot
+// line counts the C++ heap allocations made while configuring the devices
+// (ini parsing, port lists, the device objects and their buffers). A second
+// table reruns a few workloads without per-cycle clock reads and times
+// them as a batch: the dispatch cost of a short handler is below what a
+// clock_gettime() pair can resolve, and changes to listen_loop()'s own
+// overhead only show up there.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <time.h>
+
+#include "bus_sim.hpp"
+#include "bus.hpp"
+#include "host_boot.hpp"
+#include "host_disk.h"
+#include "disk_cache.h"
+#include "file_pool.hpp"
+#include "ff.h"
+#include "i2s_audio.hpp"
+#include "pico_mgr.hpp"
+#include "qd.hpp"
+
+// ---- C++ heap accounting for the boot line ----
+static size_t heap_allocs = 0;
+static size_t heap_bytes = 0;
+
+void* operator new(size_t n) {
+    heap_allocs++;
+    heap_bytes += n;
+    void* p = malloc(n ? n : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+// ---- Port map of the bench ini (see BENCH_INI) ----
+constexpr uint8_t MGR_PORT = 0x40;      // pico_mgr: cmd, data, addr0, addr1, reset
+constexpr uint8_t RD_PORT = 0x45;       // pico_rd, in RAM
+constexpr uint8_t RD_FILE_PORT = 0x50;  // pico_rd2, file-backed
+constexpr uint8_t FDC_PORT = 0xd8;
+constexpr uint8_t FDC_LINES_PORT = 0x70; // fdc2: fdc with cache_lines = 4
+constexpr uint8_t FDC_IMMEDIATE_PORT = 0x88; // fdc3: fdc with flush_policy = immediate
+constexpr uint8_t RAMDISK_PORT = 0xe9;  // ramdisk, file-backed
+constexpr uint8_t RAMDISK_RAM_PORT = 0xb0; // ramdisk2, in RAM
+constexpr uint8_t RAMDISK_LINES_PORT = 0xa8; // ramdisk3: ramdisk with cache_lines = 4
+constexpr uint8_t RAMDISK_IMMEDIATE_PORT = 0xb8; // ramdisk4: flush_policy = immediate
+constexpr uint8_t FDC_FRAG_PORT = 0x90;  // fdc4: fragmented image
+constexpr uint8_t RAMDISK_FRAG_PORT = 0x98; // ramdisk5: 1 MB, fragmented
+constexpr uint8_t FDC_FLASH_PORT = 0x78; // fdc5: image on flash:, read in place
+constexpr uint8_t FDC_DIR_PORT = 0x80;   // fdc6: CP/M directory mount
+constexpr uint8_t FDC_FORMAT_PORT = 0x68; // fdc7: blank image, formatted by the bench
+constexpr uint8_t FDC_TRACK_PORT = 0x30;  // fdc8: track_buffer, flush_policy = lazy
+constexpr uint8_t QD_PORT = 0xf4;
+constexpr uint8_t SRAM_PORT = 0xf8;
+constexpr uint8_t PSG_PORT = 0xf2;
+
+constexpr uint32_t RD_FILE_SIZE = 256 * 1024;
+constexpr uint8_t DSK_TRACKS = 80;
+constexpr uint8_t DSK_SIDES = 2;
+constexpr uint8_t DSK_SECTORS = 16;
+constexpr uint16_t DSK_SECTOR_SIZE = 256;
+constexpr int BENCH_DIR_FILES = 900;
+constexpr uint32_t RAMDISK_FRAG_SIZE = 1024 * 1024;
+constexpr uint32_t FRAG_CLUSTERS = 8;   // clusters per fragment of the fragmented images
+constexpr int CPM_DIR_FILES = 3;        // files of the CP/M directory mount
+constexpr uint32_t CPM_DIR_FILE_SIZE = 16 * 1024;
+
+static const char BENCH_INI[] =
+    "[pico_mgr]\n"
+    "[sramdisk]\n"
+    "image = @menu\n"
+    "[pico_rd]\n"
+    "[pico_rd2]\n"
+    "base_port = 0x50\n"
+    "image = sd:/bench/picord.img\n"
+    "size = 262144\n"
+    "flush_policy = lazy\n"
+    "[ramdisk]\n"
+    "image = sd:/bench/ramdisk.img\n"
+    "size = 131072\n"
+    "[ramdisk2]\n"
+    "read_ports = 0xb3, 0xb1, 0xb2\n"
+    "write_ports = 0xb0, 0xb1, 0xb2\n"
+    "[ramdisk3]\n"
+    "read_ports = 0xab, 0xa9, 0xaa\n"
+    "write_ports = 0xa8, 0xa9, 0xaa\n"
+    "image = sd:/bench/ramdisk3.img\n"
+    "size = 131072\n"
+    "cache_lines = 4\n"
+    "[ramdisk4]\n"
+    "read_ports = 0xbb, 0xb9, 0xba\n"
+    "write_ports = 0xb8, 0xb9, 0xba\n"
+    "image = sd:/bench/ramdisk4.img\n"
+    "size = 131072\n"
+    "flush_policy = immediate\n"
+    "[fdc]\n"
+    "image_disk1 = sd:/bench/cpm.dsk\n"
+    "[fdc2]\n"
+    "base_port = 0x70\n"
+    "image_disk1 = sd:/bench/cpm2.dsk\n"
+    "cache_lines = 4\n"
+    "[fdc3]\n"
+    "base_port = 0x88\n"
+    "image_disk1 = sd:/bench/cpm3.dsk\n"
+    "flush_policy = immediate\n"
+    "[fdc4]\n"
+    "base_port = 0x90\n"
+    "image_disk1 = sd:/bench/frag.dsk\n"
+    "[ramdisk5]\n"
+    "read_ports = 0x9b, 0x99, 0x9a\n"
+    "write_ports = 0x98, 0x99, 0x9a\n"
+    "image = sd:/bench/ramdisk5.img\n"
+    "size = 1048576\n"
+    "[fdc5]\n"
+    "base_port = 0x78\n"
+    "image_disk1 = flash:/bench/xip.dsk\n"
+    "[fdc6]\n"
+    "base_port = 0x80\n"
+    "image_disk1 = sd:/bench/cpmdir\n"
+    "fs_disk1 = cpm\n"
+    "[fdc7]\n"
+    "base_port = 0x68\n"
+    "image_disk1 = sd:/bench/blank.dsk\n"
+    "[fdc8]\n"
+    "base_port = 0x30\n"
+    "image_disk1 = sd:/bench/cpm4.dsk\n"
+    "image_disk2 = sd:/bench/blank2.dsk\n"
+    "track_buffer = true\n"
+    "flush_policy = lazy\n"
+    "[qd]\n"
+    "image = sd:/bench/disk.mzq\n"
+    "[psg]\n";
+
+// ---- Deterministic content, so reads can be verified ----
+
+static inline uint8_t seq_byte(uint32_t i) { return (uint8_t)(i * 7 + (i >> 8)); }
+static inline uint8_t qd_byte(uint32_t i) { return (uint8_t)(i ^ (i >> 7) ^ 0x3c); }
+static inline uint8_t cpm_file_byte(int file, uint32_t i) {
+    return (uint8_t)(i * 13 + file * 0x47 + (i >> 9));
+}
+static inline uint8_t dsk_byte(uint8_t t, uint8_t s, uint8_t r, uint16_t i, uint8_t gen) {
+    return (uint8_t)((t * 7) ^ (s * 0x55) ^ (r * 29) ^ i ^ (gen * 0xa5));
+}
+
+// ---- Fixtures ----
+
+static int write_file(const char *path, const uint8_t *data, uint32_t len) {
+    FIL f;
+    UINT bw = 0;
+    if (f_open(&f, path, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) return -1;
+    FRESULT fr = f_write(&f, data, len, &bw);
+    f_close(&f);
+    return (fr == FR_OK && bw == len) ? 0 : -1;
+}
+
+// Writes `data` a few clusters at a time, alternating with a filler file
+// that is deleted afterwards: the file ends up in one fragment per piece,
+// like an image on a card that has seen years of saves
+static int write_fragmented(const char *path, const uint8_t *data, uint32_t len) {
+    static const char gap_path[] = "sd:/bench/gap.tmp";
+    FATFS *fs;
+    DWORD free_clusters;
+    if (f_getfree("sd:", &free_clusters, &fs) != FR_OK) return -1;
+    const uint32_t piece = FRAG_CLUSTERS * fs->csize * FF_MIN_SS;
+    const std::string gap(piece, '\0');
+
+    FIL f, g;
+    if (f_open(&f, path, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) return -1;
+    if (f_open(&g, gap_path, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+        f_close(&f);
+        return -1;
+    }
+    int ret = 0;
+    for (uint32_t off = 0; off < len && ret == 0; off += piece) {
+        const uint32_t n = (len - off < piece) ? len - off : piece;
+        UINT bw = 0, gw = 0;
+        if (f_write(&f, data + off, n, &bw) != FR_OK || bw != n ||
+            f_write(&g, gap.data(), piece, &gw) != FR_OK || gw != piece)
+            ret = -1;
+    }
+    f_close(&g);
+    f_close(&f);
+    if (f_unlink(gap_path) != FR_OK) return -1;
+    return ret;
+}
+
+// Extended CPC DSK, uniform geometry, sector IDs 1..n
+static int make_dsk(const char *path, bool fragmented = false) {
+    const uint32_t track_len = 0x100 + DSK_SECTORS * DSK_SECTOR_SIZE;
+    std::string img(0x100 + (size_t)DSK_TRACKS * DSK_SIDES * track_len, '\0');
+    uint8_t *p = (uint8_t *)&img[0];
+
+    memcpy(p, "EXTENDED CPC DSK File\r\nDisk-Info\r\n", 34);
+    memcpy(p + 0x22, "mzpico-bench", 12);
+    p[0x30] = DSK_TRACKS;
+    p[0x31] = DSK_SIDES;
+    for (int i = 0; i < DSK_TRACKS * DSK_SIDES; i++)
+        p[0x34 + i] = (uint8_t)(track_len >> 8);
+
+    uint8_t *t = p + 0x100;
+    for (uint8_t track = 0; track < DSK_TRACKS; track++) {
+        for (uint8_t side = 0; side < DSK_SIDES; side++, t += track_len) {
+            memcpy(t, "Track-Info\r\n", 12);
+            t[0x10] = track;
+            t[0x11] = side;
+            t[0x14] = DSK_SECTOR_SIZE >> 8;
+            t[0x15] = DSK_SECTORS;
+            t[0x16] = 0x4e;
+            t[0x17] = 0xe5;
+            for (uint8_t r = 1; r <= DSK_SECTORS; r++) {
+                uint8_t *d = t + 0x18 + (r - 1) * 8;
+                d[0] = track;
+                d[1] = side;
+                d[2] = r;
+                d[3] = DSK_SECTOR_SIZE >> 8;
+                d[6] = DSK_SECTOR_SIZE & 0xff;
+                d[7] = DSK_SECTOR_SIZE >> 8;
+                uint8_t *data = t + 0x100 + (r - 1) * DSK_SECTOR_SIZE;
+                for (uint16_t i = 0; i < DSK_SECTOR_SIZE; i++)
+                    data[i] = dsk_byte(track, side, r, i, 0);
+            }
+        }
+    }
+    if (fragmented)
+        return write_fragmented(path, p, (uint32_t)img.size());
+    return write_file(path, p, (uint32_t)img.size());
+}
+
+static int make_fixtures() {
+    if (f_mkdir("sd:/bench") != FR_OK) return -1;
+    if (f_mkdir("sd:/bench/dir") != FR_OK) return -1;
+    if (make_dsk("sd:/bench/cpm.dsk") != 0) return -1;
+    if (make_dsk("sd:/bench/cpm2.dsk") != 0) return -1;
+    if (make_dsk("sd:/bench/cpm3.dsk") != 0) return -1;
+    if (make_dsk("sd:/bench/frag.dsk", /* fragmented = */ true) != 0) return -1;
+    if (make_dsk("sd:/bench/cpm4.dsk") != 0) return -1;
+    if (write_file("sd:/bench/blank.dsk", nullptr, 0) != 0) return -1;
+    if (write_file("sd:/bench/blank2.dsk", nullptr, 0) != 0) return -1;
+    if (f_mkdir("flash:/bench") != FR_OK) return -1;
+    if (make_dsk("flash:/bench/xip.dsk") != 0) return -1;
+
+    std::string rd(RAMDISK_FRAG_SIZE, '\0');
+    for (uint32_t i = 0; i < rd.size(); i++) rd[i] = (char)seq_byte(i);
+    if (write_fragmented("sd:/bench/ramdisk5.img", (const uint8_t *)rd.data(), (uint32_t)rd.size()) != 0)
+        return -1;
+
+    std::string qd(QDISK_FORMAT_SIZE, '\0');
+    for (uint32_t i = 0; i < qd.size(); i++) qd[i] = (char)qd_byte(i);
+    if (write_file("sd:/bench/disk.mzq", (const uint8_t *)qd.data(), (uint32_t)qd.size()) != 0)
+        return -1;
+
+    if (f_mkdir("sd:/bench/cpmdir") != FR_OK) return -1;
+    std::string cpm(CPM_DIR_FILE_SIZE, '\0');
+    for (int f = 0; f < CPM_DIR_FILES; f++) {
+        char path[48];
+        snprintf(path, sizeof(path), "sd:/bench/cpmdir/PART%d.DAT", f);
+        for (uint32_t i = 0; i < cpm.size(); i++) cpm[i] = (char)cpm_file_byte(f, i);
+        if (write_file(path, (const uint8_t *)cpm.data(), (uint32_t)cpm.size()) != 0) return -1;
+    }
+
+    uint8_t mzf[128 + 256] = { 0x01 };
+    for (int i = 0; i < BENCH_DIR_FILES; i++) {
+        char path[48];
+        snprintf(path, sizeof(path), "sd:/bench/dir/GAME%03d.MZF", i);
+        if (write_file(path, mzf, sizeof(mzf)) != 0) return -1;
+    }
+    return write_file("sd:/mzpico.ini", (const uint8_t *)BENCH_INI, sizeof(BENCH_INI) - 1);
+}
+
+// ---- Workloads; each returns its number of verification errors ----
+
+static uint32_t rd_seq_write(BusSim& bus, uint8_t base, uint32_t len) {
+    bus.out(base, 0); // control: rewind
+    for (uint32_t i = 0; i < len; i++) bus.out(base + 1, seq_byte(i));
+    return 0;
+}
+
+static uint32_t rd_seq_read(BusSim& bus, uint8_t base, uint32_t len) {
+    uint32_t errors = 0;
+    bus.in(base); // control: rewind
+    for (uint32_t i = 0; i < len; i++)
+        if (bus.in(base + 1) != seq_byte(i)) errors++;
+    return errors;
+}
+
+// 256-byte blocks at scattered addresses, positioned through the
+// auto-indexed address port (low, middle, high byte)
+static uint32_t rd_random_blocks(BusSim& bus, uint8_t base, uint32_t size, int blocks) {
+    uint32_t errors = 0;
+    uint32_t lcg = 12345;
+    for (int b = 0; b < blocks; b++) {
+        lcg = lcg * 1103515245u + 12345u;
+        const uint32_t addr = ((lcg >> 8) % size) & ~0xffu;
+        bus.out(base + 5, (uint8_t)addr);
+        bus.out(base + 5, (uint8_t)(addr >> 8));
+        bus.out(base + 5, (uint8_t)(addr >> 16));
+        for (uint32_t i = 0; i < 256; i++)
+            if (bus.in(base + 1) != seq_byte(addr + i)) errors++;
+    }
+    return errors;
+}
+
+static uint32_t ramdisk_write(BusSim& bus, uint8_t base) {
+    bus.out(base, 0);          // page 0
+    bus.out(base + 2, 0, 0);   // address 0x0000 (high byte from A8-A15)
+    for (uint32_t i = 0; i < 65536; i++) bus.out(base + 1, seq_byte(i));
+    return 0;
+}
+
+static uint32_t ramdisk_read(BusSim& bus, uint8_t base) {
+    uint32_t errors = 0;
+    bus.out(base, 0);
+    bus.out(base + 2, 0, 0);
+    for (uint32_t i = 0; i < 65536; i++)
+        if (bus.in(base + 1) != seq_byte(i)) errors++;
+    return errors;
+}
+
+// Page 0 to page 1 in 32-byte bursts, re-addressing for each as a
+// buffer-bound copy does: the two regions alternate every burst
+static uint32_t ramdisk_page_copy(BusSim& bus, uint8_t base) {
+    uint8_t buf[32];
+    for (uint32_t a = 0; a < 65536; a += sizeof(buf)) {
+        bus.out(base, 0);
+        bus.out(base + 2, (uint8_t)a, (uint8_t)(a >> 8));
+        for (uint8_t& b : buf) b = bus.in(base + 1);
+        bus.out(base, 1);
+        bus.out(base + 2, (uint8_t)a, (uint8_t)(a >> 8));
+        for (uint8_t b : buf) bus.out(base + 1, b);
+    }
+    uint32_t errors = 0;
+    bus.out(base, 1);
+    bus.out(base + 2, 0, 0);
+    for (uint32_t i = 0; i < 65536; i++)
+        if (bus.in(base + 1) != seq_byte(i)) errors++;
+    return errors;
+}
+
+// 32-byte bursts at scattered addresses of a multi-page ramdisk: each one
+// a seek into the image
+static uint32_t ramdisk_random_bursts(BusSim& bus, uint8_t base, uint32_t size, int bursts) {
+    uint32_t errors = 0;
+    uint32_t lcg = 54321;
+    for (int b = 0; b < bursts; b++) {
+        lcg = lcg * 1103515245u + 12345u;
+        const uint32_t addr = ((lcg >> 4) % size) & ~31u;
+        bus.out(base, (uint8_t)(addr >> 16));
+        bus.out(base + 2, (uint8_t)addr, (uint8_t)(addr >> 8));
+        for (uint32_t i = 0; i < 32; i++)
+            if (bus.in(base + 1) != seq_byte(addr + i)) errors++;
+    }
+    return errors;
+}
+
+static uint32_t sram_stream(BusSim& bus) {
+    bus.in(SRAM_PORT); // reset the read pointer (also the ramdisk counter)
+    for (uint32_t i = 0; i < 128 + 4096; i++) bus.in(SRAM_PORT + 1);
+    return 0;
+}
+
+// Commands are written inverted, as the MZ FDC interface does
+constexpr uint8_t FDC_CMD_SEEK = 0xef;
+constexpr uint8_t FDC_CMD_READ_SECTOR = 0x7f;
+constexpr uint8_t FDC_CMD_WRITE_SECTOR = 0x5f;
+constexpr uint8_t FDC_WRITTEN_FIRST = 20; // tracks fdc_write_sectors rewrites
+constexpr uint8_t FDC_WRITTEN_LAST = 23;
+
+static void fdc_seek(BusSim& bus, uint8_t base, uint8_t track, uint8_t side) {
+    bus.out(base + 3, (uint8_t)~track);
+    bus.out(base, FDC_CMD_SEEK);
+    bus.in(base);
+    bus.out(base + 5, side);
+}
+
+// `written`: fdc_write_sectors has run on this controller
+static uint32_t fdc_read_disk(BusSim& bus, uint8_t base, uint8_t tracks, bool written = true) {
+    uint32_t errors = 0;
+    bus.out(base + 4, 0x84); // motor on, drive 0
+    for (uint8_t t = 0; t < tracks; t++) {
+        for (uint8_t s = 0; s < DSK_SIDES; s++) {
+            fdc_seek(bus, base, t, s);
+            const uint8_t gen = (written && t >= FDC_WRITTEN_FIRST && t <= FDC_WRITTEN_LAST) ? 1 : 0;
+            for (uint8_t r = 1; r <= DSK_SECTORS; r++) {
+                bus.out(base + 2, (uint8_t)~r);
+                bus.out(base, FDC_CMD_READ_SECTOR);
+                bus.in(base);
+                for (uint16_t i = 0; i < DSK_SECTOR_SIZE; i++)
+                    if ((uint8_t)~bus.in(base + 3) != dsk_byte(t, s, r, i, gen)) errors++;
+            }
+        }
+    }
+    return errors;
+}
+
+// Sectors of scattered tracks and sides, as a CP/M directory lookup and
+// file reads hop around the disk
+static uint32_t fdc_random_sectors(BusSim& bus, uint8_t base, int count) {
+    uint32_t errors = 0;
+    uint32_t lcg = 4321;
+    bus.out(base + 4, 0x84);
+    for (int n = 0; n < count; n++) {
+        lcg = lcg * 1103515245u + 12345u;
+        const uint8_t t = (uint8_t)((lcg >> 8) % DSK_TRACKS);
+        const uint8_t s = (uint8_t)((lcg >> 16) & 1);
+        const uint8_t r = (uint8_t)(1 + (lcg >> 20) % DSK_SECTORS);
+        fdc_seek(bus, base, t, s);
+        bus.out(base + 2, (uint8_t)~r);
+        bus.out(base, FDC_CMD_READ_SECTOR);
+        bus.in(base);
+        for (uint16_t i = 0; i < DSK_SECTOR_SIZE; i++)
+            if ((uint8_t)~bus.in(base + 3) != dsk_byte(t, s, r, i, 0)) errors++;
+    }
+    return errors;
+}
+
+// read_first reads each track's first sector before writing it, as an
+// OS does its directory, which puts the track in a track buffer
+static uint32_t fdc_write_sectors(BusSim& bus, uint8_t base, bool read_first = false) {
+    uint32_t errors = 0;
+    bus.out(base + 4, 0x84);
+    for (uint8_t t = FDC_WRITTEN_FIRST; t <= FDC_WRITTEN_LAST; t++) {
+        for (uint8_t s = 0; s < DSK_SIDES; s++) {
+            fdc_seek(bus, base, t, s);
+            if (read_first) {
+                bus.out(base + 2, (uint8_t)~1);
+                bus.out(base, FDC_CMD_READ_SECTOR);
+                bus.in(base);
+                for (uint16_t i = 0; i < DSK_SECTOR_SIZE; i++)
+                    if ((uint8_t)~bus.in(base + 3) != dsk_byte(t, s, 1, i, 0)) errors++;
+            }
+            for (uint8_t r = 1; r <= DSK_SECTORS; r++) {
+                bus.out(base + 2, (uint8_t)~r);
+                bus.out(base, FDC_CMD_WRITE_SECTOR);
+                bus.in(base);
+                for (uint16_t i = 0; i < DSK_SECTOR_SIZE; i++)
+                    bus.out(base + 3, (uint8_t)~dsk_byte(t, s, r, i, 1));
+            }
+        }
+    }
+    return errors;
+}
+
+constexpr uint8_t FDC_CMD_WRITE_TRACK = 0x0f;
+constexpr uint8_t FDC_CMD_READ_TRACK = 0x1f;
+
+static inline uint8_t fmt_fill(uint8_t t, uint8_t s, uint8_t pass) {
+    return (uint8_t)(0x40 + t * 2 + s + pass * 0x10);
+}
+// Pass 0 numbers the sectors 1..n, pass 1 backwards
+static inline uint8_t fmt_id(uint8_t r, uint8_t pass) {
+    return pass ? (uint8_t)(DSK_SECTORS + 1 - r) : r;
+}
+
+// One WRITE TRACK stream as a format routine sends it: gaps, an ID field
+// and a filled data field per sector (bytes go out inverted)
+static void fdc_format_track(BusSim& bus, uint8_t base, uint8_t t, uint8_t s, uint8_t pass) {
+    auto put = [&](uint8_t b, int n) { while (n--) bus.out(base + 3, (uint8_t)~b); };
+    fdc_seek(bus, base, t, s);
+    bus.out(base, FDC_CMD_WRITE_TRACK);
+    put(0x4e, 32);
+    put(0xfc, 1);
+    for (uint8_t r = 1; r <= DSK_SECTORS; r++) {
+        put(0x4e, 16);
+        put(0xfe, 1);
+        put(t, 1);
+        put(s, 1);
+        put(fmt_id(r, pass), 1);
+        put(DSK_SECTOR_SIZE >> 8, 1);
+        put(0xf7, 1);
+        put(0x4e, 22);
+        put(0xfb, 1);
+        put(fmt_fill(t, s, pass), DSK_SECTOR_SIZE);
+        put(0xf7, 1);
+    }
+    put(0x4e, 256);
+}
+
+// Every sector by ID, then the READ TRACK stream: IDs and fill bytes
+static uint32_t fdc_verify_track(BusSim& bus, uint8_t base, uint8_t t, uint8_t s, uint8_t pass) {
+    uint32_t errors = 0;
+    const uint8_t fill = fmt_fill(t, s, pass);
+    fdc_seek(bus, base, t, s);
+    for (uint8_t r = 1; r <= DSK_SECTORS; r++) {
+        bus.out(base + 2, (uint8_t)~r);
+        bus.out(base, FDC_CMD_READ_SECTOR);
+        bus.in(base);
+        for (uint16_t i = 0; i < DSK_SECTOR_SIZE; i++)
+            if ((uint8_t)~bus.in(base + 3) != fill) errors++;
+    }
+    bus.out(base, FDC_CMD_READ_TRACK);
+    bus.in(base);
+    if ((uint8_t)~bus.in(base + 3) != 0xfc) errors++;
+    for (uint8_t r = 1; r <= DSK_SECTORS; r++) {
+        const uint8_t id[6] = { 0xfe, t, (uint8_t)(s & 1), fmt_id(r, pass), DSK_SECTOR_SIZE >> 8, 0xfb };
+        for (uint8_t b : id)
+            if ((uint8_t)~bus.in(base + 3) != b) errors++;
+        for (uint16_t i = 0; i < DSK_SECTOR_SIZE; i++)
+            if ((uint8_t)~bus.in(base + 3) != fill) errors++;
+    }
+    return errors;
+}
+
+// Formats two cylinders of a blank image in `drive` and reads them back,
+// then reformats the last but one track with other IDs, which drops the
+// track after it: what is left must read as laid out
+static uint32_t fdc_format(BusSim& bus, uint8_t base, uint8_t drive = 0) {
+    uint32_t errors = 0;
+    bus.out(base + 4, (uint8_t)(0x84 | drive));
+    for (uint8_t t = 0; t < 2; t++)
+        for (uint8_t s = 0; s < DSK_SIDES; s++)
+            fdc_format_track(bus, base, t, s, 0);
+    for (uint8_t t = 0; t < 2; t++)
+        for (uint8_t s = 0; s < DSK_SIDES; s++)
+            errors += fdc_verify_track(bus, base, t, s, 0);
+    fdc_format_track(bus, base, 1, 0, 1);
+    errors += fdc_verify_track(bus, base, 1, 0, 1);
+    errors += fdc_verify_track(bus, base, 0, 1, 0);
+    return errors;
+}
+
+// LEC CP/M geometry of a directory mount (FDCDirSource): 512-byte
+// sectors 1..9, four reserved tracks, 2 KB blocks, the directory in
+// blocks 0 and 1. DSK track = cylinder * 2 + side.
+constexpr uint16_t CPM_SECTOR_SIZE = 512;
+constexpr uint8_t CPM_OFF_TRACKS = 4;
+
+static uint32_t cpm_read_record_sector(BusSim& bus, uint8_t base, uint32_t rec, uint8_t *out) {
+    const uint8_t track = (uint8_t)(CPM_OFF_TRACKS + rec / 36);
+    const uint8_t id = (uint8_t)(1 + (rec % 36) / 4);
+    fdc_seek(bus, base, track >> 1, track & 1);
+    bus.out(base + 2, (uint8_t)~id);
+    bus.out(base, FDC_CMD_READ_SECTOR);
+    bus.in(base);
+    for (uint16_t i = 0; i < CPM_SECTOR_SIZE; i++) out[i] = (uint8_t)~bus.in(base + 3);
+    return 0;
+}
+
+// PIP-style: reads the directory, then the files' 2 KB blocks in turn -
+// a block of PART0, one of PART1, one of PART2, the next of PART0 - as a
+// concatenation or a program pulling in overlays does
+static uint32_t fdc_dir_interleaved(BusSim& bus, uint8_t base) {
+    uint32_t errors = 0;
+    uint8_t dir[4096], sec[CPM_SECTOR_SIZE];
+    bus.out(base + 4, 0x84);
+    for (uint32_t rec = 0; rec < sizeof(dir) / 128; rec += 4)
+        cpm_read_record_sector(bus, base, rec, dir + rec * 128);
+
+    uint16_t blocks[CPM_DIR_FILES][CPM_DIR_FILE_SIZE / 2048] = {};
+    for (int e = 0; e < 128; e++) {
+        const uint8_t *d = dir + e * 32;
+        int f;
+        if (d[0] != 0 || memcmp(d + 1, "PART", 4) != 0 || (f = d[5] - '0') < 0 || f >= CPM_DIR_FILES)
+            continue;
+        const uint32_t extent = d[12] | (uint32_t)d[14] << 5;
+        for (uint32_t b = 0; b < 8 && extent * 8 + b < CPM_DIR_FILE_SIZE / 2048; b++)
+            blocks[f][extent * 8 + b] = (uint16_t)(d[16 + b * 2] | d[17 + b * 2] << 8);
+    }
+    for (uint32_t b = 0; b < CPM_DIR_FILE_SIZE / 2048; b++) {
+        for (int f = 0; f < CPM_DIR_FILES; f++) {
+            if (!blocks[f][b]) { errors++; continue; }
+            for (uint32_t s = 0; s < 4; s++) {
+                cpm_read_record_sector(bus, base, blocks[f][b] * 16u + s * 4, sec);
+                for (uint16_t i = 0; i < CPM_SECTOR_SIZE; i++)
+                    if (sec[i] != cpm_file_byte(f, b * 2048 + s * CPM_SECTOR_SIZE + i)) errors++;
+            }
+        }
+    }
+    return errors;
+}
+
+static uint32_t qd_stream(BusSim& bus) {
+    uint32_t errors = 0;
+    bus.out(QD_PORT + 3, 0x05); // channel B: select WR5
+    bus.out(QD_PORT + 3, 0x80); // motor on (rewinds to position 0)
+    for (uint32_t i = 0; i < QDISK_FORMAT_SIZE; i++)
+        if (bus.in(QD_PORT) != qd_byte(i)) errors++;
+    bus.out(QD_PORT + 3, 0x05);
+    bus.out(QD_PORT + 3, 0x00); // motor off
+    return errors;
+}
+
+static uint32_t mgr_list_dir(BusSim& bus) {
+    static const char path[] = "sd:/bench/dir";
+    const uint16_t len = sizeof(path);
+    bus.out(MGR_PORT + 4, 0); // reset index
+    bus.out(MGR_PORT + 1, (uint8_t)len);
+    bus.out(MGR_PORT + 1, (uint8_t)(len >> 8));
+    for (uint16_t i = 0; i < len; i++) bus.out(MGR_PORT + 1, (uint8_t)path[i]);
+    bus.out(MGR_PORT, REPO_CMD_LIST_DIR);
+    // Poll the status port while the listing is built, as the manager does
+    uint8_t status;
+    for (uint32_t polls = 0; (status = bus.in(MGR_PORT)) == PICO_MGR_RESULT_IN_PROGRESS; polls++)
+        if (polls > 1000000) return 1;
+    if (status != PICO_MGR_RESULT_OK) return 1;
+
+    // Read the whole listing back, as the explorer does
+    bus.out(MGR_PORT + 4, 0);
+    uint16_t payload = bus.in(MGR_PORT + 1);
+    payload |= (uint16_t)(bus.in(MGR_PORT + 1) << 8);
+    for (uint32_t i = 0; i < payload; i++) bus.in(MGR_PORT + 1);
+    return payload ? 0 : 1;
+}
+
+// One REPO_CMD_RECONFIG round trip; returns the error count
+static uint32_t mgr_reconfig(BusSim& bus, const char* cmd) {
+    const uint16_t len = (uint16_t)strlen(cmd) + 1;
+    bus.out(MGR_PORT + 4, 0);
+    bus.out(MGR_PORT + 1, (uint8_t)len);
+    bus.out(MGR_PORT + 1, (uint8_t)(len >> 8));
+    for (uint16_t i = 0; i < len; i++) bus.out(MGR_PORT + 1, (uint8_t)cmd[i]);
+    bus.out(MGR_PORT, REPO_CMD_RECONFIG);
+    uint8_t status;
+    for (uint32_t polls = 0; (status = bus.in(MGR_PORT)) == PICO_MGR_RESULT_IN_PROGRESS; polls++)
+        if (polls > 1000000) return 1;
+    return status == PICO_MGR_RESULT_OK ? 0 : 1;
+}
+
+// Re-ports ramdisk2 and back (its RAM content from the earlier write
+// pass must follow it), then adds, uses and removes a third pico_rd
+static uint32_t mgr_hot_config(BusSim& bus) {
+    constexpr uint8_t MOVED_PORT = 0xc0, ADDED_PORT = 0x60;
+    uint32_t errors = mgr_reconfig(bus, "ports ramdisk2 base_port=0xc0");
+    errors += ramdisk_read(bus, MOVED_PORT);
+    errors += mgr_reconfig(bus, "ports ramdisk2 read_ports=0xb3,0xb1,0xb2 write_ports=0xb0,0xb1,0xb2");
+    errors += ramdisk_read(bus, RAMDISK_RAM_PORT);
+    errors += mgr_reconfig(bus, "add pico_rd3 base_port=0x60 size=4096");
+    errors += rd_seq_write(bus, ADDED_PORT, 4096);
+    errors += rd_seq_read(bus, ADDED_PORT, 4096);
+    errors += mgr_reconfig(bus, "remove pico_rd3");
+    errors += mgr_reconfig(bus, "remove pico_rd3") ? 0 : 1; // gone now
+    return errors;
+}
+
+static uint32_t psg_writes(BusSim& bus) {
+    for (uint32_t i = 0; i < 16384; i++) {
+        bus.out(PSG_PORT, (uint8_t)(0x80 | (i & 0x7f)));
+        if ((i & 31) == 31) i2s_audio_poll(); // core 0 drains the queue
+    }
+    return 0;
+}
+
+struct Workload {
+    const char *name;
+    uint32_t (*run)(BusSim&);
+};
+
+static const Workload workloads[] = {
+    { "pico_rd ram: seq write 64K",     [](BusSim& b) { return rd_seq_write(b, RD_PORT, 65536); } },
+    { "pico_rd ram: seq read 64K",      [](BusSim& b) { return rd_seq_read(b, RD_PORT, 65536); } },
+    { "pico_rd file: seq write 256K",   [](BusSim& b) { return rd_seq_write(b, RD_FILE_PORT, RD_FILE_SIZE); } },
+    { "pico_rd file: seq read 256K",    [](BusSim& b) { return rd_seq_read(b, RD_FILE_PORT, RD_FILE_SIZE); } },
+    { "pico_rd file: random 256B x256", [](BusSim& b) { return rd_random_blocks(b, RD_FILE_PORT, RD_FILE_SIZE, 256); } },
+    { "ramdisk ram: write 64K",         [](BusSim& b) { return ramdisk_write(b, RAMDISK_RAM_PORT); } },
+    { "ramdisk ram: read 64K",          [](BusSim& b) { return ramdisk_read(b, RAMDISK_RAM_PORT); } },
+    { "ramdisk file: write 64K",        [](BusSim& b) { return ramdisk_write(b, RAMDISK_PORT); } },
+    { "ramdisk file: read 64K",         [](BusSim& b) { return ramdisk_read(b, RAMDISK_PORT); } },
+    { "ramdisk file: page copy 32B",    [](BusSim& b) { return ramdisk_page_copy(b, RAMDISK_PORT); } },
+    { "ramdisk immediate: write 64K",   [](BusSim& b) { return ramdisk_write(b, RAMDISK_IMMEDIATE_PORT); } },
+    { "ramdisk immediate: read 64K",    [](BusSim& b) { return ramdisk_read(b, RAMDISK_IMMEDIATE_PORT); } },
+    { "ramdisk 4 lines: write 64K",     [](BusSim& b) { return ramdisk_write(b, RAMDISK_LINES_PORT); } },
+    { "ramdisk 4 lines: read 64K",      [](BusSim& b) { return ramdisk_read(b, RAMDISK_LINES_PORT); } },
+    { "ramdisk 4 lines: page copy 32B", [](BusSim& b) { return ramdisk_page_copy(b, RAMDISK_LINES_PORT); } },
+    { "sramdisk: @menu stream",         [](BusSim& b) { return sram_stream(b); } },
+    { "fdc: write 128 sectors",         [](BusSim& b) { return fdc_write_sectors(b, FDC_PORT); } },
+    { "fdc: read 40 tracks x2 sides",   [](BusSim& b) { return fdc_read_disk(b, FDC_PORT, 40); } },
+    { "fdc 4 lines: write 128 sectors", [](BusSim& b) { return fdc_write_sectors(b, FDC_LINES_PORT); } },
+    { "fdc 4 lines: read 40 tracks x2", [](BusSim& b) { return fdc_read_disk(b, FDC_LINES_PORT, 40); } },
+    { "fdc immediate: write 128 sect",  [](BusSim& b) { return fdc_write_sectors(b, FDC_IMMEDIATE_PORT); } },
+    { "fdc immediate: read 40 tracks",  [](BusSim& b) { return fdc_read_disk(b, FDC_IMMEDIATE_PORT, 40); } },
+    { "fdc fragmented: random 512 sect", [](BusSim& b) { return fdc_random_sectors(b, FDC_FRAG_PORT, 512); } },
+    { "fdc flash: read 40 tracks x2",   [](BusSim& b) { return fdc_read_disk(b, FDC_FLASH_PORT, 40, false); } },
+    { "fdc cpm dir: 3 files interleaved", [](BusSim& b) { return fdc_dir_interleaved(b, FDC_DIR_PORT); } },
+    { "fdc: format 4 tracks, read back", [](BusSim& b) { return fdc_format(b, FDC_FORMAT_PORT); } },
+    { "fdc track buf: random 512 sect", [](BusSim& b) { return fdc_random_sectors(b, FDC_TRACK_PORT, 512); } },
+    { "fdc track buf: write 128 sectors", [](BusSim& b) { return fdc_write_sectors(b, FDC_TRACK_PORT, true); } },
+    { "fdc track buf: read 40 tracks x2", [](BusSim& b) { return fdc_read_disk(b, FDC_TRACK_PORT, 40); } },
+    { "fdc track buf: format, read back", [](BusSim& b) { return fdc_format(b, FDC_TRACK_PORT, 1); } },
+    { "ramdisk 1M fragmented: 32B x2048", [](BusSim& b) { return ramdisk_random_bursts(b, RAMDISK_FRAG_PORT, RAMDISK_FRAG_SIZE, 2048); } },
+    { "qd: stream whole image",         [](BusSim& b) { return qd_stream(b); } },
+    { "pico_mgr: LIST_DIR 900 files",   [](BusSim& b) { return mgr_list_dir(b); } },
+    { "psg: register writes",           [](BusSim& b) { return psg_writes(b); } },
+    { "pico_mgr: RECONFIG move/add/del", [](BusSim& b) { return mgr_hot_config(b); } },
+};
+
+// Batch-timed reruns: one cheap handler per dispatch shape (direct read,
+// direct write, /INT-capable port, pre-staged read), then the per-byte
+// ByteSource cost of the data ports over RAM and a cache window
+static const Workload dispatch_workloads[] = {
+    { "ramdisk ram: read 64K",          [](BusSim& b) { return ramdisk_read(b, RAMDISK_RAM_PORT); } },
+    { "psg: register writes",           [](BusSim& b) { return psg_writes(b); } },
+    { "fdc: read 40 tracks x2 sides",   [](BusSim& b) { return fdc_read_disk(b, FDC_PORT, 40); } },
+    { "fdc flash: read 40 tracks x2",   [](BusSim& b) { return fdc_read_disk(b, FDC_FLASH_PORT, 40, false); } },
+    { "pico_rd ram: seq read 64K",      [](BusSim& b) { return rd_seq_read(b, RD_PORT, 65536); } },
+    { "ramdisk ram: write 64K",         [](BusSim& b) { return ramdisk_write(b, RAMDISK_RAM_PORT); } },
+    { "ramdisk file: read 64K",         [](BusSim& b) { return ramdisk_read(b, RAMDISK_PORT); } },
+    { "pico_rd file: seq read 256K",    [](BusSim& b) { return rd_seq_read(b, RD_FILE_PORT, RD_FILE_SIZE); } },
+    { "sramdisk: @menu stream",         [](BusSim& b) { return sram_stream(b); } },
+    { "qd: stream whole image",         [](BusSim& b) { return qd_stream(b); } },
+};
+static constexpr int DISPATCH_PASSES = 8;
+
+static uint64_t wall_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+    const bool show_ports = (argc > 1 && strcmp(argv[1], "--ports") == 0);
+
+    if (host_mount_volumes() != 0 || make_fixtures() != 0) {
+        fprintf(stderr, "bench: volume setup failed\n");
+        return 2;
+    }
+    const size_t allocs0 = heap_allocs, bytes0 = heap_bytes;
+    const uint64_t boot0 = wall_ns();
+    const int booted = host_boot_devices("sd:/mzpico.ini");
+    const uint64_t boot1 = wall_ns();
+    if (booted <= 0) {
+        fprintf(stderr, "bench: device boot failed\n");
+        return 2;
+    }
+
+    BusSim bus;
+    printf("\nmzpico host bench (%llu ns timer overhead subtracted per cycle)\n",
+           (unsigned long long)bus.timerOverheadNs());
+    printf("boot: %d devices in %.1f us, %zu heap allocations (%zu bytes)\n\n", booted,
+           (double)(boot1 - boot0) / 1e3, heap_allocs - allocs0, heap_bytes - bytes0);
+    printf("  %-32s %9s %9s %9s %8s %8s %7s\n",
+           "workload", "cycles", "ns/op", "max ns", "sd rd", "sd wr", "errors");
+
+    uint32_t total_errors = 0;
+    for (const auto &w : workloads) {
+        // Per-workload max; the per-port statistics keep accumulating for
+        // the reports below
+        bus.resetMax();
+        const BusSim::Totals before = bus.totals();
+        host_disk_reset_stats();
+
+        const uint32_t errors = w.run(bus);
+        const BusSim::Totals &after = bus.totals();
+
+        HostDiskStats sd;
+        host_disk_get_stats(HOST_DISK_SD, &sd);
+        const uint64_t cycles = after.cycles - before.cycles;
+        printf("  %-32s %9llu %9.1f %9llu %8u %8u %7u\n", w.name,
+               (unsigned long long)cycles,
+               cycles ? (double)(after.total_ns - before.total_ns) / (double)cycles : 0.0,
+               (unsigned long long)after.max_ns, sd.read_sectors, sd.write_sectors, errors);
+        total_errors += errors;
+    }
+
+    const BusSim::Totals &t = bus.totals();
+    printf("\n%llu reads pre-staged, longest handler after one %llu ns\n",
+           (unsigned long long)t.staged, (unsigned long long)t.staged_handler_max_ns);
+
+    // Same workloads through one window, through 4 lines (ramdisk vs
+    // ramdisk3, fdc vs fdc2) and storing in the handler (ramdisk4, fdc3),
+    // before the batch reruns add to fdc
+    printf("\ncache\n");
+    BusSim::printCacheReport(stdout);
+
+    const FilePoolStats fp = FilePool::stats();
+    printf("\nfile pool (directory mounts): %u opens, %u reuses, %u evictions\n",
+           fp.opens, fp.hits, fp.evictions);
+
+    // Sectors FatFS found below it, over every workload and the boot
+    printf("\n  %-12s %10s %10s %10s %10s %7s\n",
+           "disk cache", "hits", "misses", "fat hits", "evictions", "hit %");
+    for (uint8_t pdrv = 0; pdrv < HOST_DISK_COUNT; pdrv++) {
+        DiskCacheStats d;
+        disk_cache_get_stats(pdrv, &d);
+        const uint64_t lookups = (uint64_t)d.hits + d.misses;
+        printf("  %-12s %10u %10u %10u %10u %7.2f\n", pdrv == HOST_DISK_SD ? "sd" : "flash",
+               d.hits, d.misses, d.meta_hits, d.evictions,
+               lookups ? 100.0 * (double)d.hits / (double)lookups : 0.0);
+    }
+
+    // Batch timing includes the workload's own driving and checking, which
+    // is the same in every build: compare ns/op between builds
+    printf("\n  %-32s %9s %9s %7s\n", "batch-timed", "cycles", "ns/op", "errors");
+    bus.setTimed(false);
+    for (const auto &w : dispatch_workloads) {
+        uint64_t best = UINT64_MAX, cycles = 0;
+        uint32_t errors = 0;
+        for (int pass = 0; pass < DISPATCH_PASSES; pass++) {
+            const uint64_t before = bus.totals().cycles;
+            const uint64_t t0 = wall_ns();
+            errors += w.run(bus);
+            const uint64_t t1 = wall_ns();
+            cycles = bus.totals().cycles - before;
+            if (t1 - t0 < best) best = t1 - t0;
+        }
+        printf("  %-32s %9llu %9.1f %7u\n", w.name, (unsigned long long)cycles,
+               cycles ? (double)best / (double)cycles : 0.0, errors);
+        total_errors += errors;
+    }
+    bus.setTimed(true);
+
+    printf("\nper device\n");
+    bus.printDeviceReport(stdout);
+    if (show_ports) {
+        printf("\nper port\n");
+        bus.printPortReport(stdout);
+    }
+
+    if (total_errors) {
+        printf("\nFAILED: %u verification errors\n", total_errors);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,182 @@
+#include <time.h>
+#include <algorithm>
+#include <map>
+
+#include "bus_sim.hpp"
+#include "bus.hpp"
+#include "work_queue.hpp"
+#include "hot_config.hpp"
+#include "byte_source.hpp"
+
+static inline uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+BusSim::BusSim() {
+    // Minimum of many empty pairs: the floor is the clock read itself,
+    // anything above it is scheduling noise that should stay visible
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < 10000; i++) {
+        const uint64_t t0 = timed_ ? now_ns() : 0;
+        const uint64_t t1 = timed_ ? now_ns() : 0;
+        best = std::min(best, t1 - t0);
+    }
+    timerOverhead_ = best;
+}
+
+// Core 0's share of the deferred work (a job, or else an idle round),
+// and listen_loop()'s idle branch, run between cycles and outside the
+// timed window (on the board it overlaps the Z80's next instructions)
+static inline void core0_step() {
+    work_poll();
+    if (core1_event_take(CORE1_EV_WORK)) work_reap();
+    else if (core1_event_take(CORE1_EV_HOT_CONFIG)) hot_config_apply();
+}
+
+void BusSim::resetStats() {
+    for (auto &s : readStats_) s = PortStats();
+    for (auto &s : writeStats_) s = PortStats();
+    totals_ = Totals();
+}
+
+void BusSim::record(PortStats& ps, uint64_t ns, bool irq) {
+    if (!timed_) {
+        // Batch-timed run: count only, keep the per-port figures clean
+        totals_.cycles++;
+        return;
+    }
+    ns = ns > timerOverhead_ ? ns - timerOverhead_ : 0;
+    ps.count++;
+    ps.total_ns += ns;
+    if (ns > ps.max_ns) ps.max_ns = ns;
+    totals_.cycles++;
+    totals_.total_ns += ns;
+    if (ns > totals_.max_ns) totals_.max_ns = ns;
+    if (irq) totals_.interrupts++;
+}
+
+uint8_t BusSim::in(uint8_t port, uint8_t high) {
+    MZDeviceManager::PortDispatch& d = MZDeviceManager::flatPorts[port];
+    if (!d.read) {
+        totals_.unhandled++;
+        return 0xff;
+    }
+    const uint64_t t0 = timed_ ? now_ns() : 0;
+    const uint16_t staged = d.staged;
+    if (staged) {
+        d.staged = 0;
+        data_ = (uint8_t)staged;
+        acquire_data_bus_for_writing();
+        write_data_bus(data_);
+        const uint64_t t1 = timed_ ? now_ns() : 0;
+        release_data_bus();
+        const uint8_t driven = data_;
+        const int ret = d.read(d.readDev, port, &data_, high);
+        const bool irq = MZDeviceManager::portInterrupt(d.readFlags, d.readDev, ret);
+        if (irq) set_interrupt();
+        const uint64_t t2 = timed_ ? now_ns() : 0;
+        record(readStats_[port], t1 - t0, irq);
+        totals_.staged++;
+        totals_.staged_handler_max_ns = std::max(totals_.staged_handler_max_ns, t2 - t1);
+        data_ = driven;
+        core0_step();
+        return driven;
+    }
+    const uint8_t flags = d.readFlags;
+    if (flags & MZDeviceManager::PORT_EXWAIT) set_exwait();
+    const int ret = d.read(d.readDev, port, &data_, high);
+    acquire_data_bus_for_writing();
+    write_data_bus(data_);
+    const bool irq = MZDeviceManager::portInterrupt(flags, d.readDev, ret);
+    if (irq) set_interrupt();
+    if (flags & MZDeviceManager::PORT_EXWAIT) release_exwait();
+    const uint64_t t1 = timed_ ? now_ns() : 0;
+    release_data_bus();
+    record(readStats_[port], t1 - t0, irq);
+    core0_step();
+    return data_;
+}
+
+void BusSim::out(uint8_t port, uint8_t data, uint8_t high) {
+    const MZDeviceManager::PortDispatch& d = MZDeviceManager::flatPorts[port];
+    if (!d.write) {
+        totals_.unhandled++;
+        return;
+    }
+    const uint64_t t0 = timed_ ? now_ns() : 0;
+    const uint8_t flags = d.writeFlags;
+    if (flags & MZDeviceManager::PORT_EXWAIT) set_exwait();
+    const int ret = d.write(d.writeDev, port, data, high);
+    const bool irq = MZDeviceManager::portInterrupt(flags, d.writeDev, ret);
+    if (irq) set_interrupt();
+    if (flags & MZDeviceManager::PORT_EXWAIT) release_exwait();
+    const uint64_t t1 = timed_ ? now_ns() : 0;
+    record(writeStats_[port], t1 - t0, irq);
+    core0_step();
+}
+
+static void print_row(FILE* out, const char* dir, unsigned port, const std::string& dev,
+                      const BusSim::PortStats& s, bool exwait) {
+    fprintf(out, "  %-3s 0x%02x  %-12s %10llu %9.1f %9llu  %s\n",
+            dir, port, dev.c_str(), (unsigned long long)s.count,
+            s.count ? (double)s.total_ns / (double)s.count : 0.0,
+            (unsigned long long)s.max_ns, exwait ? "yes" : "no");
+}
+
+void BusSim::printPortReport(FILE* out) const {
+    fprintf(out, "  dir port  device           cycles     ns/op    max ns  exwait\n");
+    for (unsigned p = 0; p < MAX_PORTS; p++) {
+        if (readStats_[p].count) {
+            const MZDeviceManager::PortDispatch& d = MZDeviceManager::flatPorts[p];
+            print_row(out, "IN", p, d.readDev ? d.readDev->getDevID() : "?", readStats_[p],
+                      d.readFlags & MZDeviceManager::PORT_EXWAIT);
+        }
+    }
+    for (unsigned p = 0; p < MAX_PORTS; p++) {
+        if (writeStats_[p].count) {
+            const MZDeviceManager::PortDispatch& d = MZDeviceManager::flatPorts[p];
+            print_row(out, "OUT", p, d.writeDev ? d.writeDev->getDevID() : "?", writeStats_[p],
+                      d.writeFlags & MZDeviceManager::PORT_EXWAIT);
+        }
+    }
+}
+
+void BusSim::printDeviceReport(FILE* out) const {
+    // Shared ports dispatch through a thunk whose flat "device" is the
+    // first listener; the cycle is attributed to that device
+    std::map<std::string, PortStats> per_dev;
+    auto add = [&](MZDevice* dev, const PortStats& s) {
+        if (!s.count) return;
+        PortStats& d = per_dev[dev ? dev->getDevID() : "?"];
+        d.count += s.count;
+        d.total_ns += s.total_ns;
+        d.max_ns = std::max(d.max_ns, s.max_ns);
+    };
+    for (unsigned p = 0; p < MAX_PORTS; p++) {
+        add(MZDeviceManager::flatPorts[p].readDev, readStats_[p]);
+        add(MZDeviceManager::flatPorts[p].writeDev, writeStats_[p]);
+    }
+    fprintf(out, "  device           cycles     ns/op    max ns\n");
+    for (const auto &kv : per_dev) {
+        const PortStats& s = kv.second;
+        fprintf(out, "  %-12s %10llu %9.1f %9llu\n", kv.first.c_str(),
+                (unsigned long long)s.count, (double)s.total_ns / (double)s.count,
+                (unsigned long long)s.max_ns);
+    }
+}
+
+void BusSim::printCacheReport(FILE* out) {
+    fprintf(out, "  device           hits     misses  prefetched  writebacks  deferred   hit %%\n");
+    for (uint8_t i = 0; i < MZDeviceManager::getDeviceCount(); i++) {
+        const MZDevice* dev = MZDeviceManager::getDevice(i);
+        CacheStats s;
+        if (!dev->cacheStats(s))
+            continue;
+        const uint64_t lookups = (uint64_t)s.hits + s.misses;
+        fprintf(out, "  %-12s %10u %10u %11u %11u %9u %7.2f\n", dev->getDevID().c_str(),
+                s.hits, s.misses, s.prefetched, s.writebacks, s.deferred,
+                lookups ? 100.0 * (double)s.hits / (double)lookups : 0.0);
+    }
+}
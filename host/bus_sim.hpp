@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+#include "mz_devices.hpp"
+
+// Host-side stand-in for listen_loop(): drives Z80 I/O cycles through the
+// same flat dispatch tables, in the same order (EXWAIT, handler, data bus,
+// interrupt check, EXWAIT release), and times every handled cycle. The
+// time measured is the EXWAIT hold, i.e. what the Z80 waits for on the
+// real bus (for a pre-staged read, up to the data bus being driven); the harness runs it on a host CPU, so compare ratios between
+// builds, not absolute nanoseconds against the RP2040.
+class BusSim {
+public:
+    struct PortStats {
+        uint64_t count = 0;
+        uint64_t total_ns = 0;
+        uint64_t max_ns = 0;
+    };
+
+    struct Totals {
+        uint64_t cycles = 0;
+        uint64_t total_ns = 0;
+        uint64_t max_ns = 0;
+        uint64_t unhandled = 0;
+        uint64_t interrupts = 0;
+        // Reads served from a staged PortDispatch entry, and the longest
+        // handler run after one of them (must fit the gap between cycles)
+        uint64_t staged = 0;
+        uint64_t staged_handler_max_ns = 0;
+    };
+
+    BusSim();
+
+    // One IN cycle. Unhandled ports read as a floating (0xff) bus.
+    uint8_t in(uint8_t port, uint8_t high = 0);
+    // One OUT cycle.
+    void out(uint8_t port, uint8_t data, uint8_t high = 0);
+
+    const PortStats& readStats(uint8_t port) const { return readStats_[port]; }
+    const PortStats& writeStats(uint8_t port) const { return writeStats_[port]; }
+    const Totals& totals() const { return totals_; }
+    void resetStats();
+    void resetMax() { totals_.max_ns = 0; }
+
+    // Cost of one back-to-back timestamp pair, subtracted from every cycle
+    uint64_t timerOverheadNs() const { return timerOverhead_; }
+
+    // Untimed cycles are still counted but read no clock, so a caller can
+    // time a whole batch: dispatch costs below the clock's resolution
+    void setTimed(bool timed) { timed_ = timed; }
+
+    // Per-port and per-device tables of everything measured so far
+    void printPortReport(FILE* out) const;
+    void printDeviceReport(FILE* out) const;
+    // Cache counters of every device with a file image (MZDevice::cacheStats)
+    static void printCacheReport(FILE* out);
+
+private:
+    void record(PortStats& ps, uint64_t ns, bool irq);
+
+    PortStats readStats_[MAX_PORTS];
+    PortStats writeStats_[MAX_PORTS];
+    Totals totals_;
+    uint64_t timerOverhead_ = 0;
+    bool timed_ = true;
+    // listen_loop keeps `data` across cycles: a handler that does not
+    // store drives the previous value
+    uint8_t data_ = 0;
+};
@@ -0,0 +1,9 @@
+#pragma once
+
+// Host build stand-in for the generated header, see mzf_menu.hpp.
+
+const uint8_t mzf_explorer[128 + 4096] = {
+    0x01, 'E', 'X', 'P', 'L', 'O', 'R', 'E',
+    'R', 0x0D, 0x0D, 0x0D, 0x0D, 0x0D, 0x0D, 0x0D,
+    0x0D, 0x0D, 0x00, 0x10, 0x00, 0x12, 0x00, 0x12
+};
@@ -0,0 +1,12 @@
+#pragma once
+
+// Host build stand-in for the generated header (the real one is built from
+// the Z80 sources with z88dk, see the top-level CMakeLists.txt): a valid
+// 128-byte MZF header announcing a 4 KB zero-filled body, so sramdisk
+// streams a realistically sized payload.
+
+const uint8_t mzf_menu[128 + 4096] = {
+    0x01, 'M', 'E', 'N', 'U', 0x0D, 0x0D, 0x0D,
+    0x0D, 0x0D, 0x0D, 0x0D, 0x0D, 0x0D, 0x0D, 0x0D,
+    0x0D, 0x0D, 0x00, 0x10, 0x00, 0x12, 0x00, 0x12
+};
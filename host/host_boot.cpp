@@ -0,0 +1,128 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "host_boot.hpp"
+#include "host_disk.h"
+#include "ff.h"
+#include "iniparser.h"
+#include "device.hpp"
+#include "file.hpp"
+#include "mz_devices.hpp"
+
+static int format_volume(uint8_t pdrv, const char *path, uint32_t sectors) {
+    static uint8_t work[FF_MAX_SS * 8];
+    if (!host_disk_attach(pdrv, sectors))
+        return -1;
+    MKFS_PARM opt = { FM_ANY, 0, 0, 0, 0 };
+    return f_mkfs(path, &opt, work, sizeof(work)) == FR_OK ? 0 : -1;
+}
+
+int host_mount_volumes() {
+    if (format_volume(HOST_DISK_FLASH, "flash:", HOST_FLASH_SECTORS) != 0)
+        return -1;
+    if (format_volume(HOST_DISK_SD, "sd:", HOST_SD_SECTORS) != 0)
+        return -1;
+    return mount_devices();
+}
+
+static const char *ini_key(char *buf, size_t len, const char *section, const char *key) {
+    snprintf(buf, len, "%s:%s", section, key);
+    return buf;
+}
+
+int host_boot_devices(const char *ini_path) {
+    dictionary *ini = iniparser_load(ini_path);
+    if (!ini)
+        return -1;
+
+    int booted = 0;
+    char key[64];
+    const int sectionNumber = iniparser_getnsec(ini);
+    for (int i = 0; i < sectionNumber; i++) {
+        const char *sectionName = iniparser_getsecname(ini, i);
+        if (strcmp(sectionName, "menu") == 0 || strcmp(sectionName, "explorer") == 0)
+            continue;
+        const std::string_view devName = MZDeviceManager::sectionDevType(sectionName);
+
+        MZDevice *dev = MZDeviceManager::createDevice(devName, sectionName);
+        if (!dev) {
+            printf("%s: not created (unknown type or out of RAM)\n", sectionName);
+            continue;
+        }
+        const bool enabled = iniparser_getboolean(ini, ini_key(key, sizeof(key), sectionName, "enabled"), true);
+        if (!enabled)
+            MZDeviceManager::disableDevice(dev);
+
+        PortList read_ports, write_ports;
+        const int ret = MZDeviceManager::resolvePorts(dev, ini, sectionName, read_ports, write_ports);
+        if (ret || MZDeviceManager::setPortsList(dev, read_ports, write_ports) != 0) {
+            printf("%s: invalid port list\n", sectionName);
+            MZDeviceManager::disableDevice(dev);
+            continue;
+        }
+        if (!enabled)
+            continue;
+
+        dev->init();
+        if (dev->readConfig(ini) != 0) {
+            printf("%s: readConfig failed\n", sectionName);
+            MZDeviceManager::disableDevice(dev);
+            continue;
+        }
+        dev->setConfigured();
+        if (devName == FDC_ID)
+            fdc = (FDCDevice *)dev;
+        else if (devName == QD_ID)
+            qd = (QDDevice *)dev;
+        else if (devName == SN76489_ID)
+            sn76489 = (SN76489Device *)dev;
+        booted++;
+    }
+
+    iniparser_freedict(ini);
+    MZDeviceManager::buildFlatTables();
+    work_drain(); // image creation deferred to core 0
+    return booted;
+}
+
+int host_import_file(const char *host_path, const char *vol_path) {
+    FILE *in = fopen(host_path, "rb");
+    if (!in)
+        return -1;
+
+    // Create the parent directories: "sd:/a/b/file" -> sd:/a, sd:/a/b
+    const std::string path = vol_path;
+    size_t pos = path.find(":/");
+    pos = (pos == std::string::npos) ? 0 : pos + 2;
+    while ((pos = path.find('/', pos)) != std::string::npos) {
+        FRESULT fr = f_mkdir(path.substr(0, pos).c_str());
+        if (fr != FR_OK && fr != FR_EXIST) {
+            fclose(in);
+            return -1;
+        }
+        pos++;
+    }
+
+    FIL f;
+    if (f_open(&f, vol_path, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+        fclose(in);
+        return -1;
+    }
+    static uint8_t buf[16384];
+    int ret = 0;
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        UINT bw = 0;
+        if (f_write(&f, buf, (UINT)n, &bw) != FR_OK || bw != n) {
+            ret = -1;
+            break;
+        }
+    }
+    if (ferror(in))
+        ret = -1;
+    f_close(&f);
+    fclose(in);
+    return ret;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+
+// Host build: formats and mounts the RAM-disk volumes (flash: and sd:),
+// then mirrors device_main1(): one device per ini section, ports from
+// read_ports/write_ports, base_port or the device defaults, init() and
+// readConfig(), and finally the flat dispatch tables listen_loop() uses.
+// Unlike the firmware it does not halt on a bad section, and it ignores
+// supportedOnBoard() so Deluxe-only devices can be measured too.
+
+// Sector counts of the RAM disks: a 2M-variant flash drive and a small SD
+constexpr uint32_t HOST_FLASH_SECTORS = 2044;
+constexpr uint32_t HOST_SD_SECTORS = 64u * 1024 * 1024 / 512;
+
+// Returns 0 on success
+int host_mount_volumes();
+// Boots the devices from an ini on a mounted volume; returns the number
+// of devices that came up, or -1 when the ini cannot be loaded
+int host_boot_devices(const char *ini_path);
+// Copies a file from the build machine onto a mounted volume (e.g. the
+// images a recorded trace was taken with), creating missing directories;
+// returns 0 on success
+int host_import_file(const char *host_path, const char *vol_path);
@@ -0,0 +1,134 @@
+// Host build: RAM disks standing in for the flash and SD drives. Every
+// transfer is counted so the benchmark can report the sector traffic a
+// workload causes, which is what costs time on the real SPI/XIP media.
+// The sector cache sits in front of both, as in fatfs_glue.c and
+// fatfs_disk.c: the counts are of the reads that still reach the drive.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ff.h"
+#include "diskio.h"
+#include "host_disk.h"
+#include "flash_fs.h"
+#include "disk_cache.h"
+
+#define SECTOR_SIZE 512
+
+const char* VolumeStr[FF_VOLUMES] = { FF_VOLUME_STRS };
+
+static struct {
+  uint8_t *data;
+  uint32_t sectors;
+} drives[HOST_DISK_COUNT];
+
+static HostDiskStats stats[HOST_DISK_COUNT];
+
+bool host_disk_attach(uint8_t pdrv, uint32_t sectors) {
+  if (pdrv >= HOST_DISK_COUNT) return false;
+  free(drives[pdrv].data);
+  drives[pdrv].data = (uint8_t *)calloc(sectors, SECTOR_SIZE);
+  drives[pdrv].sectors = drives[pdrv].data ? sectors : 0;
+  disk_cache_invalidate_drive(pdrv);
+  return drives[pdrv].data != NULL;
+}
+
+void host_disk_get_stats(uint8_t pdrv, HostDiskStats *out) {
+  if (pdrv < HOST_DISK_COUNT) *out = stats[pdrv];
+  else memset(out, 0, sizeof(*out));
+}
+
+void host_disk_reset_stats(void) {
+  memset(stats, 0, sizeof(stats));
+}
+
+DSTATUS disk_status(BYTE pdrv) {
+  if (pdrv >= HOST_DISK_COUNT) return STA_NODISK;
+  return drives[pdrv].data ? 0 : STA_NOINIT;
+}
+
+DSTATUS disk_initialize(BYTE pdrv) {
+  return disk_status(pdrv);
+}
+
+DRESULT disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count) {
+  if (pdrv >= HOST_DISK_COUNT || !drives[pdrv].data) return RES_NOTRDY;
+  if (sector + count > drives[pdrv].sectors) return RES_PARERR;
+  if (count == 1 && disk_cache_read(pdrv, sector, buff)) return RES_OK;
+  memcpy(buff, drives[pdrv].data + (size_t)sector * SECTOR_SIZE, (size_t)count * SECTOR_SIZE);
+  stats[pdrv].read_calls++;
+  stats[pdrv].read_sectors += count;
+  if (count == 1) disk_cache_fill(pdrv, sector, buff);
+  return RES_OK;
+}
+
+#if FF_FS_READONLY == 0
+
+DRESULT disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count) {
+  if (pdrv >= HOST_DISK_COUNT || !drives[pdrv].data) return RES_NOTRDY;
+  if (sector + count > drives[pdrv].sectors) return RES_PARERR;
+  memcpy(drives[pdrv].data + (size_t)sector * SECTOR_SIZE, buff, (size_t)count * SECTOR_SIZE);
+  stats[pdrv].write_calls++;
+  stats[pdrv].write_sectors += count;
+  disk_cache_write(pdrv, sector, buff, count);
+  return RES_OK;
+}
+
+#endif
+
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff) {
+  if (pdrv >= HOST_DISK_COUNT || !drives[pdrv].data) return RES_NOTRDY;
+  switch (cmd) {
+    case CTRL_SYNC:
+      return RES_OK;
+    case GET_SECTOR_COUNT:
+      *(LBA_t *)buff = drives[pdrv].sectors;
+      return RES_OK;
+    case GET_SECTOR_SIZE:
+      *(WORD *)buff = SECTOR_SIZE;
+      return RES_OK;
+    case GET_BLOCK_SIZE:
+      *(DWORD *)buff = 1;
+      return RES_OK;
+    case CTRL_TRIM:
+      // Flash only, as flash_fs_trim_FAT_sectors(): trimmed sectors read
+      // as zeros. An SD card makes no such promise.
+      if (pdrv == HOST_DISK_FLASH) {
+        const LBA_t *range = (const LBA_t *)buff;
+        if (range[0] <= range[1] && range[1] < drives[pdrv].sectors) {
+          memset(drives[pdrv].data + (size_t)range[0] * SECTOR_SIZE, 0,
+                 (size_t)(range[1] - range[0] + 1) * SECTOR_SIZE);
+          disk_cache_invalidate(pdrv, range[0], range[1] - range[0] + 1);
+        }
+      }
+      return RES_OK;
+    default:
+      return RES_PARERR;
+  }
+}
+
+// The flash drive is one block of RAM with every sector at its LBA, so it
+// stands in for XIP flash whose map has never moved a page: a file reads
+// in place where its sectors follow each other, and nothing relocates
+const uint8_t *flash_fs_xip_address(uint16_t fat_sector) {
+  if (!drives[HOST_DISK_FLASH].data || fat_sector >= drives[HOST_DISK_FLASH].sectors)
+    return NULL;
+  return drives[HOST_DISK_FLASH].data + (size_t)fat_sector * SECTOR_SIZE;
+}
+
+bool flash_fs_place_contiguous(const flash_fs_run *runs, uint32_t count) {
+  uint32_t next = 0;
+  bool first = true;
+  for (uint32_t r = 0; r < count; r++) {
+    if (!runs[r].count) continue;
+    if (!first && runs[r].first != next) return false;
+    next = (uint32_t)runs[r].first + runs[r].count;
+    first = false;
+  }
+  return true;
+}
+
+DWORD get_fattime(void) {
+  // 2024-01-01 00:00:00, fixed so images are reproducible run to run
+  return ((DWORD)(2024 - 1980) << 25) | ((DWORD)1 << 21) | ((DWORD)1 << 16);
+}
@@ -0,0 +1,34 @@
+#ifndef __HOST_DISK_H__
+#define __HOST_DISK_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Host build: RAM-backed physical drives behind the FatFS diskio API, in
+// place of fatfs_glue.c (flash + SD card). Drive numbers match the glue:
+// 0 = "flash", 1 = "sd".
+
+#define HOST_DISK_FLASH 0
+#define HOST_DISK_SD 1
+#define HOST_DISK_COUNT 2
+
+typedef struct {
+  uint32_t read_calls;
+  uint32_t read_sectors;
+  uint32_t write_calls;
+  uint32_t write_sectors;
+} HostDiskStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+// Allocates (zeroed) backing RAM for a drive; the volume still needs
+// f_mkfs() before it mounts. Returns false when out of memory.
+bool host_disk_attach(uint8_t pdrv, uint32_t sectors);
+void host_disk_get_stats(uint8_t pdrv, HostDiskStats *out);
+void host_disk_reset_stats(void);
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,58 @@
+// Host build: the firmware globals and core-0 services that the compiled
+// subset of src/ links against. device.cpp, i2s_audio.cpp and the flash
+// FS driver are replaced here, everything else is the real code.
+
+#include "hardware/structs/sio.h"
+#include "device.hpp"
+#include "fatfs_disk.h"
+#include "i2s_audio.hpp"
+
+sio_hw_t host_sio_hw = { 0, 0xffffffffu, 0xffffffffu };
+
+FDCDevice *fdc = nullptr;
+QDDevice *qd = nullptr;
+SN76489Device *sn76489 = nullptr;
+volatile bool shutting_down = false;
+
+void blink(uint8_t i) { (void)i; }
+
+// The flash drive is a host_disk RAM disk that the harness formats before
+// mount_devices() runs, so there is nothing to mount or create here.
+bool mount_fatfs_disk() { return true; }
+bool fatfs_is_mounted() { return true; }
+void create_fatfs_disk() {}
+
+// No audio output: sources register (so their init succeeds) but are
+// never rendered. sn76489 write cycles still run the real handler.
+static I2SAudioSource *audio_sources[MAX_AUDIO_SOURCES];
+
+int i2s_audio_register_source(I2SAudioSource* source) {
+    for (auto &s : audio_sources) {
+        if (!s) { s = source; return 0; }
+    }
+    return -1;
+}
+
+void i2s_audio_unregister_source(I2SAudioSource* source) {
+    for (auto &s : audio_sources) {
+        if (s == source) s = nullptr;
+    }
+}
+
+int i2s_audio_init_on_core0() { return 0; }
+void i2s_audio_shutdown() {}
+bool i2s_audio_is_ready() { return false; }
+
+bool i2s_audio_has_sources() {
+    for (auto *s : audio_sources) {
+        if (s) return true;
+    }
+    return false;
+}
+
+// Drains queued register writes the way core 0 would between samples.
+void i2s_audio_poll() {
+    for (auto *s : audio_sources) {
+        if (s) s->processWrites();
+    }
+}
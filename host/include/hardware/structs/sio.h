@@ -0,0 +1,33 @@
+#pragma once
+
+// Host build: plain memory in place of the SIO register block, so the pin
+// helpers in bus.hpp (set_exwait(), set_interrupt(), ...) compile
+// unchanged. Writes land in the matching field and have no side effects;
+// gpio_in reads as all-high (IORQ/RD/WR idle, nothing driving the bus).
+
+#include <stdint.h>
+
+typedef struct {
+    volatile uint32_t cpuid;
+    volatile uint32_t gpio_in;
+    volatile uint32_t gpio_hi_in;
+    uint32_t _pad0;
+    volatile uint32_t gpio_out;
+    volatile uint32_t gpio_set;
+    volatile uint32_t gpio_clr;
+    volatile uint32_t gpio_togl;
+    volatile uint32_t gpio_oe;
+    volatile uint32_t gpio_oe_set;
+    volatile uint32_t gpio_oe_clr;
+    volatile uint32_t gpio_oe_togl;
+} sio_hw_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+extern sio_hw_t host_sio_hw;
+#ifdef __cplusplus
+}
+#endif
+
+#define sio_hw (&host_sio_hw)
@@ -0,0 +1,7 @@
+#pragma once
+
+// Host build: the barrier the cross-core handshakes use. The host runs
+// both "cores" on one thread, so a compiler fence would do; a full fence
+// keeps the intent explicit.
+
+static inline void __dmb(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
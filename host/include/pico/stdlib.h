@@ -0,0 +1,16 @@
+#pragma once
+
+// Host build (host/): the slice of the Pico SDK that the device core
+// touches, mapped onto POSIX. Only what src/ actually includes lives here;
+// anything hardware-facing beyond the bus pins belongs in device.cpp,
+// which the host build does not compile.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "pico/time.h"
+
+typedef unsigned int uint;
+
+static inline void tight_loop_contents(void) {}
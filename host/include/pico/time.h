@@ -0,0 +1,31 @@
+#pragma once
+
+// Host build: the SDK time base on CLOCK_MONOTONIC. "Since boot" means
+// since an arbitrary fixed origin, which is all the device core relies on
+// (differences and ordering).
+
+#include <stdint.h>
+#include <time.h>
+
+typedef uint64_t absolute_time_t;
+
+static inline uint64_t time_us_64(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static inline uint32_t time_us_32(void) { return (uint32_t)time_us_64(); }
+static inline absolute_time_t get_absolute_time(void) { return time_us_64(); }
+static inline uint32_t to_ms_since_boot(absolute_time_t t) { return (uint32_t)(t / 1000u); }
+static inline uint64_t to_us_since_boot(absolute_time_t t) { return t; }
+
+static inline void sleep_us(uint64_t us) {
+    struct timespec ts = { (time_t)(us / 1000000u), (long)(us % 1000000u) * 1000 };
+    nanosleep(&ts, NULL);
+}
+static inline void sleep_ms(uint32_t ms) { sleep_us((uint64_t)ms * 1000u); }
+static inline void busy_wait_us(uint64_t us) {
+    const uint64_t end = time_us_64() + us;
+    while (time_us_64() < end) {}
+}
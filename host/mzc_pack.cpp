@@ -0,0 +1,78 @@
+#include "mzc_pack.hpp"
+
+#include <cstring>
+
+#include "common.hpp"
+#include "compressed_source.hpp"
+#include "lz_block.hpp"
+
+bool mzc_pack(const std::vector<uint8_t>& image, uint8_t shift, std::vector<uint8_t>& out) {
+    const uint32_t size = static_cast<uint32_t>(image.size());
+    if (!size || image.size() > UINT32_MAX)
+        return false;
+    if (!shift) {
+        shift = 12;
+        while (shift < COMPRESSED_MAX_SHIFT && ((size - 1) >> shift) + 1 > COMPRESSED_MAX_BLOCKS)
+            shift++;
+    }
+    if (shift < COMPRESSED_MIN_SHIFT || shift > COMPRESSED_MAX_SHIFT)
+        return false;
+    const uint32_t count = ((size - 1) >> shift) + 1;
+    if (count > COMPRESSED_MAX_BLOCKS)
+        return false;
+
+    const uint32_t data = COMPRESSED_HEADER_SIZE + (count + 1) * 4;
+    out.assign(data, 0);
+    memcpy(out.data(), "MZC1", 4);
+    write_u32_le(out.data() + 4, size);
+    out[8] = shift;
+    out[9] = COMPRESSED_CODEC_LZ;
+    write_u32_le(out.data() + 12, count);
+    write_u32_le(out.data() + COMPRESSED_HEADER_SIZE, data);
+
+    std::vector<uint16_t> table(LZ_HASH_ENTRIES);
+    std::vector<uint8_t> packed(1u << shift);
+    for (uint32_t b = 0; b < count; b++) {
+        const uint8_t* block = image.data() + (static_cast<size_t>(b) << shift);
+        const uint32_t len = (size - (b << shift) < (1u << shift)) ? size - (b << shift) : 1u << shift;
+        uint32_t n = 0;
+        while (n < len && !block[n])
+            n++;
+        if (n < len) { // all zeros: no data
+            n = lz_compress(block, len, packed.data(), len - 1, table.data());
+            if (n)
+                out.insert(out.end(), packed.begin(), packed.begin() + n);
+            else
+                out.insert(out.end(), block, block + len);
+        }
+        write_u32_le(out.data() + COMPRESSED_HEADER_SIZE + (b + 1) * 4,
+                     static_cast<uint32_t>(out.size()));
+    }
+    return true;
+}
+
+bool mzc_unpack(const std::vector<uint8_t>& in, std::vector<uint8_t>& image) {
+    if (in.size() < COMPRESSED_HEADER_SIZE || !compressed_magic(in.data()) ||
+        in[9] != COMPRESSED_CODEC_LZ || in[8] < COMPRESSED_MIN_SHIFT || in[8] > COMPRESSED_MAX_SHIFT)
+        return false;
+    const uint32_t size = read_u32_le(in.data() + 4);
+    const uint8_t shift = in[8];
+    const uint32_t count = read_u32_le(in.data() + 12);
+    if (!size || count != ((size - 1) >> shift) + 1 ||
+        in.size() < COMPRESSED_HEADER_SIZE + (static_cast<size_t>(count) + 1) * 4)
+        return false;
+    image.assign(size, 0);
+    for (uint32_t b = 0; b < count; b++) {
+        const uint32_t from = read_u32_le(in.data() + COMPRESSED_HEADER_SIZE + b * 4);
+        const uint32_t to = read_u32_le(in.data() + COMPRESSED_HEADER_SIZE + (b + 1) * 4);
+        const uint32_t len = (size - (b << shift) < (1u << shift)) ? size - (b << shift) : 1u << shift;
+        uint8_t* block = image.data() + (static_cast<size_t>(b) << shift);
+        if (to < from || to > in.size() || to - from > len)
+            return false;
+        if (to - from == len)
+            memcpy(block, in.data() + from, len);
+        else if (to != from && lz_decompress(in.data() + from, to - from, block, len) != 0)
+            return false;
+    }
+    return true;
+}
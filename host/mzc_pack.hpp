@@ -0,0 +1,14 @@
+#pragma once
+// The compressed image container (compressed_source.hpp) built and read
+// in memory, for mzpico_pack and mzpico_source_bench.
+
+#include <cstdint>
+#include <vector>
+
+// A container of `image`, in blocks of 1 << shift bytes (0: 4 KB, or the
+// smallest that keeps the block count within COMPRESSED_MAX_BLOCKS);
+// false if the image is empty or too large for any block size
+bool mzc_pack(const std::vector<uint8_t>& image, uint8_t shift, std::vector<uint8_t>& out);
+
+// The image a container holds; false if `in` is not a valid container
+bool mzc_unpack(const std::vector<uint8_t>& in, std::vector<uint8_t>& image);
@@ -0,0 +1,87 @@
+// mzpico_pack: turns a DSK, MZQ or RAM disk image into the compressed
+// container the firmware mounts in its place (CompressedSource), and back.
+//
+//   mzpico_pack [-b BLOCK] in out      pack
+//   mzpico_pack -d in out              unpack
+//
+// BLOCK is the block size in bytes, a power of two from 512 to 32768
+// (default 4096, larger for an image of more than 1024 blocks). Smaller
+// blocks decode faster per fetch and compress worse. Keep the image's
+// name: the firmware tells a container from a plain image by its magic.
+// An <image>.ovl next to the old image holds blocks written to it since
+// and does not apply to a new container - delete it along with the old one.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "mzc_pack.hpp"
+
+static int usage() {
+    fprintf(stderr, "usage: mzpico_pack [-b BLOCK] in out\n"
+                    "       mzpico_pack -d in out\n");
+    return 2;
+}
+
+static bool load(const char* path, std::vector<uint8_t>& data) {
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return false;
+    uint8_t buf[4096];
+    size_t n;
+    data.clear();
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        data.insert(data.end(), buf, buf + n);
+    const bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+static bool save(const char* path, const std::vector<uint8_t>& data) {
+    FILE* f = fopen(path, "wb");
+    if (!f)
+        return false;
+    const bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    return fclose(f) == 0 && ok;
+}
+
+int main(int argc, char** argv) {
+    bool unpack = false;
+    uint8_t shift = 0;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "-d")) {
+            unpack = true;
+        } else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+            const unsigned long block = strtoul(argv[++i], nullptr, 0);
+            for (shift = 9; shift <= 15 && (1ul << shift) != block; shift++) {}
+            if (shift > 15) {
+                fprintf(stderr, "mzpico_pack: block size must be a power of two, 512..32768\n");
+                return 2;
+            }
+        } else {
+            return usage();
+        }
+    }
+    if (argc - i != 2)
+        return usage();
+
+    std::vector<uint8_t> in, out;
+    if (!load(argv[i], in)) {
+        fprintf(stderr, "mzpico_pack: cannot read %s\n", argv[i]);
+        return 1;
+    }
+    if (unpack ? !mzc_unpack(in, out) : !mzc_pack(in, shift, out)) {
+        fprintf(stderr, unpack ? "mzpico_pack: %s is not a valid container\n"
+                               : "mzpico_pack: %s is empty or too large\n", argv[i]);
+        return 1;
+    }
+    if (!save(argv[i + 1], out)) {
+        fprintf(stderr, "mzpico_pack: cannot write %s\n", argv[i + 1]);
+        return 1;
+    }
+    printf("%s: %zu -> %zu bytes (%.1f%%)\n", argv[i + 1], in.size(), out.size(),
+           in.empty() ? 0.0 : 100.0 * out.size() / in.size());
+    return 0;
+}
@@ -0,0 +1,1033 @@
+// mzpico_source_bench: correctness checks and micro-benchmarks for the
+// byte_source library, on the RAM-disk volumes the device bench uses.
+//
+//   mzpico_source_bench [--checks]
+//
+// The checks run first:
+//  - RamSource position rules: wrap, auto-increment or not, next()
+//  - CachedSource against a plain array, over random operations on a RAM
+//    storage whose fetch/store callbacks count calls and refuse any out of
+//    range: one window, cache lines, read-ahead and write-behind (each
+//    mode, with a background queue that runs when it is pumped), wrap and
+//    auto-increment on and off. After every flush() the storage must
+//    equal the array.
+//  - the gap rule of setByte(): bytes a fetch came up short on read as
+//    zeros and are stored as zeros, and the single window never stores
+//    bytes it neither fetched nor had written
+//  - flush() of windows that wrap past the storage end: both parts land,
+//    nothing beyond the end is stored
+//  - FileSource, Mzf2SramFileSource (against Mzf2SramRamSource),
+//    QDDirSource and FDCDirSource on FatFS: the contents, and the same
+//    byte stream whatever the cache size and access pattern
+//  - the LZ block codec: round trips of several kinds of data, decoded
+//    apart and in place, and corrupt input refused without a stray access
+//  - CompressedSource on a container from mzc_pack(): reads, writes to
+//    the overlay and across a remount, recompression in idle rounds (one
+//    interrupted by a write), a replaced container's stale overlay, and
+//    an interrupted swap recovered from <image>.tmp
+//
+// Then the timings (--checks skips them): ns per byte of getByte(),
+// setByte() and 512-byte get()/set() through a ByteSource*, as a device
+// calls them, with the cache refills and stores per pass and the sector
+// reads and writes FatFS made on the RAM disk for them. The exit code is
+// non-zero when a check fails.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <time.h>
+
+#include "host_boot.hpp"
+#include "host_disk.h"
+#include "ff.h"
+#include "ram_source.hpp"
+#include "cached_source.hpp"
+#include "file_source.hpp"
+#include "file_pool.hpp"
+#include "mzf_sram_file_source.hpp"
+#include "mzf_sram_ram_source.hpp"
+#include "qd_dir_source.hpp"
+#include "fdc_dir_source.hpp"
+#include "compressed_source.hpp"
+#include "lz_block.hpp"
+#include "mzc_pack.hpp"
+#include "pico/time.h"
+
+static constexpr int MODEL_OPS = 20000;
+static constexpr int BENCH_PASSES = 5;
+static constexpr uint32_t BENCH_SIZE = 64 * 1024;
+static constexpr int MZF_FILES = 3;
+static constexpr int CPM_FILES = 3;
+static constexpr uint32_t CPM_FILE_SIZE = 16 * 1024;
+
+static uint32_t failures = 0;
+static const char *check_ctx = "";
+
+#define CHECK(cond) do { if (!(cond)) fail(__LINE__, #cond); } while (0)
+
+static void fail(int line, const char *what) {
+    // The first few of a run say enough; the count says the rest
+    if (failures++ < 20)
+        printf("  FAIL line %d: %s [%s]\n", line, what, check_ctx);
+}
+
+// xorshift32: the same operations on every run
+static uint32_t rng_state = 0x2545f491;
+static uint32_t rnd(uint32_t n) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return n ? rng_state % n : 0;
+}
+
+static inline uint8_t seq_byte(uint32_t i) { return (uint8_t)(i * 7 + (i >> 8)); }
+static inline uint8_t cpm_file_byte(int file, uint32_t i) {
+    return (uint8_t)(i * 13 + file * 0x47 + (i >> 9));
+}
+
+static uint64_t wall_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// ---- A CachedSource over RAM, standing in for storage ----
+
+// Every fetch and store is counted and range-checked. Only the first
+// `backed` bytes exist, like a file shorter than the image: fetches past
+// them come up short, and stores extend them.
+class RamBacked : public CachedSource {
+public:
+    RamBacked(uint32_t size, uint32_t cache_size, bool wrap, bool auto_increment)
+        : CachedSource(this, &RamBacked::fetch, &RamBacked::store, size, cache_size,
+                       wrap, auto_increment),
+          data(size), backed(size) {}
+    // The base destructor's flush would store into members already gone
+    ~RamBacked() { invalidate(); }
+
+    int writeBehind(const BackgroundIo *io, WriteBehind mode) {
+        return enable_write_behind(io, mode);
+    }
+
+    std::vector<uint8_t> data;
+    uint32_t backed;
+    uint32_t fetches = 0;
+    uint32_t stores = 0;
+    uint32_t bad_calls = 0;     // out of range, or empty
+
+private:
+    static int fetch(void *ctx, uint32_t index, uint8_t *buf, uint32_t size, uint32_t &read) {
+        RamBacked *s = static_cast<RamBacked *>(ctx);
+        s->fetches++;
+        read = 0;
+        if (!size || index + size > s->data.size()) {
+            s->bad_calls++;
+            return -1;
+        }
+        if (index < s->backed) {
+            read = (size < s->backed - index) ? size : s->backed - index;
+            memcpy(buf, &s->data[index], read);
+        }
+        return 0;
+    }
+    static int store(void *ctx, uint32_t index, const uint8_t *buf, uint32_t size,
+                     uint32_t &written) {
+        RamBacked *s = static_cast<RamBacked *>(ctx);
+        s->stores++;
+        written = 0;
+        if (!size || index + size > s->data.size()) {
+            s->bad_calls++;
+            return -1;
+        }
+        memcpy(&s->data[index], buf, size);
+        written = size;
+        if (index + size > s->backed) s->backed = index + size;
+        return 0;
+    }
+};
+
+// BackgroundIo whose jobs run when pump() is called, standing in for
+// core 0; `refuse` makes post() fail, as a full work queue does
+struct Deferred {
+    std::vector<CachedSource *> queue;
+    bool refuse = false;
+    BackgroundIo io;
+
+    Deferred() : io{this, &Deferred::post, &Deferred::wait, &Deferred::idle} {}
+    void pump() {
+        std::vector<CachedSource *> jobs;
+        jobs.swap(queue);
+        for (CachedSource *s : jobs) s->runBackground();
+    }
+
+private:
+    static bool post(void *ctx, CachedSource *src) {
+        Deferred *d = static_cast<Deferred *>(ctx);
+        if (d->refuse) return false;
+        d->queue.push_back(src);
+        return true;
+    }
+    static void wait(void *ctx) { static_cast<Deferred *>(ctx)->pump(); }
+    static bool idle(void *, bool (*)(void *), void *) { return false; }
+};
+
+// BackgroundIo holding the idle job it is given, run a round at a time by
+// round(); nothing can be posted
+struct Idler {
+    bool (*run)(void *) = nullptr;
+    void *arg = nullptr;
+    BackgroundIo io;
+
+    Idler() : io{this, &Idler::post, &Idler::wait, &Idler::idle} {}
+    // False once the job has stopped
+    bool round() {
+        if (run && !run(arg)) run = nullptr;
+        return run != nullptr;
+    }
+
+private:
+    static bool post(void *, CachedSource *) { return false; }
+    static void wait(void *) {}
+    static bool idle(void *ctx, bool (*run)(void *), void *arg) {
+        Idler *i = static_cast<Idler *>(ctx);
+        i->run = run;
+        i->arg = arg;
+        return true;
+    }
+};
+
+// ---- RamSource ----
+
+static void check_ram_source() {
+    check_ctx = "RamSource";
+    uint8_t mem[16];
+    for (uint32_t i = 0; i < sizeof(mem); i++) mem[i] = seq_byte(i);
+
+    std::unique_ptr<ByteSource> bs;
+    ByteSourceFactory::from_ram(mem, sizeof(mem), bs);
+    uint8_t b = 0;
+    for (uint32_t i = 0; i < 40; i++) {
+        CHECK(bs->getByte(b) == 0 && b == mem[i % sizeof(mem)]);
+    }
+    CHECK(bs->tell() == 40 % sizeof(mem));
+    CHECK(bs->seek(sizeof(mem) + 3) == 0 && bs->tell() == 3);
+
+    uint8_t in[20], out[20];
+    for (uint32_t i = 0; i < sizeof(in); i++) in[i] = (uint8_t)(0xa0 + i);
+    uint32_t n = 0;
+    bs->seek(10);
+    CHECK(bs->set(in, sizeof(in), n) == 0 && n == sizeof(in) && bs->tell() == 14);
+    bs->seek(10);
+    CHECK(bs->get(out, sizeof(out), n) == 0 && n == sizeof(out));
+    CHECK(memcmp(in + 4, out + 4, sizeof(in) - 4) == 0);   // the wrapped writes won
+    CHECK(mem[0] == in[6] && mem[15] == in[5]);
+
+    ByteSourceFactory::from_ram(mem, sizeof(mem), bs, /* auto_increment = */ false);
+    bs->seek(15);
+    CHECK(bs->setByte(0x5a) == 0 && bs->tell() == 15);
+    CHECK(bs->getByte(b) == 0 && b == 0x5a && bs->tell() == 15);
+    CHECK(bs->next() == 0 && bs->tell() == 0);
+    CHECK(bs->peekByte(b) == 0 && b == mem[0] && bs->tell() == 0);
+}
+
+// ---- CachedSource against an array ----
+
+struct ModelConfig {
+    const char *name;
+    uint8_t lines;              // 0: single window
+    uint8_t ways;
+    bool ahead;
+    WriteBehind wb;
+};
+
+static const ModelConfig model_configs[] = {
+    { "window",                         0, 0, false, WriteBehind::IMMEDIATE },
+    { "window, read-ahead",             0, 0, true,  WriteBehind::IMMEDIATE },
+    { "window, write-behind",           0, 0, false, WriteBehind::BACKGROUND },
+    { "window, lazy write-behind",      0, 0, false, WriteBehind::LAZY },
+    { "window, read-ahead + behind",    0, 0, true,  WriteBehind::BACKGROUND },
+    { "window, read-ahead + lazy",      0, 0, true,  WriteBehind::LAZY },
+    { "4 lines, direct mapped",         4, 1, false, WriteBehind::IMMEDIATE },
+    { "4 lines, 2-way",                 4, 2, false, WriteBehind::IMMEDIATE },
+    { "8 lines, fully associative",     8, 0, false, WriteBehind::IMMEDIATE },
+};
+
+// One random run: `size` bytes of storage, 256-byte windows or lines
+static void model_run(const ModelConfig &cfg, uint32_t size, bool wrap, bool auto_inc) {
+    static char ctx[96];
+    snprintf(ctx, sizeof(ctx), "%s, %u bytes%s%s", cfg.name, size, wrap ? ", wrap" : "",
+             auto_inc ? ", auto-increment" : "");
+    check_ctx = ctx;
+
+    Deferred bg;
+    RamBacked src(size, 256, wrap, auto_inc);
+    std::vector<uint8_t> model(size);
+    for (uint32_t i = 0; i < size; i++) model[i] = src.data[i] = seq_byte(i * 3);
+    if (cfg.lines) CHECK(src.setCacheLines(cfg.lines, cfg.ways) == 0);
+    if (cfg.ahead) CHECK(src.setReadAhead(&bg.io) == 0);
+    if (cfg.wb != WriteBehind::IMMEDIATE) CHECK(src.writeBehind(&bg.io, cfg.wb) == 0);
+
+    // The model's position: never past the end with wrap, at most at it without
+    uint32_t pos = 0;
+    auto advance = [&](uint32_t n) {
+        pos += n;
+        if (wrap) pos %= size;
+    };
+    uint8_t buf[600];
+    uint32_t bad = 0;
+
+    for (int op = 0; op < MODEL_OPS && bad < 5; op++) {
+        const uint32_t before = failures;
+        switch (rnd(auto_inc ? 12 : 9)) {
+        case 0: {   // seek, now and then out of range
+            const uint32_t to = rnd(size + size / 8);
+            const int ret = src.seek(to);
+            CHECK((ret == 0) == (to < size));
+            if (to < size) pos = to;
+            break;
+        }
+        case 1: case 2: {
+            uint8_t b = 0;
+            const int ret = src.getByte(b);
+            CHECK((ret == 0) == (pos < size));
+            if (pos < size) {
+                CHECK(b == model[pos]);
+                if (auto_inc) advance(1);
+            }
+            break;
+        }
+        case 3: case 4: {
+            const uint8_t v = (uint8_t)rnd(256);
+            const int ret = src.setByte(v);
+            CHECK((ret == 0) == (pos < size));
+            if (pos < size) {
+                model[pos] = v;
+                if (auto_inc) advance(1);
+            }
+            break;
+        }
+        case 5: {
+            const int ret = src.next();
+            const bool ok = wrap || pos + 1 < size;
+            CHECK((ret == 0) == ok);
+            if (ok) advance(1);
+            break;
+        }
+        case 6: {
+            uint8_t b = 0;
+            const int ret = src.peekByte(b);
+            CHECK((ret == 0) == (pos < size));
+            if (pos < size) CHECK(b == model[pos]);
+            break;
+        }
+        case 7: {   // a span, read or written in place
+            const uint32_t at = rnd(size);
+            const bool for_write = rnd(2);
+            uint32_t avail = 0;
+            uint8_t *p = src.acquireSpan(at, 1 + rnd(300), for_write, avail);
+            CHECK(p && avail > 0 && at + avail <= size);
+            if (!p) break;
+            pos = at;
+            const uint32_t used = 1 + rnd(avail);
+            for (uint32_t i = 0; i < used; i++) {
+                if (for_write) model[at + i] = p[i] = (uint8_t)rnd(256);
+                else CHECK(p[i] == model[at + i]);
+            }
+            src.releaseSpan(used);
+            if (auto_inc) advance(used);
+            break;
+        }
+        case 8: {   // flush, or everything dropped, and the storage compared
+            const int ret = rnd(4) ? src.flush() : src.invalidate();
+            CHECK(ret == 0);
+            CHECK(src.data == model);
+            break;
+        }
+        case 9: {   // get()/set() only auto-increment
+            const uint32_t n = 1 + rnd(sizeof(buf));
+            uint32_t read = 0;
+            CHECK(src.get(buf, n, read) == 0);
+            const uint32_t expect = wrap ? n : (pos < size ? std::min(n, size - pos) : 0);
+            CHECK(read == expect);
+            for (uint32_t i = 0; i < read && i < expect; i++)
+                CHECK(buf[i] == model[(pos + i) % size]);
+            advance(read);
+            break;
+        }
+        case 10: {
+            const uint32_t n = 1 + rnd(sizeof(buf));
+            for (uint32_t i = 0; i < n; i++) buf[i] = (uint8_t)rnd(256);
+            uint32_t written = 0;
+            CHECK(src.set(buf, n, written) == 0);
+            const uint32_t expect = wrap ? n : (pos < size ? std::min(n, size - pos) : 0);
+            CHECK(written == expect);
+            for (uint32_t i = 0; i < written && i < expect; i++)
+                model[(pos + i) % size] = buf[i];
+            advance(written);
+            break;
+        }
+        case 11:    // core 0 gets to the queued jobs; sometimes it is busy
+            bg.pump();
+            bg.refuse = rnd(8) == 0;
+            break;
+        }
+        if (failures != before) bad++;
+        CHECK(src.tell() == pos);
+    }
+    CHECK(src.flush() == 0);
+    CHECK(src.data == model);
+    CHECK(src.bad_calls == 0);
+}
+
+static void check_cached_model() {
+    for (const ModelConfig &cfg : model_configs)
+        for (uint32_t size : { 5000u, 200u })
+            for (int wrap = 0; wrap < 2; wrap++)
+                for (int inc = 0; inc < 2; inc++)
+                    model_run(cfg, size, wrap, inc);
+}
+
+// ---- setByte()'s gap rule ----
+
+static void check_gap_rule() {
+    // Lines: a line fetched short (a file shorter than the image) and
+    // written past its end reads, and is stored, as zeros in between
+    check_ctx = "gap rule, cache lines";
+    {
+        RamBacked src(4096, 512, false, true);
+        memset(src.data.data(), 0xee, src.data.size());
+        src.backed = 100;
+        CHECK(src.setCacheLines(4, 0) == 0);
+        uint8_t b = 0;
+        CHECK(src.seek(300) == 0 && src.setByte(0xaa) == 0);
+        CHECK(src.seek(150) == 0 && src.getByte(b) == 0 && b == 0);
+        CHECK(src.seek(300) == 0 && src.getByte(b) == 0 && b == 0xaa);
+        CHECK(src.flush() == 0);
+        bool zeros = true;
+        for (uint32_t i = 100; i < 300; i++) zeros &= src.data[i] == 0;
+        CHECK(zeros);
+        CHECK(src.data[300] == 0xaa && src.data[301] == 0xee);
+        CHECK(src.bad_calls == 0);
+    }
+
+    // One window: a write it cannot reach contiguously starts a window
+    // there, with no fetch, and the byte in between is never stored
+    check_ctx = "gap rule, one window";
+    {
+        RamBacked src(4096, 512, false, true);
+        for (uint32_t i = 0; i < src.data.size(); i++) src.data[i] = seq_byte(i);
+        CHECK(src.seek(1000) == 0 && src.setByte(1) == 0);
+        CHECK(src.seek(1002) == 0 && src.setByte(2) == 0);
+        CHECK(src.flush() == 0);
+        CHECK(src.fetches == 0 && src.stores == 2);
+        CHECK(src.data[1000] == 1 && src.data[1001] == seq_byte(1001) && src.data[1002] == 2);
+        // The window stays contiguous: 1003 extends it, 1002 reads back
+        uint8_t b = 0;
+        CHECK(src.setByte(3) == 0 && src.seek(1002) == 0 && src.getByte(b) == 0 && b == 2);
+        CHECK(src.flush() == 0 && src.data[1003] == 3);
+    }
+}
+
+// ---- flush() of a wrapped window ----
+
+static void split_flush_run(WriteBehind mode) {
+    Deferred bg;
+    RamBacked src(1000, 256, true, true);
+    for (uint32_t i = 0; i < src.data.size(); i++) src.data[i] = seq_byte(i);
+    std::vector<uint8_t> model = src.data;
+    if (mode != WriteBehind::IMMEDIATE) CHECK(src.writeBehind(&bg.io, mode) == 0);
+
+    // A read at 900 fills 900..999 and 0..155 into one window
+    uint8_t buf[120];
+    uint32_t n = 0;
+    CHECK(src.seek(900) == 0 && src.get(buf, sizeof(buf), n) == 0 && n == sizeof(buf));
+    for (uint32_t i = 0; i < n; i++) CHECK(buf[i] == model[(900 + i) % 1000]);
+    CHECK(src.fetches == 2);
+
+    // Writes at its tail, running on past the end to 0..4
+    uint8_t in[15];
+    for (uint32_t i = 0; i < sizeof(in); i++) in[i] = (uint8_t)(0x80 + i);
+    CHECK(src.seek(990) == 0 && src.set(in, sizeof(in), n) == 0 && n == sizeof(in));
+    for (uint32_t i = 0; i < sizeof(in); i++) model[(990 + i) % 1000] = in[i];
+    CHECK(src.tell() == 5);
+
+    // Read back across the end before anything is stored
+    CHECK(src.seek(985) == 0 && src.get(buf, 30, n) == 0 && n == 30);
+    for (uint32_t i = 0; i < 30; i++) CHECK(buf[i] == model[(985 + i) % 1000]);
+
+    CHECK(src.flush() == 0);
+    CHECK(src.data == model);
+    CHECK(src.bad_calls == 0);
+}
+
+static void check_split_flush() {
+    check_ctx = "wrapped window, immediate";
+    split_flush_run(WriteBehind::IMMEDIATE);
+    check_ctx = "wrapped window, write-behind";
+    split_flush_run(WriteBehind::BACKGROUND);
+    check_ctx = "wrapped window, lazy";
+    split_flush_run(WriteBehind::LAZY);
+}
+
+// ---- Sources on FatFS ----
+
+static int write_file(const char *path, const uint8_t *data, uint32_t len) {
+    FIL f;
+    UINT bw = 0;
+    if (f_open(&f, path, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) return -1;
+    FRESULT fr = f_write(&f, data, len, &bw);
+    f_close(&f);
+    return (fr == FR_OK && bw == len) ? 0 : -1;
+}
+
+// An MZF: 128-byte header (type 1, name, size, load and exec address), body
+static std::vector<uint8_t> make_mzf(int n, uint16_t body) {
+    std::vector<uint8_t> mzf(128 + body, 0);
+    mzf[0] = 0x01;
+    snprintf((char *)&mzf[1], 17, "FILE%d", n);
+    mzf[1 + strlen((char *)&mzf[1])] = 0x0d;
+    mzf[18] = body & 0xff;
+    mzf[19] = body >> 8;
+    mzf[20] = 0x00;
+    mzf[21] = 0x12;
+    mzf[22] = 0x00;
+    mzf[23] = 0x12;
+    for (uint32_t i = 0; i < body; i++) mzf[128 + i] = seq_byte(i * 11 + n);
+    return mzf;
+}
+
+static int make_fixtures() {
+    if (f_mkdir("sd:/src") != FR_OK || f_mkdir("sd:/src/qd") != FR_OK ||
+        f_mkdir("sd:/src/cpm") != FR_OK)
+        return -1;
+    for (int n = 0; n < MZF_FILES; n++) {
+        char path[40];
+        snprintf(path, sizeof(path), "sd:/src/qd/FILE%d.MZF", n);
+        const std::vector<uint8_t> mzf = make_mzf(n, (uint16_t)(1000 + n * 2345));
+        if (write_file(path, mzf.data(), (uint32_t)mzf.size()) != 0) return -1;
+    }
+    const std::vector<uint8_t> sram = make_mzf(9, 3000);
+    if (write_file("sd:/src/sram.mzf", sram.data(), (uint32_t)sram.size()) != 0) return -1;
+
+    std::vector<uint8_t> cpm(CPM_FILE_SIZE);
+    for (int f = 0; f < CPM_FILES; f++) {
+        char path[40];
+        snprintf(path, sizeof(path), "sd:/src/cpm/PART%d.DAT", f);
+        for (uint32_t i = 0; i < cpm.size(); i++) cpm[i] = cpm_file_byte(f, i);
+        if (write_file(path, cpm.data(), (uint32_t)cpm.size()) != 0) return -1;
+    }
+    return f_mkdir("flash:/src") == FR_OK ? 0 : -1;
+}
+
+static void check_file_source() {
+    check_ctx = "FileSource";
+    const char path[] = "sd:/src/image.bin";
+    const uint32_t size = 40000;
+    {
+        // A new image reads as zeros; written through one window
+        std::unique_ptr<ByteSource> bs;
+        CHECK(ByteSourceFactory::from_file(path, size, 512, true, bs) == 0);
+        uint8_t b = 0xff;
+        CHECK(bs->seek(size - 1) == 0 && bs->getByte(b) == 0 && b == 0 && bs->tell() == 0);
+        std::vector<uint8_t> data(size);
+        for (uint32_t i = 0; i < size; i++) data[i] = seq_byte(i);
+        uint32_t n = 0;
+        CHECK(bs->set(data.data(), size, n) == 0 && n == size);
+        CHECK(bs->flush() == 0);
+    }
+    {
+        // Reopened at its own size, through lines, without wrap
+        std::unique_ptr<ByteSource> bs;
+        CHECK(ByteSourceFactory::from_file(path, 0, 512, false, bs) == 0);
+        CHECK(bs->size() == size);
+        CHECK(bs->setCacheLines(4, 2) == 0);
+        uint8_t b = 0;
+        uint32_t wrong = 0;
+        for (uint32_t i = 0; i < size; i++)
+            if (bs->getByte(b) != 0 || b != seq_byte(i)) wrong++;
+        CHECK(wrong == 0);
+        CHECK(bs->getByte(b) != 0 && bs->tell() == size);
+        for (int i = 0; i < 2000; i++) {
+            const uint32_t at = rnd(size);
+            if (bs->seek(at) != 0 || bs->getByte(b) != 0 || b != seq_byte(at)) wrong++;
+        }
+        CHECK(wrong == 0);
+        CacheStats cs;
+        CHECK(bs->cacheStats(cs) && cs.misses > 0);
+    }
+    // And what FatFS holds
+    FIL f;
+    UINT br = 0;
+    std::vector<uint8_t> back(size);
+    CHECK(f_open(&f, path, FA_READ) == FR_OK);
+    CHECK(f_read(&f, back.data(), size, &br) == FR_OK && br == size);
+    f_close(&f);
+    uint32_t wrong = 0;
+    for (uint32_t i = 0; i < size; i++)
+        if (back[i] != seq_byte(i)) wrong++;
+    CHECK(wrong == 0);
+}
+
+static void check_mzf_sram() {
+    check_ctx = "Mzf2SramFileSource";
+    std::vector<uint8_t> mzf = make_mzf(9, 3000);
+    std::unique_ptr<ByteSource> file, ram;
+    CHECK(ByteSourceFactory::from_mzf_to_sram_file("sd:/src/sram.mzf", 128, file) == 0);
+    ByteSourceFactory::from_mzf_to_sram_ram(mzf.data(), (uint32_t)mzf.size(), ram);
+    CHECK(file->size() == 9 + 3000 && ram->size() == file->size());
+    // Twice round: both wrap to the rebuilt header
+    uint32_t wrong = 0;
+    for (uint32_t i = 0; i < 2 * ram->size(); i++) {
+        uint8_t a = 0, b = 0;
+        if (file->getByte(a) != 0 || ram->getByte(b) != 0 || a != b) wrong++;
+    }
+    CHECK(wrong == 0);
+    CHECK(file->tell() == 0 && ram->tell() == 0);
+}
+
+// The whole stream of `bs`, a byte at a time or in blocks
+static std::vector<uint8_t> read_all(ByteSource *bs, bool bytewise) {
+    std::vector<uint8_t> out(bs->size());
+    bs->seek(0);
+    uint32_t done = 0;
+    while (done < out.size()) {
+        uint32_t n = 0;
+        if (bytewise) {
+            if (bs->getByte(out[done]) != 0) break;
+            n = 1;
+        } else {
+            const uint32_t want = std::min<uint32_t>(512, (uint32_t)out.size() - done);
+            if (bs->get(&out[done], want, n) != 0 || n == 0) break;
+        }
+        done += n;
+    }
+    out.resize(done);
+    return out;
+}
+
+// Random single bytes of `bs` agree with `image`
+static uint32_t random_reads(ByteSource *bs, const std::vector<uint8_t> &image, int count) {
+    uint32_t wrong = 0;
+    for (int i = 0; i < count; i++) {
+        const uint32_t at = rnd((uint32_t)image.size());
+        uint8_t b = 0;
+        if (bs->seek(at) != 0 || bs->getByte(b) != 0 || b != image[at]) wrong++;
+    }
+    return wrong;
+}
+
+static void check_qd_dir() {
+    check_ctx = "QDDirSource";
+    std::unique_ptr<ByteSource> a, b;
+    CHECK(ByteSourceFactory::from_qddir("sd:/src/qd", 128, a) == 0);
+    CHECK(ByteSourceFactory::from_qddir("sd:/src/qd", 1024, b) == 0);
+    if (!a || !b) return;
+    const std::vector<uint8_t> img = read_all(a.get(), true);
+    CHECK(img.size() == QD_MAX_SIZE);
+    CHECK(read_all(b.get(), false) == img);
+    CHECK(random_reads(b.get(), img, 2000) == 0);
+    // Each file's body, whole, in its body block
+    for (int n = 0; n < MZF_FILES; n++) {
+        const std::vector<uint8_t> mzf = make_mzf(n, (uint16_t)(1000 + n * 2345));
+        CHECK(memmem(img.data(), img.size(), mzf.data() + 128, mzf.size() - 128) != nullptr);
+    }
+}
+
+// LEC CP/M geometry of a directory mount: DSK track 0 is 9 x 512, track
+// 1 the 16 x 256 boot track, then 9 x 512; four reserved tracks, 2 KB
+// blocks, the directory in blocks 0 and 1
+static uint32_t cpm_track_offset(uint32_t track) {
+    return 0x100 + (track ? 0x1300 + 0x1100 + (track - 2) * 0x1300 : 0);
+}
+
+// The 512-byte sector holding 128-byte record `rec`, found through the
+// Track-Info sector IDs (the mount interleaves them)
+static const uint8_t *cpm_record_sector(const std::vector<uint8_t> &img, uint32_t rec) {
+    const uint32_t t = cpm_track_offset(4 + rec / 36);
+    const uint8_t id = (uint8_t)(1 + (rec % 36) / 4);
+    for (uint32_t i = 0; i < 9; i++)
+        if (t + 0x18 + i * 8 + 2 < img.size() && img[t + 0x18 + i * 8 + 2] == id)
+            return &img[t + 0x100 + i * 512];
+    return nullptr;
+}
+
+static void check_fdc_dir() {
+    check_ctx = "FDCDirSource";
+    std::unique_ptr<ByteSource> a, b;
+    CHECK(ByteSourceFactory::from_fdcdir("sd:/src/cpm", FDCDirSource::Fs::CPM, 512, a) == 0);
+    CHECK(ByteSourceFactory::from_fdcdir("sd:/src/cpm", FDCDirSource::Fs::CPM, 4096, b) == 0);
+    if (!a || !b) return;
+    const std::vector<uint8_t> img = read_all(a.get(), false);
+    CHECK(img.size() == a->size() && memcmp(img.data(), "EXTENDED CPC DSK", 16) == 0);
+    CHECK(read_all(b.get(), true) == img);
+    CHECK(random_reads(a.get(), img, 2000) == 0);
+
+    // Every file, found through the CP/M directory
+    std::vector<uint8_t> dir;
+    for (uint32_t rec = 0; rec < 32; rec += 4) {
+        const uint8_t *s = cpm_record_sector(img, rec);
+        CHECK(s != nullptr);
+        if (!s) return;
+        dir.insert(dir.end(), s, s + 512);
+    }
+    uint32_t found = 0, wrong = 0;
+    for (uint32_t e = 0; e < 128; e++) {
+        const uint8_t *d = &dir[e * 32];
+        const int f = d[5] - '0';
+        if (d[0] != 0 || memcmp(d + 1, "PART", 4) != 0 || f < 0 || f >= CPM_FILES) continue;
+        const uint32_t extent = d[12] | (uint32_t)d[14] << 5;
+        for (uint32_t k = 0; k < 8; k++) {
+            const uint32_t block = d[16 + k * 2] | d[17 + k * 2] << 8;
+            const uint32_t off = (extent * 8 + k) * 2048;
+            if (!block || off >= CPM_FILE_SIZE) continue;
+            found++;
+            for (uint32_t s = 0; s < 4; s++) {
+                const uint8_t *p = cpm_record_sector(img, block * 16 + s * 4);
+                for (uint32_t i = 0; p && i < 512; i++)
+                    if (p[i] != cpm_file_byte(f, off + s * 512 + i)) wrong++;
+                if (!p) wrong++;
+            }
+        }
+    }
+    CHECK(found == CPM_FILES * CPM_FILE_SIZE / 2048);
+    CHECK(wrong == 0);
+}
+
+// ---- Compressed images ----
+
+// A mostly empty CP/M disk: E5 fill, a few text sectors, one random stretch
+static std::vector<uint8_t> make_sparse_image(uint32_t size) {
+    std::vector<uint8_t> img(size, 0xe5);
+    static const char text[] = "A>DIR\r\nPIP B:=A:*.COM[V]\r\nSTAT DSK:\r\n";
+    for (uint32_t at = 0; at + 4096 <= size; at += 40000)
+        for (uint32_t i = 0; i < 4096; i++) img[at + i] = (uint8_t)text[i % (sizeof(text) - 1)];
+    for (uint32_t i = 0; i < size / 16; i++) img[size / 2 + i] = (uint8_t)rnd(256);
+    memset(img.data() + size - size / 8, 0, size / 8);
+    return img;
+}
+
+static void check_lz_block() {
+    check_ctx = "lz_block";
+    std::vector<uint16_t> table(LZ_HASH_ENTRIES);
+    for (int kind = 0; kind < 5; kind++) {
+        for (uint32_t len : { 0u, 1u, 12u, 13u, 100u, 4096u, 20000u, 65536u }) {
+            std::vector<uint8_t> src(len);
+            for (uint32_t i = 0; i < len; i++)
+                src[i] = kind == 0 ? 0 :
+                         kind == 1 ? (uint8_t)rnd(256) :
+                         kind == 2 ? (uint8_t)(i % 7) :
+                         kind == 3 ? (uint8_t)(rnd(8) ? 0xe5 : rnd(256)) : seq_byte(i / 3);
+            std::vector<uint8_t> packed(len + len / 255 + 16);
+            const uint32_t n = lz_compress(src.data(), len, packed.data(), (uint32_t)packed.size(), table.data());
+            CHECK(n > 0);
+            if (!n) continue;
+            std::vector<uint8_t> out(len + 1, 0x55);
+            CHECK(lz_decompress(packed.data(), n, out.data(), len) == 0);
+            CHECK(memcmp(out.data(), src.data(), len) == 0 && out[len] == 0x55);
+            // In place, as CompressedSource::hold() decodes
+            std::vector<uint8_t> buf(len + lz_inplace_margin(n));
+            memcpy(buf.data() + buf.size() - n, packed.data(), n);
+            CHECK(lz_decompress(buf.data() + buf.size() - n, n, buf.data(), len) == 0);
+            CHECK(memcmp(buf.data(), src.data(), len) == 0);
+            // Too small an output, or a size that is not the block's
+            if (n > 1)
+                CHECK(lz_compress(src.data(), len, packed.data(), n - 1, table.data()) == 0);
+            if (len)
+                CHECK(lz_decompress(packed.data(), n, out.data(), len - 1) != 0);
+        }
+    }
+    // Corrupt input decodes to an error or to something, within bounds
+    // (ASan builds catch a stray access)
+    std::vector<uint8_t> src(4096);
+    for (uint32_t i = 0; i < src.size(); i++) src[i] = (uint8_t)(rnd(4) ? i / 64 : rnd(256));
+    std::vector<uint8_t> packed(5000), bad, out(4096);
+    const uint32_t n = lz_compress(src.data(), 4096, packed.data(), 5000, table.data());
+    for (int i = 0; i < 2000; i++) {
+        bad.assign(packed.begin(), packed.begin() + n);
+        for (int k = 0; k < 3; k++) bad[rnd(n)] = (uint8_t)rnd(256);
+        const uint32_t cut = rnd(4) ? n : 1 + rnd(n);
+        std::vector<uint8_t> exact(bad.begin(), bad.begin() + cut);
+        lz_decompress(exact.data(), cut, out.data(), 4096);
+    }
+}
+
+// The whole file at `path`, or empty
+static std::vector<uint8_t> read_file(const char *path) {
+    FIL f;
+    std::vector<uint8_t> data;
+    if (f_open(&f, path, FA_READ) != FR_OK) return data;
+    data.resize(f_size(&f));
+    UINT br = 0;
+    if (f_read(&f, data.data(), (UINT)data.size(), &br) != FR_OK) br = 0;
+    data.resize(br);
+    f_close(&f);
+    return data;
+}
+
+static bool file_exists(const char *path) {
+    FILINFO fno;
+    return f_stat(path, &fno) == FR_OK;
+}
+
+// Random writes through `bs`, mirrored in `model`, then flushed
+static void random_writes(ByteSource *bs, std::vector<uint8_t> &model, int count) {
+    uint8_t buf[700];
+    for (int i = 0; i < count; i++) {
+        const uint32_t len = 1 + rnd(sizeof(buf));
+        const uint32_t at = rnd((uint32_t)model.size() - len);
+        for (uint32_t k = 0; k < len; k++) buf[k] = (uint8_t)rnd(256);
+        uint32_t n = 0;
+        CHECK(bs->seek(at) == 0 && bs->set(buf, len, n) == 0 && n == len);
+        memcpy(model.data() + at, buf, len);
+    }
+    CHECK(bs->flush() == 0);
+}
+
+static void check_compressed_source() {
+    check_ctx = "CompressedSource";
+    const char path[] = "sd:/src/packed.dsk";
+    const char ovl[] = "sd:/src/packed.dsk.ovl";
+    const uint32_t size = 348160; // 80 x 2 x 16 x 256 + DSK headers, roughly
+    std::vector<uint8_t> model = make_sparse_image(size), packed;
+    CHECK(mzc_pack(model, 0, packed) && packed.size() < size / 2);
+    CHECK(write_file(path, packed.data(), (uint32_t)packed.size()) == 0);
+
+    std::unique_ptr<ByteSource> bs;
+    CHECK(ByteSourceFactory::from_compressed("sd:/src/sram.mzf", 512, false, bs) == 1 && !bs);
+    CHECK(ByteSourceFactory::from_compressed(path, 512, false, bs) == 0);
+    if (!bs) return;
+    CHECK(bs->size() == size && !bs->readOnly());
+    CHECK(read_all(bs.get(), false) == model);
+    CHECK(random_reads(bs.get(), model, 2000) == 0);
+    CHECK(bs->resize(size - 1000) == 0 && bs->size() == size && bs->resize(size + 1) != 0);
+
+    // Writes go to the overlay, and stay there across a remount
+    random_writes(bs.get(), model, 300);
+    CHECK(read_all(bs.get(), true) == model);
+    CHECK(read_file(path) == packed);
+    bs.reset();
+    CHECK(ByteSourceFactory::from_compressed(path, 128, true, bs) == 0);
+    if (!bs) return;
+    CHECK(static_cast<CompressedSource *>(bs.get())->overlaid() > 0);
+    CHECK(read_all(bs.get(), false) == model);
+    CHECK(bs->setCacheLines(4, 0) == 0 && random_reads(bs.get(), model, 2000) == 0);
+
+    // Recompression: nothing until writes have been quiet, a write midway
+    // abandons the pass, the next one folds the overlay in
+    Idler idle;
+    CHECK(bs->recompressInBackground(&idle.io) == 0);
+    random_writes(bs.get(), model, 10);
+    for (int i = 0; i < 10; i++) idle.round();
+    CHECK(!file_exists("sd:/src/packed.dsk.tmp"));
+    sleep_us(COMPRESSED_SOURCE_QUIET_US + 50000);
+    for (int i = 0; i < 5; i++) idle.round();
+    CHECK(file_exists("sd:/src/packed.dsk.tmp"));
+    random_writes(bs.get(), model, 5);
+    idle.round();
+    CHECK(!file_exists("sd:/src/packed.dsk.tmp"));
+    sleep_us(COMPRESSED_SOURCE_QUIET_US + 50000);
+    int rounds = 0;
+    while (file_exists(ovl) && rounds < 10000 && idle.round()) rounds++;
+    CHECK(!file_exists(ovl) && idle.run != nullptr);
+    CHECK(static_cast<CompressedSource *>(bs.get())->overlaid() == 0);
+    CHECK(read_all(bs.get(), false) == model);
+    std::vector<uint8_t> image;
+    CHECK(mzc_unpack(read_file(path), image) && image == model);
+
+    // Still writable after the swap
+    random_writes(bs.get(), model, 20);
+    CHECK(file_exists(ovl));
+    bs.reset();
+    CHECK(idle.run == nullptr);
+
+    // A new container in its place: the overlay no longer applies
+    std::vector<uint8_t> fresh = make_sparse_image(size);
+    fresh[0] ^= 0xff;
+    CHECK(mzc_pack(fresh, 9, packed));
+    CHECK(write_file(path, packed.data(), (uint32_t)packed.size()) == 0);
+    CHECK(ByteSourceFactory::from_compressed(path, 512, false, bs) == 0);
+    CHECK(bs && read_all(bs.get(), false) == fresh && !file_exists(ovl));
+    bs.reset();
+
+    // Cut short between the delete and the rename
+    CHECK(f_rename(path, "sd:/src/packed.dsk.tmp") == FR_OK);
+    CHECK(ByteSourceFactory::from_compressed(path, 512, false, bs) == 0);
+    CHECK(bs && read_all(bs.get(), false) == fresh && !file_exists("sd:/src/packed.dsk.tmp"));
+}
+
+// ---- Timings ----
+
+enum class Op { GET_BYTE, SET_BYTE, GET_BLOCK, SET_BLOCK, RANDOM_GET };
+
+static const char *const op_names[] = { "getByte", "setByte", "get 512", "set 512", "random 256" };
+
+// One pass over `len` bytes from 0 (RANDOM_GET: as many in 256-byte reads
+// at random positions); returns the bytes moved
+static uint32_t run_op(ByteSource *bs, Op op, uint32_t len) {
+    uint8_t buf[512];
+    uint32_t done = 0, n = 0;
+    bs->seek(0);
+    switch (op) {
+    case Op::GET_BYTE:
+        for (; done < len; done++) bs->getByte(buf[0]);
+        break;
+    case Op::SET_BYTE:
+        for (; done < len; done++) bs->setByte((uint8_t)done);
+        break;
+    case Op::GET_BLOCK:
+        for (; done < len; done += sizeof(buf)) bs->get(buf, sizeof(buf), n);
+        break;
+    case Op::SET_BLOCK:
+        memset(buf, 0x5a, sizeof(buf));
+        for (; done < len; done += sizeof(buf)) bs->set(buf, sizeof(buf), n);
+        break;
+    case Op::RANDOM_GET:
+        for (; done < len; done += 256) {
+            bs->seek(rnd(len - 256));
+            bs->get(buf, 256, n);
+        }
+        break;
+    }
+    if (op == Op::SET_BYTE || op == Op::SET_BLOCK) bs->flush();
+    return done;
+}
+
+static void bench(const char *name, ByteSource *bs, Op op, uint32_t len) {
+    if (!bs) {
+        printf("  %-30s %-10s (no source)\n", name, op_names[(int)op]);
+        return;
+    }
+    CacheStats cs0{}, cs1{};
+    const bool cached = bs->cacheStats(cs0);
+    HostDiskStats d0[HOST_DISK_COUNT], d1[HOST_DISK_COUNT];
+    for (uint8_t p = 0; p < HOST_DISK_COUNT; p++) host_disk_get_stats(p, &d0[p]);
+
+    uint64_t best = UINT64_MAX;
+    uint32_t bytes = 0;
+    for (int pass = 0; pass < BENCH_PASSES; pass++) {
+        const uint64_t t0 = wall_ns();
+        bytes = run_op(bs, op, len);
+        const uint64_t t1 = wall_ns();
+        if (t1 - t0 < best) best = t1 - t0;
+    }
+
+    bs->cacheStats(cs1);
+    uint32_t rd = 0, wr = 0;
+    for (uint8_t p = 0; p < HOST_DISK_COUNT; p++) {
+        host_disk_get_stats(p, &d1[p]);
+        rd += d1[p].read_sectors - d0[p].read_sectors;
+        wr += d1[p].write_sectors - d0[p].write_sectors;
+    }
+    const uint32_t refills = (cs1.misses - cs0.misses) / BENCH_PASSES;
+    const uint32_t stores = (cs1.writebacks - cs0.writebacks) / BENCH_PASSES;
+    printf("  %-30s %-10s %9.2f %9s %9s %9u %9u\n", name, op_names[(int)op],
+           bytes ? (double)best / (double)bytes : 0.0,
+           cached ? std::to_string(refills).c_str() : "-",
+           cached ? std::to_string(stores).c_str() : "-",
+           rd / BENCH_PASSES, wr / BENCH_PASSES);
+}
+
+static void run_benchmarks() {
+    printf("\n  %-30s %-10s %9s %9s %9s %9s %9s\n", "source", "op", "ns/byte", "refills",
+           "stores", "sect rd", "sect wr");
+
+    static uint8_t mem[BENCH_SIZE];
+    std::unique_ptr<ByteSource> ram;
+    ByteSourceFactory::from_ram(mem, sizeof(mem), ram);
+    for (Op op : { Op::GET_BYTE, Op::SET_BYTE, Op::GET_BLOCK, Op::SET_BLOCK })
+        bench("ram", ram.get(), op, BENCH_SIZE);
+
+    RamBacked window(BENCH_SIZE, 512, true, true);
+    RamBacked lines(BENCH_SIZE, 512, true, true);
+    lines.setCacheLines(4, 0);
+    for (Op op : { Op::GET_BYTE, Op::SET_BYTE, Op::GET_BLOCK, Op::SET_BLOCK, Op::RANDOM_GET }) {
+        bench("cached ram: window 512", &window, op, BENCH_SIZE);
+        bench("cached ram: 4 lines 512", &lines, op, BENCH_SIZE);
+    }
+
+    std::unique_ptr<ByteSource> sd, sd_lines, flash;
+    ByteSourceFactory::from_file("sd:/src/bench.img", 4 * BENCH_SIZE, 512, true, sd);
+    ByteSourceFactory::from_file("sd:/src/bench4.img", 4 * BENCH_SIZE, 512, true, sd_lines);
+    ByteSourceFactory::from_file("flash:/src/bench.img", BENCH_SIZE, 512, true, flash);
+    if (sd_lines) sd_lines->setCacheLines(4, 0);
+    for (Op op : { Op::SET_BYTE, Op::GET_BYTE, Op::SET_BLOCK, Op::GET_BLOCK, Op::RANDOM_GET }) {
+        bench("file sd: window 512", sd.get(), op, 4 * BENCH_SIZE);
+        bench("file sd: 4 lines 512", sd_lines.get(), op, 4 * BENCH_SIZE);
+        bench("file flash: window 512", flash.get(), op, BENCH_SIZE);
+    }
+
+    // The same image, compressed: a mostly empty disk
+    std::unique_ptr<ByteSource> plain, packed;
+    const std::vector<uint8_t> sparse = make_sparse_image(4 * BENCH_SIZE);
+    std::vector<uint8_t> container;
+    mzc_pack(sparse, 0, container);
+    write_file("sd:/src/sparse.img", sparse.data(), (uint32_t)sparse.size());
+    write_file("sd:/src/sparse.mzc", container.data(), (uint32_t)container.size());
+    ByteSourceFactory::from_file("sd:/src/sparse.img", 0, 512, false, plain);
+    ByteSourceFactory::from_compressed("sd:/src/sparse.mzc", 512, false, packed);
+    for (Op op : { Op::GET_BYTE, Op::GET_BLOCK, Op::RANDOM_GET }) {
+        bench("sparse sd: plain, 512", plain.get(), op, 4 * BENCH_SIZE);
+        bench("sparse sd: compressed, 512", packed.get(), op, 4 * BENCH_SIZE);
+    }
+
+    std::vector<uint8_t> mzf = make_mzf(9, 3000);
+    std::unique_ptr<ByteSource> sram_ram, sram_file, qd, fdc;
+    ByteSourceFactory::from_mzf_to_sram_ram(mzf.data(), (uint32_t)mzf.size(), sram_ram);
+    ByteSourceFactory::from_mzf_to_sram_file("sd:/src/sram.mzf", 128, sram_file);
+    bench("mzf sram: ram", sram_ram.get(), Op::GET_BYTE, 3009);
+    bench("mzf sram: file, 128", sram_file.get(), Op::GET_BYTE, 3009);
+
+    const FilePoolStats pool0 = FilePool::stats();
+    ByteSourceFactory::from_qddir("sd:/src/qd", 128, qd);
+    ByteSourceFactory::from_fdcdir("sd:/src/cpm", FDCDirSource::Fs::CPM, 512, fdc);
+    bench("qd dir: 128", qd.get(), Op::GET_BYTE, QD_MAX_SIZE);
+    for (Op op : { Op::GET_BYTE, Op::GET_BLOCK })
+        bench("fdc cp/m dir: 512", fdc.get(), op, fdc ? fdc->size() : 0);
+    const FilePoolStats pool1 = FilePool::stats();
+    printf("\nfile pool (dir sources above): %u opens, %u reuses, %u evictions\n",
+           pool1.opens - pool0.opens, pool1.hits - pool0.hits, pool1.evictions - pool0.evictions);
+    printf("sparse image: %u bytes, %u compressed\n", 4 * BENCH_SIZE, (unsigned)container.size());
+}
+
+int main(int argc, char **argv) {
+    const bool checks_only = (argc > 1 && strcmp(argv[1], "--checks") == 0);
+
+    if (host_mount_volumes() != 0 || make_fixtures() != 0) {
+        fprintf(stderr, "source bench: volume setup failed\n");
+        return 2;
+    }
+
+    printf("\nmzpico byte_source checks\n");
+    static const struct {
+        const char *name;
+        void (*run)();
+    } checks[] = {
+        { "RamSource wrap / auto-increment",     check_ram_source },
+        { "CachedSource against an array",       check_cached_model },
+        { "setByte() gap rule",                  check_gap_rule },
+        { "flush() of a wrapped window",         check_split_flush },
+        { "FileSource on FatFS",                 check_file_source },
+        { "Mzf2SramFileSource vs RAM",           check_mzf_sram },
+        { "QDDirSource stream",                  check_qd_dir },
+        { "FDCDirSource CP/M image",             check_fdc_dir },
+        { "LZ block codec",                      check_lz_block },
+        { "CompressedSource and its overlay",    check_compressed_source },
+    };
+    for (const auto &c : checks) {
+        const uint32_t before = failures;
+        c.run();
+        printf("  %-40s %s\n", c.name, failures == before ? "ok" : "FAILED");
+    }
+
+    if (!checks_only)
+        run_benchmarks();
+
+    if (failures) {
+        printf("\nFAILED: %u checks\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,195 @@
+// mzpico_trace_replay: feeds a bus trace recorded by a BUS_TRACE firmware
+// build (sd:/traces/traceNNN.bin) back through the device handlers.
+//
+//   mzpico_trace_replay [--ports] [--import HOST=VOL]... mzpico.ini trace.bin
+//
+// The ini and every image it references must match the ones the trace was
+// taken with: --import copies them onto the RAM-disk volumes first, e.g.
+// --import cpm.dsk=sd:/cpm/cpm.dsk. Each OUT cycle is replayed as is;
+// each IN cycle is replayed and its result compared with the byte the
+// firmware drove, so the first mismatch points at where host and board
+// state parted. Reports the per-device handler times of the replay and
+// the longest gaps between recorded cycles (a hang shows up as one), and
+// the cache counters of every file image: replaying the same trace with a
+// different cache_lines/cache_ways in the ini compares cache geometries.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "bus_sim.hpp"
+#include "bus_trace_format.hpp"
+#include "host_boot.hpp"
+
+static constexpr int MAX_MISMATCHES_SHOWN = 10;
+static constexpr int GAPS_SHOWN = 5;
+
+struct Gap {
+    uint32_t us;
+    uint64_t index; // cycle that ended the gap
+    BusTraceCycle cycle;
+};
+
+static int usage() {
+    fprintf(stderr, "usage: mzpico_trace_replay [--ports] [--import HOST=VOL]... "
+                    "mzpico.ini trace.bin\n");
+    return 2;
+}
+
+static bool read_host_file(const char *path, std::vector<uint8_t>& out) {
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+    uint8_t buf[16384];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        out.insert(out.end(), buf, buf + n);
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+static void note_gap(std::vector<Gap>& gaps, const Gap& g) {
+    if (gaps.size() == GAPS_SHOWN && g.us <= gaps.back().us)
+        return;
+    if (gaps.size() == GAPS_SHOWN)
+        gaps.pop_back();
+    auto it = gaps.begin();
+    while (it != gaps.end() && it->us >= g.us)
+        ++it;
+    gaps.insert(it, g);
+}
+
+int main(int argc, char **argv) {
+    bool show_ports = false;
+    std::vector<std::pair<std::string, std::string>> imports;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "--ports") == 0) {
+            show_ports = true;
+        } else if (strcmp(argv[i], "--import") == 0 && i + 1 < argc) {
+            const char *arg = argv[++i];
+            const char *eq = strchr(arg, '=');
+            if (!eq)
+                return usage();
+            imports.emplace_back(std::string(arg, eq), std::string(eq + 1));
+        } else {
+            return usage();
+        }
+    }
+    if (argc - i != 2)
+        return usage();
+    const char *ini_path = argv[i];
+    const char *trace_path = argv[i + 1];
+
+    std::vector<uint8_t> trace;
+    if (!read_host_file(trace_path, trace)) {
+        fprintf(stderr, "replay: cannot read %s\n", trace_path);
+        return 2;
+    }
+    uint8_t board = 0;
+    if (trace.size() < BUS_TRACE_HEADER_SIZE || bus_trace_check_header(trace.data(), &board) != 0) {
+        fprintf(stderr, "replay: %s is not a version %u bus trace\n", trace_path, BUS_TRACE_VERSION);
+        return 2;
+    }
+    if (board != 0)
+        printf("replay: Deluxe trace on the Frugal host build; Deluxe-only "
+               "devices (ctc) are not replayed\n");
+
+    if (host_mount_volumes() != 0) {
+        fprintf(stderr, "replay: volume setup failed\n");
+        return 2;
+    }
+    for (const auto& imp : imports) {
+        if (host_import_file(imp.first.c_str(), imp.second.c_str()) != 0) {
+            fprintf(stderr, "replay: cannot import %s to %s\n", imp.first.c_str(), imp.second.c_str());
+            return 2;
+        }
+    }
+    if (host_import_file(ini_path, "sd:/mzpico.ini") != 0 ||
+        host_boot_devices("sd:/mzpico.ini") <= 0) {
+        fprintf(stderr, "replay: device boot from %s failed\n", ini_path);
+        return 2;
+    }
+
+    BusSim bus;
+    BusTraceDecoder decoder;
+    const uint8_t *p = trace.data() + BUS_TRACE_HEADER_SIZE;
+    const uint8_t *end = trace.data() + trace.size();
+    uint64_t cycles = 0, ins = 0, outs = 0, mismatches = 0, dropped = 0;
+    uint32_t first_time = 0, last_time = 0;
+    bool after_drop = false;
+    std::vector<Gap> gaps;
+
+    while (true) {
+        BusTraceCycle c;
+        uint32_t lost = 0;
+        BusTraceDecoder::Result r = decoder.next(p, end, c, lost);
+        if (r == BusTraceDecoder::DROP) {
+            dropped += lost;
+            after_drop = true;
+            continue;
+        }
+        if (r != BusTraceDecoder::CYCLE) {
+            if (r == BusTraceDecoder::BAD_RECORD)
+                printf("replay: corrupt record at offset %zu, stopping\n",
+                       (size_t)(p - trace.data()));
+            else if (p != end)
+                printf("replay: trace ends mid-record (%zu bytes ignored)\n", (size_t)(end - p));
+            break;
+        }
+
+        if (cycles == 0)
+            first_time = c.time;
+        else if (!after_drop)
+            note_gap(gaps, Gap{c.time - last_time, cycles, c});
+        last_time = c.time;
+        after_drop = false;
+
+        if (c.out) {
+            bus.out(c.low_addr, c.data, c.high_addr);
+            outs++;
+        } else {
+            uint8_t got = bus.in(c.low_addr, c.high_addr);
+            ins++;
+            if (got != c.data) {
+                if (mismatches < MAX_MISMATCHES_SHOWN)
+                    printf("  mismatch at cycle %llu (t=%u us): IN 0x%02x%02x recorded 0x%02x, replayed 0x%02x\n",
+                           (unsigned long long)cycles, c.time - first_time,
+                           c.high_addr, c.low_addr, c.data, got);
+                mismatches++;
+            }
+        }
+        cycles++;
+    }
+
+    const BusSim::Totals& t = bus.totals();
+    printf("\nreplayed %llu cycles (%llu IN, %llu OUT) spanning %.3f s\n",
+           (unsigned long long)cycles, (unsigned long long)ins, (unsigned long long)outs,
+           (double)(last_time - first_time) / 1e6);
+    printf("  %llu IN mismatches, %llu cycles dropped by the recorder, %llu unhandled\n",
+           (unsigned long long)mismatches, (unsigned long long)dropped,
+           (unsigned long long)t.unhandled);
+    if (dropped)
+        printf("  (device state may legitimately diverge after a drop)\n");
+
+    if (!gaps.empty()) {
+        printf("\nlongest gaps between cycles\n");
+        for (const Gap& g : gaps)
+            printf("  %10u us before cycle %llu (%s 0x%02x%02x)\n", g.us,
+                   (unsigned long long)g.index, g.cycle.out ? "OUT" : "IN ",
+                   g.cycle.high_addr, g.cycle.low_addr);
+    }
+
+    printf("\nper device\n");
+    bus.printDeviceReport(stdout);
+    printf("\ncache\n");
+    BusSim::printCacheReport(stdout);
+    if (show_ports) {
+        printf("\nper port\n");
+        bus.printPortReport(stdout);
+    }
+    return mismatches ? 1 : 0;
+}
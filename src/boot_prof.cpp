@@ -0,0 +1,26 @@
+#include <cstring>
+
+#include "boot_prof.hpp"
+
+static const char* const phase_names[BOOT_PHASE_COUNT] = {
+    "clock", "gpio", "pio", "mount", "ini_stat", "ini_load",
+    "devices", "menu", "flat_tables",
+};
+
+const char* boot_prof_phase_name(uint8_t phase) {
+    return phase < BOOT_PHASE_COUNT ? phase_names[phase] : "?";
+}
+
+#ifdef BOOT_PROF
+
+BootProfile boot_prof;
+
+int boot_prof_device(const char* id) {
+    if (boot_prof.devCount >= BOOT_PROF_MAX_DEVICES)
+        return -1;
+    BootDevice& d = boot_prof.dev[boot_prof.devCount];
+    strncpy(d.id, id, BOOT_PROF_ID_LEN - 1);
+    return boot_prof.devCount++;
+}
+
+#endif // BOOT_PROF
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "common.hpp"
+
+// Boot phase profile, on by default (-DBOOT_PROF=OFF compiles it out).
+//
+// device_main() (core 0) and device_main1() (core 1) stamp each boot
+// phase with the 1MHz timer, which starts at reset; the record stays in
+// RAM for PicoMgr (REPO_CMD_GET_BOOT_PROF) and /api/status to read later.
+// The figure that matters is listen_us - when listen_loop() starts
+// answering the bus - against the MZ-800's one-shot IPL probe ~180ms
+// after power-on: every device and image the ini adds eats into that
+// margin. The timer counts from the RP2040 reset, not from power-good,
+// so the real margin is a few ms smaller (crystal start-up, boot ROM).
+//
+// Core 0 writes its phases before core 1 could read them back, core 1
+// its own; readers run long after boot, so no locking.
+
+constexpr uint32_t BOOT_PROF_IPL_US = 180000;
+constexpr uint8_t BOOT_PROF_MAX_DEVICES = 16;
+constexpr uint8_t BOOT_PROF_ID_LEN = 12;
+
+enum BootPhase : uint8_t {
+    BOOT_PHASE_CLOCK,       // core 0: set_sys_clock_khz
+    BOOT_PHASE_GPIO,        // core 0: init_gpio
+    BOOT_PHASE_PIO,         // core 0: bus PIO programs, reset IRQ
+    BOOT_PHASE_MOUNT,       // core 1: mount_devices
+    BOOT_PHASE_INI_STAT,    // core 1: f_stat sd:/mzpico.ini
+    BOOT_PHASE_INI_LOAD,    // core 1: iniparser_load, sd: then flash:
+    BOOT_PHASE_DEVICES,     // core 1: the whole device loop
+    BOOT_PHASE_MENU,        // core 1: [menu]/[explorer] into picoConfig
+    BOOT_PHASE_FLAT_TABLES, // core 1: MZDeviceManager::buildFlatTables
+    BOOT_PHASE_COUNT
+};
+
+// Per device, in ini order
+enum BootDevStep : uint8_t {
+    BOOT_DEV_PORTS,         // port list resolution + setPortsList
+    BOOT_DEV_INIT,
+    BOOT_DEV_CONFIG,        // readConfig: buffers, image open/creation
+    BOOT_DEV_STEPS
+};
+
+struct BootSpan {
+    uint32_t start_us;      // since reset
+    uint32_t dur_us;
+};
+
+struct BootDevice {
+    char id[BOOT_PROF_ID_LEN];  // ini section, truncated, NUL-padded
+    uint32_t step_us[BOOT_DEV_STEPS];
+};
+
+struct BootProfile {
+    BootSpan phase[BOOT_PHASE_COUNT];
+    BootDevice dev[BOOT_PROF_MAX_DEVICES];
+    uint8_t devCount;
+    bool iniFromSd;
+    uint32_t listen_us;     // listen_loop() entry since reset, 0 before
+};
+
+// Phase name for reports ("clock", "mount", ...)
+const char* boot_prof_phase_name(uint8_t phase);
+
+#ifdef BOOT_PROF
+
+#include "hardware/timer.h"
+
+extern BootProfile boot_prof;
+
+ALWAYS_INLINE uint32_t boot_prof_now(void) {
+    return time_us_32();
+}
+
+ALWAYS_INLINE void boot_prof_phase(BootPhase phase, uint32_t start) {
+    boot_prof.phase[phase].start_us = start;
+    boot_prof.phase[phase].dur_us = time_us_32() - start;
+}
+
+// Core 1: next device slot for `id`, -1 once the table is full (the
+// device still boots, it just isn't itemized)
+int boot_prof_device(const char* id);
+
+ALWAYS_INLINE void boot_prof_device_step(int slot, BootDevStep step, uint32_t start) {
+    if (slot >= 0)
+        boot_prof.dev[slot].step_us[step] = time_us_32() - start;
+}
+
+ALWAYS_INLINE void boot_prof_ini(bool fromSd) {
+    boot_prof.iniFromSd = fromSd;
+}
+
+ALWAYS_INLINE void boot_prof_listen(void) {
+    boot_prof.listen_us = time_us_32();
+}
+
+#else
+
+ALWAYS_INLINE uint32_t boot_prof_now(void) { return 0; }
+ALWAYS_INLINE void boot_prof_phase(BootPhase, uint32_t) {}
+inline int boot_prof_device(const char*) { return -1; }
+ALWAYS_INLINE void boot_prof_device_step(int, BootDevStep, uint32_t) {}
+ALWAYS_INLINE void boot_prof_ini(bool) {}
+ALWAYS_INLINE void boot_prof_listen(void) {}
+
+#endif // BOOT_PROF
@@ -43,6 +43,10 @@
 #define REPO_CMD_CHREPO     0x0a
 #define REPO_CMD_GET_CONFIG     0x0b
 #define REPO_CMD_GET_WIFI_STATUS 0x0c
+#define REPO_CMD_GET_BUS_STATS  0x0d
+#define REPO_CMD_GET_BOOT_PROF  0x0e
+#define REPO_CMD_RECONFIG       0x0f
+#define REPO_CMD_GET_CORE_LOAD  0x10
 
 #define PICO_MGR_BUFF_SIZE (0xd000 - 0x1200 + 128 + 2 + 4)
 
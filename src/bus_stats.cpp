@@ -0,0 +1,54 @@
+#ifdef BUS_STATS
+
+#include <cstring>
+
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+
+#include "bus_stats.hpp"
+#include "mz_devices.hpp"
+
+uint8_t bus_stats_slot[256];
+BusPortStats bus_stats[BUS_STATS_MAX_PORTS];
+uint8_t bus_stats_ports = 0;
+uint32_t bus_stats_busy = 0;
+
+void bus_stats_add_ports(void) {
+    for (uint16_t p = 0; p < MAX_PORTS; ++p) {
+        if (bus_stats_slot[p] != BUS_STATS_NO_SLOT)
+            continue;
+        if (!MZDeviceManager::flatPorts[p].read && !MZDeviceManager::flatPorts[p].write)
+            continue;
+        if (bus_stats_ports == BUS_STATS_MAX_PORTS)
+            break;
+        bus_stats[bus_stats_ports].port = (uint8_t)p;
+        bus_stats_slot[p] = bus_stats_ports++;
+    }
+}
+
+void bus_stats_init(void) {
+    memset(bus_stats_slot, BUS_STATS_NO_SLOT, sizeof(bus_stats_slot));
+    memset(bus_stats, 0, sizeof(bus_stats));
+    bus_stats_ports = 0;
+    bus_stats_add_ports();
+
+    // SysTick is per core: free-running over the full 24 bits on clk_sys
+    systick_hw->csr = 0;
+    systick_hw->rvr = 0x00FFFFFF;
+    systick_hw->cvr = 0;
+    systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+}
+
+void bus_stats_reset(void) {
+    for (uint8_t i = 0; i < bus_stats_ports; i++) {
+        uint8_t port = bus_stats[i].port;
+        memset(&bus_stats[i], 0, sizeof(bus_stats[i]));
+        bus_stats[i].port = port;
+    }
+}
+
+uint32_t bus_stats_clock_khz(void) {
+    return clock_get_hz(clk_sys) / 1000;
+}
+
+#endif // BUS_STATS
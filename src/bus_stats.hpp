@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "common.hpp"
+
+// Per-port dispatch timing of listen_loop(), on by default (-DBUS_STATS=OFF
+// drops it from the hot path).
+//
+// Core 1 snapshots its SysTick (clk_sys cycles, 24-bit) when it pops a
+// cycle off the PIO FIFO, right after set_exwait() and right after
+// release_exwait(), and accumulates two log2 histograms per port:
+//   latency  pop -> EXWAIT asserted (what eats into the ~423ns /WAIT
+//            sampling deadline)
+//   hold     EXWAIT asserted -> released, i.e. how long the Z80 sat in
+//            /WAIT; long holds stop MZ-800 DRAM refresh. On non-EXWAIT
+//            ports (psg) it is the handler time, the Z80 does not wait.
+// A pre-staged read (MZDeviceManager::stageRead) counts pop -> data bus
+// driven as latency and zero hold.
+// Bucket 0 counts below 2^BUS_STATS_BUCKET_SHIFT cycles, bucket i
+// [2^(i+SHIFT-1), 2^(i+SHIFT)), the last bucket everything above. Holds
+// over 2^24 cycles (~93ms at 180MHz) wrap the SysTick and are undercounted.
+//
+// Read by PicoMgr (REPO_CMD_GET_BUS_STATS) on core 1 and /api/status on
+// core 0; the counters only grow, so a racing reader sees at worst a
+// cycle's worth of skew between fields.
+
+constexpr uint8_t BUS_STATS_BUCKETS = 20;
+constexpr uint8_t BUS_STATS_BUCKET_SHIFT = 5;
+constexpr uint8_t BUS_STATS_MAX_PORTS = 32;
+constexpr uint8_t BUS_STATS_NO_SLOT = 0xFF;
+
+struct BusPortStats {
+    uint8_t port;
+    uint32_t count;
+    uint32_t lat_max;   // clk_sys cycles
+    uint32_t hold_max;
+    uint32_t lat[BUS_STATS_BUCKETS];
+    uint32_t hold[BUS_STATS_BUCKETS];
+};
+
+#ifdef BUS_STATS
+
+#include "hardware/structs/systick.h"
+
+extern uint8_t bus_stats_slot[256];
+extern BusPortStats bus_stats[BUS_STATS_MAX_PORTS];
+extern uint8_t bus_stats_ports;
+// All cycles' latency + hold, wrapping (core_load.hpp takes deltas)
+extern uint32_t bus_stats_busy;
+
+ALWAYS_INLINE uint32_t bus_stats_now(void) {
+    return systick_hw->cvr;
+}
+
+ALWAYS_INLINE uint8_t bus_stats_bucket(uint32_t cycles) {
+    uint32_t b = 32 - __builtin_clz(cycles | ((1u << BUS_STATS_BUCKET_SHIFT) - 1)) - BUS_STATS_BUCKET_SHIFT;
+    return b < BUS_STATS_BUCKETS ? b : BUS_STATS_BUCKETS - 1;
+}
+
+// Core 1, after the cycle is complete. SysTick counts down.
+ALWAYS_INLINE void bus_stats_record(uint8_t port, uint32_t t_pop, uint32_t t_exwait, uint32_t t_release) {
+    uint8_t slot = bus_stats_slot[port];
+    if (slot == BUS_STATS_NO_SLOT)
+        return;
+    BusPortStats& s = bus_stats[slot];
+    uint32_t lat = (t_pop - t_exwait) & 0xFFFFFF;
+    uint32_t hold = (t_exwait - t_release) & 0xFFFFFF;
+    bus_stats_busy += lat + hold;
+    s.count++;
+    s.lat[bus_stats_bucket(lat)]++;
+    s.hold[bus_stats_bucket(hold)]++;
+    if (lat > s.lat_max) s.lat_max = lat;
+    if (hold > s.hold_max) s.hold_max = hold;
+}
+
+// Core 1, after MZDeviceManager::buildFlatTables(): assigns a slot to
+// every port with a handler (first BUS_STATS_MAX_PORTS of them) and
+// starts this core's SysTick
+void bus_stats_init(void);
+void bus_stats_reset(void);
+// After a runtime reconfiguration (hot_config.hpp): slots for ports that
+// gained a handler; removed ports keep theirs and simply stop counting
+void bus_stats_add_ports(void);
+
+// clk_sys in kHz, to turn the cycle counts into time
+uint32_t bus_stats_clock_khz(void);
+
+#endif // BUS_STATS
@@ -0,0 +1,155 @@
+#ifdef BUS_TRACE
+
+#include <cstdio>
+#include <cstring>
+
+#include "pico/stdlib.h"
+
+#include "bus_trace.hpp"
+#include "bus_trace_format.hpp"
+#include "work_queue.hpp"
+#include "ff.h"
+
+BusTraceEntry bus_trace_ring[BUS_TRACE_RING_SIZE];
+volatile uint32_t bus_trace_head = 0;
+volatile uint32_t bus_trace_tail = 0;
+volatile uint32_t bus_trace_dropped = 0;
+uint32_t bus_trace_lost = 0;
+volatile bool bus_trace_active = false;
+
+// Ring entries encoded per poll: bounds the time core 0 spends here, so
+// i2s_audio_poll() and the WiFi state machine keep their latency
+static constexpr int DRAIN_BATCH = 64;
+static constexpr uint32_t SYNC_INTERVAL_MS = 1000;
+static constexpr int MAX_TRACE_FILES = 1000;
+
+// Core 0 state
+static FIL trace_file;
+static bool trace_open = false;
+static bool trace_failed = false;
+static bool resync_pending = true;
+static BusTraceEncoder encoder;
+// Encoded bytes waiting for the card, written ~one sector at a time
+static uint8_t staging[512];
+static size_t staged = 0;
+static bool unsynced = false;
+static uint32_t last_sync_ms = 0;
+
+void bus_trace_start(void) {
+    __asm volatile("" ::: "memory");
+    bus_trace_active = true;
+}
+
+// Claim the FatFS volume from core 0. Fails (try again next poll) while
+// core 1 is inside a handler; once it succeeds, core 1 parks its next
+// EXWAIT cycle until fs_release().
+static bool fs_claim(void) {
+    return work_fs_claim(nullptr);
+}
+
+static void fs_release(void) {
+    work_fs_release();
+}
+
+static void trace_fail(const char* what, FRESULT fr) {
+    printf("bus trace: %s failed (%d), capture stopped\n", what, fr);
+    trace_failed = true;
+    bus_trace_active = false;
+}
+
+static bool open_trace(void) {
+    if (!fs_claim())
+        return false;
+    FRESULT fr = f_mkdir("sd:/traces");
+    if (fr != FR_OK && fr != FR_EXIST) {
+        fs_release();
+        trace_fail("mkdir sd:/traces", fr);
+        return false;
+    }
+    char path[32];
+    fr = FR_EXIST;
+    for (int n = 0; n < MAX_TRACE_FILES && fr == FR_EXIST; n++) {
+        snprintf(path, sizeof(path), "sd:/traces/trace%03d.bin", n);
+        fr = f_open(&trace_file, path, FA_WRITE | FA_CREATE_NEW);
+    }
+    fs_release();
+    if (fr != FR_OK) {
+        trace_fail("open trace file", fr);
+        return false;
+    }
+    printf("bus trace: recording to %s\n", path);
+    #ifdef BOARD_DELUXE
+    bus_trace_write_header(staging, 1);
+    #else
+    bus_trace_write_header(staging, 0);
+    #endif
+    staged = BUS_TRACE_HEADER_SIZE;
+    trace_open = true;
+    last_sync_ms = to_ms_since_boot(get_absolute_time());
+    return true;
+}
+
+static bool write_staging(bool sync) {
+    if (!fs_claim())
+        return false;
+    UINT bw = 0;
+    FRESULT fr = staged ? f_write(&trace_file, staging, staged, &bw) : FR_OK;
+    if (fr == FR_OK && bw != staged)
+        fr = FR_DENIED; // volume full
+    if (fr == FR_OK && sync)
+        fr = f_sync(&trace_file);
+    if (fr != FR_OK)
+        f_close(&trace_file);
+    fs_release();
+    if (fr != FR_OK) {
+        trace_open = false;
+        trace_fail("write", fr);
+        return false;
+    }
+    unsynced = !sync;
+    staged = 0;
+    return true;
+}
+
+void bus_trace_poll(void) {
+    if (!bus_trace_active || trace_failed)
+        return;
+    if (!trace_open && !open_trace())
+        return;
+
+    for (int n = 0; n < DRAIN_BATCH; n++) {
+        // Room for a drop marker, a resync and a cycle
+        if (staged + 2 * BUS_TRACE_MAX_RECORD + 5 > sizeof(staging)) {
+            if (!write_staging(false))
+                return;
+        }
+        uint32_t tail = bus_trace_tail;
+        if (tail == bus_trace_head)
+            break;
+        __asm volatile("" ::: "memory");
+        const BusTraceEntry& e = bus_trace_ring[tail & (BUS_TRACE_RING_SIZE - 1)];
+        if (e.kind == BUS_TRACE_ENTRY_DROP) {
+            staged += encoder.drop(staging + staged, e.time);
+            resync_pending = true;
+        } else {
+            if (resync_pending) {
+                staged += encoder.resync(staging + staged, e.time);
+                resync_pending = false;
+            }
+            BusTraceCycle c{e.time, e.kind == BUS_TRACE_ENTRY_OUT, e.low_addr, e.high_addr, e.data};
+            staged += encoder.cycle(staging + staged, c);
+        }
+        __asm volatile("" ::: "memory");
+        bus_trace_tail = tail + 1;
+    }
+
+    // A hang is what traces are mostly taken for: make sure the cycles
+    // leading up to it reach the card even if the bus goes quiet
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+    if ((staged || unsynced) && now - last_sync_ms >= SYNC_INTERVAL_MS) {
+        if (write_staging(true))
+            last_sync_ms = now;
+    }
+}
+
+#endif // BUS_TRACE
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "common.hpp"
+
+// Z80 I/O bus trace recorder, compiled in with -DBUS_TRACE=ON (diagnostic
+// builds only; release builds carry none of it).
+//
+// Core 1 appends one 8-byte entry per dispatched cycle to a single-
+// producer/single-consumer RAM ring; core 0 drains it from its poll loop,
+// delta-encodes it (bus_trace_format.hpp) and appends to
+// sd:/traces/traceNNN.bin. Core 1 never waits on the ring: when it is
+// full, cycles are counted and written out as a drop marker. The host
+// replays a trace with mzpico_trace_replay (host/).
+//
+// Core 0 writes the file through the same FatFS handover as deferred
+// work (work_queue.hpp): it backs off while core 1 is mid-handler, and
+// core 1 holds an EXWAIT cycle until a running write finishes. The cost
+// is that an SD write (~1ms, more during card housekeeping) can stretch
+// one Z80 I/O cycle - trace builds trade timing fidelity for visibility.
+
+#ifdef BUS_TRACE
+
+#include "pico/stdlib.h"
+#include "hardware/structs/timer.h"
+
+constexpr uint32_t BUS_TRACE_RING_SIZE = 2048; // entries, power of 2 (16KB)
+
+enum : uint8_t { BUS_TRACE_ENTRY_IN, BUS_TRACE_ENTRY_OUT, BUS_TRACE_ENTRY_DROP };
+
+struct BusTraceEntry {
+    uint32_t time;  // timer_hw->timerawl after the handler; DROP: count
+    uint8_t kind;
+    uint8_t low_addr;
+    uint8_t high_addr;
+    uint8_t data;
+};
+
+extern BusTraceEntry bus_trace_ring[BUS_TRACE_RING_SIZE];
+extern volatile uint32_t bus_trace_head;      // written by core 1 only
+extern volatile uint32_t bus_trace_tail;      // written by core 0 only
+extern volatile uint32_t bus_trace_dropped;   // written by core 1 only
+extern uint32_t bus_trace_lost;               // core 1: drops not yet logged
+extern volatile bool bus_trace_active;
+
+// Core 1: log one dispatched cycle. Cycles lost to a full ring go in as
+// one DROP entry ahead of the next cycle that fits, so the replayer sees
+// the gap where it happened.
+ALWAYS_INLINE void bus_trace_record(bool out, uint8_t low_addr, uint8_t high_addr, uint8_t data) {
+    if (!bus_trace_active)
+        return;
+    uint32_t head = bus_trace_head;
+    uint32_t need = bus_trace_lost ? 2 : 1;
+    if (head - bus_trace_tail > BUS_TRACE_RING_SIZE - need) {
+        bus_trace_lost++;
+        bus_trace_dropped = bus_trace_dropped + 1;
+        return;
+    }
+    if (bus_trace_lost) {
+        BusTraceEntry& d = bus_trace_ring[head & (BUS_TRACE_RING_SIZE - 1)];
+        d.time = bus_trace_lost;
+        d.kind = BUS_TRACE_ENTRY_DROP;
+        bus_trace_lost = 0;
+        head++;
+    }
+    BusTraceEntry& e = bus_trace_ring[head & (BUS_TRACE_RING_SIZE - 1)];
+    e.time = timer_hw->timerawl;
+    e.kind = out ? BUS_TRACE_ENTRY_OUT : BUS_TRACE_ENTRY_IN;
+    e.low_addr = low_addr;
+    e.high_addr = high_addr;
+    e.data = data;
+    __asm volatile("" ::: "memory");
+    bus_trace_head = head + 1;
+}
+
+// Core 1, once the devices are configured: start capturing
+void bus_trace_start(void);
+
+// Core 0 poll loop: open the trace file on the first call after
+// bus_trace_start(), then encode and write out what core 1 captured
+void bus_trace_poll(void);
+
+#else
+
+ALWAYS_INLINE void bus_trace_record(bool, uint8_t, uint8_t, uint8_t) {}
+inline void bus_trace_start(void) {}
+inline void bus_trace_poll(void) {}
+
+#endif // BUS_TRACE
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "common.hpp"
+
+// On-SD format of the Z80 I/O bus trace (BUS_TRACE builds, see
+// bus_trace.hpp). Shared by the firmware writer and the host replayer
+// (host/trace_replay.cpp), so it stays free of Pico SDK headers.
+//
+// A trace file is a 16-byte header followed by a stream of records:
+//
+//   header   "MZTRACE" + version byte, u8 board (0 Frugal, 1 Deluxe),
+//            3 bytes reserved, u32 LE timestamp unit in ns
+//   cycle    tag, LEB128 time delta to the previous cycle, [low_addr],
+//            [high_addr], data
+//              tag bit 0: OUT cycle (clear: IN, data is what was driven)
+//              tag bit 1: low_addr is the previous cycle's (byte omitted)
+//              tag bit 2: high_addr is the previous cycle's (byte omitted)
+//   resync   0xFE, u32 LE absolute timestamp; starts the stream and
+//            follows every drop, the next cycle carries both address bytes
+//   drop     0xFD, LEB128 number of cycles lost to a full capture ring
+//
+// Streaming transfers (same port, same high byte, <128 units apart) cost
+// 3 bytes a cycle against 8 in the capture ring.
+
+constexpr uint8_t BUS_TRACE_VERSION = 1;
+constexpr size_t BUS_TRACE_HEADER_SIZE = 16;
+constexpr uint32_t BUS_TRACE_UNIT_NS = 1000; // timer_hw->timerawl ticks
+
+constexpr uint8_t BUS_TRACE_TAG_OUT = 0x01;
+constexpr uint8_t BUS_TRACE_TAG_SAME_LOW = 0x02;
+constexpr uint8_t BUS_TRACE_TAG_SAME_HIGH = 0x04;
+constexpr uint8_t BUS_TRACE_TAG_CYCLE_MASK = 0x07;
+constexpr uint8_t BUS_TRACE_TAG_DROP = 0xFD;
+constexpr uint8_t BUS_TRACE_TAG_RESYNC = 0xFE;
+
+// Longest encoded record: tag + 5-byte delta + low + high + data
+constexpr size_t BUS_TRACE_MAX_RECORD = 9;
+
+struct BusTraceCycle {
+    uint32_t time;
+    bool out;
+    uint8_t low_addr;
+    uint8_t high_addr;
+    uint8_t data;
+};
+
+inline void bus_trace_write_header(uint8_t* dst, uint8_t board) {
+    memcpy(dst, "MZTRACE", 7);
+    dst[7] = BUS_TRACE_VERSION;
+    dst[8] = board;
+    dst[9] = dst[10] = dst[11] = 0;
+    write_u32_le(dst + 12, BUS_TRACE_UNIT_NS);
+}
+
+// Returns 0 and the board byte for a header this build can decode
+inline int bus_trace_check_header(const uint8_t* src, uint8_t* board) {
+    if (memcmp(src, "MZTRACE", 7) != 0 || src[7] != BUS_TRACE_VERSION)
+        return -1;
+    if (read_u32_le(src + 12) != BUS_TRACE_UNIT_NS)
+        return -1;
+    *board = src[8];
+    return 0;
+}
+
+class BusTraceEncoder {
+public:
+    // All encode calls return the number of bytes written to dst, which
+    // must have room for BUS_TRACE_MAX_RECORD.
+    size_t resync(uint8_t* dst, uint32_t time) {
+        dst[0] = BUS_TRACE_TAG_RESYNC;
+        write_u32_le(dst + 1, time);
+        prevTime_ = time;
+        havePrev_ = false;
+        return 5;
+    }
+
+    size_t drop(uint8_t* dst, uint32_t count) {
+        dst[0] = BUS_TRACE_TAG_DROP;
+        return 1 + putVarint(dst + 1, count);
+    }
+
+    size_t cycle(uint8_t* dst, const BusTraceCycle& c) {
+        uint8_t tag = c.out ? BUS_TRACE_TAG_OUT : 0;
+        if (havePrev_ && c.low_addr == prevLow_) tag |= BUS_TRACE_TAG_SAME_LOW;
+        if (havePrev_ && c.high_addr == prevHigh_) tag |= BUS_TRACE_TAG_SAME_HIGH;
+        size_t n = 0;
+        dst[n++] = tag;
+        n += putVarint(dst + n, c.time - prevTime_);
+        if (!(tag & BUS_TRACE_TAG_SAME_LOW)) dst[n++] = c.low_addr;
+        if (!(tag & BUS_TRACE_TAG_SAME_HIGH)) dst[n++] = c.high_addr;
+        dst[n++] = c.data;
+        prevTime_ = c.time;
+        prevLow_ = c.low_addr;
+        prevHigh_ = c.high_addr;
+        havePrev_ = true;
+        return n;
+    }
+
+private:
+    static size_t putVarint(uint8_t* dst, uint32_t v) {
+        size_t n = 0;
+        while (v >= 0x80) {
+            dst[n++] = (uint8_t)(v | 0x80);
+            v >>= 7;
+        }
+        dst[n++] = (uint8_t)v;
+        return n;
+    }
+
+    uint32_t prevTime_ = 0;
+    uint8_t prevLow_ = 0;
+    uint8_t prevHigh_ = 0;
+    bool havePrev_ = false;
+};
+
+class BusTraceDecoder {
+public:
+    enum Result { CYCLE, DROP, NEED_MORE, BAD_RECORD };
+
+    // Decodes one record from [p, end). On CYCLE and DROP, p advances past
+    // it; NEED_MORE leaves p alone (a truncated tail, e.g. power loss
+    // between syncs). Resync records are consumed internally.
+    Result next(const uint8_t*& p, const uint8_t* end, BusTraceCycle& c, uint32_t& dropped) {
+        while (p < end) {
+            const uint8_t* q = p;
+            uint8_t tag = *q++;
+            if (tag == BUS_TRACE_TAG_RESYNC) {
+                if (end - q < 4) return NEED_MORE;
+                prevTime_ = read_u32_le(q);
+                havePrev_ = false;
+                p = q + 4;
+                continue;
+            }
+            if (tag == BUS_TRACE_TAG_DROP) {
+                int r = getVarint(q, end, dropped);
+                if (r) return r < 0 ? BAD_RECORD : NEED_MORE;
+                p = q;
+                return DROP;
+            }
+            if (tag & ~BUS_TRACE_TAG_CYCLE_MASK) return BAD_RECORD;
+            if (!havePrev_ && (tag & (BUS_TRACE_TAG_SAME_LOW | BUS_TRACE_TAG_SAME_HIGH)))
+                return BAD_RECORD;
+            uint32_t delta;
+            int r = getVarint(q, end, delta);
+            if (r) return r < 0 ? BAD_RECORD : NEED_MORE;
+            size_t need = 1 + !(tag & BUS_TRACE_TAG_SAME_LOW) + !(tag & BUS_TRACE_TAG_SAME_HIGH);
+            if ((size_t)(end - q) < need) return NEED_MORE;
+            c.out = tag & BUS_TRACE_TAG_OUT;
+            c.low_addr = (tag & BUS_TRACE_TAG_SAME_LOW) ? prevLow_ : *q++;
+            c.high_addr = (tag & BUS_TRACE_TAG_SAME_HIGH) ? prevHigh_ : *q++;
+            c.data = *q++;
+            c.time = prevTime_ + delta;
+            prevTime_ = c.time;
+            prevLow_ = c.low_addr;
+            prevHigh_ = c.high_addr;
+            havePrev_ = true;
+            p = q;
+            return CYCLE;
+        }
+        return NEED_MORE;
+    }
+
+private:
+    // 0 on success, 1 if the buffer ends mid-varint, -1 if it overflows
+    static int getVarint(const uint8_t*& q, const uint8_t* end, uint32_t& v) {
+        v = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            if (q >= end) return 1;
+            uint8_t b = *q++;
+            v |= (uint32_t)(b & 0x7F) << shift;
+            if (!(b & 0x80)) return 0;
+        }
+        return -1;
+    }
+
+    uint32_t prevTime_ = 0;
+    uint8_t prevLow_ = 0;
+    uint8_t prevHigh_ = 0;
+    bool havePrev_ = false;
+};
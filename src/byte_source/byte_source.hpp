@@ -6,6 +6,44 @@
 #include "ff.h"
 #include "common.hpp"
 
+// Cache counters of a CachedSource: lookups that found their byte cached
+// and line fills; writebacks are dirty lines stored on eviction or flush
+// (deferred: of those, stored by write-behind), prefetched windows swapped
+// in from read-ahead instead of a fill
+struct CacheStats {
+    std::uint32_t hits = 0;
+    std::uint32_t misses = 0;
+    std::uint32_t writebacks = 0;
+    std::uint32_t prefetched = 0;
+    std::uint32_t deferred = 0;
+};
+
+class CachedSource;
+
+// Where a CachedSource's read-ahead fills, write-behind stores and idle
+// work run (CachedSource::setReadAhead, setWriteBehind,
+// ByteSource::zeroInBackground, recompressInBackground)
+struct BackgroundIo {
+    void* ctx;
+    // Queue src->runBackground() elsewhere, to run while nothing else
+    // uses the storage below (another image on the same volume included);
+    // false if it cannot be queued now
+    bool (*post)(void* ctx, CachedSource* src);
+    // Return once every queued job has run
+    void (*wait)(void* ctx);
+    // Call run(arg) over and over whenever nothing else is running there
+    // and the source is not in use, until it returns false; run nullptr:
+    // stop (waiting out a call in progress). False if it cannot be taken on.
+    bool (*idle)(void* ctx, bool (*run)(void* arg), void* arg);
+};
+
+// When a dirty window that is left gets stored
+enum class WriteBehind : std::uint8_t {
+    IMMEDIATE,  // right there, by whoever leaves it
+    BACKGROUND, // handed to the BackgroundIo and stored as soon as it runs
+    LAZY,       // kept until the pool is full or flush() is called
+};
+
 class ByteSource {
 public:
     virtual ~ByteSource() {}
@@ -19,7 +57,119 @@ public:
     virtual std::uint32_t size() const { return 0; }
     virtual int resize(std::uint32_t) { return -1; } // grow/truncate backing store
     virtual bool readOnly() const { return false; }  // backing store rejects writes
+    // getByte() is a plain memory access (RAM, or XIP flash for embedded
+    // images) with no FatFS I/O behind it: bounded time, so devices may
+    // pre-stage their next read response (MZDeviceManager::stageRead)
+    virtual bool inMemory() const { return false; }
+    // The byte the next getByte() returns, without advancing
+    virtual int peekByte(std::uint8_t &out) {
+        std::uint32_t p = pos_;
+        int ret = getByte(out);
+        seek(p);
+        return ret;
+    }
+    // Split the cache into `lines` lines, `ways`-way set-associative (0:
+    // fully associative); -1 if the source has no cache or no RAM for it
+    virtual int setCacheLines(std::uint8_t, std::uint8_t) { return -1; }
+    // Fill the next window through `io` while this one is read; -1 if
+    // the source cannot (no cache, cache lines, no RAM). nullptr: off.
+    virtual int setReadAhead(const BackgroundIo*) { return -1; }
+    // Store the windows writes leave through `io` (file images only); -1
+    // if the source cannot
+    virtual int setWriteBehind(const BackgroundIo*, WriteBehind) { return -1; }
+    // Write out, through `io`'s idle work, the zeros a newly created image
+    // only reads as (FileSource); -1 if there are none or it cannot
+    virtual int zeroInBackground(const BackgroundIo*) { return -1; }
+    // Fold the blocks written since into the image, through `io`'s idle
+    // work (CompressedSource); -1 if the source keeps no such blocks
+    virtual int recompressInBackground(const BackgroundIo*) { return -1; }
+    virtual bool cacheStats(CacheStats&) const { return false; }
+    // Up to `len` bytes at `pos` in place: a pointer into the source's
+    // RAM, embedded image or cache window with `avail` (1..len) bytes
+    // behind it, for a device that works on them directly instead of
+    // byte by byte; nullptr if the source has no such memory or pos is out
+    // of range. The bytes stay put until the next call on the source other
+    // than releaseSpan(), which hands back the first `used` of them: the
+    // position moves past them (auto-incrementing sources), and in a
+    // `writable` span they count as written - write them from the start,
+    // without gaps.
+    virtual std::uint8_t* acquireSpan(std::uint32_t, std::uint32_t, bool, std::uint32_t& avail) {
+        avail = 0;
+        return nullptr;
+    }
+    virtual void releaseSpan(std::uint32_t) {}
     inline std::uint32_t tell() const { return pos_; }
 protected:
     std::uint32_t pos_ = 0;
 };
+
+// A data port's view of a ByteSource through acquireSpan(): a read or
+// write inside the span is a plain memory access, and the source is only
+// called when the position leaves it (or has no span: then seek() and
+// getByte()/setByte()). Writes must follow each other without a gap, as
+// an auto-incremented port address does. sync() hands the span back;
+// call it before any other call on the source.
+class ByteCursor {
+public:
+    inline int read(ByteSource* bs, std::uint32_t pos, std::uint8_t& out) {
+        std::uint32_t i = pos - start_;
+        if (writable_ || i >= len_) {
+            if (!acquire(bs, pos, false))
+                return bs->seek(pos) != 0 ? -1 : bs->getByte(out);
+            i = 0;
+        }
+        out = span_[i];
+        if (i >= used_) used_ = i + 1;
+        return 0;
+    }
+    inline int write(ByteSource* bs, std::uint32_t pos, std::uint8_t in) {
+        std::uint32_t i = pos - start_;
+        if (!writable_ || i > used_ || i >= len_) {
+            if (!acquire(bs, pos, true))
+                return bs->seek(pos) != 0 ? -1 : bs->setByte(in);
+            i = 0;
+        }
+        span_[i] = in;
+        if (i >= used_) used_ = i + 1;
+        return 0;
+    }
+    // The byte at pos, if the span holds it for reading
+    inline bool peek(std::uint32_t pos, std::uint8_t& out) const {
+        std::uint32_t i = pos - start_;
+        if (!span_ || writable_ || i >= len_)
+            return false;
+        out = span_[i];
+        return true;
+    }
+    // A span is held; end() is the position past the last byte used
+    inline bool active() const { return span_ != nullptr; }
+    inline std::uint32_t end() const { return start_ + used_; }
+    inline void sync(ByteSource* bs) {
+        if (!span_)
+            return;
+        bs->releaseSpan(used_);
+        span_ = nullptr;
+        len_ = 0;
+        used_ = 0;
+        writable_ = false;
+    }
+
+private:
+    inline bool acquire(ByteSource* bs, std::uint32_t pos, bool writable) {
+        sync(bs);
+        std::uint32_t avail = 0;
+        span_ = bs->acquireSpan(pos, ~0u, writable, avail);
+        if (!span_)
+            return false;
+        start_ = pos;
+        len_ = avail;
+        writable_ = writable;
+        return true;
+    }
+
+    std::uint8_t* span_ = nullptr;
+    std::uint32_t start_ = 0;
+    std::uint32_t len_ = 0;
+    std::uint32_t used_ = 0;
+    bool writable_ = false;
+};
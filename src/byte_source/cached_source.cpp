@@ -2,8 +2,11 @@
 #include <cstring>
 #include <string>
 #include <algorithm>
+#include <new>
 
-CachedSource::CachedSource(void* ctx, FetchFunc f, StoreFunc s, 
+#include "hardware/sync.h"
+
+CachedSource::CachedSource(void* ctx, FetchFunc f, StoreFunc s,
                            std::uint32_t storage_size,
                            std::uint32_t cache_size,
                            bool wrap,
@@ -18,50 +21,343 @@ CachedSource::CachedSource(void* ctx, FetchFunc f, StoreFunc s,
       cache_dirty_(false),
       storage_size_(storage_size),
       wrap_(wrap),
-      auto_increment_(auto_increment)
+      auto_increment_(auto_increment),
+      buf_(nullptr)
 {
     if (cache_size_ > 0) {
-        cache_ = new std::uint8_t[cache_size_];
+        buf_ = new std::uint8_t[cache_size_];
+        cache_ = buf_;
     }
 }
 
 CachedSource::~CachedSource() {
+    settle_background();
     flush();
-    delete[] cache_;
+    delete[] buf_;
+    delete[] lines_;
+    delete[] ahead_;
+    for (Pending& p : wb_)
+        delete[] p.buf;
     cache_ = nullptr;
 }
 
+int CachedSource::setCacheLines(std::uint8_t lines, std::uint8_t ways) {
+    if (lines < 2 || cache_size_ == 0)
+        return 0; // the single window it already is
+    if (io_)
+        return -1;
+    if (lines > CACHED_SOURCE_MAX_LINES)
+        lines = CACHED_SOURCE_MAX_LINES;
+    if (!ways || ways > lines || lines % ways)
+        ways = lines;
+    if (CachedSource::flush() != 0)
+        return -1;
+
+    std::uint8_t* buf = new (std::nothrow) std::uint8_t[(std::size_t)lines * cache_size_];
+    Line* meta = new (std::nothrow) Line[lines];
+    if (!buf || !meta) {
+        delete[] buf;
+        delete[] meta;
+        return -1; // keeps the single window
+    }
+    delete[] buf_;
+    delete[] lines_;
+    buf_ = buf;
+    lines_ = meta;
+    lineCount_ = lines;
+    ways_ = ways;
+    discard();
+    return 0;
+}
+
+int CachedSource::setReadAhead(const BackgroundIo* io) {
+    if (lines_ || cache_size_ == 0)
+        return -1;
+    settle_background();
+    ahead_state_ = AHEAD_IDLE;
+    if (!io) {
+        delete[] ahead_;
+        ahead_ = nullptr;
+        if (wb_mode_ == WriteBehind::IMMEDIATE)
+            io_ = nullptr;
+        return 0;
+    }
+    if (!ahead_) {
+        ahead_ = new (std::nothrow) std::uint8_t[cache_size_];
+        if (!ahead_)
+            return -1;
+    }
+    io_ = io;
+    return 0;
+}
+
+int CachedSource::enable_write_behind(const BackgroundIo* io, WriteBehind mode) {
+    if (lines_ || cache_size_ == 0 || (io_ && io != io_))
+        return -1;
+    if (flush() != 0)
+        return -1;
+    if (mode == WriteBehind::IMMEDIATE || !io) {
+        wb_mode_ = WriteBehind::IMMEDIATE;
+        if (!ahead_)
+            io_ = nullptr;
+        return 0;
+    }
+    for (Pending& p : wb_) {
+        if (!p.buf)
+            p.buf = new (std::nothrow) std::uint8_t[cache_size_];
+        if (!p.buf)
+            return -1; // stays immediate; the buffers go with the source
+    }
+    io_ = io;
+    wb_mode_ = mode;
+    return 0;
+}
+
+// Core 0 (or wherever post sent it): core 1 only hands off more windows
+// and queues fills meanwhile, never touching the slots being stored or
+// ahead_
+int CachedSource::runBackground() {
+    drain_behind();
+    int ret = wb_failed_ ? -1 : 0;
+    if (ahead_state_ == AHEAD_QUEUED) {
+        std::uint32_t fetched = 0;
+        if (fetch_(ctx_, ahead_start_, ahead_, ahead_len_, fetched) != 0) {
+            fetched = 0;
+            ret = -1;
+        }
+        ahead_valid_ = fetched;
+        __dmb();
+        ahead_state_ = AHEAD_READY;
+    }
+    return ret;
+}
+
+// Store the posted windows, oldest first; on core 1 only with nothing queued
+void CachedSource::drain_behind() {
+    const std::uint32_t posted = wb_posted_;
+    __dmb();
+    while (wb_tail_ != posted) {
+        const Pending& p = wb_[wb_tail_ % CACHED_SOURCE_WB_SLOTS];
+        if (store_range(p.start + p.lo, p.buf + p.lo, p.hi - p.lo) != 0)
+            wb_failed_ = true;
+        __dmb();
+        wb_tail_ = wb_tail_ + 1;
+    }
+}
+
+void CachedSource::wait_background() {
+    io_->wait(io_->ctx);
+    // Stores whose post failed: nothing else will run them
+    if (wb_tail_ != wb_posted_)
+        drain_behind();
+}
+
+// Queue the window following a full one (never across the storage end)
+void CachedSource::post_ahead() {
+    const std::uint32_t end = cache_start_ + cache_valid_;
+    if (cache_valid_ < cache_size_ || end >= storage_size_)
+        return;
+    const std::uint32_t remain = storage_size_ - end;
+    ahead_start_ = end;
+    ahead_len_ = (cache_size_ < remain) ? cache_size_ : remain;
+    ahead_usable_ = true;
+    ahead_state_ = AHEAD_QUEUED;
+    __dmb();
+    wb_posted_ = wb_head_; // the fill reads what LAZY holds too
+    if (!io_->post(io_->ctx, this))
+        ahead_state_ = AHEAD_IDLE;
+}
+
+void CachedSource::discard() {
+    settle_background();
+    ahead_state_ = AHEAD_IDLE;
+    wb_head_ = wb_tail_; // LAZY windows not stored yet go too
+    cache_start_ = 0;
+    cache_valid_ = 0;
+    cache_dirty_ = false;
+    if (!lines_)
+        return;
+    for (std::uint8_t i = 0; i < lineCount_; i++)
+        lines_[i] = Line{0, 0, 0, false};
+    cur_ = 0;
+    cache_ = buf_;
+}
+
 int CachedSource::flush() {
-    if (!cache_dirty_ || cache_valid_ == 0)
+    if (lines_)
+        return flush_lines();
+    const bool dirty = cache_dirty_ && cache_valid_ != 0;
+    if (!dirty && wb_head_ == wb_tail_ && !wb_failed_)
         return 0;
     if (storage_size_ == 0)
         return -1;
+    settle_background();
 
-    // wrapping adjustment only if enabled
-    if (wrap_)
-        cache_start_ %= storage_size_;
+    // Handed-off windows first: they are older than this one
+    int ret = 0;
+    if (wb_head_ != wb_tail_) {
+        wb_posted_ = wb_head_;
+        drain_behind();
+    }
+    if (wb_failed_) {
+        wb_failed_ = false;
+        ret = -1;
+    }
+    if (!dirty)
+        return ret;
+    if (store_range(cache_start_ + dirty_lo_, cache_ + dirty_lo_, dirty_hi_ - dirty_lo_) != 0)
+        return -1;
+    stats_.writebacks++;
+    cache_dirty_ = false;
+    return ret;
+}
 
-    if (cache_start_ + cache_valid_ <= storage_size_) {
-        std::uint32_t written = 0;
-        if (store_(ctx_, cache_start_, cache_, cache_valid_, written) != 0)
-            return -1;
-    } else if (wrap_) {
-        // only split if wrapping enabled
-        std::uint32_t first_len = storage_size_ - cache_start_;
-        std::uint32_t written1 = 0;
-        if (store_(ctx_, cache_start_, cache_, first_len, written1) != 0)
-            return -1;
+// Window bytes at `start`, split at the storage end if the window wraps
+int CachedSource::store_range(std::uint32_t start, const std::uint8_t* data, std::uint32_t len) {
+    std::uint32_t written = 0;
+    if (wrap_ && start >= storage_size_)
+        start -= storage_size_;
+    if (start + len <= storage_size_)
+        return store_(ctx_, start, data, len, written) ? -1 : 0;
+    if (!wrap_)
+        return 0;
+    const std::uint32_t first_len = storage_size_ - start;
+    if (store_(ctx_, start, data, first_len, written) != 0)
+        return -1;
+    return store_(ctx_, 0, data + first_len, len - first_len, written) ? -1 : 0;
+}
 
-        std::uint32_t second_len = cache_valid_ - first_len;
-        std::uint32_t written2 = 0;
-        if (store_(ctx_, 0, cache_ + first_len, second_len, written2) != 0)
-            return -1;
-    }
+// The single window is being left: store it, or hand it off. A fetch
+// that follows would wait for the store anyway, and may need what LAZY
+// still holds: then everything is stored here (not synced, FileSource
+// leaves that to flush()).
+int CachedSource::leave_window(bool fetching) {
+    if (wb_mode_ != WriteBehind::IMMEDIATE && fetching)
+        return CachedSource::flush();
+    if (!cache_dirty_ || cache_valid_ == 0)
+        return 0;
+    if (wb_mode_ == WriteBehind::IMMEDIATE)
+        return flush();
+    hand_off();
+    return 0;
+}
 
+void CachedSource::hand_off() {
+    if (wb_head_ - wb_tail_ == CACHED_SOURCE_WB_SLOTS) {
+        // Pool full: the oldest store has to finish first
+        settle_background();
+        if (wb_head_ - wb_tail_ == CACHED_SOURCE_WB_SLOTS) {
+            wb_posted_ = wb_head_; // LAZY: store them all now
+            drain_behind();
+        }
+    }
+    Pending& p = wb_[wb_head_ % CACHED_SOURCE_WB_SLOTS];
+    std::swap(p.buf, cache_);
+    buf_ = cache_;
+    p.start = cache_start_;
+    p.lo = dirty_lo_;
+    p.hi = dirty_hi_;
+    wb_head_++;
+    stats_.writebacks++;
+    stats_.deferred++;
+    cache_valid_ = 0;
     cache_dirty_ = false;
+    if (wb_mode_ != WriteBehind::BACKGROUND)
+        return;
+    __dmb();
+    wb_posted_ = wb_head_;
+    if (!io_->post(io_->ctx, this))
+        wait_background(); // stores it here once the queue is idle
+}
+
+// A write outside the single window: start an empty one at pos_ rather
+// than fetching bytes that are about to be overwritten
+int CachedSource::claim_window() {
+    if (leave_window(false) != 0)
+        return -1;
+    ahead_usable_ = false;
+    cache_start_ = pos_;
+    cache_valid_ = 0;
     return 0;
 }
 
+int CachedSource::flush_lines() {
+    lines_[cur_].valid = cache_valid_;
+    lines_[cur_].dirty = cache_dirty_;
+    int ret = 0;
+    for (std::uint8_t i = 0; i < lineCount_; i++) {
+        Line& l = lines_[i];
+        if (!l.dirty || !l.valid)
+            continue;
+        std::uint32_t written = 0;
+        if (store_(ctx_, l.start, buf_ + i * cache_size_, l.valid, written) != 0) {
+            ret = -1; // stays dirty for the next flush
+            continue;
+        }
+        l.dirty = false;
+        stats_.writebacks++;
+    }
+    cache_dirty_ = lines_[cur_].dirty;
+    return ret;
+}
+
+void CachedSource::use_line(std::uint8_t i) {
+    cur_ = i;
+    cache_ = buf_ + i * cache_size_;
+    cache_start_ = lines_[i].start;
+    cache_valid_ = lines_[i].valid;
+    cache_dirty_ = lines_[i].dirty;
+    lines_[i].used = ++tick_;
+}
+
+// The line holding pos_: another cached line of its set, else the set's
+// empty or least recently used line, written back and refilled
+int CachedSource::select_line() {
+    lines_[cur_].valid = cache_valid_;
+    lines_[cur_].dirty = cache_dirty_;
+
+    const std::uint32_t base = pos_ - pos_ % cache_size_;
+    const std::uint8_t first = (base / cache_size_) % (lineCount_ / ways_) * ways_;
+    std::uint8_t victim = first;
+    for (std::uint8_t i = first; i < first + ways_; i++) {
+        const Line& l = lines_[i];
+        if (l.valid && l.start == base) {
+            if (pos_ - base < l.valid) {
+                stats_.hits++;
+                use_line(i);
+                return 0;
+            }
+            // Only its first bytes are held (written into before any
+            // fetch, or fetched short): stored and fetched again
+            victim = i;
+            break;
+        }
+        if (!l.valid) {
+            if (lines_[victim].valid) victim = i;
+        } else if (lines_[victim].valid && (std::int32_t)(l.used - lines_[victim].used) < 0) {
+            victim = i;
+        }
+    }
+
+    stats_.misses++;
+    Line& v = lines_[victim];
+    std::uint8_t* data = buf_ + victim * cache_size_;
+    if (v.valid && v.dirty) {
+        std::uint32_t written = 0;
+        if (store_(ctx_, v.start, data, v.valid, written) != 0)
+            return -1;
+        stats_.writebacks++;
+    }
+    const std::uint32_t remain = storage_size_ - base;
+    std::uint32_t fetched = 0;
+    int ret = fetch_(ctx_, base, data, (cache_size_ < remain) ? cache_size_ : remain, fetched);
+    v.start = base;
+    v.valid = ret ? 0 : fetched;
+    v.dirty = false;
+    use_line(victim);
+    return ret ? -1 : 0;
+}
+
 int CachedSource::refill_cache() {
     if (storage_size_ == 0 || cache_size_ == 0) {
         cache_start_ = 0;
@@ -69,9 +365,30 @@ int CachedSource::refill_cache() {
         return 0;
     }
 
-    if (wrap_)
-        pos_ %= storage_size_;
-    flush();
+    step(0);
+    if (lines_)
+        return select_line();
+
+    // Read on past the window: the one after is worth fetching ahead
+    const bool sequential = ahead_ && cache_valid_ && pos_ == cache_start_ + cache_valid_;
+    settle_background();
+    if (ahead_state_ == AHEAD_READY) {
+        ahead_state_ = AHEAD_IDLE;
+        __dmb();
+        if (ahead_usable_ && pos_ >= ahead_start_ && pos_ < ahead_start_ + ahead_valid_) {
+            leave_window(false);
+            std::swap(cache_, ahead_);
+            buf_ = cache_;
+            cache_start_ = ahead_start_;
+            cache_valid_ = ahead_valid_;
+            cache_dirty_ = false;
+            stats_.prefetched++;
+            post_ahead();
+            return 0;
+        }
+    }
+    leave_window(true);
+    stats_.misses++;
 
     std::uint32_t remain = storage_size_ - pos_;
     std::uint32_t first_len = (cache_size_ < remain) ? cache_size_ : remain;
@@ -83,90 +400,150 @@ int CachedSource::refill_cache() {
     cache_start_ = pos_;
     cache_valid_ = fetched1;
 
-    if (wrap_ && fetched1 == remain && cache_valid_ < cache_size_) {
+    // The wrapped part stops short of pos_: a window never holds a byte
+    // twice, and never more than the storage (from 0, there is none)
+    if (wrap_ && pos_ && fetched1 == remain && cache_valid_ < cache_size_) {
         std::uint32_t left = cache_size_ - cache_valid_;
+        if (left > pos_) left = pos_;
         std::uint32_t fetched2 = 0;
         if (fetch_(ctx_, 0, cache_ + cache_valid_, left, fetched2) != 0)
             return -1;
         cache_valid_ += fetched2;
     }
 
+    if (sequential)
+        post_ahead();
     return 0;
 }
 
 int CachedSource::seek(std::uint32_t new_pos) {
     if (new_pos >= storage_size_) return -1;
+    span_held_ = false;
 
-    if (!(new_pos >= cache_start_ &&
-          new_pos < cache_start_ + cache_valid_)) {
-        flush();
+    // The single window is written back when left (a write may still
+    // extend it); lines stay cached
+    if (!lines_ && !writable(new_pos)) {
+        leave_window(false);
     }
 
     pos_ = new_pos;
     return 0;
 }
 
-int CachedSource::getByte(std::uint8_t &out) {
-    if (storage_size_ == 0 || cache_size_ == 0) return -1;
-
-    if (wrap_)
-        pos_ %= storage_size_;
-    else if (pos_ >= storage_size_)
-        return -1;
-
-    if (!(pos_ >= cache_start_ &&
-          pos_ < cache_start_ + cache_valid_)) {
-        if (refill_cache() != 0) return -1;
-        if (cache_valid_ == 0) return -1;
-    }
-
-    std::uint32_t offset = pos_ - cache_start_;
-    out = cache_[offset];
-
-    if (auto_increment_) {
-        if (wrap_) {
-            pos_ = (pos_ + 1) % storage_size_;
+std::uint8_t* CachedSource::acquireSpan(std::uint32_t pos, std::uint32_t len, bool for_write,
+                                        std::uint32_t& avail) {
+    avail = 0;
+    span_held_ = false;
+    if (storage_size_ == 0 || cache_size_ == 0 || !len || seek(pos) != 0)
+        return nullptr;
+
+    std::uint32_t end;
+    if (for_write) {
+        if (writable(pos_)) {
+            stats_.hits++;
         } else {
-            pos_++;
+            if ((lines_ ? refill_cache() : claim_window()) != 0) return nullptr;
+        }
+        end = capacity();
+        std::uint32_t offset = pos_ - cache_start_;
+        if (offset >= end) return nullptr;
+        // Same gap rule as setByte()
+        if (offset > cache_valid_) {
+            std::memset(cache_ + cache_valid_, 0, offset - cache_valid_);
+            cache_valid_ = offset;
         }
+    } else {
+        if (cached(pos_)) {
+            stats_.hits++;
+        } else {
+            if (refill_cache() != 0) return nullptr;
+            if (!cached(pos_)) return nullptr;
+        }
+        end = cache_valid_;
     }
 
-    return 0;
+    // A wrapped window continues at 0: the span stops at the storage end
+    span_off_ = pos_ - cache_start_;
+    avail = end - span_off_;
+    if (avail > storage_size_ - pos_) avail = storage_size_ - pos_;
+    if (avail > len) avail = len;
+    span_held_ = true;
+    span_writable_ = for_write;
+    return cache_ + span_off_;
 }
 
-int CachedSource::setByte(std::uint8_t in) {
-    if (storage_size_ == 0 || cache_size_ == 0) return -1;
-
-    if (wrap_)
-        pos_ %= storage_size_;
-    else if (pos_ >= storage_size_)
-        return -1;
-
-    // Writing past cache_valid_ would leave a gap of never-fetched bytes
-    // that flush() would push to storage; only write contiguously with the
-    // valid region, otherwise refill at the new position first.
-    if (!(pos_ >= cache_start_ &&
-          pos_ <= cache_start_ + cache_valid_ &&
-          pos_ < cache_start_ + cache_size_)) {
-        if (refill_cache() != 0) return -1;
+void CachedSource::releaseSpan(std::uint32_t used) {
+    if (!span_held_)
+        return;
+    span_held_ = false;
+    if (span_writable_ && used) {
+        mark_dirty(span_off_, used);
+        if (span_off_ + used > cache_valid_)
+            cache_valid_ = span_off_ + used;
     }
+    if (auto_increment_)
+        step(used);
+}
 
-    std::uint32_t offset = pos_ - cache_start_;
-    if (offset >= cache_size_) return -1;
+int CachedSource::getByte(std::uint8_t &out) {
+    if (wrap_)
+        return auto_increment_ ? get_byte<true, true>(out) : get_byte<true, false>(out);
+    return auto_increment_ ? get_byte<false, true>(out) : get_byte<false, false>(out);
+}
 
-    cache_[offset] = in;
-    cache_dirty_ = true;
-    if (offset + 1 > cache_valid_)
-        cache_valid_ = offset + 1;
+int CachedSource::setByte(std::uint8_t in) {
+    if (wrap_)
+        return auto_increment_ ? set_byte<true, true>(in) : set_byte<true, false>(in);
+    return auto_increment_ ? set_byte<false, true>(in) : set_byte<false, false>(in);
+}
 
-    if (auto_increment_) {
-        if (wrap_) {
-            pos_ = (pos_ + 1) % storage_size_;
-        } else {
-            pos_++;
+// The cached bytes of [start, start + valid), which may wrap past the
+// storage end, that fall in [pos_, pos_ + len): copied over data after a
+// fetch, or from data after a store
+void CachedSource::overlay(std::uint32_t start, std::uint8_t* cached, std::uint32_t valid,
+                           std::uint8_t* data, std::uint32_t len, bool store) {
+    while (valid) {
+        const std::uint32_t part = (start + valid > storage_size_) ? storage_size_ - start : valid;
+        const std::uint32_t lo = std::max(start, pos_);
+        const std::uint32_t hi = std::min(start + part, pos_ + len);
+        if (lo < hi) {
+            if (store)
+                std::memcpy(cached + (lo - start), data + (lo - pos_), hi - lo);
+            else
+                std::memcpy(data + (lo - pos_), cached + (lo - start), hi - lo);
         }
+        cached += part;
+        valid -= part;
+        start = 0;
     }
+}
 
+// get()/set() past a window, at pos_ and short of the storage end
+int CachedSource::transfer_direct(std::uint8_t* data, std::uint32_t len, bool store,
+                                  std::uint32_t& done) {
+    done = 0;
+    settle_background();
+    if (wb_head_ != wb_tail_) {
+        wb_posted_ = wb_head_;
+        drain_behind();
+    }
+    const int ret = store ? store_(ctx_, pos_, data, len, done)
+                          : fetch_(ctx_, pos_, data, len, done);
+    if (ret != 0)
+        return -1;
+    if (store) {
+        stats_.writebacks++;
+        ahead_usable_ = false;
+    } else {
+        stats_.misses++;
+    }
+    if (!lines_) {
+        overlay(cache_start_, cache_, cache_valid_, data, done, store);
+        return 0;
+    }
+    lines_[cur_].valid = cache_valid_;
+    for (std::uint8_t i = 0; i < lineCount_; i++)
+        overlay(lines_[i].start, buf_ + i * cache_size_, lines_[i].valid, data, done, store);
     return 0;
 }
 
@@ -174,16 +551,25 @@ int CachedSource::get(std::uint8_t *out, std::uint32_t size, std::uint32_t &read
     read = 0;
     if (storage_size_ == 0 || cache_size_ == 0) return -1;
 
+    step(0);
+    if (size > cache_size_ && pos_ < storage_size_ && size <= storage_size_ - pos_) {
+        if (transfer_direct(out, size, false, read) != 0)
+            read = 0;
+        else if (auto_increment_)
+            step(read);
+        return 0;
+    }
+
     while (size > 0) {
-        if (wrap_)
-            pos_ %= storage_size_;
-        else if (pos_ >= storage_size_)
+        step(0);
+        if (!wrap_ && pos_ >= storage_size_)
             break;
 
-        if (!(pos_ >= cache_start_ &&
-              pos_ < cache_start_ + cache_valid_)) {
+        if (cached(pos_)) {
+            stats_.hits++;
+        } else {
             if (refill_cache() != 0) break;
-            if (cache_valid_ == 0) break;
+            if (!cached(pos_)) break;
         }
 
         std::uint32_t offset = pos_ - cache_start_;
@@ -192,12 +578,8 @@ int CachedSource::get(std::uint8_t *out, std::uint32_t size, std::uint32_t &read
 
         std::memcpy(out, cache_ + offset, tocopy);
 
-        if (auto_increment_) {
-            if (wrap_)
-                pos_ = (pos_ + tocopy) % storage_size_;
-            else
-                pos_ += tocopy;
-        }
+        if (auto_increment_)
+            step(tocopy);
 
         out += tocopy;
         size -= tocopy;
@@ -210,34 +592,42 @@ int CachedSource::set(const std::uint8_t *in, std::uint32_t size, std::uint32_t
     written = 0;
     if (storage_size_ == 0 || cache_size_ == 0) return -1;
 
+    step(0);
+    if (size > cache_size_ && pos_ < storage_size_ && size <= storage_size_ - pos_) {
+        if (transfer_direct(const_cast<std::uint8_t*>(in), size, true, written) != 0)
+            return -1;
+        if (auto_increment_)
+            step(written);
+        return 0;
+    }
+
     while (size > 0) {
-        if (wrap_)
-            pos_ %= storage_size_;
-        else if (pos_ >= storage_size_)
+        step(0);
+        if (!wrap_ && pos_ >= storage_size_)
             break;
 
         // Same gap rule as setByte(): stay contiguous with the valid bytes
-        if (!(pos_ >= cache_start_ &&
-              pos_ <= cache_start_ + cache_valid_ &&
-              pos_ < cache_start_ + cache_size_)) {
-            if (refill_cache() != 0) return -1;
+        if (writable(pos_)) {
+            stats_.hits++;
+        } else {
+            if ((lines_ ? refill_cache() : claim_window()) != 0) return -1;
         }
 
         std::uint32_t offset = pos_ - cache_start_;
-        std::uint32_t avail = cache_size_ - offset;
+        std::uint32_t cap = capacity();
+        if (offset >= cap) return -1;
+        if (offset > cache_valid_)
+            std::memset(cache_ + cache_valid_, 0, offset - cache_valid_);
+        std::uint32_t avail = cap - offset;
         std::uint32_t tocopy = (size < avail) ? size : avail;
 
         std::memcpy(cache_ + offset, in, tocopy);
-        cache_dirty_ = true;
+        mark_dirty(offset, tocopy);
         if (offset + tocopy > cache_valid_)
             cache_valid_ = offset + tocopy;
 
-        if (auto_increment_) {
-            if (wrap_)
-                pos_ = (pos_ + tocopy) % storage_size_;
-            else
-                pos_ += tocopy;
-        }
+        if (auto_increment_)
+            step(tocopy);
 
         in += tocopy;
         size -= tocopy;
@@ -247,19 +637,5 @@ int CachedSource::set(const std::uint8_t *in, std::uint32_t size, std::uint32_t
 }
 
 int CachedSource::next() {
-    if (storage_size_ == 0) return -1;
-
-    if (wrap_)
-        pos_ = (pos_ + 1) % storage_size_;
-    else {
-        if (pos_ + 1 >= storage_size_) return -1;
-        pos_++;
-    }
-
-    if (!(pos_ >= cache_start_ &&
-          pos_ < cache_start_ + cache_valid_)) {
-        if (refill_cache() != 0) return -1;
-        if (cache_valid_ == 0) return -1;
-    }
-    return 0;
+    return wrap_ ? next_byte<true>() : next_byte<false>();
 }
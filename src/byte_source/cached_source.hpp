@@ -3,10 +3,51 @@
 #include <vector>
 #include <memory>
 #include <array>
+#include <cstring>
 #include "ff.h"
 #include "common.hpp"
 #include "byte_source.hpp"
 
+// Up to this many lines per source (setCacheLines)
+constexpr std::uint8_t CACHED_SOURCE_MAX_LINES = 16;
+// Windows write-behind may hold before it waits for (or does) a store
+constexpr std::uint8_t CACHED_SOURCE_WB_SLOTS = 2;
+
+// A window of cache_size bytes over fetch/store callbacks. By default one
+// window, refilled at the position that missed (and written back first).
+//
+// setCacheLines() splits the cache into lines of cache_size bytes each,
+// aligned to their size, with LRU replacement inside each set and a dirty
+// bit per line: alternating between a few regions (a DSK track table and
+// its sector data, ramdisk pages) then hits instead of refetching. Dirty
+// lines are written back on eviction and on flush(), not on seek().
+// cache_/cache_start_/cache_valid_/cache_dirty_ always describe the most
+// recently used line, so a hit costs the same in both modes.
+//
+// The single window tracks the range writes dirtied and stores only that.
+// A write outside it starts an empty window at the written position
+// instead of fetching one: a window the Z80 only writes is never read.
+//
+// setReadAhead() gives the single window a second buffer: when a read runs
+// off the end of the window into the next one, the window after that is
+// fetched elsewhere (runBackground(), core 0) while this one is read, and
+// the next boundary swaps buffers instead of fetching. The prefetched data
+// never overlaps the window, which alone takes writes; a write miss drops
+// it, since the new window may be where it was fetched from.
+//
+// setWriteBehind() hands a dirty window that is left to a pool of
+// CACHED_SOURCE_WB_SLOTS buffers instead of storing it there and then: the
+// window's buffer is swapped for a free one, and the stores run in order
+// in runBackground() (BACKGROUND) or once the pool is full or on flush()
+// (LAZY). flush() stores everything handed off before the window itself.
+// Storage is only touched once everything queued has run
+// (settle_background()).
+//
+// A get() or set() of more than a window that stays short of the storage
+// end is one fetch or store (a floppy track read whole is one FatFS read
+// rather than one per window). Windows handed off are stored first; the
+// cached bytes it overlaps are copied over what it fetched, or updated
+// from what it stored.
 class CachedSource : public ByteSource {
 public:
     typedef int (*FetchFunc)(void* ctx, std::uint32_t index, std::uint8_t* buf,
@@ -37,24 +78,184 @@ public:
     // Drop the cached window (flushing first); next access refetches
     int invalidate() {
         int r = flush();
-        cache_start_ = 0;
-        cache_valid_ = 0;
-        cache_dirty_ = false;
+        discard();
         return r;
     }
+    // A span into the current window (line): refilled, or claimed for a
+    // write, as getByte()/setByte() would for the first byte
+    std::uint8_t* acquireSpan(std::uint32_t pos, std::uint32_t len, bool writable,
+                              std::uint32_t& avail) override;
+    void releaseSpan(std::uint32_t used) override;
+    int setCacheLines(std::uint8_t lines, std::uint8_t ways) override;
+    int setReadAhead(const BackgroundIo* io) override;
+    // Queued write-behind stores, then the queued read-ahead fill; runs
+    // where BackgroundIo::post sent it
+    int runBackground();
+    bool cacheStats(CacheStats& out) const override {
+        out = stats_;
+        return true;
+    }
 
 protected:
     void* ctx_;
     FetchFunc fetch_;
     StoreFunc store_;
-    std::uint8_t* cache_;
-    std::uint32_t cache_size_;
+    std::uint8_t* cache_;           // the current line
+    std::uint32_t cache_size_;      // window, or line, size
     std::uint32_t cache_start_;
     std::uint32_t cache_valid_;
     bool cache_dirty_;
     std::uint32_t storage_size_;
     bool wrap_;
     bool auto_increment_;
+    CacheStats stats_;
 
     int refill_cache();
+    int claim_window();
+    // pos_ + n, wrapped by comparison rather than modulo (the M0+ has no
+    // divide instruction): n is never more than the storage size
+    template<bool WRAP>
+    inline void step(std::uint32_t n) {
+        pos_ += n;
+        if (WRAP && pos_ >= storage_size_)
+            pos_ -= storage_size_;
+    }
+    inline void step(std::uint32_t n) {
+        if (wrap_) step<true>(n);
+        else step<false>(n);
+    }
+    // getByte()/setByte()/next() for a wrap and auto-increment policy
+    // fixed at compile time; the virtuals pick one from wrap_ and
+    // auto_increment_, FileSourceImpl (file_source.hpp) is built on one
+    template<bool WRAP, bool AUTO_INCREMENT>
+    inline int get_byte(std::uint8_t &out) {
+        step<WRAP>(0); // a resize() may have left pos_ at the end
+        if (WRAP ? !storage_size_ : pos_ >= storage_size_) return -1;
+        if (cached(pos_)) {
+            stats_.hits++;
+        } else if (refill_cache() != 0 || !cached(pos_)) {
+            return -1;
+        }
+        out = cache_[pos_ - cache_start_];
+        if (AUTO_INCREMENT) step<WRAP>(1);
+        return 0;
+    }
+    template<bool WRAP, bool AUTO_INCREMENT>
+    inline int set_byte(std::uint8_t in) {
+        step<WRAP>(0);
+        if (WRAP ? !storage_size_ : pos_ >= storage_size_) return -1;
+        // Writing past cache_valid_ would leave a gap of never-fetched
+        // bytes that flush() would push to storage; only write
+        // contiguously with the valid region, otherwise start a window
+        // (refill a line) at the new position first.
+        if (writable(pos_)) {
+            stats_.hits++;
+        } else if ((lines_ ? refill_cache() : claim_window()) != 0) {
+            return -1;
+        }
+        const std::uint32_t offset = pos_ - cache_start_;
+        if (offset >= capacity()) return -1;
+        // An aligned line the fetch came up short on: the gap reads as zeros
+        if (offset > cache_valid_)
+            std::memset(cache_ + cache_valid_, 0, offset - cache_valid_);
+        cache_[offset] = in;
+        mark_dirty(offset, 1);
+        if (offset + 1 > cache_valid_)
+            cache_valid_ = offset + 1;
+        if (AUTO_INCREMENT) step<WRAP>(1);
+        return 0;
+    }
+    template<bool WRAP>
+    inline int next_byte() {
+        if (WRAP ? !storage_size_ : pos_ + 1 >= storage_size_) return -1;
+        step<WRAP>(1);
+        if (!cached(pos_) && (refill_cache() != 0 || !cached(pos_))) return -1;
+        return 0;
+    }
+    // Forget every cached byte, dirty or not
+    void discard();
+    // For file images (FileSource::setWriteBehind)
+    int enable_write_behind(const BackgroundIo* io, WriteBehind mode);
+    // Wait out queued background jobs: before any storage access
+    inline void settle_background() {
+        if (ahead_state_ == AHEAD_QUEUED || wb_tail_ != wb_posted_)
+            wait_background();
+    }
+
+private:
+    struct Line {
+        std::uint32_t start;
+        std::uint32_t valid;        // 0: empty
+        std::uint32_t used;         // LRU stamp
+        bool dirty;
+    };
+    std::uint8_t* buf_;             // all lines
+    Line* lines_ = nullptr;         // nullptr: single window
+    std::uint8_t lineCount_ = 1;
+    std::uint8_t ways_ = 1;
+    std::uint8_t cur_ = 0;
+    std::uint32_t tick_ = 0;
+
+    std::uint32_t dirty_lo_ = 0;    // single window: dirty bytes, if cache_dirty_
+    std::uint32_t dirty_hi_ = 0;
+
+    std::uint32_t span_off_ = 0;    // the acquired span, within cache_
+    bool span_held_ = false;
+    bool span_writable_ = false;
+
+    const BackgroundIo* io_ = nullptr;
+
+    enum : std::uint8_t { AHEAD_IDLE, AHEAD_QUEUED, AHEAD_READY };
+    std::uint8_t* ahead_ = nullptr;         // the buffer being filled; nullptr: off
+    std::uint32_t ahead_start_ = 0;
+    std::uint32_t ahead_len_ = 0;
+    std::uint32_t ahead_valid_ = 0;         // set by runBackground()
+    bool ahead_usable_ = false;             // no write miss since it was queued
+    volatile std::uint8_t ahead_state_ = AHEAD_IDLE;
+
+    // A window handed off: bytes [lo, hi) of buf go to start + lo
+    struct Pending {
+        std::uint8_t* buf;
+        std::uint32_t start;
+        std::uint32_t lo;
+        std::uint32_t hi;
+    };
+    WriteBehind wb_mode_ = WriteBehind::IMMEDIATE;
+    Pending wb_[CACHED_SOURCE_WB_SLOTS] = {};
+    std::uint32_t wb_head_ = 0;             // handed off
+    volatile std::uint32_t wb_posted_ = 0;  // up to here, runBackground() stores
+    volatile std::uint32_t wb_tail_ = 0;    // stored
+    volatile bool wb_failed_ = false;       // reported by the next flush()
+
+    inline bool cached(std::uint32_t pos) const {
+        return pos >= cache_start_ && pos < cache_start_ + cache_valid_;
+    }
+    // A write at pos stays contiguous with the valid bytes
+    inline bool writable(std::uint32_t pos) const {
+        return pos >= cache_start_ && pos <= cache_start_ + cache_valid_ &&
+               pos < cache_start_ + capacity();
+    }
+    // Bytes the current line can hold: a line, or a window without wrap,
+    // stops at the storage end, and a wrapping window holds no byte twice
+    inline std::uint32_t capacity() const {
+        std::uint32_t left = (lines_ || !wrap_) ? storage_size_ - cache_start_ : storage_size_;
+        return left < cache_size_ ? left : cache_size_;
+    }
+    inline void mark_dirty(std::uint32_t offset, std::uint32_t len) {
+        if (!cache_dirty_ || offset < dirty_lo_) dirty_lo_ = offset;
+        if (!cache_dirty_ || offset + len > dirty_hi_) dirty_hi_ = offset + len;
+        cache_dirty_ = true;
+    }
+    int flush_lines();
+    int transfer_direct(std::uint8_t* data, std::uint32_t len, bool store, std::uint32_t& done);
+    void overlay(std::uint32_t start, std::uint8_t* cached, std::uint32_t valid,
+                 std::uint8_t* data, std::uint32_t len, bool store);
+    int store_range(std::uint32_t start, const std::uint8_t* data, std::uint32_t len);
+    int leave_window(bool fetching);
+    void hand_off();
+    void drain_behind();
+    void wait_background();
+    void post_ahead();
+    int select_line();
+    void use_line(std::uint8_t i);
 };
@@ -0,0 +1,497 @@
+#include "compressed_source.hpp"
+#include "lz_block.hpp"
+#include "pico/time.h"
+#include <cstring>
+#include <string>
+
+namespace {
+    inline bool overlay_magic(const std::uint8_t* p) {
+        return p[0] == 'M' && p[1] == 'Z' && p[2] == 'O' && p[3] == '1';
+    }
+
+    FRESULT read_at(FIL& f, std::uint32_t at, std::uint8_t* buf, std::uint32_t len) {
+        UINT br = 0;
+        FRESULT fr = f_lseek(&f, at);
+        if (fr == FR_OK)
+            fr = f_read(&f, buf, len, &br);
+        return (fr == FR_OK && br != len) ? FR_INT_ERR : fr;
+    }
+
+    FRESULT write_at(FIL& f, std::uint32_t at, const std::uint8_t* buf, std::uint32_t len) {
+        UINT bw = 0;
+        FRESULT fr = f_lseek(&f, at);
+        if (fr == FR_OK)
+            fr = f_write(&f, buf, len, &bw);
+        return (fr == FR_OK && bw != len) ? FR_DENIED : fr; // medium full
+    }
+
+    // Zeros up to `to`, from the current end of a file opened for writing
+    FRESULT write_zeros(FIL& f, std::uint32_t to) {
+        static const std::uint8_t zeros[64] = {};
+        FRESULT fr = f_lseek(&f, f_size(&f));
+        for (std::uint32_t at = f_size(&f); fr == FR_OK && at < to; ) {
+            const std::uint32_t n = (to - at < sizeof(zeros)) ? to - at : sizeof(zeros);
+            fr = write_at(f, at, zeros, n);
+            at += n;
+        }
+        return fr;
+    }
+
+    bool is_container(const char* path) {
+        FIL f;
+        if (f_open(&f, path, FA_READ) != FR_OK)
+            return false;
+        std::uint8_t magic[4];
+        UINT br = 0;
+        const bool ok = f_read(&f, magic, sizeof(magic), &br) == FR_OK && br == sizeof(magic) &&
+                        compressed_magic(magic);
+        f_close(&f);
+        return ok;
+    }
+}
+
+CompressedSource::CompressedSource(const std::string& path,
+                                   std::uint32_t cache_size,
+                                   bool wrap,
+                                   bool auto_increment)
+    : CachedSource(this, &CompressedSource::fetch, &CompressedSource::store, 0, cache_size, wrap, auto_increment),
+      path_(path)
+{
+    FILINFO fno;
+    if (f_stat(path_.c_str(), &fno) != FR_OK)
+        return;
+    read_only_ = (fno.fattrib & AM_RDO) != 0;
+    if (open_container() != 0)
+        return;
+    slots_ = new (std::nothrow) std::uint16_t[count_]();
+    block_ = new (std::nothrow) std::uint8_t[(1u << shift_) + lz_inplace_margin(1u << shift_)];
+    if (!slots_ || !block_ || open_overlay() != 0) {
+        f_close(&file_);
+        return;
+    }
+    valid_ = true;
+}
+
+CompressedSource::~CompressedSource() {
+    if (pack_io_)
+        pack_io_->idle(pack_io_->ctx, nullptr, this);
+    settle_background();
+    flush();
+    if (packing_)
+        pack_abandon();
+    if (valid_)
+        close_files();
+    delete[] index_;
+    delete[] slots_;
+    delete[] block_;
+}
+
+// Header and index, checked: the blocks must tile the image and their data
+// the file
+int CompressedSource::open_container() {
+    if (f_open(&file_, path_.c_str(), FA_READ) != FR_OK)
+        return -1;
+    std::uint8_t h[COMPRESSED_HEADER_SIZE];
+    if (read_at(file_, 0, h, sizeof(h)) != FR_OK || !compressed_magic(h) ||
+        h[8] < COMPRESSED_MIN_SHIFT || h[8] > COMPRESSED_MAX_SHIFT || h[9] != COMPRESSED_CODEC_LZ) {
+        f_close(&file_);
+        return -1;
+    }
+    const std::uint32_t size = read_u32_le(h + 4);
+    const std::uint32_t count = read_u32_le(h + 12);
+    shift_ = h[8];
+    if (!size || count > COMPRESSED_MAX_BLOCKS || count != ((size - 1) >> shift_) + 1) {
+        f_close(&file_);
+        return -1;
+    }
+    delete[] index_;
+    index_ = new (std::nothrow) std::uint32_t[count + 1];
+    if (!index_ || read_at(file_, sizeof(h), reinterpret_cast<std::uint8_t*>(index_),
+                           (count + 1) * sizeof(*index_)) != FR_OK) {
+        f_close(&file_);
+        return -1;
+    }
+    storage_size_ = size;
+    count_ = count;
+    bool ok = read_u32_le(reinterpret_cast<std::uint8_t*>(index_)) ==
+              COMPRESSED_HEADER_SIZE + (count + 1) * sizeof(*index_);
+    for (std::uint32_t b = 0; b <= count; b++) {
+        index_[b] = read_u32_le(reinterpret_cast<std::uint8_t*>(index_ + b));
+        if (b && (index_[b] < index_[b - 1] || index_[b] - index_[b - 1] > block_len(b - 1)))
+            ok = false;
+    }
+    if (!ok || index_[count] > f_size(&file_)) {
+        f_close(&file_);
+        return -1;
+    }
+    held_ = UINT32_MAX;
+    return 0;
+}
+
+// An overlay left by an earlier mount. One written over another container
+// than this one (its data end is in the header) no longer applies: the
+// image was replaced, or recompressed just before a power cut.
+int CompressedSource::open_overlay() {
+    const std::string ovl = path_ + ".ovl";
+    FRESULT fr = f_open(&overlay_, ovl.c_str(), read_only_ ? FA_READ : FA_READ | FA_WRITE);
+    if (fr == FR_NO_FILE)
+        return 0;
+    if (fr != FR_OK)
+        return -1;
+    std::uint8_t h[COMPRESSED_OVERLAY_HEADER];
+    slot_base_ = (COMPRESSED_OVERLAY_HEADER + count_ * 2 + 511) & ~511u;
+    const bool ours = read_at(overlay_, 0, h, sizeof(h)) == FR_OK && overlay_magic(h) &&
+                      read_u32_le(h + 4) == count_ && read_u32_le(h + 8) == (1u << shift_) &&
+                      read_u32_le(h + 12) == index_[count_];
+    if (!ours || read_at(overlay_, sizeof(h), reinterpret_cast<std::uint8_t*>(slots_), count_ * 2) != FR_OK) {
+        f_close(&overlay_);
+        return (read_only_ || f_unlink(ovl.c_str()) == FR_OK) ? 0 : -1;
+    }
+    overlay_open_ = true;
+    slots_used_ = 0;
+    for (std::uint32_t b = 0; b < count_; b++) {
+        slots_[b] = read_u16_le(reinterpret_cast<std::uint8_t*>(slots_ + b));
+        if (slots_[b] > slots_used_)
+            slots_used_ = slots_[b];
+    }
+    if (slots_used_ > count_ || f_size(&overlay_) < slot_base_ + (slots_used_ << shift_)) {
+        f_close(&overlay_);
+        overlay_open_ = false;
+        return -1;
+    }
+    return 0;
+}
+
+void CompressedSource::close_files() {
+    f_close(&file_);
+    if (overlay_open_)
+        f_close(&overlay_);
+    overlay_open_ = false;
+}
+
+int CompressedSource::flush() {
+    int ret = CachedSource::flush();
+    settle_background();
+    if (overlay_open_ && f_sync(&overlay_) != FR_OK)
+        ret = -1;
+    return ret;
+}
+
+int CompressedSource::hold(std::uint32_t block) {
+    if (held_ == block)
+        return 0;
+    held_ = UINT32_MAX;
+    const std::uint32_t len = block_len(block);
+    const std::uint32_t packed = index_[block + 1] - index_[block];
+    if (slots_[block]) {
+        const std::uint32_t at = slot_base_ + ((slots_[block] - 1u) << shift_);
+        if (read_at(overlay_, at, block_, len) != FR_OK)
+            return -1;
+    } else if (!packed) {
+        std::memset(block_, 0, len);
+    } else if (packed == len) {
+        if (read_at(file_, index_[block], block_, len) != FR_OK)
+            return -1;
+    } else {
+        // The compressed bytes end where the buffer does; decoding fills
+        // it from the front
+        std::uint8_t* src = block_ + (1u << shift_) + lz_inplace_margin(1u << shift_) - packed;
+        if (read_at(file_, index_[block], src, packed) != FR_OK ||
+            lz_decompress(src, packed, block_, len) != 0)
+            return -1;
+    }
+    held_ = block;
+    return 0;
+}
+
+// A block's first store writes all of it to a new slot, then maps it: a
+// power cut in between leaves the slot unused
+int CompressedSource::write_slot(std::uint32_t block, std::uint32_t from, std::uint32_t len) {
+    if (slots_[block])
+        return write_at(overlay_, slot_base_ + ((slots_[block] - 1u) << shift_) + from,
+                        block_ + from, len) == FR_OK ? 0 : -1;
+    if (!overlay_open_) {
+        const std::string ovl = path_ + ".ovl";
+        if (f_open(&overlay_, ovl.c_str(), FA_CREATE_ALWAYS | FA_READ | FA_WRITE) != FR_OK)
+            return -1;
+        overlay_open_ = true;
+        std::uint8_t h[COMPRESSED_OVERLAY_HEADER] = { 'M', 'Z', 'O', '1' };
+        write_u32_le(h + 4, count_);
+        write_u32_le(h + 8, 1u << shift_);
+        write_u32_le(h + 12, index_[count_]);
+        slot_base_ = (COMPRESSED_OVERLAY_HEADER + count_ * 2 + 511) & ~511u;
+        slots_used_ = 0;
+        if (write_at(overlay_, 0, h, sizeof(h)) != FR_OK || write_zeros(overlay_, slot_base_) != FR_OK)
+            return -1;
+    }
+    const std::uint16_t slot = static_cast<std::uint16_t>(slots_used_ + 1);
+    std::uint8_t entry[2];
+    write_u16_le(entry, slot);
+    if (write_at(overlay_, slot_base_ + (slots_used_ << shift_), block_, block_len(block)) != FR_OK ||
+        write_at(overlay_, COMPRESSED_OVERLAY_HEADER + block * 2, entry, sizeof(entry)) != FR_OK)
+        return -1;
+    slots_[block] = slot;
+    slots_used_ = slot;
+    return 0;
+}
+
+int CompressedSource::fetch(void* ctx, std::uint32_t index, std::uint8_t* buf,
+                            std::uint32_t size, std::uint32_t& read)
+{
+    auto* self = static_cast<CompressedSource*>(ctx);
+    read = 0;
+    const std::uint32_t total = self->storage_size_;
+    if (self->wrap_)
+        index %= total;
+    else if (index >= total)
+        return 0;
+    if (size > (self->wrap_ ? total : total - index))
+        size = self->wrap_ ? total : total - index;
+
+    while (read < size) {
+        if (index == total)
+            index = 0;
+        const std::uint32_t block = index >> self->shift_;
+        const std::uint32_t off = index - (block << self->shift_);
+        std::uint32_t n = self->block_len(block) - off;
+        if (n > size - read)
+            n = size - read;
+        const std::uint32_t packed = self->index_[block + 1] - self->index_[block];
+        FRESULT fr = FR_OK;
+        // Only an LZ block needs decoding whole
+        if (self->held_ == block) {
+            std::memcpy(buf + read, self->block_ + off, n);
+        } else if (self->slots_[block]) {
+            fr = read_at(self->overlay_, self->slot_base_ + ((self->slots_[block] - 1u) << self->shift_) + off,
+                         buf + read, n);
+        } else if (!packed) {
+            std::memset(buf + read, 0, n);
+        } else if (packed == self->block_len(block)) {
+            fr = read_at(self->file_, self->index_[block] + off, buf + read, n);
+        } else if (self->hold(block) == 0) {
+            std::memcpy(buf + read, self->block_ + off, n);
+        } else {
+            fr = FR_INT_ERR;
+        }
+        if (fr != FR_OK)
+            return -1;
+        read += n;
+        index += n;
+    }
+    return 0;
+}
+
+int CompressedSource::store(void* ctx, std::uint32_t index, const std::uint8_t* buf,
+                            std::uint32_t size, std::uint32_t& written)
+{
+    auto* self = static_cast<CompressedSource*>(ctx);
+    written = 0;
+    const std::uint32_t total = self->storage_size_;
+    if (self->read_only_)
+        return -1;
+    if (self->wrap_)
+        index %= total;
+    else if (index >= total)
+        return 0;
+    if (size > (self->wrap_ ? total : total - index))
+        size = self->wrap_ ? total : total - index;
+
+    self->stored_ = true;
+    while (written < size) {
+        if (index == total)
+            index = 0;
+        const std::uint32_t block = index >> self->shift_;
+        const std::uint32_t off = index - (block << self->shift_);
+        std::uint32_t n = self->block_len(block) - off;
+        if (n > size - written)
+            n = size - written;
+        if (!self->slots_[block] && self->hold(block) != 0)
+            return -1;
+        if (self->held_ == block) {
+            std::memcpy(self->block_ + off, buf + written, n);
+        } else if (write_at(self->overlay_, self->slot_base_ + ((self->slots_[block] - 1u) << self->shift_) + off,
+                            buf + written, n) != FR_OK) {
+            return -1;
+        }
+        if (self->held_ == block && self->write_slot(block, off, n) != 0) {
+            self->held_ = UINT32_MAX; // holds bytes the overlay does not
+            return -1;
+        }
+        written += n;
+        index += n;
+    }
+    self->last_store_ = time_us_32();
+    return 0;
+}
+
+int CompressedSource::recompressInBackground(const BackgroundIo* io) {
+    if (!valid_ || read_only_ || pack_io_ || !io || !io->idle)
+        return -1;
+    if (!io->idle(io->ctx, &CompressedSource::pack_round, this))
+        return -1;
+    pack_io_ = io;
+    return 0;
+}
+
+// Idle work, for as long as the image is mounted: a round with nothing to
+// fold in, or writes too recent, only looks. A failure stops it - the
+// overlay stays, and is read from as before.
+bool CompressedSource::pack_round(void* arg) {
+    auto* self = static_cast<CompressedSource*>(arg);
+    if (self->packing_ && self->stored_)
+        self->pack_abandon();
+    if (!self->packing_) {
+        if (!self->slots_used_ || time_us_32() - self->last_store_ < COMPRESSED_SOURCE_QUIET_US)
+            return true;
+        return self->pack_start();
+    }
+    if (self->pack_next_ < self->count_) {
+        if (self->pack_block(self->pack_next_))
+            self->pack_next_++;
+        else
+            self->pack_abandon();
+        return self->packing_;
+    }
+    return self->pack_finish();
+}
+
+// The new container's header stays zeros until it is complete
+bool CompressedSource::pack_start() {
+    const std::uint32_t block = 1u << shift_;
+    pack_index_ = new (std::nothrow) std::uint32_t[count_ + 1];
+    pack_out_ = new (std::nothrow) std::uint8_t[block];
+    pack_table_ = new (std::nothrow) std::uint16_t[LZ_HASH_ENTRIES];
+    packing_ = true;
+    stored_ = false;
+    pack_next_ = 0;
+    if (!pack_index_ || !pack_out_ || !pack_table_ ||
+        f_open(&tmp_, (path_ + ".tmp").c_str(), FA_CREATE_ALWAYS | FA_WRITE) != FR_OK) {
+        pack_abandon();
+        return false;
+    }
+    tmp_open_ = true;
+    pack_index_[0] = COMPRESSED_HEADER_SIZE + (count_ + 1) * sizeof(*pack_index_);
+    if (write_zeros(tmp_, pack_index_[0]) != FR_OK) {
+        pack_abandon();
+        return false;
+    }
+    return true;
+}
+
+// A block not in the overlay is copied as it is; one that is, compressed
+// (stored as is if that does not make it smaller)
+bool CompressedSource::pack_block(std::uint32_t block) {
+    const std::uint32_t len = block_len(block);
+    const std::uint8_t* data = pack_out_;
+    std::uint32_t packed = index_[block + 1] - index_[block];
+    if (!slots_[block]) {
+        if (packed && read_at(file_, index_[block], pack_out_, packed) != FR_OK)
+            return false;
+    } else {
+        if (hold(block) != 0)
+            return false;
+        std::uint32_t nz = 0;
+        while (nz < len && !block_[nz])
+            nz++;
+        packed = (nz == len) ? 0 : lz_compress(block_, len, pack_out_, len - 1, pack_table_);
+        if (nz < len && !packed) {
+            data = block_;
+            packed = len;
+        }
+    }
+    if (packed && write_at(tmp_, pack_index_[block], data, packed) != FR_OK)
+        return false;
+    pack_index_[block + 1] = pack_index_[block] + packed;
+    return true;
+}
+
+// Index, header (magic last), then the swap: a power cut before the
+// rename finds <image>.tmp complete (from_compressed() renames it), one
+// after it an overlay that no longer matches
+bool CompressedSource::pack_finish() {
+    std::uint8_t chunk[64];
+    FRESULT fr = FR_OK;
+    for (std::uint32_t b = 0; fr == FR_OK && b <= count_; ) {
+        std::uint32_t n = 0;
+        for (; n < sizeof(chunk) && b <= count_; n += 4, b++)
+            write_u32_le(chunk + n, pack_index_[b]);
+        fr = write_at(tmp_, COMPRESSED_HEADER_SIZE + (b << 2) - n, chunk, n);
+    }
+    if (fr == FR_OK)
+        fr = f_sync(&tmp_);
+    std::uint8_t* h = chunk;
+    std::memset(h, 0, COMPRESSED_HEADER_SIZE);
+    std::memcpy(h, "MZC1", 4);
+    write_u32_le(h + 4, storage_size_);
+    h[8] = shift_;
+    h[9] = COMPRESSED_CODEC_LZ;
+    write_u32_le(h + 12, count_);
+    if (fr == FR_OK)
+        fr = write_at(tmp_, 0, h, COMPRESSED_HEADER_SIZE);
+    tmp_open_ = false;
+    if (f_close(&tmp_) != FR_OK || fr != FR_OK) {
+        f_unlink((path_ + ".tmp").c_str());
+        pack_abandon();
+        return false;
+    }
+
+    const std::string tmp = path_ + ".tmp";
+    close_files();
+    const bool swapped = f_unlink(path_.c_str()) == FR_OK;
+    if (swapped) {
+        f_rename(tmp.c_str(), path_.c_str());
+        f_unlink((path_ + ".ovl").c_str());
+        std::memset(slots_, 0, count_ * sizeof(*slots_));
+        slots_used_ = 0;
+    } else {
+        f_unlink(tmp.c_str());
+    }
+    delete[] pack_index_;
+    delete[] pack_out_;
+    delete[] pack_table_;
+    pack_index_ = nullptr;
+    pack_out_ = nullptr;
+    pack_table_ = nullptr;
+    packing_ = false;
+    // Same geometry, new offsets
+    if (open_container() != 0 || (!swapped && open_overlay() != 0)) {
+        valid_ = false;
+        return false;
+    }
+    return swapped;
+}
+
+void CompressedSource::pack_abandon() {
+    if (tmp_open_) {
+        f_close(&tmp_);
+        f_unlink((path_ + ".tmp").c_str());
+    }
+    tmp_open_ = false;
+    delete[] pack_index_;
+    delete[] pack_out_;
+    delete[] pack_table_;
+    pack_index_ = nullptr;
+    pack_out_ = nullptr;
+    pack_table_ = nullptr;
+    packing_ = false;
+}
+
+int ByteSourceFactory::from_compressed(const std::string& path,
+                                       std::uint32_t cache_size,
+                                       bool wrap,
+                                       std::unique_ptr<ByteSource>& out,
+                                       bool auto_increment)
+{
+    // A recompression cut short between removing the image and renaming
+    // its replacement
+    const std::string tmp = path + ".tmp";
+    FILINFO fno;
+    if (f_stat(path.c_str(), &fno) == FR_NO_FILE && is_container(tmp.c_str()))
+        f_rename(tmp.c_str(), path.c_str());
+    if (!is_container(path.c_str()))
+        return 1;
+    auto* cs = new (std::nothrow) CompressedSource(path, cache_size, wrap, auto_increment);
+    out.reset(cs);
+    if (!cs) return -1; // out of RAM
+    return cs->valid() ? 0 : -1;
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <memory>
+#include "ff.h"
+#include "common.hpp"
+#include "cached_source.hpp"
+
+// Container layout (little-endian): magic, image size, log2 of the block
+// size, codec, 2 reserved bytes, block count, then count + 1 offsets of
+// the blocks' data within the file. A block of 0 bytes is all zeros, one
+// of its full size is stored as is, anything else is LZ (lz_block.hpp).
+constexpr std::uint32_t COMPRESSED_HEADER_SIZE = 16;
+constexpr std::uint8_t COMPRESSED_CODEC_LZ = 1;
+constexpr std::uint8_t COMPRESSED_MIN_SHIFT = 9;
+constexpr std::uint8_t COMPRESSED_MAX_SHIFT = 15;
+// Most blocks a container may have: its index is held in RAM (4 KB), and
+// mzpico_pack picks a block size large enough
+constexpr std::uint32_t COMPRESSED_MAX_BLOCKS = 1024;
+// Overlay (<image>.ovl): magic, block count, block size, reserved, then a
+// slot map of a uint16_t per block (slot + 1, 0: not written), then the
+// slots from the next 512-byte boundary, a whole block each
+constexpr std::uint32_t COMPRESSED_OVERLAY_HEADER = 16;
+// How long writes must have stopped before idle time recompresses
+constexpr std::uint32_t COMPRESSED_SOURCE_QUIET_US = 1000000;
+
+inline bool compressed_magic(const std::uint8_t* p) {
+    return p[0] == 'M' && p[1] == 'Z' && p[2] == 'C' && p[3] == '1';
+}
+
+// A disk or RAM disk image kept compressed in fixed blocks (mzpico_pack
+// makes them, under the image's own name: a container is told apart by
+// its magic, not its extension). A mostly empty CP/M disk or RAM disk
+// image shrinks to a few KB, which is what fits on flash:, and a fetch
+// reads fewer bytes from the card.
+//
+// The block index is held in RAM (4 bytes a block), and one decoded block
+// (block_): a fetch within it is a copy, one elsewhere reads that block's
+// compressed bytes to the end of the buffer and decodes them in place in
+// front of them. The cache window above it is the CachedSource's, as for
+// a FileSource.
+//
+// The container itself is never written: a stored block goes, whole, to
+// a slot in the overlay file next to it, and from then on reads come from
+// there. recompressInBackground() folds the overlay back in during core
+// 0's idle time, once writes have stopped for COMPRESSED_SOURCE_QUIET_US,
+// one block per round: a new container is written to <image>.tmp, then
+// replaces the image, and the overlay is deleted. A store in the meantime
+// abandons that pass and a later one starts over. Until then, and on
+// flash: where it does not run, the overlay simply persists.
+class CompressedSource : public CachedSource {
+public:
+    CompressedSource(const std::string& path,
+                     std::uint32_t cache_size,
+                     bool wrap = true,
+                     bool auto_increment = true);
+    ~CompressedSource();
+
+    int flush() override;
+    // The block count is fixed: shrinking is accepted and ignored (the FDC
+    // formatter sizes a DSK track by track), growing refused
+    int resize(std::uint32_t new_size) override { return new_size <= storage_size_ ? 0 : -1; }
+    bool readOnly() const override { return read_only_; }
+    int recompressInBackground(const BackgroundIo* io) override;
+    bool valid() const { return valid_; }
+    // Blocks held in the overlay
+    std::uint32_t overlaid() const { return slots_used_; }
+
+private:
+    static int fetch(void* ctx, std::uint32_t index, std::uint8_t* buf, std::uint32_t size, std::uint32_t& read);
+    static int store(void* ctx, std::uint32_t index, const std::uint8_t* buf, std::uint32_t size, std::uint32_t& written);
+    static bool pack_round(void* arg);
+
+    int open_container();
+    int open_overlay();
+    void close_files();
+    // Decode `block` into block_; -1 on an I/O error or a corrupt block
+    int hold(std::uint32_t block);
+    int write_slot(std::uint32_t block, std::uint32_t from, std::uint32_t len);
+    // Whole-block pack steps (pack_round)
+    bool pack_start();
+    bool pack_block(std::uint32_t block);
+    bool pack_finish();
+    void pack_abandon();
+    inline std::uint32_t block_len(std::uint32_t block) const {
+        const std::uint32_t start = block << shift_;
+        return storage_size_ - start < (1u << shift_) ? storage_size_ - start : 1u << shift_;
+    }
+
+    std::string path_;
+    FIL file_{};
+    FIL overlay_{};
+    bool valid_ = false;
+    bool read_only_ = false;
+    bool overlay_open_ = false;
+
+    std::uint8_t shift_ = 12;
+    std::uint32_t count_ = 0;
+    std::uint32_t* index_ = nullptr;        // count_ + 1 offsets
+    std::uint16_t* slots_ = nullptr;        // count_ overlay slots + 1
+    std::uint32_t slots_used_ = 0;
+    std::uint32_t slot_base_ = 0;           // offset of slot 0 in the overlay
+    std::uint8_t* block_ = nullptr;         // a block and its in-place margin
+    std::uint32_t held_ = UINT32_MAX;       // the block decoded in block_
+
+    // Recompression
+    const BackgroundIo* pack_io_ = nullptr;
+    volatile std::uint32_t last_store_ = 0; // time_us_32() of the last store
+    volatile bool stored_ = false;          // a store since the pass started
+    bool packing_ = false;
+    FIL tmp_{};
+    bool tmp_open_ = false;
+    std::uint32_t pack_next_ = 0;
+    std::uint32_t* pack_index_ = nullptr;
+    std::uint8_t* pack_out_ = nullptr;
+    std::uint16_t* pack_table_ = nullptr;
+};
+
+namespace ByteSourceFactory {
+    // An image that is a compressed container (see CompressedSource); 1,
+    // with nothing open, if it is not one, for the caller to use
+    // from_file(); -1 if it is but does not open (corrupt, out of RAM)
+    int from_compressed(const std::string& path,
+                        std::uint32_t cache_size,
+                        bool wrap,
+                        std::unique_ptr<ByteSource>& out,
+                        bool auto_increment = true);
+}
@@ -129,7 +129,8 @@ FDCDirSource::FDCDirSource(const std::string& path, Fs fs, std::uint32_t cache_s
     else
         bas_moved_ = new (std::nothrow) std::string[64];
 
-    if (!dir_image_ || !prev_dir_ || !stage_ || !scratch_ ||
+    pooled_ = FilePool::attach() == 0;
+    if (!dir_image_ || !prev_dir_ || !stage_ || !scratch_ || !pooled_ ||
         (fs_ == Fs::CPM && !cpm_files_) ||
         (fs_ == Fs::BASIC && !bas_moved_))
         return; // valid_ stays false; factory reports out-of-RAM
@@ -149,6 +150,10 @@ FDCDirSource::FDCDirSource(const std::string& path, Fs fs, std::uint32_t cache_s
 FDCDirSource::~FDCDirSource() {
     flush();
     closeOpen();
+    if (pooled_) {
+        FilePool::dropDir(dir_);
+        FilePool::detach();
+    }
     if (stage_open_) {
         f_close(&stage_file_);
         stage_open_ = false;
@@ -211,7 +216,7 @@ void FDCDirSource::buildBasic() {
             if (!is_mzf_name(fno.fname)) continue;
             if (slot > kBasMaxFiles) { printf("fdcdir: >63 files, rest skipped\n"); break; }
 
-            // cur_ doubles as the scan handle: a local FIL (~560 B) would
+            // A pooled handle serves the scan: a local FIL (~560 B) would
             // not fit the ~2 KB core stack next to DIR + FILINFO
             FIL* f = nullptr;
             std::uint8_t hdr[24];
@@ -220,7 +225,6 @@ void FDCDirSource::buildBasic() {
             const bool ok =
                 f_lseek(f, 0) == FR_OK &&
                 f_read(f, hdr, sizeof(hdr), &br) == FR_OK && br == sizeof(hdr);
-            closeOpen();
             if (!ok) continue;
 
             if (hdr[0] == 0x04) { // BRD random files are not contiguous; unsupported
@@ -659,12 +663,16 @@ int FDCDirSource::ensureOpen(const std::string& filename, bool writable, FIL*& o
         out = &cur_.f;
         return 0;
     }
+    if (!writable) {
+        out = FilePool::open(fullPath(filename));
+        return out ? 0 : -1;
+    }
     closeOpen();
-    const BYTE mode = writable ? (FA_READ | FA_WRITE) : FA_READ;
-    if (f_open(&cur_.f, fullPath(filename), mode) != FR_OK) return -1;
+    FilePool::drop(fullPath(filename)); // FF_FS_LOCK: no writer beside a reader
+    if (f_open(&cur_.f, fullPath(filename), FA_READ | FA_WRITE) != FR_OK) return -1;
     cur_.filename = filename;
     cur_.open = true;
-    cur_.writable = writable;
+    cur_.writable = true;
     out = &cur_.f;
     return 0;
 }
@@ -679,24 +687,8 @@ void FDCDirSource::closeOpen() {
 }
 
 int FDCDirSource::ensureAux(const std::string& filename, FIL*& out) {
-    if (aux_.open && aux_.filename == filename) {
-        out = &aux_.f;
-        return 0;
-    }
-    closeAux();
-    if (f_open(&aux_.f, fullPath(filename), FA_READ) != FR_OK) return -1;
-    aux_.filename = filename;
-    aux_.open = true;
-    out = &aux_.f;
-    return 0;
-}
-
-void FDCDirSource::closeAux() {
-    if (aux_.open) {
-        f_close(&aux_.f);
-        aux_.open = false;
-        aux_.filename.clear();
-    }
+    out = FilePool::open(fullPath(filename));
+    return out ? 0 : -1;
 }
 
 // ─────────────────────────────────────────────────────────────────────────────
@@ -999,11 +991,8 @@ void FDCDirSource::sessionAbort() {
     // rolled back. (DINFO changes stick - allocation bits leaked by an
     // aborted save waste virtual space until remount, which is harmless;
     // rolling DINFO back could revert a legitimately committed operation.)
-    cache_dirty_ = false;
-    cache_start_ = 0;
-    cache_valid_ = 0;
+    discard();
     closeOpen();
-    closeAux();
     stageClear();
     if (dir_dirty_) {
         const std::uint32_t dirb = (fs_ == Fs::BASIC) ? kBasDirBytes : kCpmDirBytes;
@@ -1015,7 +1004,9 @@ void FDCDirSource::sessionAbort() {
 }
 
 void FDCDirSource::commit() {
-    closeOpen(); // the read cursor may point at a file we are about to change
+    // Pooled read handles may be on files we are about to change
+    closeOpen();
+    FilePool::dropDir(dir_);
     memo_block_ = -1;
     memo_idx_ = -1;
     if (fs_ == Fs::BASIC) commitBasic();
@@ -1023,7 +1014,7 @@ void FDCDirSource::commit() {
     const std::uint32_t dirb = (fs_ == Fs::BASIC) ? kBasDirBytes : kCpmDirBytes;
     std::memcpy(prev_dir_, dir_image_, dirb);
     closeOpen();
-    closeAux();
+    FilePool::dropDir(dir_);
 }
 
 // A FAT container name that does not collide (case-insensitively) with any
@@ -1535,7 +1526,7 @@ void FDCDirSource::commitCpm() {
         const int fi = findFile(id);
         if (fi < 0) continue;
         closeOpen();
-        closeAux();
+        FilePool::drop(fullPath(cpm_files_[fi].fat_name));
         f_unlink(fullPath(cpm_files_[fi].fat_name));
         dropFile(fi);
     }
@@ -5,6 +5,7 @@
 
 #include "ff.h"
 #include "cached_source.hpp"
+#include "file_pool.hpp"
 
 // Directory-mounted floppy: presents a directory of files as a synthesized
 // extended-DSK image to the FDC device, with one of two on-disk filesystem
@@ -157,11 +158,13 @@ private:
     void commitCpm();
     std::string uniqueFatName(const std::string& base, const std::string& ext);
 
+    // Reads come from the shared FilePool (or cur_, while it has the file
+    // open for writing); a writable handle is cur_, the file dropped from
+    // the pool first
     int  ensureOpen(const std::string& filename, bool writable, FIL*& out);
     void closeOpen();
-    // Second handle for commit-time copies from a previous owner's container
+    // Pooled handle for commit-time copies from a previous owner's container
     int  ensureAux(const std::string& filename, FIL*& out);
-    void closeAux();
 
     // ---- members -----------------------------------------------------------
     Fs            fs_;
@@ -192,8 +195,8 @@ private:
 
     std::uint8_t* scratch_ = nullptr;    // one guest sector (512 B)
 
-    OpenFile      cur_{};
-    OpenFile      aux_{};                // commit-time copy source
+    OpenFile      cur_{};                // the file being written
+    bool          pooled_ = false;       // attached to FilePool
 
     // Commit-time slot-move tracking (BASIC only); heap-side, the core
     // stacks are ~2 KB and 64 strings do not fit there
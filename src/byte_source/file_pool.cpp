@@ -0,0 +1,90 @@
+#include "file_pool.hpp"
+#include <cstring>
+#include <strings.h>
+#include <new>
+
+namespace {
+    struct Slot {
+        FIL         f{};
+        std::string path{};
+        std::uint32_t used = 0;     // LRU stamp
+        bool        open = false;
+    };
+
+    Slot*         slots = nullptr;
+    std::uint32_t users = 0;
+    std::uint32_t tick = 0;
+    FilePoolStats counters;
+
+    void close_slot(Slot& s) {
+        if (!s.open) return;
+        f_close(&s.f);
+        s.open = false;
+        s.path.clear();
+    }
+}
+
+int FilePool::attach() {
+    if (!slots) {
+        slots = new (std::nothrow) Slot[FILE_POOL_SLOTS];
+        if (!slots) return -1;
+    }
+    users++;
+    return 0;
+}
+
+void FilePool::detach() {
+    if (!users || --users) return;
+    for (std::uint8_t i = 0; i < FILE_POOL_SLOTS; i++)
+        close_slot(slots[i]);
+    delete[] slots;
+    slots = nullptr;
+}
+
+FIL* FilePool::open(const char* path) {
+    if (!slots) return nullptr;
+    Slot* victim = &slots[0];
+    for (std::uint8_t i = 0; i < FILE_POOL_SLOTS; i++) {
+        Slot& s = slots[i];
+        if (s.open && strcasecmp(s.path.c_str(), path) == 0) {
+            s.used = ++tick;
+            counters.hits++;
+            return &s.f;
+        }
+        if (victim->open && (!s.open || s.used < victim->used))
+            victim = &s;
+    }
+    if (victim->open) {
+        close_slot(*victim);
+        counters.evictions++;
+    }
+    counters.opens++;
+    if (f_open(&victim->f, path, FA_READ) != FR_OK) return nullptr;
+    victim->path = path;
+    victim->open = true;
+    victim->used = ++tick;
+    return &victim->f;
+}
+
+void FilePool::drop(const char* path) {
+    if (!slots) return;
+    for (std::uint8_t i = 0; i < FILE_POOL_SLOTS; i++)
+        if (slots[i].open && strcasecmp(slots[i].path.c_str(), path) == 0)
+            close_slot(slots[i]);
+}
+
+void FilePool::dropDir(const std::string& dir) {
+    if (!slots) return;
+    std::size_t len = dir.size();
+    while (len && dir[len - 1] == '/') len--;
+    for (std::uint8_t i = 0; i < FILE_POOL_SLOTS; i++) {
+        Slot& s = slots[i];
+        if (s.open && s.path.size() > len && s.path[len] == '/' &&
+            strncasecmp(s.path.c_str(), dir.c_str(), len) == 0)
+            close_slot(s);
+    }
+}
+
+FilePoolStats FilePool::stats() {
+    return counters;
+}
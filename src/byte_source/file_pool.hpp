@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "ff.h"
+
+// Read handles open at once, over every directory mount (~560 B each)
+constexpr std::uint8_t FILE_POOL_SLOTS = 4;
+
+// Opens and handle reuses since boot; evictions close the least recently
+// used handle for another file
+struct FilePoolStats {
+    std::uint32_t hits = 0;
+    std::uint32_t opens = 0;
+    std::uint32_t evictions = 0;
+};
+
+// Read handles for the files behind directory-mounted disks (QDDirSource,
+// FDCDirSource), kept open across reads and shared by all of them. A
+// guest reading several files in turn - a CP/M PIP concatenation, a
+// program loading overlays - then reuses the open handle instead of
+// closing one file and opening the next, a path walk through the
+// directory each time.
+//
+// Handles are LRU over FILE_POOL_SLOTS slots, keyed by full path (case
+// blind, as FAT is). FF_FS_LOCK refuses to write, rename or delete a file
+// that is open, so a file is dropped from the pool before any of that
+// (drop(), or dropDir() ahead of a directory commit).
+namespace FilePool {
+    // Every source using the pool attaches once: the first allocates the
+    // slots, the last detach closes and frees them. -1: out of RAM
+    int attach();
+    void detach();
+    // A read handle on path, at some position: reused, or opened in the
+    // least recently used slot. nullptr if the file does not open. Stays
+    // valid until FILE_POOL_SLOTS other files have been opened, or it is
+    // dropped.
+    FIL* open(const char* path);
+    // Close path's handle, if pooled
+    void drop(const char* path);
+    // Close the handles of every file in dir
+    void dropDir(const std::string& dir);
+    FilePoolStats stats();
+}
@@ -1,5 +1,7 @@
 #include "file_source.hpp"
 #include "device.hpp"
+#include "diskio.h"
+#include "flash_fs.h"
 #include <cstring>
 #include <string>
 #include <algorithm>
@@ -13,6 +15,7 @@ FileSource::FileSource(const std::string& path,
 {
     FRESULT fr;
     FILINFO finfo;
+    std::uint32_t unwritten = UINT32_MAX; // where the part left unwritten begins
 
     fr = f_stat(path.c_str(), &finfo);
     
@@ -20,7 +23,7 @@ FileSource::FileSource(const std::string& path,
         fr = f_open(&file_, path.c_str(), FA_CREATE_ALWAYS | FA_READ | FA_WRITE);
         if (fr != FR_OK) return;
         valid_ = true;
-        if (storage_size_ > 0) resize_file(storage_size_);
+        if (storage_size_ > 0) unwritten = resize_file(storage_size_);
     } else if (fr == FR_OK) {
         fr = f_open(&file_, path.c_str(), FA_READ | FA_WRITE);
         if (fr == FR_DENIED || fr == FR_WRITE_PROTECTED) {
@@ -41,33 +44,96 @@ FileSource::FileSource(const std::string& path,
         } else if (storage_size_ == 0) {
             storage_size_ = fileSize;
         } else if (storage_size_ != fileSize) {
-            resize_file(storage_size_);
+            unwritten = resize_file(storage_size_);
         }
     }
 
     pos_ = 0;
+    map_clusters();
+    if (unwritten < storage_size_) {
+        blank_from(unwritten);
+        // On flash: the map sync is the commit, an erase or more: the
+        // first flush() makes the file durable, and a power cut before it
+        // leaves the volume as it was
+        if (file_.obj.fs->pdrv != FLASH_FS_DRIVE)
+            f_sync(&file_);
+    }
 }
 
 FileSource::~FileSource() {
+    if (zero_io_)
+        zero_io_->idle(zero_io_->ctx, nullptr, this);
+    settle_background();
     flush();
     if (valid_) f_close(&file_);
+    delete[] clmt_;
+    delete[] blank_;
+}
+
+// FatFS reports the size a file needs when the table given is too small,
+// so a small first try covers the common unfragmented file and a second
+// one the rest
+DWORD* FileSource::link_map(FIL& file) {
+#if FF_USE_FASTSEEK
+    DWORD len = 8;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        DWORD* clmt = new (std::nothrow) DWORD[len];
+        if (!clmt)
+            return nullptr;
+        clmt[0] = len;
+        file.cltbl = clmt;
+        const FRESULT fr = f_lseek(&file, CREATE_LINKMAP);
+        if (fr == FR_OK)
+            return clmt;
+        const DWORD need = clmt[0];
+        file.cltbl = nullptr;
+        delete[] clmt;
+        if (fr != FR_NOT_ENOUGH_CORE || need > FILE_SOURCE_CLMT_MAX)
+            return nullptr;
+        len = need;
+    }
+#endif
+    return nullptr;
+}
+
+void FileSource::map_clusters() {
+#if FF_USE_FASTSEEK
+    unmap_clusters();
+    // A short file (resize_file() ran out of space) would grow on write
+    if (!valid_ || f_size(&file_) == 0 || f_size(&file_) < storage_size_)
+        return;
+    clmt_ = link_map(file_);
+#endif
+}
+
+void FileSource::unmap_clusters() {
+#if FF_USE_FASTSEEK
+    file_.cltbl = nullptr;
+    delete[] clmt_;
+    clmt_ = nullptr;
+#endif
 }
 
 int FileSource::flush() {
     int ret = CachedSource::flush();
     // Push FatFS's dirty sector buffer and directory entry to the medium;
     // without this the tail of a write sits in RAM until the file is closed.
+    settle_background();
     if (valid_ && !read_only_ && f_sync(&file_) != FR_OK) ret = -1;
     return ret;
 }
 
+int FileSource::setWriteBehind(const BackgroundIo* io, WriteBehind mode) {
+    if (!valid_ || read_only_) return -1;
+    return enable_write_behind(io, mode);
+}
+
 int FileSource::resize(std::uint32_t new_size) {
     if (!valid_ || read_only_) return -1;
     if (CachedSource::flush() != 0) return -1;
     // The cache may cover a region past the new end; drop it entirely
-    cache_start_ = 0;
-    cache_valid_ = 0;
-    cache_dirty_ = false;
+    discard();
+    unmap_clusters();
 
     std::uint32_t current = f_size(&file_);
     if (new_size > current) {
@@ -76,7 +142,9 @@ int FileSource::resize(std::uint32_t new_size) {
         // region's content is undefined). resize() callers - the FDC
         // formatter - overwrite the whole grown area, and zero-filling
         // it first through FatFS doubled every page program on flash.
-        // File creation (resize_file in the constructor) still zero-fills.
+        // File creation (resize_file in the constructor) does not fill
+        // either: it allocates (f_expand where it can) and blank_from()
+        // makes the new part read as zeros.
         if (f_lseek(&file_, new_size) != FR_OK) return -1;
     } else if (new_size < current) {
         if (f_lseek(&file_, new_size) != FR_OK) return -1;
@@ -87,10 +155,12 @@ int FileSource::resize(std::uint32_t new_size) {
     // an extra sync per call meant an extra flash map cycle per track.
     storage_size_ = new_size;
     if (pos_ > new_size) pos_ = new_size;
+    drop_blanks(new_size);
+    map_clusters();
     return 0;
 }
 
-void FileSource::resize_file(std::uint32_t new_size) {
+std::uint32_t FileSource::resize_file(std::uint32_t new_size) {
     FRESULT fr;
 
     std::uint32_t current_size = f_size(&file_);
@@ -98,27 +168,200 @@ void FileSource::resize_file(std::uint32_t new_size) {
         // truncate
         fr = f_lseek(&file_, new_size);
         if (fr != FR_OK) {
-            return;
+            return new_size;
         }
         fr = f_truncate(&file_);
         if (fr != FR_OK) {
-            return;
+            return new_size;
         }
         f_sync(&file_);
     } else if (new_size > current_size) {
-        // expand with zeros
-        f_lseek(&file_, current_size);
-        std::vector<std::uint8_t> zeros(128, 0);
-        std::uint32_t remaining = new_size - current_size;
-        while (remaining > 0) {
-            UINT bw = 0;
-            std::uint32_t chunk = (remaining > zeros.size()) ? zeros.size() : remaining;
-            f_write(&file_, zeros.data(), chunk, &bw);
-            if (bw != chunk) return; // medium full/error; caller sees the short size
-            remaining -= bw;
+        // Allocate without writing: the grown part is left to
+        // blank_from(), from a block boundary - the partial block before
+        // it is zero-filled here
+        while (((new_size - 1) >> blank_shift_) >= FILE_SOURCE_BLANK_BLOCKS)
+            blank_shift_++;
+        const std::uint32_t block = 1u << blank_shift_;
+        std::uint32_t from = (current_size + block - 1) & ~(block - 1);
+        if (from > new_size) from = new_size;
+        // A new file in one contiguous stretch if there is one (it needs
+        // no cluster map, and its sectors follow each other for XIP)
+        if (current_size == 0)
+            f_expand(&file_, new_size, 1);
+        if (f_size(&file_) < new_size) {
+            if (zero_range(current_size, from) != FR_OK)
+                return new_size; // medium full/error; caller sees the short size
+            f_lseek(&file_, new_size);
         }
-        f_sync(&file_);
+        return from;
+    }
+    return new_size;
+}
+
+// The part of the file from `from` on holds what its clusters held: make
+// it read as zeros - trimmed on flash:, blank blocks elsewhere, and
+// zero-filled the old way if neither can be had
+void FileSource::blank_from(std::uint32_t from) {
+    if (file_.obj.fs->pdrv == FLASH_FS_DRIVE ? trim_from(from) : map_blanks(from))
+        return;
+    zero_range(from, storage_size_);
+}
+
+// The file's sectors from `from` on, fragment by fragment through the
+// cluster map. FatFS may hold the last one, if partial, in the file's
+// sector buffer as it was: rewriting its zeros replaces that.
+bool FileSource::trim_from(std::uint32_t from) {
+#if FF_USE_FASTSEEK
+    if (!clmt_)
+        return false;
+    const FATFS* fs = file_.obj.fs;
+    LBA_t skip = from / FLASH_FS_PAGE_SIZE;
+    LBA_t left = (storage_size_ + FLASH_FS_PAGE_SIZE - 1) / FLASH_FS_PAGE_SIZE - skip;
+    for (const DWORD* frag = clmt_ + 1; left && frag[0]; frag += 2) {
+        LBA_t n = (LBA_t)frag[0] * fs->csize;
+        if (skip >= n) {
+            skip -= n;
+            continue;
+        }
+        const LBA_t first = fs->database + (LBA_t)fs->csize * (frag[1] - 2) + skip;
+        n -= skip;
+        skip = 0;
+        if (n > left) n = left;
+        LBA_t range[2] = { first, first + n - 1 };
+        if (disk_ioctl(fs->pdrv, CTRL_TRIM, range) != RES_OK)
+            return false;
+        left -= n;
+    }
+    if (left)
+        return false;
+    const std::uint32_t tail = storage_size_ % FLASH_FS_PAGE_SIZE;
+    return !tail || zero_range(storage_size_ - tail, storage_size_) == FR_OK;
+#else
+    (void)from;
+    return false;
+#endif
+}
+
+bool FileSource::map_blanks(std::uint32_t from) {
+    const std::uint32_t blocks = (storage_size_ + (1u << blank_shift_) - 1) >> blank_shift_;
+    blank_ = new (std::nothrow) std::uint32_t[(blocks + 31) / 32]();
+    if (!blank_)
+        return false;
+    blank_blocks_ = blocks;
+    blank_next_ = from >> blank_shift_;
+    for (std::uint32_t b = blank_next_; b < blocks; b++)
+        blank_[b >> 5] |= 1u << (b & 31);
+    blank_left_ = blocks - blank_next_;
+    return true;
+}
+
+void FileSource::unblank(std::uint32_t block) {
+    if (!blank(block))
+        return;
+    blank_[block >> 5] &= ~(1u << (block & 31));
+    blank_left_--;
+}
+
+// Past a new end nothing is left to zero
+void FileSource::drop_blanks(std::uint32_t from) {
+    for (std::uint32_t b = (from + (1u << blank_shift_) - 1) >> blank_shift_;
+         blank_left_ && b < blank_blocks_; b++)
+        unblank(b);
+}
+
+FRESULT FileSource::zero_range(std::uint32_t from, std::uint32_t to) {
+    static const std::uint8_t zeros[FF_MIN_SS] = {};
+    if (from >= to)
+        return FR_OK;
+    FRESULT fr = f_lseek(&file_, from);
+    while (fr == FR_OK && from < to) {
+        UINT bw = 0;
+        const std::uint32_t chunk = (to - from < sizeof(zeros)) ? to - from : sizeof(zeros);
+        fr = f_write(&file_, zeros, chunk, &bw);
+        if (fr == FR_OK && bw != chunk)
+            fr = FR_DENIED; // medium full
+        from += bw;
+    }
+    return fr;
+}
+
+int FileSource::zeroInBackground(const BackgroundIo* io) {
+    if (!blank_left_ || zero_io_ || !io || !io->idle)
+        return -1;
+    if (!io->idle(io->ctx, &FileSource::zero_round, this))
+        return -1;
+    zero_io_ = io;
+    return 0;
+}
+
+// Idle work: one blank block written out per call, then the file synced
+// once the last one is. A failed write stops it; the block still reads
+// as zeros.
+bool FileSource::zero_round(void* arg) {
+    auto* self = static_cast<FileSource*>(arg);
+    for (std::uint32_t n = 0; self->blank_left_ && n < self->blank_blocks_; n++) {
+        std::uint32_t b = self->blank_next_;
+        if (b >= self->blank_blocks_)
+            b = 0;
+        self->blank_next_ = b + 1;
+        if (!self->blank(b))
+            continue;
+        if (self->zero_range(b << self->blank_shift_, self->block_end(b)) != FR_OK)
+            return false;
+        self->unblank(b);
+        break;
+    }
+    if (self->blank_left_)
+        return true;
+    f_sync(&self->file_);
+    return false;
+}
+
+// Bytes at `index` (within the file), blank blocks as zeros
+FRESULT FileSource::read_at(std::uint32_t index, std::uint8_t* buf, std::uint32_t len, UINT& done) {
+    done = 0;
+    while (done < len) {
+        const std::uint32_t at = index + done;
+        std::uint32_t n = len - done;
+        if (blank_left_) {
+            const std::uint32_t block = at >> blank_shift_;
+            const std::uint32_t left = ((block + 1) << blank_shift_) - at;
+            if (n > left) n = left;
+            if (blank(block)) {
+                std::memset(buf + done, 0, n);
+                done += n;
+                continue;
+            }
+        }
+        UINT br = 0;
+        f_lseek(&file_, at);
+        const FRESULT fr = f_read(&file_, buf + done, n, &br);
+        done += br;
+        if (fr != FR_OK || br < n)
+            return fr;
+    }
+    return FR_OK;
+}
+
+// A blank block's first write brings the rest of its zeros along
+FRESULT FileSource::write_at(std::uint32_t index, const std::uint8_t* buf, std::uint32_t len, UINT& done) {
+    done = 0;
+    if (blank_left_ && len) {
+        const std::uint32_t end = index + len;
+        const std::uint32_t first = index >> blank_shift_;
+        const std::uint32_t last = (end - 1) >> blank_shift_;
+        FRESULT fr = FR_OK;
+        if (blank(first))
+            fr = zero_range(first << blank_shift_, index);
+        if (fr == FR_OK && blank(last))
+            fr = zero_range(end, block_end(last));
+        if (fr != FR_OK)
+            return fr;
+        for (std::uint32_t b = first; b <= last; b++)
+            unblank(b);
     }
+    f_lseek(&file_, index);
+    return f_write(&file_, buf, len, &done);
 }
 
 int FileSource::fetch(void *ctx, std::uint32_t index, std::uint8_t* buf,
@@ -136,9 +379,8 @@ int FileSource::fetch(void *ctx, std::uint32_t index, std::uint8_t* buf,
     std::uint32_t remain = self->storage_size_ - index;
     std::uint32_t first_len = (size < remain) ? size : remain;
 
-    f_lseek(&self->file_, index);
     UINT br;
-    FRESULT fr = f_read(&self->file_, buf, first_len, &br);
+    FRESULT fr = self->read_at(index, buf, first_len, br);
     if (fr != FR_OK) return -1;
     read = br;
 
@@ -146,9 +388,8 @@ int FileSource::fetch(void *ctx, std::uint32_t index, std::uint8_t* buf,
     if (self->wrap_ && read == first_len && read < size) {
         std::uint32_t second_len = size - read;
         if (second_len > self->storage_size_) second_len = self->storage_size_;
-        f_lseek(&self->file_, 0);
         UINT br2;
-        fr = f_read(&self->file_, buf + read, second_len, &br2);
+        fr = self->read_at(0, buf + read, second_len, br2);
         if (fr != FR_OK) return -1;
         read += br2;
     }
@@ -172,9 +413,8 @@ int FileSource::store(void *ctx, std::uint32_t index, const std::uint8_t* buf,
     std::uint32_t remain = self->storage_size_ - index;
     std::uint32_t first_len = (size < remain) ? size : remain;
 
-    f_lseek(&self->file_, index);
     UINT bw;
-    FRESULT fr = f_write(&self->file_, buf, first_len, &bw);
+    FRESULT fr = self->write_at(index, buf, first_len, bw);
     if (fr != FR_OK) return -1;
     written = bw;
 
@@ -182,9 +422,8 @@ int FileSource::store(void *ctx, std::uint32_t index, const std::uint8_t* buf,
     if (self->wrap_ && written == first_len && written < size) {
         std::uint32_t second_len = size - written;
         if (second_len > self->storage_size_) second_len = self->storage_size_;
-        f_lseek(&self->file_, 0);
         UINT bw2;
-        fr = f_write(&self->file_, buf + written, second_len, &bw2);
+        fr = self->write_at(0, buf + written, second_len, bw2);
         if (fr != FR_OK) return -1;
         written += bw2;
     }
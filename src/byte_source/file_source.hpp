@@ -7,6 +7,31 @@
 #include "common.hpp"
 #include "cached_source.hpp"
 
+// Largest fast-seek cluster map a FileSource allocates, in DWORDs: two per
+// fragment plus one (1 KB, 127 fragments)
+constexpr std::uint32_t FILE_SOURCE_CLMT_MAX = 256;
+// Most blocks a FileSource's never-written map has (256 bytes of bits);
+// a block is 512 bytes, or larger so a big image fits
+constexpr std::uint32_t FILE_SOURCE_BLANK_BLOCKS = 2048;
+
+// A file image behind a CachedSource. With FF_USE_FASTSEEK it keeps a
+// cluster link map of the file (FIL::cltbl), so f_lseek() to a window of
+// a large or fragmented image finds its cluster in RAM instead of walking
+// the FAT chain from the start of the file. The map is sized for the
+// file's fragments; a file with more than FILE_SOURCE_CLMT_MAX allows, or
+// no RAM for it, seeks the slow way. A map cannot grow the file, so
+// resize() drops it and maps the new file.
+//
+// Creating an image, or growing a short one, allocates its clusters
+// without writing them (f_expand(), or f_lseek() past the end): zero
+// filling them took hundreds of ms at boot. They must still read as
+// zeros. On flash: the new sectors are trimmed - flash_fs reads a sector
+// it holds no page for as zeros. Elsewhere a bitmap of never-written
+// blocks has fetch() return zeros for them, and a block's first store()
+// writes the rest of its zeros with it; zeroInBackground() writes out
+// the others in idle time. Until it is done a power cut leaves those
+// blocks holding whatever the clusters held, like a RAM disk's RAM at
+// power on.
 class FileSource : public CachedSource {
 public:
     FileSource(const std::string &path,
@@ -18,21 +43,84 @@ public:
 
     int flush() override;
     int resize(std::uint32_t new_size) override;
+    int setWriteBehind(const BackgroundIo* io, WriteBehind mode) override;
+    int zeroInBackground(const BackgroundIo* io) override;
     bool readOnly() const override { return read_only_; }
     bool valid() const { return valid_; }
+    // A fast-seek map of `file`, installed as its cltbl; nullptr (and no
+    // map) if it needs more than FILE_SOURCE_CLMT_MAX or there is no RAM.
+    // The caller owns it and must clear cltbl before freeing it.
+    static DWORD* link_map(FIL& file);
 
 private:
     static int fetch(void *ctx, std::uint32_t index, std::uint8_t *buf, std::uint32_t size, std::uint32_t &read);
     static int store(void *ctx, std::uint32_t index, const std::uint8_t *buf, std::uint32_t size, std::uint32_t &written);
 
-    void resize_file(std::uint32_t new_size);
+    // Where the part left unwritten begins (new_size: none)
+    std::uint32_t resize_file(std::uint32_t new_size);
+    void map_clusters();
+    void unmap_clusters();
+
+    FRESULT read_at(std::uint32_t index, std::uint8_t* buf, std::uint32_t len, UINT& done);
+    FRESULT write_at(std::uint32_t index, const std::uint8_t* buf, std::uint32_t len, UINT& done);
+    FRESULT zero_range(std::uint32_t from, std::uint32_t to);
+    void blank_from(std::uint32_t from);
+    bool trim_from(std::uint32_t from);
+    bool map_blanks(std::uint32_t from);
+    void unblank(std::uint32_t block);
+    void drop_blanks(std::uint32_t from);
+    static bool zero_round(void* arg);
+    inline bool blank(std::uint32_t block) const {
+        return block < blank_blocks_ && (blank_[block >> 5] >> (block & 31)) & 1u;
+    }
+    inline std::uint32_t block_end(std::uint32_t block) const {
+        const std::uint32_t end = (block + 1) << blank_shift_;
+        return end < storage_size_ ? end : storage_size_;
+    }
 
     FIL file_{};
+    DWORD* clmt_ = nullptr;     // the fast-seek map, if any
     bool valid_ = false;
     bool read_only_ = false;
+
+    std::uint32_t* blank_ = nullptr;    // never-written blocks, a bit each
+    std::uint32_t blank_blocks_ = 0;
+    std::uint32_t blank_left_ = 0;      // bits set
+    std::uint32_t blank_next_ = 0;      // zero_round() goes on from here
+    std::uint8_t blank_shift_ = 9;      // log2 of the block size
+    const BackgroundIo* zero_io_ = nullptr;
+};
+
+// A FileSource with its wrap and auto-increment policy fixed at compile
+// time, like RamSourceImpl: the byte accessors test no flags, and a device
+// holding a pointer of this (final) type calls them directly
+template<bool WRAP, bool AUTO_INCREMENT>
+class FileSourceImpl final : public FileSource {
+public:
+    FileSourceImpl(const std::string &path, std::uint32_t size, std::uint32_t cache_size)
+        : FileSource(path, size, cache_size, WRAP, AUTO_INCREMENT) {}
+
+    RAM_FUNC int getByte(std::uint8_t &out) override { return get_byte<WRAP, AUTO_INCREMENT>(out); }
+    RAM_FUNC int setByte(std::uint8_t in) override { return set_byte<WRAP, AUTO_INCREMENT>(in); }
+    RAM_FUNC int next() override { return next_byte<WRAP>(); }
 };
 
 namespace ByteSourceFactory {
+    // `typed`, if given, receives the source as its concrete type
+    template<bool WRAP, bool AUTO_INCREMENT>
+    static inline int from_file(const std::string &path,
+                                std::uint32_t size,
+                                std::uint32_t cache_size,
+                                std::unique_ptr<ByteSource> &out,
+                                FileSourceImpl<WRAP, AUTO_INCREMENT>** typed = nullptr)
+    {
+        auto* fs = new (std::nothrow) FileSourceImpl<WRAP, AUTO_INCREMENT>(path, size, cache_size);
+        if (typed) *typed = fs;
+        out.reset(fs);
+        if (!fs) return -1; // out of RAM
+        return fs->valid() ? 0 : -1;
+    }
+
     static inline int from_file(const std::string &path,
                                 std::uint32_t size,
                                 std::uint32_t cache_size,
@@ -40,11 +128,10 @@ namespace ByteSourceFactory {
                                 std::unique_ptr<ByteSource> &out,
                                 bool auto_increment = true)
     {
-        std::unique_ptr<FileSource> fs(
-            new (std::nothrow) FileSource(path, size, cache_size, wrap, auto_increment));
-        if (!fs) { out.reset(); return -1; } // out of RAM
-        const int ret = fs->valid() ? 0 : -1;
-        out = std::move(fs);
-        return ret;
+        if (wrap)
+            return auto_increment ? from_file<true, true>(path, size, cache_size, out)
+                                  : from_file<true, false>(path, size, cache_size, out);
+        return auto_increment ? from_file<false, true>(path, size, cache_size, out)
+                              : from_file<false, false>(path, size, cache_size, out);
     }
 }
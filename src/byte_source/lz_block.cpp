@@ -0,0 +1,151 @@
+#include "lz_block.hpp"
+#include <cstring>
+
+namespace {
+    constexpr std::uint32_t MIN_MATCH = 4;
+    constexpr std::uint32_t LAST_LITERALS = 5;  // a block ends in literals
+    constexpr std::uint32_t MATCH_LIMIT = 12;   // no match starts this close to the end
+    constexpr std::uint32_t MAX_OFFSET = 65535;
+
+    inline std::uint32_t read32(const std::uint8_t* p) {
+        std::uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline std::uint32_t hash(std::uint32_t seq) {
+        return (seq * 2654435761u) >> (32 - 12);
+    }
+    static_assert(LZ_HASH_ENTRIES == 1u << 12, "hash() yields 12 bits");
+
+    // A length past the token's 15: 255s, then the rest
+    inline std::uint8_t* put_length(std::uint8_t* op, std::uint32_t n) {
+        for (; n >= 255; n -= 255)
+            *op++ = 255;
+        *op++ = static_cast<std::uint8_t>(n);
+        return op;
+    }
+
+    // One sequence: `lit` literals, then (offset non-zero) a match; nullptr
+    // if it does not fit before `end`
+    std::uint8_t* put_sequence(std::uint8_t* op, std::uint8_t* end, const std::uint8_t* lits,
+                               std::uint32_t lit, std::uint32_t offset, std::uint32_t mlen) {
+        const std::uint32_t need = 1 + lit / 255 + 1 + lit + (offset ? 2 + mlen / 255 + 1 : 0);
+        if (need > static_cast<std::uint32_t>(end - op))
+            return nullptr;
+        std::uint8_t* token = op++;
+        *token = static_cast<std::uint8_t>((lit < 15 ? lit : 15) << 4);
+        if (lit >= 15)
+            op = put_length(op, lit - 15);
+        std::memcpy(op, lits, lit);
+        op += lit;
+        if (!offset)
+            return op;
+        *op++ = static_cast<std::uint8_t>(offset);
+        *op++ = static_cast<std::uint8_t>(offset >> 8);
+        mlen -= MIN_MATCH;
+        *token |= static_cast<std::uint8_t>(mlen < 15 ? mlen : 15);
+        if (mlen >= 15)
+            op = put_length(op, mlen - 15);
+        return op;
+    }
+
+    // A token's length field of 15 continues in the following bytes
+    inline bool get_length(const std::uint8_t*& ip, const std::uint8_t* end, std::uint32_t& n) {
+        std::uint8_t b;
+        do {
+            if (ip >= end)
+                return false;
+            b = *ip++;
+            n += b;
+        } while (b == 255);
+        return true;
+    }
+}
+
+// Greedy: each position is looked up once in the hash table of the last
+// position with the same 4 bytes; a run of misses speeds the scan up over
+// data that does not compress
+std::uint32_t lz_compress(const std::uint8_t* src, std::uint32_t len,
+                          std::uint8_t* dst, std::uint32_t cap, std::uint16_t* table) {
+    std::uint8_t* op = dst;
+    std::uint8_t* const end = dst + cap;
+    std::uint32_t anchor = 0;
+
+    if (len > MAX_OFFSET + 1)
+        return 0;
+    if (len > MATCH_LIMIT) {
+        std::memset(table, 0, LZ_HASH_ENTRIES * sizeof(*table));
+        std::uint32_t ip = 0, misses = 0;
+        while (ip + MATCH_LIMIT <= len) {
+            const std::uint32_t seq = read32(src + ip);
+            const std::uint32_t h = hash(seq);
+            const std::uint32_t ref = table[h];
+            table[h] = static_cast<std::uint16_t>(ip);
+            if (ref >= ip || read32(src + ref) != seq) {
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+            std::uint32_t mlen = MIN_MATCH;
+            while (ip + mlen < len - LAST_LITERALS && src[ref + mlen] == src[ip + mlen])
+                mlen++;
+            op = put_sequence(op, end, src + anchor, ip - anchor, ip - ref, mlen);
+            if (!op)
+                return 0;
+            ip += mlen;
+            anchor = ip;
+        }
+    }
+    op = put_sequence(op, end, src + anchor, len - anchor, 0, 0);
+    return op ? static_cast<std::uint32_t>(op - dst) : 0;
+}
+
+int lz_decompress(const std::uint8_t* src, std::uint32_t len,
+                  std::uint8_t* dst, std::uint32_t out_len) {
+    const std::uint8_t* ip = src;
+    const std::uint8_t* const iend = src + len;
+    std::uint8_t* op = dst;
+    std::uint8_t* const oend = dst + out_len;
+    // Decoding in place: output must never catch up with input unread
+    const bool shared = src < oend && dst < iend;
+
+    for (;;) {
+        if (ip >= iend)
+            return -1;
+        const std::uint8_t token = *ip++;
+        std::uint32_t lit = token >> 4;
+        if (lit == 15 && !get_length(ip, iend, lit))
+            return -1;
+        if (lit > static_cast<std::uint32_t>(iend - ip) || lit > static_cast<std::uint32_t>(oend - op) ||
+            (shared && op > ip))
+            return -1;
+        std::memmove(op, ip, lit);
+        op += lit;
+        ip += lit;
+        if (ip == iend)
+            return op == oend ? 0 : -1; // the last sequence has no match
+
+        if (iend - ip < 2)
+            return -1;
+        const std::uint32_t offset = ip[0] | static_cast<std::uint32_t>(ip[1]) << 8;
+        ip += 2;
+        std::uint32_t mlen = token & 15;
+        if (mlen == 15 && !get_length(ip, iend, mlen))
+            return -1;
+        mlen += MIN_MATCH;
+        if (!offset || offset > static_cast<std::uint32_t>(op - dst) ||
+            mlen > static_cast<std::uint32_t>(oend - op))
+            return -1;
+        if (shared && op + mlen > ip)
+            return -1;
+        const std::uint8_t* match = op - offset;
+        if (offset >= mlen) {
+            std::memcpy(op, match, mlen);
+            op += mlen;
+        } else {
+            while (mlen--)
+                *op++ = *match++;  // a repeat overlapping what it writes
+        }
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+
+// The LZ4 block format (no frame, no checksum): sequences of a token
+// (literal run length, match length - 4, 4 bits each, 15 meaning more
+// length bytes follow), the literals, and a 16-bit little-endian offset
+// back into the output. Decoding is a copy loop with no tables, fast
+// enough on the M0+ to run per cache window (CompressedSource).
+
+// Entries of the compressor's hash table (uint16_t each, 8 KB)
+constexpr std::uint32_t LZ_HASH_ENTRIES = 4096;
+
+// Extra bytes after a block's decoded size that let its compressed form
+// sit at the end of the same buffer and be decoded in place (the LZ4
+// in-place margin for a `compressed`-byte input)
+constexpr std::uint32_t lz_inplace_margin(std::uint32_t compressed) {
+    return (compressed >> 8) + 32;
+}
+
+// Compress src (at most 64 KB) into dst; the compressed size, or 0 if it
+// does not fit in cap bytes. `table` is LZ_HASH_ENTRIES of scratch.
+std::uint32_t lz_compress(const std::uint8_t* src, std::uint32_t len,
+                          std::uint8_t* dst, std::uint32_t cap, std::uint16_t* table);
+
+// Decode `len` bytes of src into exactly out_len bytes at dst; -1 if the
+// input is corrupt (never reads or writes outside the two ranges). dst
+// may overlap src when src ends at dst + out_len + lz_inplace_margin(len).
+int lz_decompress(const std::uint8_t* src, std::uint32_t len,
+                  std::uint8_t* dst, std::uint32_t out_len);
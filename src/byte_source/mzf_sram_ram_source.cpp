@@ -56,6 +56,14 @@ int Mzf2SramRamSource::getByte(std::uint8_t &out) {
     return 0;
 }
 
+int Mzf2SramRamSource::peekByte(std::uint8_t &out) {
+    if (pos_ < SRAM_HEADER_SIZE_)
+        out = header_[pos_];
+    else
+        out = base_[MZF_HEADER_SIZE_ + pos_ - SRAM_HEADER_SIZE_];
+    return 0;
+}
+
 int Mzf2SramRamSource::setByte(std::uint8_t in) {
     if (pos_ < SRAM_HEADER_SIZE_)
         header_[pos_] = in;
@@ -115,6 +123,25 @@ int Mzf2SramRamSource::set(const std::uint8_t *in, std::uint32_t n, std::uint32_
     return -1;
 }
 
+std::uint8_t* Mzf2SramRamSource::acquireSpan(std::uint32_t pos, std::uint32_t len,
+                                             bool writable, std::uint32_t& avail) {
+    avail = 0;
+    if (writable || pos >= transformed_size_ || !len)
+        return nullptr;
+    pos_ = pos;
+    const std::uint32_t left = (pos < SRAM_HEADER_SIZE_ ? SRAM_HEADER_SIZE_ : transformed_size_) - pos;
+    avail = (len < left) ? len : left;
+    if (pos < SRAM_HEADER_SIZE_)
+        return header_ + pos;
+    return base_ + MZF_HEADER_SIZE_ + pos - SRAM_HEADER_SIZE_;
+}
+
+void Mzf2SramRamSource::releaseSpan(std::uint32_t used) {
+    pos_ += used;
+    if (pos_ >= transformed_size_)
+        pos_ = 0;
+}
+
 int Mzf2SramRamSource::seek(std::uint32_t new_pos) {
     if (new_pos >= transformed_size_) return -1;
     pos_ = new_pos;
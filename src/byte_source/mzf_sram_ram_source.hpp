@@ -7,7 +7,7 @@
 #include "common.hpp"
 #include "byte_source.hpp"
 
-class Mzf2SramRamSource : public ByteSource {
+class Mzf2SramRamSource final : public ByteSource {
 public:
     Mzf2SramRamSource(std::uint8_t *data, std::uint32_t size);
 
@@ -17,6 +17,13 @@ public:
     RAM_FUNC int set(const std::uint8_t *in, std::uint32_t n, std::uint32_t& written) override;
     RAM_FUNC int seek(std::uint32_t new_pos) override;
     RAM_FUNC int next() override;
+    bool inMemory() const override { return true; }
+    RAM_FUNC int peekByte(std::uint8_t &out) override;
+    std::uint32_t size() const override { return transformed_size_; }
+    // The rebuilt header and the body are separate spans; read-only
+    RAM_FUNC std::uint8_t* acquireSpan(std::uint32_t pos, std::uint32_t len, bool writable,
+                                       std::uint32_t& avail) override;
+    RAM_FUNC void releaseSpan(std::uint32_t used) override;
 
 private:
     static const uint8_t MZF_HEADER_SIZE_ = 128;
@@ -32,6 +39,13 @@ private:
 };
 
 namespace ByteSourceFactory {
-    static inline int from_mzf_to_sram_ram(std::uint8_t* data, std::uint32_t size, std::unique_ptr<ByteSource> &out)
-        { out = std::make_unique<Mzf2SramRamSource>(data, size); return 0; }
+    // `typed`, if given, receives the source as its concrete type
+    static inline int from_mzf_to_sram_ram(std::uint8_t* data, std::uint32_t size, std::unique_ptr<ByteSource> &out,
+                                           Mzf2SramRamSource** typed = nullptr)
+    {
+        auto src = std::make_unique<Mzf2SramRamSource>(data, size);
+        if (typed) *typed = src.get();
+        out = std::move(src);
+        return 0;
+    }
 }
@@ -118,13 +118,17 @@ QDDirSource::QDDirSource(const std::string &path, std::uint32_t cache_size)
 : CachedSource(this, fetch, store, QD_MAX_SIZE, cache_size, /* wrap = */false),
   dir_(!path.empty() ? path : ""),
   count_block_len_(qd::kCountBlockLen) {
-    cur_.open = false;
+    pooled_ = FilePool::attach() == 0;
     build_index();
 }
 
 QDDirSource::~QDDirSource() {
+    settle_background();
     abortTemp();
-    close_open();
+    if (pooled_) {
+        close_open();
+        FilePool::detach();
+    }
     delete[] pair_prefix_; pair_prefix_ = nullptr;
     delete[] files_;       files_       = nullptr;
 }
@@ -370,13 +374,13 @@ void QDDirSource::wrDataEvent(std::uint8_t v) {
         } else if (wr_pos_ == 6) {
             wr_body_remaining_ |= static_cast<std::uint16_t>(v) << 8;
             ++wr_pos_;
-            if (wr_body_remaining_ == 0) finalizeSave(); // empty body
+            if (wr_body_remaining_ == 0) wr_stage_ = WR_SAVED; // empty body
         } else if (wr_pos_ > 6) {
             if (wr_file_open_) {
                 UINT bw = 0;
                 f_write(&wr_file_, &v, 1, &bw);
             }
-            if (--wr_body_remaining_ == 0) finalizeSave();
+            if (--wr_body_remaining_ == 0) wr_stage_ = WR_SAVED;
         } else {
             ++wr_pos_; // positions 3..4: A5 marker, block id
         }
@@ -508,24 +512,12 @@ int QDDirSource::fetch(void* ctx, std::uint32_t index,
 }
 
 int QDDirSource::ensure_open(const std::string& filename, FIL*& out) {
-    if (cur_.open && cur_.filename == filename) {
-        out = &cur_.f;
-        return 0;
-    }
-    close_open();
-    if (f_open(&cur_.f, build_full_path(filename), FA_READ) != FR_OK) return -1;
-    cur_.filename = filename;
-    cur_.open = true;
-    out = &cur_.f;
-    return 0;
+    out = FilePool::open(build_full_path(filename));
+    return out ? 0 : -1;
 }
 
 void QDDirSource::close_open() {
-    if (cur_.open) {
-        f_close(&cur_.f);
-        cur_.open = false;
-        cur_.filename.clear();
-    }
+    FilePool::dropDir(dir_);
 }
 
 int QDDirSource::fetch_bytes(std::uint32_t index, std::uint8_t* out,
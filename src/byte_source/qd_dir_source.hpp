@@ -5,6 +5,7 @@
 
 #include "ff.h"
 #include "cached_source.hpp"
+#include "file_pool.hpp"
 
 // Fixed QD stream size (media format capacity, == QDISK_FORMAT_SIZE)
 #define QD_MAX_SIZE 82958
@@ -17,6 +18,7 @@ public:
     // Writable through the save engine below (raw store() stays refused);
     // the QD device applies its own write protection from the ini flag
     bool readOnly() const override { return false; }
+    bool valid() const { return pooled_; }
 
     // ---- QD save engine: port of mz800emu's virtual-mode write path ----
     // The QD device feeds it SIO-level events; the engine parses the block
@@ -26,6 +28,12 @@ public:
     void wrAbortEvent();            // motor off: abandon an unfinished save
     void rdCountEvent();            // count byte is being read: fresh listing
 
+    // A body block is complete: the QD device runs finalizeSave() next,
+    // on core 0 for sd: directories (the FAT work takes tens of ms).
+    // The engine takes no events until then.
+    bool savePending() const { return wr_stage_ == WR_SAVED; }
+    void finalizeSave();
+
 private:
     enum WrStage : std::uint8_t {
         WR_IDLE = 0,   // reading / free area
@@ -33,6 +41,7 @@ private:
         WR_HEADER,     // header block payload -> wr_hdr_
         WR_BODY,       // body block payload -> temp file
         WR_FORMATTING, // format in progress: swallow the stream
+        WR_SAVED,      // body complete, finalizeSave() pending
     };
     WrStage       wr_stage_ = WR_IDLE;
     std::uint32_t wr_pos_ = 0;              // position within the current block
@@ -45,7 +54,6 @@ private:
     void rebuild();
     void openTemp();
     void abortTemp();
-    void finalizeSave();
     void doFormat();
     struct FileEntry {
         std::string   filename;
@@ -61,11 +69,7 @@ private:
 
     std::uint32_t count_block_len_;
 
-    struct OpenFile {
-        FIL         f{};
-        std::string filename{};
-        bool        open{false};
-    } cur_;
+    bool pooled_ = false;                   // attached to FilePool
 
     static int fetch(void* ctx, std::uint32_t index,
                      std::uint8_t* buf, std::uint32_t size, std::uint32_t& read);
@@ -79,6 +83,8 @@ private:
     void        build_index();
     const char* build_full_path(const std::string& filename);
 
+    // Read handles come from the shared FilePool; close_open() drops
+    // this directory's before its files change
     int  ensure_open(const std::string& filename, FIL*& out);
     void close_open();
 
@@ -89,8 +95,11 @@ private:
 namespace ByteSourceFactory {
     static inline int from_qddir(const std::string &path, std::uint32_t cache_size, std::unique_ptr<ByteSource>& out)
     {
-        out.reset(new (std::nothrow) QDDirSource(path, cache_size));
-        return out ? 0 : -1; // out of RAM
+        QDDirSource* src = new (std::nothrow) QDDirSource(path, cache_size);
+        if (!src) { out.reset(); return -1; } // out of RAM
+        const int ret = src->valid() ? 0 : -1;
+        out.reset(src);
+        return ret;
     }
 }
 
@@ -76,6 +76,27 @@ RAM_FUNC int RamSourceImpl<AUTO_INCREMENT>::next() {
     return 0;
 }
 
+template<bool AUTO_INCREMENT>
+RAM_FUNC std::uint8_t* RamSourceImpl<AUTO_INCREMENT>::acquireSpan(std::uint32_t pos, std::uint32_t len,
+                                                                  bool, std::uint32_t& avail) {
+    avail = 0;
+    if (pos >= size_ || !len)
+        return nullptr;
+    pos_ = pos;
+    const std::uint32_t left = size_ - pos;
+    avail = (len < left) ? len : left;
+    return base_ + pos;
+}
+
+template<bool AUTO_INCREMENT>
+RAM_FUNC void RamSourceImpl<AUTO_INCREMENT>::releaseSpan(std::uint32_t used) {
+    if constexpr (AUTO_INCREMENT) {
+        pos_ += used;
+        if (pos_ >= size_)
+            pos_ = 0;
+    }
+}
+
 // AUTO_INCREMENT=true: getByte auto-increments
 template<>
 RAM_FUNC int RamSourceImpl<true>::getByte(std::uint8_t &out) {
@@ -18,6 +18,12 @@ public:
     RAM_FUNC int set(const std::uint8_t *in, std::uint32_t size, std::uint32_t &written) override;
     RAM_FUNC int seek(std::uint32_t new_pos) override;
     RAM_FUNC int next() override;
+    bool inMemory() const override { return true; }
+    RAM_FUNC int peekByte(std::uint8_t &out) override { out = base_[pos_]; return 0; }
+    std::uint32_t size() const override { return size_; }
+    RAM_FUNC std::uint8_t* acquireSpan(std::uint32_t pos, std::uint32_t len, bool writable,
+                                       std::uint32_t& avail) override;
+    RAM_FUNC void releaseSpan(std::uint32_t used) override;
 
 protected:
     std::uint8_t* base_;
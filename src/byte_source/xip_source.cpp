@@ -0,0 +1,259 @@
+#include "xip_source.hpp"
+#include "file_source.hpp"
+#include "flash_fs.h"
+#include <cstring>
+#include <new>
+
+XipSource::XipSource(const std::string& path,
+                     std::uint32_t size,
+                     std::uint32_t cache_size,
+                     bool wrap,
+                     bool auto_increment,
+                     bool relocate)
+    : wrap_(wrap), path_(path), cache_size_(cache_size), auto_increment_(auto_increment)
+{
+#if FF_USE_FASTSEEK
+    FRESULT fr = f_open(&fil_, path.c_str(), FA_READ | FA_WRITE);
+    if (fr == FR_DENIED || fr == FR_WRITE_PROTECTED) {
+        fr = f_open(&fil_, path.c_str(), FA_READ);
+        read_only_ = true;
+    }
+    if (fr != FR_OK)
+        return;
+    open_ = true;
+    size_ = f_size(&fil_);
+    // A size to grow or truncate to is FileSource's job
+    if (fil_.obj.fs->pdrv != FLASH_FS_DRIVE || size_ == 0 || (size && size != size_))
+        return;
+    base_ = map_pages(relocate);
+#else
+    (void)path;
+    (void)size;
+    (void)relocate;
+#endif
+    pos_ = 0;
+}
+
+XipSource::~XipSource() {
+    if (open_) f_close(&fil_);
+}
+
+// The XIP address the file reads at, if its sectors follow each other
+// there. The cluster link map gives the fragments, each a run of sectors
+// from its first cluster's (FatFS clst2sect()).
+const std::uint8_t* XipSource::map_pages(bool relocate) {
+    DWORD* clmt = FileSource::link_map(fil_);
+    fil_.cltbl = nullptr;   // only read here
+    if (!clmt)
+        return nullptr;
+    const FATFS* fs = fil_.obj.fs;
+    const std::uint32_t runs_max = (clmt[0] - 1) / 2;
+    flash_fs_run* runs = new (std::nothrow) flash_fs_run[runs_max ? runs_max : 1];
+    std::uint32_t pages = (size_ + FLASH_FS_PAGE_SIZE - 1) / FLASH_FS_PAGE_SIZE;
+    std::uint32_t count = 0;
+    bool ok = runs != nullptr;
+    for (std::uint32_t i = 1; ok && pages && clmt[i]; i += 2, count++) {
+        const LBA_t first = fs->database + (LBA_t)fs->csize * (clmt[i + 1] - 2);
+        std::uint32_t n = clmt[i] * fs->csize;
+        if (n > pages) n = pages;
+        ok = count < runs_max && first + n <= 0xFFFFu;
+        if (ok) runs[count] = { (std::uint16_t)first, (std::uint16_t)n };
+        pages -= n;
+    }
+    delete[] clmt;
+
+    const std::uint8_t* base = nullptr;
+    for (int attempt = 0; ok && !pages && attempt < 2 && !base; attempt++) {
+        if (attempt && (!relocate || !flash_fs_place_contiguous(runs, count)))
+            break;
+        base = flash_fs_xip_address(runs[0].first);
+        const std::uint8_t* next = base;
+        for (std::uint32_t r = 0; next && r < count; r++) {
+            for (std::uint32_t j = 0; j < runs[r].count; j++, next += FLASH_FS_PAGE_SIZE) {
+                if (flash_fs_xip_address((std::uint16_t)(runs[r].first + j)) != next) {
+                    next = base = nullptr;
+                    break;
+                }
+            }
+        }
+    }
+    delete[] runs;
+    return base;
+}
+
+int XipSource::reopen() {
+    if (file_)
+        return 0;
+    if (read_only_ || !open_)
+        return -1;
+    f_close(&fil_);
+    open_ = false;
+    if (ByteSourceFactory::from_file(path_, 0, cache_size_, wrap_, file_, auto_increment_) != 0) {
+        file_.reset();
+        // Back to reading in place: the pages have not moved
+        open_ = f_open(&fil_, path_.c_str(), FA_READ) == FR_OK;
+        read_only_ = true;
+        return -1;
+    }
+    if (pos_ < size_)
+        file_->seek(pos_);
+    return 0;
+}
+
+int XipSource::seek(std::uint32_t new_pos) {
+    if (file_)
+        return track(file_->seek(new_pos));
+    if (new_pos >= size_)
+        return -1;
+    pos_ = new_pos;
+    return 0;
+}
+
+int XipSource::flush() {
+    return file_ ? file_->flush() : 0;
+}
+
+int XipSource::resize(std::uint32_t new_size) {
+    if (reopen() != 0)
+        return -1;
+    const int ret = file_->resize(new_size);
+    size_ = file_->size();
+    return track(ret);
+}
+
+int XipSource::setCacheLines(std::uint8_t lines, std::uint8_t ways) {
+    return file_ ? file_->setCacheLines(lines, ways) : -1;
+}
+
+int XipSource::setReadAhead(const BackgroundIo* io) {
+    return file_ ? file_->setReadAhead(io) : -1;
+}
+
+int XipSource::setWriteBehind(const BackgroundIo* io, WriteBehind mode) {
+    return file_ ? file_->setWriteBehind(io, mode) : -1;
+}
+
+bool XipSource::cacheStats(CacheStats& out) const {
+    return file_ && file_->cacheStats(out);
+}
+
+template<bool AUTO_INCREMENT>
+RAM_FUNC int XipSourceImpl<AUTO_INCREMENT>::getByte(std::uint8_t &out) {
+    if (file_)
+        return track(file_->getByte(out));
+    if (pos_ >= size_)
+        return -1;  // past the end, not wrapping
+    out = base_[pos_];
+    if constexpr (AUTO_INCREMENT) step(1);
+    return 0;
+}
+
+template<bool AUTO_INCREMENT>
+RAM_FUNC int XipSourceImpl<AUTO_INCREMENT>::setByte(std::uint8_t in) {
+    if (reopen() != 0)
+        return -1;
+    return track(file_->setByte(in));
+}
+
+template<bool AUTO_INCREMENT>
+RAM_FUNC int XipSourceImpl<AUTO_INCREMENT>::get(std::uint8_t *out, std::uint32_t size,
+                                                std::uint32_t &read) {
+    if (file_)
+        return track(file_->get(out, size, read));
+    read = 0;
+    std::uint32_t p = pos_;
+    while (read < size && p < size_) {
+        std::uint32_t chunk = size_ - p;
+        if (chunk > size - read) chunk = size - read;
+        std::memcpy(out + read, base_ + p, chunk);
+        read += chunk;
+        p += chunk;
+        if (wrap_ && p >= size_)
+            p = 0;
+    }
+    if constexpr (AUTO_INCREMENT) pos_ = p;
+    return 0;
+}
+
+template<bool AUTO_INCREMENT>
+RAM_FUNC int XipSourceImpl<AUTO_INCREMENT>::set(const std::uint8_t *in, std::uint32_t size,
+                                                std::uint32_t &written) {
+    written = 0;
+    if (reopen() != 0)
+        return -1;
+    return track(file_->set(in, size, written));
+}
+
+template<bool AUTO_INCREMENT>
+RAM_FUNC int XipSourceImpl<AUTO_INCREMENT>::next() {
+    if (file_)
+        return track(file_->next());
+    if (!wrap_ && pos_ + 1 >= size_)
+        return -1;
+    step(1);
+    return 0;
+}
+
+template<bool AUTO_INCREMENT>
+RAM_FUNC int XipSourceImpl<AUTO_INCREMENT>::peekByte(std::uint8_t &out) {
+    if (file_)
+        return file_->peekByte(out);
+    if (pos_ >= size_)
+        return -1;
+    out = base_[pos_];
+    return 0;
+}
+
+template<bool AUTO_INCREMENT>
+RAM_FUNC std::uint8_t* XipSourceImpl<AUTO_INCREMENT>::acquireSpan(std::uint32_t pos, std::uint32_t len,
+                                                                 bool writable, std::uint32_t& avail) {
+    avail = 0;
+    if (writable && reopen() != 0)
+        return nullptr;
+    if (file_) {
+        std::uint8_t* span = file_->acquireSpan(pos, len, writable, avail);
+        track(0);
+        return span;
+    }
+    if (pos >= size_ || !len)
+        return nullptr;
+    pos_ = pos;
+    const std::uint32_t left = size_ - pos;
+    avail = (len < left) ? len : left;
+    // Never written through: reads only (see ByteSource::acquireSpan)
+    return const_cast<std::uint8_t*>(base_ + pos);
+}
+
+template<bool AUTO_INCREMENT>
+RAM_FUNC void XipSourceImpl<AUTO_INCREMENT>::releaseSpan(std::uint32_t used) {
+    if (file_) {
+        file_->releaseSpan(used);
+        track(0);
+        return;
+    }
+    if constexpr (AUTO_INCREMENT) step(used);
+}
+
+template class XipSourceImpl<true>;
+template class XipSourceImpl<false>;
+
+int ByteSourceFactory::from_flash_xip(const std::string &path,
+                                      std::uint32_t size,
+                                      std::uint32_t cache_size,
+                                      bool wrap,
+                                      std::unique_ptr<ByteSource> &out,
+                                      bool auto_increment,
+                                      bool relocate)
+{
+    XipSource* xs;
+    if (auto_increment)
+        xs = new (std::nothrow) XipSourceImpl<true>(path, size, cache_size, wrap, relocate);
+    else
+        xs = new (std::nothrow) XipSourceImpl<false>(path, size, cache_size, wrap, relocate);
+    if (!xs || !xs->valid()) {
+        delete xs; // closes the file
+        return -1;
+    }
+    out.reset(xs);
+    return 0;
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <memory>
+#include "ff.h"
+#include "common.hpp"
+#include "byte_source.hpp"
+
+// A file image on the flash: volume read in place. flash_fs keeps every
+// 512-byte FAT sector on a flash page of its own, and the flash is memory
+// mapped (XIP), so when the file's sectors - fragment by fragment, through
+// its cluster link map - sit on consecutive pages the whole image is one
+// block of XIP flash, read like a RamSource: no cache window, no FatFS and
+// no copy per byte. With `relocate` the pages are first moved there if
+// they are not (flash_fs_place_contiguous: an erase per 4 KB of image,
+// once - they stay put until written).
+//
+// The file stays open, as a FileSource would keep it. The first write
+// (or resize()) goes the normal way: it closes the file, reopens it as a
+// FileSource, and from then on every call is passed to that - a written
+// sector moves to a new page, so the XIP view is never read again.
+class XipSource : public ByteSource {
+public:
+    ~XipSource();
+
+    int seek(std::uint32_t new_pos) override;
+    int flush() override;
+    std::uint32_t size() const override { return size_; }
+    int resize(std::uint32_t new_size) override;
+    bool readOnly() const override { return read_only_; }
+    bool inMemory() const override { return !file_; }
+    int setCacheLines(std::uint8_t lines, std::uint8_t ways) override;
+    int setReadAhead(const BackgroundIo* io) override;
+    int setWriteBehind(const BackgroundIo* io, WriteBehind mode) override;
+    bool cacheStats(CacheStats& out) const override;
+    bool valid() const { return base_ != nullptr; }
+
+protected:
+    XipSource(const std::string& path,
+              std::uint32_t size,
+              std::uint32_t cache_size,
+              bool wrap,
+              bool auto_increment,
+              bool relocate);
+
+    // Switch to the FileSource, at pos_; -1 if read-only or it won't open
+    int reopen();
+    // pos_ + n, wrapped like CachedSource::step (n <= size_)
+    inline void step(std::uint32_t n) {
+        pos_ += n;
+        if (wrap_ && pos_ >= size_)
+            pos_ -= size_;
+    }
+    // After a call passed to the FileSource: tell() reads pos_
+    inline int track(int ret) {
+        pos_ = file_->tell();
+        return ret;
+    }
+
+    const std::uint8_t* base_ = nullptr;
+    std::uint32_t size_ = 0;
+    bool wrap_;
+    std::unique_ptr<ByteSource> file_;  // after the first write
+
+private:
+    const std::uint8_t* map_pages(bool relocate);
+
+    FIL fil_{};
+    std::string path_;
+    std::uint32_t cache_size_;
+    bool auto_increment_;
+    bool open_ = false;
+    bool read_only_ = false;
+};
+
+template<bool AUTO_INCREMENT = true>
+class XipSourceImpl final : public XipSource {
+public:
+    XipSourceImpl(const std::string& path, std::uint32_t size, std::uint32_t cache_size,
+                  bool wrap, bool relocate)
+        : XipSource(path, size, cache_size, wrap, AUTO_INCREMENT, relocate) {}
+
+    RAM_FUNC int getByte(std::uint8_t &out) override;
+    RAM_FUNC int setByte(std::uint8_t in) override;
+    RAM_FUNC int get(std::uint8_t *out, std::uint32_t size, std::uint32_t &read) override;
+    RAM_FUNC int set(const std::uint8_t *in, std::uint32_t size, std::uint32_t &written) override;
+    RAM_FUNC int next() override;
+    RAM_FUNC int peekByte(std::uint8_t &out) override;
+    // Read spans point into the flash; a writable one is the FileSource's
+    RAM_FUNC std::uint8_t* acquireSpan(std::uint32_t pos, std::uint32_t len, bool writable,
+                                       std::uint32_t& avail) override;
+    RAM_FUNC void releaseSpan(std::uint32_t used) override;
+};
+
+namespace ByteSourceFactory {
+    // A file on flash: read in place if its pages allow (see XipSource);
+    // -1 with nothing left open otherwise - not on flash:, missing, empty,
+    // of another size than `size` (0: any), fragmented past a cluster map
+    // or its pages scattered - for the caller to use from_file()
+    int from_flash_xip(const std::string &path,
+                       std::uint32_t size,
+                       std::uint32_t cache_size,
+                       bool wrap,
+                       std::unique_ptr<ByteSource> &out,
+                       bool auto_increment = true,
+                       bool relocate = false);
+}
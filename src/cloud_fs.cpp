@@ -28,6 +28,9 @@ CloudWifiState cloud_wifi_state(void) {
 #include "device.hpp"
 #include "file.hpp"
 #include "i2s_audio.hpp"
+#include "bus_trace.hpp"
+#include "work_queue.hpp"
+#include "core_load.hpp"
 
 
 // ---- Default credentials (override via cloud_wifi_set_config before cloud_init) ----
@@ -231,12 +234,14 @@ bool cloud_submit_command(PicoMgr *mgr, bool list_dir, const char *path) {
 static void handle_cloud_command(void) {
     if (!g_cloud_cmd.pending) return;
     g_cloud_cmd.pending = false;
+    uint8_t task = core_load_enter(CORE_LOAD_CLOUD);
 
     int ret = g_cloud_cmd.list_dir
         ? cloud_read_directory(g_cloud_cmd.path, g_cloud_cmd.mgr)
         : cloud_mount_file(g_cloud_cmd.path, g_cloud_cmd.mgr);
 
     g_cloud_cmd.mgr->asyncComplete(ret);
+    core_load_enter(task);
 }
 
 static void handle_reconnect_request(void) {
@@ -254,10 +259,13 @@ static void handle_reconnect_request(void) {
 }
 
 static void core0_poll_loop(void) {
+    core_load_init();
     while (!shutting_down) {
+        core_load_poll();
         // Process audio sources with minimal latency (must be on core0)
         i2s_audio_poll();
         
+        uint8_t task = core_load_enter(CORE_LOAD_WIFI);
         if (is_wifi_connecting()) {
             wifi_state_machine();
         } else if (g_state == CloudWifiState::CONNECTED) {
@@ -266,9 +274,12 @@ static void core0_poll_loop(void) {
             }
             handle_reconnect_request();
         }
+        core_load_enter(task);
         // Run in every state: a command queued while WiFi is down must
         // fail fast (the Z80 is polling IN_PROGRESS on the status port)
         handle_cloud_command();
+        work_poll();
+        bus_trace_poll();
         tight_loop_contents();
     }
 }
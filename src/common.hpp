@@ -4,7 +4,13 @@
 
 //#define ALWAYS_INLINE static inline __attribute__((always_inline))
 #define ALWAYS_INLINE inline __attribute__((always_inline))
+#ifdef MZPICO_HOST
+// Host build (host/): there is no SRAM/XIP split, and a data section is
+// not executable on the host - keep handlers in .text
+#define RAM_FUNC __attribute__((noinline))
+#else
 #define RAM_FUNC __attribute__((section(".data.ram_func"))) __attribute__((noinline))
+#endif
 
 inline uint16_t read_u16_le(const uint8_t* p) {
     return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "config.hpp"
 #include "device.hpp"
 #include "pico_mgr.hpp"
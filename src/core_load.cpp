@@ -0,0 +1,98 @@
+#include <cstring>
+
+#include "core_load.hpp"
+
+static const char* const task_names[CORE_LOAD_TASKS] = {
+    "idle", "audio", "wifi", "rest", "cloud", "work",
+};
+
+const char* core_load_task_name(uint8_t task) {
+    return task < CORE_LOAD_TASKS ? task_names[task] : "?";
+}
+
+#ifdef CORE_LOAD
+
+#include "i2s_audio.hpp"
+#include "bus_stats.hpp"
+
+volatile uint32_t core_load_polls = 0;
+uint8_t core_load_task = CORE_LOAD_IDLE;
+uint32_t core_load_mark_us = 0;
+uint32_t core_load_us[CORE_LOAD_TASKS];
+uint32_t core_load_window_start = 0;
+
+CoreLoadWindow core_load_hist[CORE_LOAD_SECONDS];
+uint8_t core_load_head = 0;
+uint32_t core_load_poll_ref = 0;
+
+// Counter values at the last window close
+static uint32_t last_polls, last_busy1, last_underruns;
+
+void core_load_init(void) {
+    uint32_t now = time_us_32();
+    core_load_mark_us = now;
+    core_load_window_start = now;
+    memset(core_load_us, 0, sizeof(core_load_us));
+    last_polls = core_load_polls;
+    last_underruns = i2s_audio_underruns();
+    #ifdef BUS_STATS
+    last_busy1 = bus_stats_busy;
+    #endif
+}
+
+void core_load_close_window(uint32_t now) {
+    core_load_enter(core_load_task); // charge the running task up to now
+    CoreLoadWindow& w = core_load_hist[core_load_head];
+    w.window_us = now - core_load_window_start;
+    memcpy(w.us, core_load_us, sizeof(w.us));
+    memset(core_load_us, 0, sizeof(core_load_us));
+
+    uint32_t polls = core_load_polls;
+    w.polls = polls - last_polls;
+    last_polls = polls;
+    uint32_t underruns = i2s_audio_underruns();
+    w.underruns = underruns - last_underruns;
+    last_underruns = underruns;
+    #ifdef BUS_STATS
+    uint32_t busy1 = bus_stats_busy;
+    w.busy1 = busy1 - last_busy1;
+    last_busy1 = busy1;
+    #endif
+
+    // Reference: empty polls per full second, the most seen so far
+    uint32_t rate = (uint32_t)((uint64_t)w.polls * CORE_LOAD_WINDOW_US / w.window_us);
+    if (rate > core_load_poll_ref)
+        core_load_poll_ref = rate;
+
+    core_load_head = (core_load_head + 1) % CORE_LOAD_SECONDS;
+    core_load_window_start = now;
+}
+
+uint8_t core_load_sum(uint8_t seconds, CoreLoadWindow& out) {
+    memset(&out, 0, sizeof(out));
+    uint8_t n = 0;
+    uint8_t i = core_load_head;
+    while (n < seconds && n < CORE_LOAD_SECONDS) {
+        i = (i + CORE_LOAD_SECONDS - 1) % CORE_LOAD_SECONDS;
+        const CoreLoadWindow& w = core_load_hist[i];
+        if (!w.window_us)
+            break;
+        out.window_us += w.window_us;
+        for (uint8_t t = 0; t < CORE_LOAD_TASKS; t++)
+            out.us[t] += w.us[t];
+        out.polls += w.polls;
+        out.busy1 += w.busy1;
+        out.underruns += w.underruns;
+        n++;
+    }
+    return n;
+}
+
+uint32_t core_load_core1_permille(const CoreLoadWindow& w) {
+    uint64_t full = (uint64_t)core_load_poll_ref * w.window_us / CORE_LOAD_WINDOW_US;
+    if (!full || w.polls >= full)
+        return 0;
+    return (uint32_t)(1000 - (uint64_t)w.polls * 1000 / full);
+}
+
+#endif // CORE_LOAD
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "common.hpp"
+
+// Busy/idle time of both cores, on by default (-DCORE_LOAD=OFF compiles it
+// out): how much headroom core 0 has left for PSG/CTC audio, WiFi and REST
+// together, and whether audio underruns coincide with load spikes.
+//
+// Core 0 charges the time between two marks (1MHz timer) to the task that
+// was running: every poll loop iteration starts as idle, and i2s_audio,
+// the WiFi poll, REST requests (inside the WiFi poll), cloud commands and
+// deferred work switch to their own task only while they have something
+// to do (core_load_enter, nestable). Whatever is not charged to a task -
+// the loop itself, empty polls, the bus trace writer - is idle.
+//
+// Core 1 must not read a clock on its hot path: listen_loop() counts its
+// empty polls instead (both PIO FIFOs empty, nothing to reap), and its
+// busy share is the fraction of polls missing against the idlest second
+// seen since boot (the Z80 is mostly quiet on I/O right after the IPL
+// probe, so the reference settles within the first seconds). With
+// BUS_STATS the time core 1 spent in bus cycles is also counted exactly
+// (bus_stats_busy, clk_sys cycles).
+//
+// Core 0 closes a one-second window on the first poll past the second and
+// keeps the last CORE_LOAD_SECONDS of them; a window a long cloud exchange
+// stretched says so in window_us. Read by PicoMgr (REPO_CMD_GET_CORE_LOAD)
+// on core 1 and /api/status on core 0; a reader racing the window close
+// sees at worst one second's skew.
+
+constexpr uint8_t CORE_LOAD_SECONDS = 10;
+constexpr uint32_t CORE_LOAD_WINDOW_US = 1000000;
+
+enum CoreLoadTask : uint8_t {
+    CORE_LOAD_IDLE,
+    CORE_LOAD_AUDIO,    // i2s_audio_poll: PSG/CTC writes and rendering
+    CORE_LOAD_WIFI,     // WiFi state machine and cyw43_arch_poll (lwIP)
+    CORE_LOAD_REST,     // REST request handling, within the WiFi poll
+    CORE_LOAD_CLOUD,    // cloud LIST_DIR/MOUNT, HTTP exchange included
+    CORE_LOAD_WORK,     // deferred FatFS work for core 1 (work_queue.hpp)
+    CORE_LOAD_TASKS
+};
+
+struct CoreLoadWindow {
+    uint32_t window_us;                 // 0: not filled yet
+    uint32_t us[CORE_LOAD_TASKS];       // core 0, per task
+    uint32_t polls;                     // core 1 empty polls
+    uint32_t busy1;                     // core 1 bus cycles, clk_sys (BUS_STATS)
+    uint32_t underruns;                 // I2S buffers replayed
+};
+
+// Task name for reports ("idle", "audio", ...)
+const char* core_load_task_name(uint8_t task);
+
+#ifdef CORE_LOAD
+
+#include "hardware/timer.h"
+
+extern volatile uint32_t core_load_polls;
+extern uint8_t core_load_task;
+extern uint32_t core_load_mark_us;
+extern uint32_t core_load_us[CORE_LOAD_TASKS];
+extern uint32_t core_load_window_start;
+
+extern CoreLoadWindow core_load_hist[CORE_LOAD_SECONDS];
+extern uint8_t core_load_head;          // next slot to fill
+extern uint32_t core_load_poll_ref;     // most empty polls per second seen
+
+// Core 1, listen_loop()'s idle branch
+ALWAYS_INLINE void core_load_idle(void) {
+    core_load_polls = core_load_polls + 1;
+}
+
+// Core 0: charge the time since the last mark to the running task and
+// switch to `task`; returns the task to switch back to
+ALWAYS_INLINE uint8_t core_load_enter(uint8_t task) {
+    uint32_t now = time_us_32();
+    uint8_t prev = core_load_task;
+    core_load_us[prev] += now - core_load_mark_us;
+    core_load_mark_us = now;
+    core_load_task = task;
+    return prev;
+}
+
+// Core 0, before its poll loop
+void core_load_init(void);
+
+void core_load_close_window(uint32_t now);
+
+// Core 0, once per poll loop iteration
+ALWAYS_INLINE void core_load_poll(void) {
+    uint32_t now = time_us_32();
+    if (now - core_load_window_start >= CORE_LOAD_WINDOW_US)
+        core_load_close_window(now);
+}
+
+// The newest `seconds` windows added up (fewer while the history fills);
+// returns how many were summed
+uint8_t core_load_sum(uint8_t seconds, CoreLoadWindow& out);
+
+// Core 1 busy share of `w` in permille, from its empty polls
+uint32_t core_load_core1_permille(const CoreLoadWindow& w);
+
+#else
+
+ALWAYS_INLINE void core_load_idle(void) {}
+ALWAYS_INLINE uint8_t core_load_enter(uint8_t) { return CORE_LOAD_IDLE; }
+ALWAYS_INLINE void core_load_init(void) {}
+ALWAYS_INLINE void core_load_poll(void) {}
+
+#endif // CORE_LOAD
@@ -1,7 +1,6 @@
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
-#include <vector>
-#include <sstream>
 
 #include "pico/stdlib.h"
 #include "pico/multicore.h"
@@ -27,6 +26,12 @@
 #include "mz_devices.hpp"
 #include "fdc.hpp"
 #include "mem_snoop.hpp"
+#include "bus_trace.hpp"
+#include "bus_stats.hpp"
+#include "boot_prof.hpp"
+#include "work_queue.hpp"
+#include "hot_config.hpp"
+#include "core_load.hpp"
 
 #include "i2s_audio.hpp"
 
@@ -107,7 +112,6 @@ void blink(uint8_t cnt) {
 // interrupt asserted and this handler storms, starving the SIO lockout
 // IRQ (lower exception number wins on M0+). Historically masked because
 // the handler rebooted without returning.
-static volatile bool soft_reset_pending = false;
 static volatile uint32_t last_soft_reset_ms = 0;
 static volatile uint32_t last_reset_irq_ms = 0;
 
@@ -124,16 +128,17 @@ RAM_FUNC static void reset_handler(void) {
     last_reset_irq_ms = now;
     if (prev != 0 && (now - prev) < 500) return;
 
-    if (soft_reset_pending ||
+    if (core1_events.ev[CORE1_EV_SOFT_RESET] ||
         (last_soft_reset_ms != 0 && (now - last_soft_reset_ms) < 3000)) {
         // Escape hatch: full reboot with the old immediate semantics
         shutting_down = true;
         watchdog_enable(8000, 1); // wedge backstop should the flush hang
+        work_run_pending();
         MZDeviceManager::flushAll();
         watchdog_reboot(0, 0, 0);
         return;
     }
-    soft_reset_pending = true;
+    core1_events.ev[CORE1_EV_SOFT_RESET] = 1;
 }
 
 // Flush stale captures and restart the bus SMs from their entry points.
@@ -163,7 +168,17 @@ RAM_FUNC static void listen_loop(void) {
     restart_bus_sms();
 
     // Ensure the flat fast-path tables reflect the final device config
+    uint32_t t_boot = boot_prof_now();
     MZDeviceManager::buildFlatTables();
+    boot_prof_phase(BOOT_PHASE_FLAT_TABLES, t_boot);
+    bus_trace_start();
+    #ifdef BUS_STATS
+    bus_stats_init();
+    #endif
+    boot_prof_listen();
+    // The live dispatch table, held locally (one load per cycle, like the
+    // static table it replaced); only hot_config_apply() below swaps it
+    MZDeviceManager::PortDispatch* ports = MZDeviceManager::flatPorts;
 
     // Hot path: flat single-listener dispatch in v0.2.0 shape and order.
     // The lookups before set_exwait() are timing-critical: the Z80 samples
@@ -172,22 +187,65 @@ RAM_FUNC static void listen_loop(void) {
     while (true) {
         if (!pio_sm_is_rx_fifo_empty(pio, SM_READ)) {
             low_addr = pio_sm_get(pio, SM_READ) >> 24;
-            auto fn = MZDeviceManager::flatReadFn[low_addr];
-            if (fn) {
-                MZDevice* dev = MZDeviceManager::flatReadDev[low_addr];
-                if (MZDeviceManager::flatExwait[low_addr]) set_exwait();
+            #ifdef BUS_STATS
+            uint32_t t_pop = bus_stats_now();
+            #endif
+            MZDeviceManager::PortDispatch& d = ports[low_addr];
+            uint16_t staged = d.staged;
+            if (staged) {
+                // Pre-staged response (MZDeviceManager::stageRead): drive it
+                // at once without EXWAIT; the handler advances the device
+                // and stages the next byte after the Z80 has moved on
+                d.staged = 0;
+                data = (uint8_t)staged;
+                acquire_data_bus_for_writing();
+                write_data_bus(data);
+                #ifdef BUS_STATS
+                uint32_t t_drive = bus_stats_now();
+                #endif
+                #ifdef BOARD_DELUXE
+                high_addr = pio_sm_get_blocking(pio, SM_READ) >> 24;
+                #endif
+                while (!(sio_hw->gpio_in & (1u << IORQ_PIN)));
+                release_data_bus();
+
+                int ret = d.read(d.readDev, low_addr, &data, high_addr);
+                if (MZDeviceManager::portInterrupt(d.readFlags, d.readDev, ret)) set_interrupt();
+                #ifdef BUS_STATS
+                bus_stats_record(low_addr, t_pop, t_drive, t_drive);
+                #endif
+                #ifdef BUS_TRACE
+                bus_trace_record(false, low_addr, high_addr, (uint8_t)staged);
+                #endif
+            }
+            else if (d.read) {
+                uint8_t flags = d.readFlags;
+                if (flags & MZDeviceManager::PORT_EXWAIT) set_exwait();
+                #ifdef BUS_STATS
+                uint32_t t_exwait = bus_stats_now();
+                #endif
                 #ifdef BOARD_DELUXE
                 // The high address arrives as a second FIFO word ~75ns after
                 // the low byte; popping it after set_exwait keeps the
                 // dispatch deadline unaffected by the second capture.
                 high_addr = pio_sm_get_blocking(pio, SM_READ) >> 24;
                 #endif
-                fn(dev, low_addr, &data, high_addr);
+                // Only a handler that can reach FatFS waits for the volume
+                if (flags & MZDeviceManager::PORT_FS)
+                    work_core1_enter((flags & MZDeviceManager::PORT_MULTI) ? nullptr : d.readDev);
+                int ret = d.read(d.readDev, low_addr, &data, high_addr);
+                if (flags & MZDeviceManager::PORT_FS) work_core1_leave();
                 acquire_data_bus_for_writing();
                 write_data_bus(data);
 
-                if (dev->isInterrupt()) set_interrupt();
-                if (MZDeviceManager::flatExwait[low_addr]) release_exwait();
+                if (MZDeviceManager::portInterrupt(flags, d.readDev, ret)) set_interrupt();
+                if (flags & MZDeviceManager::PORT_EXWAIT) release_exwait();
+                #ifdef BUS_STATS
+                bus_stats_record(low_addr, t_pop, t_exwait, bus_stats_now());
+                #endif
+                #ifdef BUS_TRACE
+                bus_trace_record(false, low_addr, high_addr, data);
+                #endif
                 while (!(sio_hw->gpio_in & (1u << IORQ_PIN)));
                 release_data_bus();
             }
@@ -210,10 +268,16 @@ RAM_FUNC static void listen_loop(void) {
             raw_bus = pio_sm_get(pio, SM_WRITE);
             low_addr = (raw_bus >> 16) & 0xFF;
             #endif
-            auto fn = MZDeviceManager::flatWriteFn[low_addr];
-            if (fn) {
-                MZDevice* dev = MZDeviceManager::flatWriteDev[low_addr];
-                if (MZDeviceManager::flatExwait[low_addr]) set_exwait();
+            #ifdef BUS_STATS
+            uint32_t t_pop = bus_stats_now();
+            #endif
+            const MZDeviceManager::PortDispatch& d = ports[low_addr];
+            if (d.write) {
+                uint8_t flags = d.writeFlags;
+                if (flags & MZDeviceManager::PORT_EXWAIT) set_exwait();
+                #ifdef BUS_STATS
+                uint32_t t_exwait = bus_stats_now();
+                #endif
                 #ifdef BOARD_DELUXE
                 // The PIO captures high address and data as further FIFO words,
                 // so the data byte is valid even if this loop runs late.
@@ -222,9 +286,18 @@ RAM_FUNC static void listen_loop(void) {
                 #else
                 data = (raw_bus >> 24) & 0xFF;
                 #endif
-                fn(dev, low_addr, data, high_addr);
-                if (dev->isInterrupt()) set_interrupt();
-                if (MZDeviceManager::flatExwait[low_addr]) release_exwait();
+                if (flags & MZDeviceManager::PORT_FS)
+                    work_core1_enter((flags & MZDeviceManager::PORT_MULTI) ? nullptr : d.writeDev);
+                int ret = d.write(d.writeDev, low_addr, data, high_addr);
+                if (flags & MZDeviceManager::PORT_FS) work_core1_leave();
+                if (MZDeviceManager::portInterrupt(flags, d.writeDev, ret)) set_interrupt();
+                if (flags & MZDeviceManager::PORT_EXWAIT) release_exwait();
+                #ifdef BUS_STATS
+                bus_stats_record(low_addr, t_pop, t_exwait, bus_stats_now());
+                #endif
+                #ifdef BUS_TRACE
+                bus_trace_record(true, low_addr, high_addr, data);
+                #endif
             }
             #ifdef BOARD_DELUXE
             else {
@@ -235,21 +308,49 @@ RAM_FUNC static void listen_loop(void) {
             }
             #endif
         }
-        else if (soft_reset_pending) {
-            // Z80 soft reset: the bus is quiet (Z80 held in reset), so
-            // this runs within the reset pulse. Devices return to
-            // power-on register state, mounted images and core 0 (WiFi
-            // association, audio) persist. Sound chips are deliberately
-            // untouched - like the real 8253/SN76489 they have no reset
-            // line; the monitor re-initializes them through the bus.
-            MZDeviceManager::flushAll();
-            MZDeviceManager::softResetAll();
-            restart_bus_sms();
-            release_exwait();
-            release_interrupt();
-            last_soft_reset_ms = to_ms_since_boot(get_absolute_time());
-            soft_reset_pending = false;
+        else if (core1_events.any) {
+            // Every idle event in one load (work_queue.hpp)
+            if (core1_event_take(CORE1_EV_WORK)) {
+                // Deferred work finished on core 0: completion callbacks
+                work_reap();
+            }
+            else if (core1_event_take(CORE1_EV_HOT_CONFIG)) {
+                // Runtime reconfiguration (PicoMgr or REST): applied
+                // between cycles with the Z80 held in /WAIT, so that no
+                // cycle arrives unanswered and is then dispatched late
+                // against the new table; a cycle it was held in is
+                // dispatched after the release like any other
+                set_exwait();
+                hot_config_apply();
+                ports = MZDeviceManager::flatPorts;
+                release_exwait();
+            }
+            else if (core1_events.ev[CORE1_EV_SOFT_RESET]) {
+                // Z80 soft reset: the bus is quiet (Z80 held in reset), so
+                // this runs within the reset pulse. Devices return to
+                // power-on register state, mounted images and core 0 (WiFi
+                // association, audio) persist. Sound chips are deliberately
+                // untouched - like the real 8253/SN76489 they have no reset
+                // line; the monitor re-initializes them through the bus.
+                // Deferred writes land first, the flush and reset see them
+                work_drain();
+                work_core1_enter(nullptr);
+                MZDeviceManager::flushAll();
+                MZDeviceManager::softResetAll();
+                work_core1_leave();
+                restart_bus_sms();
+                release_exwait();
+                release_interrupt();
+                last_soft_reset_ms = to_ms_since_boot(get_absolute_time());
+                // Raised until here: another reset meanwhile reboots
+                core1_events.ev[CORE1_EV_SOFT_RESET] = 0;
+            }
+        }
+        #ifdef CORE_LOAD
+        else {
+            core_load_idle();
         }
+        #endif
     }
 }
 
@@ -299,46 +400,44 @@ static void init_gpio(void) {
 
 }
 
-std::string stripTrailingNumbers(const std::string& s) {
-    size_t end = s.size();
-    while (end > 0 && std::isdigit(static_cast<unsigned char>(s[end - 1]))) {
-        --end;
-    }
-    return s.substr(0, end);
-}
+// The [menu] and [explorer] sections, copied into picoConfig for the
+// management device
+static void loadMenuConfig(dictionary* ini, const char* section) {
+    std::string sectionName = section;
+    SectionConfig config;
 
-static std::vector<uint8_t> parsePortsList(const char* s) {
-    std::vector<uint8_t> out;
-    if (!s || !*s) return out;
-    std::stringstream ss(s);
-    std::string tok;
-    while (std::getline(ss, tok, ',')) {
-        // Trim spaces
-        size_t start = tok.find_first_not_of(" \t\n\r");
-        size_t end   = tok.find_last_not_of(" \t\n\r");
-        if (start == std::string::npos) continue;
-        std::string val = tok.substr(start, end - start + 1);
-        // Support hex like 0xD8 or plain decimal
-        unsigned int num = 0;
-        if (val.size() > 2 && (val[0] == '0') && (val[1] == 'x' || val[1] == 'X')) {
-            std::stringstream hx;
-            hx << std::hex << val;
-            hx >> num;
-        } else {
-            num = static_cast<unsigned int>(std::strtoul(val.c_str(), nullptr, 0));
-        }
-        if (num <= 0xFF) out.push_back(static_cast<uint8_t>(num));
+    // Get number of keys in this section
+    int keyCount = iniparser_getsecnkeys(ini, section);
+    if (keyCount <= 0)
+        return;
+
+    // Allocate array to hold key pointers
+    const char **keys = new const char*[keyCount];
+
+    // Fill keys[]; function returns number of keys found
+    iniparser_getseckeys(ini, section, keys);
+
+    for (int k = 0; k < keyCount; ++k) {
+        std::string fullKey = keys[k] ? keys[k] : "";
+        std::string keyName = fullKey;
+
+        // Remove "section:" prefix
+        std::string prefix = sectionName + ":";
+        if (keyName.rfind(prefix, 0) == 0)
+            keyName = keyName.substr(prefix.length());
+
+        const char *value_cstr = iniparser_getstring(ini, fullKey.c_str(), "");
+        std::string value = value_cstr ? value_cstr : "";
+
+        config.emplace_back(keyName, value);
     }
-    return out;
+
+    delete[] keys;
+    picoConfig.emplace_back(sectionName, std::move(config));
 }
 
-// Helper to create consecutive port list from base_port and count
-static std::vector<uint8_t> createConsecutivePorts(uint8_t basePort, uint8_t count) {
-    std::vector<uint8_t> ports;
-    for (uint8_t i = 0; i < count; ++i) {
-        ports.push_back(basePort + i);
-    }
-    return ports;
+static bool isMenuSection(const char* section) {
+    return strcmp(section, "menu") == 0 || strcmp(section, "explorer") == 0;
 }
 
 void halt(void) {
@@ -350,132 +449,115 @@ void halt(void) {
 void device_main1(void) {
     // Ensure this core can be safely locked out during flash operations
     multicore_lockout_victim_init();
+    uint32_t t_boot = boot_prof_now();
     mount_devices();
+    boot_prof_phase(BOOT_PHASE_MOUNT, t_boot);
     // Clean up temporary cloud files: purge flash:/tmp directory on startup
 
     dictionary *ini = nullptr;
     FILINFO fno;
-    if (f_stat("sd:/mzpico.ini", &fno) == FR_OK) {
+    t_boot = boot_prof_now();
+    bool sd_ini = f_stat("sd:/mzpico.ini", &fno) == FR_OK;
+    boot_prof_phase(BOOT_PHASE_INI_STAT, t_boot);
+    t_boot = boot_prof_now();
+    if (sd_ini) {
         ini = iniparser_load("sd:/mzpico.ini");
     }
+    boot_prof_ini(ini != nullptr);
     if (!ini) {
         ini = iniparser_load("flash:/mzpico.ini");
     }
+    boot_prof_phase(BOOT_PHASE_INI_LOAD, t_boot);
     if (!ini) {
         halt();
     }
     int sectionNumber = iniparser_getnsec(ini);
 
+    // Devices first: this runs inside the power-on IPL race, and the
+    // path up to each device's own allocations (the object, then its
+    // buffers in readConfig) stays off the heap - fixed-size port lists
+    // and ini keys, and a compile-time device type table
+    char key[64];
+    uint32_t t_devices = boot_prof_now();
+    // Work a device defers from readConfig starts on core 0 once the
+    // loop is done with FatFS
+    work_core1_enter(nullptr);
     for (int i=0; i < sectionNumber; i++) {
-        std::string sectionName = iniparser_getsecname(ini, i);
-        if (sectionName == "menu" || sectionName == "explorer") {
-            SectionConfig config;
-
-            // Get number of keys in this section
-            int keyCount = iniparser_getsecnkeys(ini, sectionName.c_str());
-            if (keyCount <= 0)
-                continue;
-
-            // Allocate array to hold key pointers
-            const char **keys = new const char*[keyCount];
-
-            // Fill keys[]; function returns number of keys found
-            iniparser_getseckeys(ini, sectionName.c_str(), keys);
-
-            for (int k = 0; k < keyCount; ++k) {
-                std::string fullKey = keys[k] ? keys[k] : "";
-                std::string keyName = fullKey;
-
-                // Remove "section:" prefix
-                std::string prefix = sectionName + ":";
-                if (keyName.rfind(prefix, 0) == 0)
-                    keyName = keyName.substr(prefix.length());
-
-                const char *value_cstr = iniparser_getstring(ini, fullKey.c_str(), "");
-                std::string value = value_cstr ? value_cstr : "";
-
-                config.emplace_back(keyName, value);
-            }
-
-            delete[] keys;
-            picoConfig.emplace_back(sectionName, std::move(config));
-        } else { // devices
-            std::string devName = stripTrailingNumbers(sectionName);
-
-            MZDevice* dev = MZDeviceManager::createDevice(devName, sectionName);
-            if (!dev) {
-                // Unknown type OR the device object allocation failed
-                // (e.g. pico_mgr's 49KB buffer on a tight W heap). Keep
-                // booting, but leave a trace: a silently missing pico_mgr
-                // presents as a dead menu with no clue otherwise.
-                printf("%s: not created (unknown type or out of RAM)\n",
-                       sectionName.c_str());
-                continue;
-            }
-            if (!dev->supportedOnBoard()) {
-                // This board variant can't support the device (e.g. psg/ctc
-                // need the Deluxe I2S/snoop hardware). Skip it BEFORE port
-                // registration - a dead device must not consume one of the
-                // MAX_DEVICES_PER_PORT listener slots on a shared port -
-                // and keep booting: same policy as the out-of-RAM skip.
-                printf("%s: not supported on this board, skipping\n",
-                       sectionName.c_str());
-                MZDeviceManager::disableDevice(dev);
-                continue;
-            }
-            bool enabled = (bool)iniparser_getboolean(ini, (sectionName + ":enabled").c_str(), true);
-            if (!enabled)
-                MZDeviceManager::disableDevice(dev);
-
-            // Get explicit port configuration from INI
-            const char* read_ports_str  = iniparser_getstring(ini, (sectionName + ":read_ports").c_str(), "");
-            const char* write_ports_str = iniparser_getstring(ini, (sectionName + ":write_ports").c_str(), "");
-            auto read_ports  = parsePortsList(read_ports_str);
-            auto write_ports = parsePortsList(write_ports_str);
-
-            // If explicit lists not provided, try base_port shorthand
-            if (read_ports.empty() && write_ports.empty()) {
-                const char* base_port_str = iniparser_getstring(ini, (sectionName + ":base_port").c_str(), "");
-                if (base_port_str && *base_port_str) {
-                    // base_port provided: let device decide how to apply it
-                    uint8_t basePort = (uint8_t)std::strtoul(base_port_str, nullptr, 0);
-                    auto ports = dev->applyBasePort(basePort);
-                    read_ports = ports.first;
-                    write_ports = ports.second;
-                } else {
-                    // No config provided: use device defaults
-                    read_ports = dev->getReadPorts();
-                    write_ports = dev->getWritePorts();
-                }
-            }
-
-            // Configure device with resolved ports
-            int ret = MZDeviceManager::setPortsList(dev, read_ports, write_ports);
-            if (ret)
-                halt();
-
-            if (!enabled)
-                continue;
-            dev->init();
-            ret = dev->readConfig(ini);
-            if (ret == E_DEVICE_NO_MEMORY) {
-                // The device's RAM buffers don't fit this variant's heap
-                // (see the README RAM budget). Boot WITHOUT the device:
-                // the running machine (with this device missing from the
-                // explorer) is diagnosable, a halted boot is not.
-                MZDeviceManager::disableDevice(dev);
-                continue;
-            }
-            if (ret)
-                halt();
-            if (devName == "fdc")
-                fdc = (FDCDevice *)dev;
-            else if (devName == "qd")
-                qd = (QDDevice *)dev;
-            else if (devName == "psg")
-                (void)dev;
+        const char* sectionName = iniparser_getsecname(ini, i);
+        if (isMenuSection(sectionName))
+            continue;
+        std::string_view devName = MZDeviceManager::sectionDevType(sectionName);
+
+        MZDevice* dev = MZDeviceManager::createDevice(devName, sectionName);
+        if (!dev) {
+            // Unknown type OR the device object allocation failed
+            // (e.g. pico_mgr's 49KB buffer on a tight W heap). Keep
+            // booting, but leave a trace: a silently missing pico_mgr
+            // presents as a dead menu with no clue otherwise.
+            printf("%s: not created (unknown type or out of RAM)\n", sectionName);
+            continue;
+        }
+        if (!dev->supportedOnBoard()) {
+            // This board variant can't support the device (e.g. psg/ctc
+            // need the Deluxe I2S/snoop hardware). Skip it BEFORE port
+            // registration - a dead device must not consume one of the
+            // MAX_DEVICES_PER_PORT listener slots on a shared port -
+            // and keep booting: same policy as the out-of-RAM skip.
+            printf("%s: not supported on this board, skipping\n", sectionName);
+            MZDeviceManager::disableDevice(dev);
+            continue;
+        }
+        int prof = boot_prof_device(sectionName);
+        t_boot = boot_prof_now();
+        bool enabled = (bool)iniparser_getboolean(ini, MZDeviceManager::iniKey(key, sizeof(key), sectionName, "enabled"), true);
+        if (!enabled)
+            MZDeviceManager::disableDevice(dev);
+
+        // Ports from read_ports/write_ports, base_port or the defaults
+        PortList read_ports, write_ports;
+        if (MZDeviceManager::resolvePorts(dev, ini, sectionName, read_ports, write_ports))
+            halt();
+
+        // Configure device with resolved ports
+        int ret = MZDeviceManager::setPortsList(dev, read_ports, write_ports);
+        if (ret)
+            halt();
+        boot_prof_device_step(prof, BOOT_DEV_PORTS, t_boot);
+
+        if (!enabled)
+            continue;
+        t_boot = boot_prof_now();
+        dev->init();
+        boot_prof_device_step(prof, BOOT_DEV_INIT, t_boot);
+        t_boot = boot_prof_now();
+        ret = dev->readConfig(ini);
+        boot_prof_device_step(prof, BOOT_DEV_CONFIG, t_boot);
+        if (ret == E_DEVICE_NO_MEMORY) {
+            // The device's RAM buffers don't fit this variant's heap
+            // (see the README RAM budget). Boot WITHOUT the device:
+            // the running machine (with this device missing from the
+            // explorer) is diagnosable, a halted boot is not.
+            MZDeviceManager::disableDevice(dev);
+            continue;
         }
+        if (ret)
+            halt();
+        dev->setConfigured();
+        if (devName == FDC_ID)
+            fdc = (FDCDevice *)dev;
+        else if (devName == QD_ID)
+            qd = (QDDevice *)dev;
+    }
+    work_core1_leave();
+    boot_prof_phase(BOOT_PHASE_DEVICES, t_devices);
+
+    t_boot = boot_prof_now();
+    for (int i=0; i < sectionNumber; i++) {
+        const char* sectionName = iniparser_getsecname(ini, i);
+        if (isMenuSection(sectionName))
+            loadMenuConfig(ini, sectionName);
     }
+    boot_prof_phase(BOOT_PHASE_MENU, t_boot);
     
     // Signal core0 that device initialization is complete and audio sources are ready
     // Use memory barrier to ensure all writes are visible to core0
@@ -501,8 +583,12 @@ void device_main1(void) {
 }
 
 void device_main() {
+    uint32_t t_boot = boot_prof_now();
     set_sys_clock_khz(SYSCLOCK, true);
+    boot_prof_phase(BOOT_PHASE_CLOCK, t_boot);
+    t_boot = boot_prof_now();
     init_gpio();
+    boot_prof_phase(BOOT_PHASE_GPIO, t_boot);
 
 
     // Initialize lockout on this core before launching the other core
@@ -510,6 +596,7 @@ void device_main() {
 
     multicore_launch_core1(device_main1);
 
+    t_boot = boot_prof_now();
     #ifdef BOARD_DELUXE
         bus_read_prog_offset  = bus_read_deluxe_init(pio, SM_READ,  ADDR_BUS_BASE, RD_PIN);
         // The write program hosts two entry points; the restartable I/O
@@ -528,6 +615,7 @@ void device_main() {
     irq_set_exclusive_handler(PIO0_IRQ_0, reset_handler);
     irq_set_enabled(PIO0_IRQ_0, true);
     pio_set_irq0_source_enabled(pio0, pis_interrupt0, true);
+    boot_prof_phase(BOOT_PHASE_PIO, t_boot);
 
     // NOTE: the A8PicoCart-inherited cold-boot workaround lived here for
     // years: on a non-watchdog boot, busy_wait 100ms + watchdog_reboot, so
@@ -535,7 +623,8 @@ void device_main() {
     // telemetry showed (a) the first pass reaches a fully working
     // listen_loop anyway, and (b) the ~102ms it burned was most of the
     // power-on budget: the MZ-800's one-shot IPL boot probe lands ~180ms
-    // after power-on and readiness is ~71ms (2M) / ~97ms (16M) per pass -
+    // after power-on and readiness is ~71ms (2M) / ~97ms (16M) per pass
+    // (boot_prof.hpp now measures it on every boot) -
     // with the double boot, 2M builds won the race by ~10ms and 16M builds
     // deterministically LOST it (the field symptom: no menu at power-up,
     // works after one reset press). The Z80 soft-reset path provides the
@@ -567,8 +656,12 @@ void device_main() {
     cloud_init();
 #else
     // Without WiFi, core0 just processes audio sources in tight loop
+    core_load_init();
     while(1) {
+        core_load_poll();
         i2s_audio_poll();
+        work_poll();
+        bus_trace_poll();
         tight_loop_contents();
     }
 #endif
@@ -0,0 +1,126 @@
+#include "disk_cache.h"
+
+#if DISK_CACHE_BLOCKS
+
+#include <string.h>
+
+#define DISK_CACHE_SECTOR 512
+
+typedef struct {
+    uint32_t lba;
+    uint32_t used;          // LRU stamp
+    uint8_t pdrv;
+    bool valid;
+    bool meta;
+} CacheEntry;
+
+static uint8_t blocks[DISK_CACHE_BLOCKS][DISK_CACHE_SECTOR];
+static CacheEntry entries[DISK_CACHE_BLOCKS];
+static uint32_t meta_end[DISK_CACHE_DRIVES];
+static DiskCacheStats stats[DISK_CACHE_DRIVES];
+static uint32_t tick;
+
+static int find(uint8_t pdrv, uint32_t lba) {
+    for (int i = 0; i < DISK_CACHE_BLOCKS; i++)
+        if (entries[i].valid && entries[i].pdrv == pdrv && entries[i].lba == lba)
+            return i;
+    return -1;
+}
+
+// A free entry, else the one least recently used, metadata counting as
+// DISK_CACHE_META_BONUS accesses younger than it is
+static int victim(void) {
+    int best = 0;
+    uint32_t best_age = 0;
+    for (int i = 0; i < DISK_CACHE_BLOCKS; i++) {
+        if (!entries[i].valid)
+            return i;
+        uint32_t age = tick - entries[i].used;
+        if (entries[i].meta)
+            age = age > DISK_CACHE_META_BONUS ? age - DISK_CACHE_META_BONUS : 0;
+        if (age >= best_age) {
+            best = i;
+            best_age = age;
+        }
+    }
+    return best;
+}
+
+static void insert(uint8_t pdrv, uint32_t lba, const uint8_t *buf) {
+    const int i = victim();
+    if (entries[i].valid)
+        stats[entries[i].pdrv].evictions++;
+    memcpy(blocks[i], buf, DISK_CACHE_SECTOR);
+    entries[i].pdrv = pdrv;
+    entries[i].valid = true;
+    entries[i].lba = lba;
+    entries[i].used = ++tick;
+    entries[i].meta = lba < meta_end[pdrv];
+}
+
+bool disk_cache_read(uint8_t pdrv, uint32_t lba, uint8_t *buf) {
+    if (pdrv >= DISK_CACHE_DRIVES)
+        return false;
+    const int i = find(pdrv, lba);
+    if (i < 0) {
+        stats[pdrv].misses++;
+        return false;
+    }
+    memcpy(buf, blocks[i], DISK_CACHE_SECTOR);
+    entries[i].used = ++tick;
+    stats[pdrv].hits++;
+    if (entries[i].meta)
+        stats[pdrv].meta_hits++;
+    return true;
+}
+
+void disk_cache_fill(uint8_t pdrv, uint32_t lba, const uint8_t *buf) {
+    if (pdrv < DISK_CACHE_DRIVES && find(pdrv, lba) < 0)
+        insert(pdrv, lba, buf);
+}
+
+void disk_cache_write(uint8_t pdrv, uint32_t lba, const uint8_t *buf, uint32_t count) {
+    if (pdrv >= DISK_CACHE_DRIVES)
+        return;
+    for (uint32_t n = 0; n < count; n++, buf += DISK_CACHE_SECTOR) {
+        const int i = find(pdrv, lba + n);
+        if (i >= 0) {
+            memcpy(blocks[i], buf, DISK_CACHE_SECTOR);
+            entries[i].used = ++tick;
+        } else if (count == 1 && lba < meta_end[pdrv]) {
+            insert(pdrv, lba, buf);
+        }
+    }
+}
+
+void disk_cache_invalidate(uint8_t pdrv, uint32_t lba, uint32_t count) {
+    for (int i = 0; i < DISK_CACHE_BLOCKS; i++)
+        if (entries[i].pdrv == pdrv && entries[i].lba - lba < count)
+            entries[i].valid = false;
+}
+
+void disk_cache_invalidate_drive(uint8_t pdrv) {
+    for (int i = 0; i < DISK_CACHE_BLOCKS; i++)
+        if (entries[i].pdrv == pdrv)
+            entries[i].valid = false;
+}
+
+void disk_cache_set_meta_end(uint8_t pdrv, uint32_t lba) {
+    if (pdrv >= DISK_CACHE_DRIVES)
+        return;
+    meta_end[pdrv] = lba;
+    for (int i = 0; i < DISK_CACHE_BLOCKS; i++)
+        if (entries[i].pdrv == pdrv)
+            entries[i].meta = entries[i].lba < lba;
+}
+
+void disk_cache_get_stats(uint8_t pdrv, DiskCacheStats *out) {
+    if (pdrv < DISK_CACHE_DRIVES) *out = stats[pdrv];
+    else memset(out, 0, sizeof(*out));
+}
+
+void disk_cache_reset_stats(void) {
+    memset(stats, 0, sizeof(stats));
+}
+
+#endif
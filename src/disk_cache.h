@@ -0,0 +1,91 @@
+#ifndef __DISK_CACHE_H__
+#define __DISK_CACHE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// A small write-through cache of 512-byte sectors shared by the flash and
+// SD drives, below FatFS (fatfs_glue.c, fatfs_disk.c). FatFS keeps one
+// sector window per volume, so a directory listing, f_stat() or f_open()
+// and every FAT chain walk reread the same directory and FAT sectors over
+// SPI again and again; here they hit.
+//
+// Only single-sector reads are looked up and kept: FatFS reads its FAT
+// and directory sectors one at a time, while multi-sector reads are file
+// data going straight to the caller's buffer. Every write goes to the
+// drive first and then updates the sectors held, so a multi-sector read
+// that bypasses the cache still reads the same data. Replacement is LRU,
+// except that sectors below the volume's data area (the FATs, and the
+// root directory of FAT12/16) count as DISK_CACHE_META_BONUS accesses
+// younger: a burst of file data reads does not push them out.
+//
+// Like FatFS itself it is used by one core at a time (work_queue.hpp).
+// DISK_CACHE_BLOCKS=0 (CMake) compiles it out.
+
+#ifndef DISK_CACHE_BLOCKS
+#define DISK_CACHE_BLOCKS 16
+#endif
+#define DISK_CACHE_DRIVES 2
+#define DISK_CACHE_META_BONUS (4 * DISK_CACHE_BLOCKS)
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t meta_hits;     // of hits, in the FAT/root directory area
+    uint32_t evictions;
+} DiskCacheStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if DISK_CACHE_BLOCKS
+
+// Copy a held sector to buf; false (a miss) if it is not held
+bool disk_cache_read(uint8_t pdrv, uint32_t lba, uint8_t *buf);
+// A sector just read from the drive after a miss
+void disk_cache_fill(uint8_t pdrv, uint32_t lba, const uint8_t *buf);
+// Sectors just written to the drive: the held ones are updated, and a
+// metadata sector not held is kept, for FatFS to read back
+void disk_cache_write(uint8_t pdrv, uint32_t lba, const uint8_t *buf, uint32_t count);
+// Sectors whose content changed behind the cache (trim, a failed write)
+void disk_cache_invalidate(uint8_t pdrv, uint32_t lba, uint32_t count);
+// Every sector of a drive (card change, remount)
+void disk_cache_invalidate_drive(uint8_t pdrv);
+// Sectors below lba are metadata; FATFS::database, after f_mount()
+void disk_cache_set_meta_end(uint8_t pdrv, uint32_t lba);
+void disk_cache_get_stats(uint8_t pdrv, DiskCacheStats *out);
+void disk_cache_reset_stats(void);
+
+#else
+
+static inline bool disk_cache_read(uint8_t pdrv, uint32_t lba, uint8_t *buf) {
+    (void)pdrv; (void)lba; (void)buf;
+    return false;
+}
+static inline void disk_cache_fill(uint8_t pdrv, uint32_t lba, const uint8_t *buf) {
+    (void)pdrv; (void)lba; (void)buf;
+}
+static inline void disk_cache_write(uint8_t pdrv, uint32_t lba, const uint8_t *buf, uint32_t count) {
+    (void)pdrv; (void)lba; (void)buf; (void)count;
+}
+static inline void disk_cache_invalidate(uint8_t pdrv, uint32_t lba, uint32_t count) {
+    (void)pdrv; (void)lba; (void)count;
+}
+static inline void disk_cache_invalidate_drive(uint8_t pdrv) { (void)pdrv; }
+static inline void disk_cache_set_meta_end(uint8_t pdrv, uint32_t lba) {
+    (void)pdrv; (void)lba;
+}
+static inline void disk_cache_get_stats(uint8_t pdrv, DiskCacheStats *out) {
+    (void)pdrv;
+    out->hits = out->misses = out->meta_hits = out->evictions = 0;
+}
+static inline void disk_cache_reset_stats(void) {}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -15,6 +15,7 @@
 #include "ff.h"
 #include "diskio.h"
 #include "fatfs_disk.h"
+#include "disk_cache.h"
 
 #include <stdio.h>
 #include "pico/stdlib.h"
@@ -29,6 +30,7 @@ bool mount_fatfs_disk()
         return false;
 
     flashfs_is_mounted = true;
+    disk_cache_invalidate_drive(FLASH_FS_DRIVE);
     return true;
 }
 
@@ -38,6 +40,7 @@ void create_fatfs_disk()
 {
     flash_fs_create();
     flashfs_is_mounted = true;
+    disk_cache_invalidate_drive(FLASH_FS_DRIVE);
 
     // now create a fatfs on the flash_fs filesystem :-)
 
@@ -129,9 +132,13 @@ uint32_t fatfs_disk_read(uint8_t* buff, uint32_t sector, uint32_t count)
     if (sector >= flash_fs_num_fat_sectors())
 			return RES_PARERR;
 
+    if (count == 1 && disk_cache_read(FLASH_FS_DRIVE, sector, buff))
+        return RES_OK;
     /* copy data to buffer */
     for (int i=0; i<count; i++)
         flash_fs_read_FAT_sector(sector + i, buff + (i*SECTOR_SIZE));
+    if (count == 1)
+        disk_cache_fill(FLASH_FS_DRIVE, sector, buff);
     return RES_OK;
 }
 
@@ -144,14 +151,19 @@ uint32_t fatfs_disk_write(const uint8_t* buff, uint32_t sector, uint32_t count)
 
     /* copy data to buffer */
     for (int i=0; i<count; i++) {
-        if (!flash_fs_write_FAT_sector(sector + i, buff + (i*SECTOR_SIZE)))
+        // the cache holds what was there before sector + i
+        if (!flash_fs_write_FAT_sector(sector + i, buff + (i*SECTOR_SIZE))) {
+            disk_cache_invalidate(FLASH_FS_DRIVE, sector, i);
             return RES_ERROR; // volume full or out of range; old data intact
+        }
         // verify
         if (!flash_fs_verify_FAT_sector(sector + i, buff + (i*SECTOR_SIZE))) {
             printf("VERIFY ERROR!");
+            disk_cache_invalidate(FLASH_FS_DRIVE, sector, i + 1);
             return RES_ERROR;
         }
     }
+    disk_cache_write(FLASH_FS_DRIVE, sector, buff, count);
     return RES_OK;
 }
 
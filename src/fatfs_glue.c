@@ -25,6 +25,7 @@ specific language governing permissions and limitations under the License.
 #include "my_debug.h"
 #include "sd_card.h"
 #include "fatfs_disk.h"
+#include "disk_cache.h"
 //
 #include "diskio.h" /* Declarations of disk functions */
 
@@ -76,6 +77,7 @@ DSTATUS disk_initialize(
 
       sd_card_t *sd_card_p = sd_get_by_num(pdrv);
       if (!sd_card_p) return RES_PARERR;
+      disk_cache_invalidate_drive(DEV_SD);  // may be another card
       DSTATUS ds = disk_status(pdrv);
       if (STA_NODISK & ds)
           return ds;
@@ -121,11 +123,15 @@ DRESULT disk_read(BYTE pdrv,  /* Physical drive number to identify the drive */
     case DEV_FLASH:
       return fatfs_disk_read((uint8_t*)buff, sector, count);
     case DEV_SD:
+      if (count == 1 && disk_cache_read(DEV_SD, sector, buff))
+        return RES_OK;
       pdrv -= DEV_SD;
       TRACE_PRINTF(">>> %s\n", __FUNCTION__);
       sd_card_t *sd_card_p = sd_get_by_num(pdrv);
       if (!sd_card_p) return RES_PARERR;
       int rc = sd_card_p->read_blocks(sd_card_p, buff, sector, count);
+      if (rc == SD_BLOCK_DEVICE_ERROR_NONE && count == 1)
+        disk_cache_fill(DEV_SD, sector, buff);
       return sdrc2dresult(rc);
   }
   return RES_PARERR;
@@ -151,6 +157,11 @@ DRESULT disk_write(BYTE pdrv, /* Physical drive number to identify the drive */
       sd_card_t *sd_card_p = sd_get_by_num(pdrv);
       if (!sd_card_p) return RES_PARERR;
       int rc = sd_card_p->write_blocks(sd_card_p, buff, sector, count);
+      // Write-through; after a failure the card may hold either version
+      if (rc == SD_BLOCK_DEVICE_ERROR_NONE)
+        disk_cache_write(DEV_SD, sector, buff, count);
+      else
+        disk_cache_invalidate(DEV_SD, sector, count);
       return sdrc2dresult(rc);
   }
   return RES_PARERR;
@@ -181,8 +192,16 @@ DRESULT disk_ioctl(BYTE pdrv, /* Physical drive number (0..) */
         case GET_BLOCK_SIZE:
           *(DWORD*) buff = 1;
           return RES_OK;
-        case CTRL_TRIM:
+        case CTRL_TRIM: {
+          // Only FileSource asks (FF_USE_TRIM is off): a preallocated
+          // image reads as zeros without a page written
+          const LBA_t *range = (const LBA_t *) buff;
+          if (range[1] >= range[0]) {
+            flash_fs_trim_FAT_sectors((uint16_t) range[0], range[1] - range[0] + 1);
+            disk_cache_invalidate(DEV_FLASH, range[0], range[1] - range[0] + 1);
+          }
           return RES_OK;
+        }
         default:
           return RES_PARERR;
       }
@@ -7,6 +7,7 @@
 #include "file.hpp"
 #include "device.hpp"
 #include "ff.h"
+#include "disk_cache.h"
 #include "fdc.hpp"
 #include "qd.hpp"
 #include "fatfs_disk.h"
@@ -57,11 +58,13 @@ int mount_devices(void) {
   device_count = 0;
   if (f_mount(&fatfs_sd, SD_ID":", 1) == FR_OK) {
     strcpy(devices[device_count++].name, SD_ID);
+    disk_cache_set_meta_end(fatfs_sd.pdrv, fatfs_sd.database);
   }
   if (f_mount(&fatfs_flash, FLASH_ID":", 1) != FR_OK)
     return 1;
   {
     strcpy(devices[device_count++].name, FLASH_ID);
+    disk_cache_set_meta_end(fatfs_flash.pdrv, fatfs_flash.database);
   }
   return 0;
 }
@@ -82,12 +85,13 @@ int is_valid_file(char *filename) {
   return 0;
 }
 
+// Compares two packed DIR_ENTRY records (is_dir byte, then the name)
 int entry_compare(const void* p1, const void* p2) {
-  const DIR_ENTRY* e1 = (const DIR_ENTRY*)p1;
-  const DIR_ENTRY* e2 = (const DIR_ENTRY*)p2;
-  if (e1->is_dir && !e2->is_dir) return -1;
-  else if (!e1->is_dir && e2->is_dir) return 1;
-  else return strcasecmp(e1->filename, e2->filename);
+  const char* e1 = (const char*)p1;
+  const char* e2 = (const char*)p2;
+  if (e1[0] && !e2[0]) return -1;
+  else if (!e1[0] && e2[0]) return 1;
+  else return strcasecmp(e1 + 1, e2 + 1);
 }
 
 int read_directory(const char *path, PicoMgr *mgr) {
@@ -97,20 +101,26 @@ int read_directory(const char *path, PicoMgr *mgr) {
     return cloud_read_directory(path, mgr);
   }
 #endif
-  FILINFO fno;
+  // Static, and the listing is built and sorted in place in the
+  // transfer buffer: this also runs on core 0 (PicoMgr's deferred local
+  // commands), whose stack is a few KB
+  static FILINFO fno;
+  static DIR dir;
+  DIR_ENTRY entry;
   int ret = 0;
   uint16_t num_dir_entries = 0;
   size_t path_ln = strlen(path);
-  DIR dir;
-  DIR_ENTRY entries[MAX_DIR_FILES];
 
   if (f_opendir(&dir, path) == FR_OK) {
+    mgr->setContent(DIR_ENTRY_SIZE, pack_DIR_ENTRY, unpack_DIR_ENTRY);
+
     // If not root, add ".."
     if (path_ln >= 2 && path[path_ln-2] != ':' && path[path_ln-1] != '/') {
-      entries[num_dir_entries].is_dir = 1;
-      sanitize_filename(entries[num_dir_entries].filename, sizeof(entries[num_dir_entries].filename), "..");
-      entries[num_dir_entries].size = 0;
-      num_dir_entries++;
+      entry.is_dir = 1;
+      sanitize_filename(entry.filename, sizeof(entry.filename), "..");
+      entry.size = 0;
+      if (mgr->addRecord(&entry))
+        num_dir_entries++;
     }
 
     while (num_dir_entries < MAX_DIR_FILES) {
@@ -123,21 +133,17 @@ int read_directory(const char *path, PicoMgr *mgr) {
       if (!is_dir && !is_valid_file(fno.fname))
         continue;
 
-      entries[num_dir_entries].is_dir = is_dir;
-      sanitize_filename(entries[num_dir_entries].filename, sizeof(entries[num_dir_entries].filename), fno.fname);
-      entries[num_dir_entries].size = fno.fsize;
+      entry.is_dir = is_dir;
+      sanitize_filename(entry.filename, sizeof(entry.filename), fno.fname);
+      entry.size = fno.fsize;
+      if (!mgr->addRecord(&entry))
+        break;
       num_dir_entries++;
     }
 
     f_closedir(&dir);
 
-    // Sort aligned array
-    qsort(entries, num_dir_entries, sizeof(DIR_ENTRY), entry_compare);
-
-    mgr->setContent(DIR_ENTRY_SIZE, pack_DIR_ENTRY, unpack_DIR_ENTRY);
-    for (uint16_t i = 0; i < num_dir_entries; i++) {
-      mgr->addRecord(&entries[i]);
-    }
+    qsort(mgr->payloadBase(), num_dir_entries, DIR_ENTRY_SIZE, entry_compare);
   } else {
     mgr->setString("Can't read directory");
     ret = 1;
@@ -183,7 +189,7 @@ int mount_file(const char *path, PicoMgr *mgr) {
   uint16_t len;
   char extension[16];
   uint8_t *payload;
-  FIL fil;
+  static FIL fil; // off the stack, see read_directory()
 
   get_uppercase_extension(path, extension);
   if (!strcmp(extension, "MZF") || !strcmp(extension, "M12")) {
@@ -227,6 +233,12 @@ int mount_file(const char *path, PicoMgr *mgr) {
   return 0;
 }
 
+bool mount_loads_mzf(const char *path) {
+  char extension[16];
+  get_uppercase_extension(path, extension);
+  return !strcmp(extension, "MZF") || !strcmp(extension, "M12");
+}
+
 int get_device_list(PicoMgr *mgr) {
   for (uint8_t i = 0; i < device_count; i++) {
     mgr->addRaw((uint8_t *)devices[i].name, MAX_DEV_NAME_LENGTH);
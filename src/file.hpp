@@ -15,6 +15,9 @@ typedef struct {
 
 int read_directory(const char *path, PicoMgr *mgr);
 int mount_file(const char *path, PicoMgr *mgr);
+// Whether mount_file(path) only loads the file into the transfer buffer
+// (an MZF), rather than inserting an image into another device
+bool mount_loads_mzf(const char *path);
 int get_device_list(PicoMgr *mgr);
 int mount_devices(void);
 
@@ -502,6 +502,98 @@ bool flash_fs_verify_FAT_sector(uint16_t fat_sector, const void *buffer)
     return false;
 }
 
+const uint8_t *flash_fs_xip_address(uint16_t fat_sector)
+{
+    if (fat_sector >= flash_fs_num_fat_sectors()) return NULL;
+    uint16_t mapEntry = fs_map.sectors[fat_sector];
+    if (!mapEntry) return NULL;
+    return (const uint8_t *)(XIP_BASE + HW_FLASH_STORAGE_BASE
+                             + (uint32_t)getMapSector(mapEntry) * FLASH_SECTOR_SIZE
+                             + getMapOffset(mapEntry) * 512);
+}
+
+// Point a FAT sector at a freshly programmed page; its old page is
+// quarantined like a rewrite's (flash_fs_write_FAT_sector)
+static void move_map_entry(uint16_t fat_sector, uint16_t mapEntry)
+{
+    uint16_t oldEntry = fs_map.sectors[fat_sector];
+    if (oldEntry) {
+        used_bitmap[getMapSector(oldEntry)] &= ~(1 << getMapOffset(oldEntry));
+        pending_free_bitmap[getMapSector(oldEntry)] |= (1 << getMapOffset(oldEntry));
+    }
+    fs_map.sectors[fat_sector] = mapEntry;
+    mark_map_meg_dirty(fat_sector);
+    used_bitmap[getMapSector(mapEntry)] |= (1 << getMapOffset(mapEntry));
+}
+
+bool flash_fs_place_contiguous(const flash_fs_run *runs, uint32_t count)
+{
+    uint32_t pages = 0;
+    for (uint32_t r = 0; r < count; r++) {
+        if ((uint32_t)runs[r].first + runs[r].count > flash_fs_num_fat_sectors()) return false;
+        pages += runs[r].count;
+    }
+    if (!pages) return true;
+
+    // A stretch of flash sectors with no page in use or quarantined, and
+    // not the one the allocator is filling (its free pages are not marked)
+    uint32_t need = (pages + 7) / 8;
+    uint32_t start = reserved_sectors(), len = 0;
+    for (uint32_t s = start; s < NUM_FLASH_SECTORS && len < need; s++) {
+        if ((used_bitmap[s] | pending_free_bitmap[s]) || s == write_sector) {
+            start = s + 1;
+            len = 0;
+        } else {
+            len++;
+        }
+    }
+    if (len < need) return false;
+
+    // One flash sector at a time: gather its 8 pages in sector_scratch,
+    // erase, program, verify, then repoint the map
+    uint32_t r = 0, i = 0;
+    bool ok = true;
+    for (uint32_t s = 0; s < need && ok; s++) {
+        uint16_t sector = (uint16_t)(start + s);
+        uint16_t fat[8];
+        uint8_t n = 0;
+        for (; n < 8; n++) {
+            while (r < count && i == runs[r].count) { r++; i = 0; }
+            if (r == count) break;
+            fat[n] = (uint16_t)(runs[r].first + i++);
+            flash_fs_read_FAT_sector(fat[n], sector_scratch + n * 512);
+        }
+        flash_erase_sector(sector);
+        flash_write_sector(sector, 0, sector_scratch, (uint16_t)(n * 512));
+        const uint8_t *xip = (const uint8_t *)(XIP_BASE + HW_FLASH_STORAGE_BASE
+                                               + (uint32_t)sector * FLASH_SECTOR_SIZE);
+        if (memcmp(xip, sector_scratch, n * 512) != 0) {
+            printf("flash_fs: relocation to sector %d failed\n", sector);
+            ok = false;
+            break;
+        }
+        for (uint8_t k = 0; k < n; k++)
+            move_map_entry(fat[k], makeMapEntry(sector, k));
+    }
+    write_fs_map();
+    return ok;
+}
+
+void flash_fs_trim_FAT_sectors(uint16_t first, uint32_t count)
+{
+    uint32_t end = (uint32_t)first + count;
+    if (end > flash_fs_num_fat_sectors()) end = flash_fs_num_fat_sectors();
+    for (uint32_t s = first; s < end; s++) {
+        uint16_t oldEntry = fs_map.sectors[s];
+        if (!oldEntry) continue;
+        // Quarantined like a rewrite's: the persisted map still has it
+        used_bitmap[getMapSector(oldEntry)] &= ~(1 << getMapOffset(oldEntry));
+        pending_free_bitmap[getMapSector(oldEntry)] |= (1 << getMapOffset(oldEntry));
+        fs_map.sectors[s] = 0;
+        mark_map_meg_dirty((uint16_t)s);
+    }
+}
+
 /* Low level flash functions */
 
 void flash_read_sector(uint16_t sector, uint8_t offset, void *buffer, uint16_t size)
@@ -40,6 +40,33 @@ uint32_t flash_fs_num_fat_sectors(void);
 // non-blank but fails to mount is damaged and must NOT be reformatted.
 bool flash_fs_region_is_blank(void);
 
+// FatFS physical drive of the flash volume (fatfs_glue.c DEV_FLASH); its
+// sectors are the FAT sectors here
+#define FLASH_FS_DRIVE 0
+#define FLASH_FS_PAGE_SIZE 512
+
+// A run of consecutive FAT sectors, see flash_fs_place_contiguous()
+typedef struct {
+    uint16_t first;
+    uint16_t count;
+} flash_fs_run;
+
+// Where a FAT sector's page reads in the XIP window; NULL for a sector
+// never written (it reads as zeros) or out of range. Valid until the
+// sector is written again, which moves it to a new page.
+const uint8_t *flash_fs_xip_address(uint16_t fat_sector);
+
+// Move the pages of `runs`, in order, to consecutive pages of wholly free
+// flash sectors, so their XIP addresses follow each other, and sync the
+// map. False when no free stretch is long enough or a program fails; the
+// pages moved until then stay moved. Erases a flash sector per 8 pages.
+bool flash_fs_place_contiguous(const flash_fs_run *runs, uint32_t count);
+
+// Forget `count` FAT sectors from `first`: they read as zeros, like
+// sectors never written, and their pages are freed once the map is next
+// synced. RAM only - no flash is written here.
+void flash_fs_trim_FAT_sectors(uint16_t first, uint32_t count);
+
 #ifdef __cplusplus
 }
 #endif
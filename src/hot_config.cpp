@@ -0,0 +1,213 @@
+#include <cstdio>
+#include <cstring>
+#include <strings.h>
+
+#include "hardware/sync.h"
+
+#include "hot_config.hpp"
+#include "mz_devices.hpp"
+#include "device.hpp"
+#include "bus_stats.hpp"
+#include "work_queue.hpp"
+#include "pico_mgr.hpp"
+#include "iniparser.h"
+#include "dictionary.h"
+#ifdef BOARD_DELUXE
+#include "ctc.hpp"
+#endif
+
+HotConfigSlot hot_config_slot[HOT_CONFIG_CLIENTS];
+
+int hot_config_submit(HotConfigClient client, const char* cmd, HotConfigDone done, void* ctx) {
+    HotConfigSlot& s = hot_config_slot[client];
+    if (s.state == HOT_CONFIG_QUEUED)
+        return -1;
+    size_t len = strlen(cmd);
+    if (len >= HOT_CONFIG_CMD_LEN)
+        return -2;
+    memcpy(s.cmd, cmd, len + 1);
+    s.done = done;
+    s.ctx = ctx;
+    s.result = 0;
+    s.msg[0] = '\0';
+    __dmb();
+    s.state = HOT_CONFIG_QUEUED;
+    core1_event_raise(CORE1_EV_HOT_CONFIG);
+    return 0;
+}
+
+static bool isSoundType(std::string_view type) {
+    #ifdef BOARD_DELUXE
+    if (type == CTC_ID) return true;
+    #endif
+    return type == SN76489_ID;
+}
+
+static int fail(char* msg, const char* id, const char* what) {
+    snprintf(msg, HOT_CONFIG_MSG_LEN, "%s: %s", id, what);
+    return -1;
+}
+
+// The device globals file.cpp mounts images through
+static void trackDevice(MZDevice* dev, bool present) {
+    std::string_view type = MZDeviceManager::sectionDevType(dev->getDevID().c_str());
+    if (type == FDC_ID)
+        fdc = present ? (FDCDevice*)dev : (fdc == dev ? nullptr : fdc);
+    else if (type == QD_ID)
+        qd = present ? (QDDevice*)dev : (qd == dev ? nullptr : qd);
+}
+
+// init() + readConfig() of a device that has not run them yet; a failure
+// leaves it disabled
+static int configure(MZDevice* dev, dictionary* ini, const char* id, char* msg) {
+    dev->init();
+    int ret = dev->readConfig(ini);
+    if (ret) {
+        MZDeviceManager::disableDevice(dev);
+        return fail(msg, id, ret == E_DEVICE_NO_MEMORY ? "out of RAM" : "readConfig failed");
+    }
+    dev->setConfigured();
+    trackDevice(dev, true);
+    return 0;
+}
+
+static int opAdd(const char* id, dictionary* ini, char* msg) {
+    std::string_view type = MZDeviceManager::sectionDevType(id);
+    if (isSoundType(type))
+        return fail(msg, id, "sound devices need a reboot");
+    MZDevice* dev = MZDeviceManager::createDevice(type, id);
+    if (!dev)
+        return fail(msg, id, "not created (type, duplicate id or RAM)");
+    if (!dev->supportedOnBoard()) {
+        MZDeviceManager::removeDevice(dev);
+        return fail(msg, id, "not supported on this board");
+    }
+    char key[64];
+    if (!iniparser_getboolean(ini, MZDeviceManager::iniKey(key, sizeof(key), id, "enabled"), true))
+        MZDeviceManager::disableDevice(dev);
+
+    PortList readPorts, writePorts;
+    if (MZDeviceManager::resolvePorts(dev, ini, id, readPorts, writePorts) ||
+        MZDeviceManager::setPortsList(dev, readPorts, writePorts)) {
+        MZDeviceManager::removeDevice(dev);
+        return fail(msg, id, "invalid port list");
+    }
+    if (!dev->isEnabled())
+        return 0;
+    if (configure(dev, ini, id, msg)) {
+        MZDeviceManager::removeDevice(dev);
+        return -1;
+    }
+    return 0;
+}
+
+static int opRemove(MZDevice* dev, const char* id, char* msg) {
+    std::string_view type = MZDeviceManager::sectionDevType(id);
+    if (isSoundType(type) || type == PICO_MGR_ID)
+        return fail(msg, id, "cannot be removed at runtime");
+    dev->waitWork();
+    dev->flush();
+    trackDevice(dev, false);
+    return MZDeviceManager::removeDevice(dev);
+}
+
+static int opEnable(MZDevice* dev, dictionary* ini, const char* id, char* msg) {
+    if (dev->isEnabled())
+        return 0;
+    if (!dev->supportedOnBoard())
+        return fail(msg, id, "not supported on this board");
+    MZDeviceManager::enableDevice(dev);
+    if (!dev->isConfigured())
+        return configure(dev, ini, id, msg);
+    return 0;
+}
+
+static int opDisable(MZDevice* dev) {
+    if (!dev->isEnabled())
+        return 0;
+    dev->waitWork();
+    dev->flush();
+    return MZDeviceManager::disableDevice(dev);
+}
+
+static int opPorts(MZDevice* dev, dictionary* ini, const char* id, char* msg) {
+    PortList readPorts, writePorts;
+    if (MZDeviceManager::resolvePorts(dev, ini, id, readPorts, writePorts) ||
+        MZDeviceManager::setPortsList(dev, readPorts, writePorts))
+        return fail(msg, id, "invalid port list");
+    return 0;
+}
+
+// "<op> <id> key=value ...": the keys become section <id> of a throwaway
+// dictionary, so devices read them exactly as they read mzpico.ini
+static int run(char* cmd, char* msg) {
+    char* save = nullptr;
+    const char* op = strtok_r(cmd, " \t", &save);
+    const char* id = strtok_r(nullptr, " \t", &save);
+    if (!op || !id)
+        return fail(msg, "reconfig", "expected <op> <id>");
+
+    dictionary* ini = dictionary_new(0);
+    if (!ini)
+        return fail(msg, id, "out of RAM");
+    iniparser_set(ini, id, nullptr);
+    char key[64];
+    for (char* kv; (kv = strtok_r(nullptr, " \t", &save)); ) {
+        char* eq = strchr(kv, '=');
+        if (!eq)
+            continue;
+        *eq = '\0';
+        iniparser_set(ini, MZDeviceManager::iniKey(key, sizeof(key), id, kv), eq + 1);
+    }
+
+    int ret;
+    MZDevice* dev = MZDeviceManager::findDevice(id);
+    if (strcasecmp(op, "add") == 0)
+        ret = opAdd(id, ini, msg);
+    else if (!dev)
+        ret = fail(msg, id, "no such device");
+    else if (strcasecmp(op, "remove") == 0)
+        ret = opRemove(dev, id, msg);
+    else if (strcasecmp(op, "enable") == 0)
+        ret = opEnable(dev, ini, id, msg);
+    else if (strcasecmp(op, "disable") == 0)
+        ret = opDisable(dev);
+    else if (strcasecmp(op, "ports") == 0)
+        ret = opPorts(dev, ini, id, msg);
+    else
+        ret = fail(msg, op, "unknown operation");
+    iniparser_freedict(ini);
+    if (!ret && !msg[0])
+        snprintf(msg, HOT_CONFIG_MSG_LEN, "%s: ok", id);
+    return ret;
+}
+
+void hot_config_apply(void) {
+    // The live table must not change in place from here on
+    if (MZDeviceManager::reserveFlatSpare()) {
+        for (HotConfigSlot& s : hot_config_slot) {
+            if (s.state != HOT_CONFIG_QUEUED)
+                continue;
+            s.result = fail(s.msg, "reconfig", "out of RAM");
+            if (s.done) s.done(s.ctx, s.result, s.msg);
+            __dmb();
+            s.state = HOT_CONFIG_DONE;
+        }
+        return;
+    }
+    for (HotConfigSlot& s : hot_config_slot) {
+        if (s.state != HOT_CONFIG_QUEUED)
+            continue;
+        __dmb();
+        // readConfig() and flush() use FatFS, like boot
+        work_core1_enter(nullptr);
+        s.result = run(s.cmd, s.msg);
+        work_core1_leave();
+        #ifdef BUS_STATS
+        bus_stats_add_ports();
+        #endif
+        if (s.done) s.done(s.ctx, s.result, s.msg);
+        __dmb();
+        s.state = HOT_CONFIG_DONE;
+    }
+}
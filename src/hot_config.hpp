@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "common.hpp"
+
+// Runtime device reconfiguration, without a reboot. A command is one line
+// of text, the device's ini section name followed by ini keys:
+//
+//   add <id> [key=value ...]     create a device, as an ini section would
+//                                ("add pico_rd2 base_port=0x50 size=32768")
+//   remove <id>                  flush, unregister and delete a device
+//   enable <id> [key=value ...]  a device the ini disabled was never set
+//                                up: its keys are read here
+//   disable <id>                 flush and stop listening
+//   ports <id> key=value ...     re-port: read_ports/write_ports or base_port
+//
+// Commands come from PicoMgr (REPO_CMD_RECONFIG, core 1) and the REST API
+// (POST /api/reconfig, core 0), each through its own single-command slot.
+// listen_loop() applies them between bus cycles; the dispatch tables are
+// rebuilt off to the side and published with one pointer store
+// (MZDeviceManager::flatPorts).
+//
+// The Z80 is held in /WAIT (EXWAIT) while a command runs: it stops at its
+// next bus cycle for as long as the command's readConfig(), flush() and
+// allocations take (milliseconds; longer when it creates an image on
+// flash:), as in a slow EXWAIT handler, and MZ-800 DRAM refresh pauses
+// meanwhile. An I/O cycle it stopped in is answered from the new table
+// once released; none is answered by a device after it was removed or
+// re-ported, and none is lost. Changes last until the next full reboot -
+// mzpico.ini is not rewritten; a Z80 soft reset keeps them.
+//
+// Sound devices (psg, ctc) cannot be added or removed: core 0 mixes them
+// from a source list it reads without locking. pico_mgr cannot be removed
+// (it may be the channel the command came through, or own a cloud job).
+
+constexpr size_t HOT_CONFIG_CMD_LEN = 160;
+constexpr size_t HOT_CONFIG_MSG_LEN = 64;
+
+enum HotConfigClient : uint8_t {
+    HOT_CONFIG_MGR,     // PicoMgr, core 1
+    HOT_CONFIG_REST,    // REST API, core 0
+    HOT_CONFIG_CLIENTS
+};
+
+enum HotConfigState : uint8_t {
+    HOT_CONFIG_IDLE,
+    HOT_CONFIG_QUEUED,  // owned by core 1 until DONE
+    HOT_CONFIG_DONE,
+};
+
+// Core 1, when the command has been applied: result 0 or an error, msg a
+// short human-readable outcome
+typedef void (*HotConfigDone)(void* ctx, int result, const char* msg);
+
+struct HotConfigSlot {
+    volatile uint8_t state;
+    int result;
+    HotConfigDone done;
+    void* ctx;
+    char cmd[HOT_CONFIG_CMD_LEN];
+    char msg[HOT_CONFIG_MSG_LEN];
+};
+
+extern HotConfigSlot hot_config_slot[HOT_CONFIG_CLIENTS];
+
+// Queue `cmd` from `client`'s core: 0, -1 while the client's previous
+// command is still queued, -2 if it does not fit. listen_loop() picks it
+// up from CORE1_EV_HOT_CONFIG (work_queue.hpp)
+int hot_config_submit(HotConfigClient client, const char* cmd, HotConfigDone done, void* ctx);
+
+// Core 1, between bus cycles: apply the queued commands
+void hot_config_apply(void);
@@ -11,6 +11,7 @@
 #include "i2s_audio.pio.h"
 #include "i2s_audio.hpp"
 #include "common.hpp"
+#include "core_load.hpp"
 
 static I2SAudioSource* g_sources[MAX_AUDIO_SOURCES] = {nullptr};
 static uint8_t g_source_count = 0;
@@ -23,6 +24,7 @@ static uint8_t g_current_buffer = 0;
 static uint32_t g_buffer_fill_pos = 0;
 static bool g_buffer_ready[2] = {false, false};
 static bool g_audio_initialized = false;
+static volatile uint32_t g_underruns = 0;
 
 static void start_audio();
 static void stop_audio();
@@ -127,12 +129,18 @@ void i2s_audio_shutdown() {
     g_audio_initialized = false;
 }
 
+uint32_t i2s_audio_underruns() {
+    return g_underruns;
+}
+
 void i2s_audio_poll() {
     if (!g_audio_initialized) return;
 
     uint8_t next_buffer = 1 - g_current_buffer;
+    if (g_buffer_ready[next_buffer]) return; // nothing to render yet
+    uint8_t task = core_load_enter(CORE_LOAD_AUDIO);
 
-    if (g_buffer_fill_pos == 0 && !g_buffer_ready[next_buffer]) {
+    if (g_buffer_fill_pos == 0) {
         for (uint8_t i = 0; i < g_source_count; i++) {
             if (g_sources[i]) {
                 g_sources[i]->processWrites();
@@ -143,6 +151,7 @@ void i2s_audio_poll() {
     while (!g_buffer_ready[next_buffer] && g_buffer_fill_pos < AUDIO_BUFFER_SIZE / 2) {
         continue_fill_buffer(AUDIO_BUFFER_SIZE / 2);
     }
+    core_load_enter(task);
 }
 
 static void start_audio() {
@@ -187,6 +196,7 @@ static void dma_irq_handler() {
     uint8_t next_buffer = 1 - g_current_buffer;
 
     if (!g_buffer_ready[next_buffer]) {
+        g_underruns = g_underruns + 1;
         dma_channel_set_read_addr(g_audio_dma, g_audio_buffer[g_current_buffer], true);
         return;
     }
@@ -23,3 +23,5 @@ void i2s_audio_shutdown();
 bool i2s_audio_is_ready();
 bool i2s_audio_has_sources();
 void i2s_audio_poll();
+// Buffers the DMA had to replay because the next one was not ready
+uint32_t i2s_audio_underruns();
@@ -1,42 +1,146 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+#include <new>
+
 #include "mz_devices.hpp"
+#include "cached_source.hpp"
+#include "xip_source.hpp"
 #include "device.hpp"
+#include "pico_mgr.hpp"
+#include "pico_rd.hpp"
+#include "ramdisk.hpp"
+#include "sramdisk.hpp"
+#ifdef BOARD_DELUXE
+#include "ctc.hpp"
+#endif
+
+template <typename T>
+static MZDevice* create() { return new (std::nothrow) T(); }
+
+// Every device type an ini section can name. ctc needs the Deluxe I2S
+// and memory-snoop hardware and is only built there.
+static constexpr MZDeviceManager::DeviceType deviceTypes[] = {
+    { PICO_MGR_ID, create<PicoMgr> },
+    { SRAM_ID,     create<SRamDisk> },
+    { PICO_RD_ID,  create<PicoRD> },
+    { RAMDISK_ID,  create<RamDisk> },
+    { FDC_ID,      create<FDCDevice> },
+    { QD_ID,       create<QDDevice> },
+    { SN76489_ID,  create<SN76489Device> },
+#ifdef BOARD_DELUXE
+    { CTC_ID,      create<CTCDevice> },
+#endif
+};
 
 // Default implementation: create consecutive ports from basePort
-std::pair<std::vector<uint8_t>, std::vector<uint8_t>> MZDevice::applyBasePort(uint8_t basePort) const {
-    std::vector<uint8_t> readPorts;
-    std::vector<uint8_t> writePorts;
-    
-    auto defaultReads = getReadPorts();
-    auto defaultWrites = getWritePorts();
-    
-    for (size_t i = 0; i < defaultReads.size(); ++i) {
-        readPorts.push_back(basePort + i);
-    }
-    for (size_t i = 0; i < defaultWrites.size(); ++i) {
-        writePorts.push_back(basePort + i);
-    }
-    
-    return {readPorts, writePorts};
+PortLists MZDevice::applyBasePort(uint8_t basePort) const {
+    return { PortList::range(basePort, getReadPorts().size()),
+             PortList::range(basePort, getWritePorts().size()) };
 }
 
-void MZDevice::initializePortMappings(const std::vector<uint8_t>& readPorts,
-                                      const std::vector<uint8_t>& writePorts) {
-    // Initialize read port mappings
+void MZDevice::initializePortMappings(const PortList& readPorts, const PortList& writePorts) {
     readPortCount = readPorts.size();
-    if (readPortCount > MAX_DEVICE_PORTS) readPortCount = MAX_DEVICE_PORTS;
     for (uint8_t i = 0; i < readPortCount; ++i) {
         readMappings[i].port = readPorts[i];
     }
-    
-    // Initialize write port mappings
+
     writePortCount = writePorts.size();
-    if (writePortCount > MAX_DEVICE_PORTS) writePortCount = MAX_DEVICE_PORTS;
     for (uint8_t i = 0; i < writePortCount; ++i) {
         writeMappings[i].port = writePorts[i];
     }
 }
 
-bool MZDeviceManager::isRegistered(std::string devID) {
+void MZDevice::readCacheConfig(dictionary* ini) {
+    int lines = iniparser_getint(ini, (devID + ":cache_lines").c_str(), 1);
+    int ways = iniparser_getint(ini, (devID + ":cache_ways").c_str(), 0);
+    cacheLines = (lines < 1) ? 1 : (lines > 255) ? 255 : (uint8_t)lines;
+    cacheWays = (ways < 0 || ways > 255) ? 0 : (uint8_t)ways;
+    readAhead = iniparser_getboolean(ini, (devID + ":read_ahead").c_str(), true);
+    const char* policy = iniparser_getstring(ini, (devID + ":flush_policy").c_str(), "background");
+    if (policy[0] == 'i' || policy[0] == 'I')      writeBehind = WriteBehind::IMMEDIATE;
+    else if (policy[0] == 'l' || policy[0] == 'L') writeBehind = WriteBehind::LAZY;
+    else                                           writeBehind = WriteBehind::BACKGROUND;
+    const std::string xipKey = devID + ":xip";
+    const char* xip = iniparser_getstring(ini, xipKey.c_str(), "on");
+    if (xip[0] == 'r' || xip[0] == 'R')
+        xipMode = XipMode::RELOCATE;
+    else if (strcasecmp(xip, "off") == 0 || iniparser_getboolean(ini, xipKey.c_str(), 1) == 0)
+        xipMode = XipMode::OFF;
+    else
+        xipMode = XipMode::ON;
+}
+
+void MZDevice::applyCacheConfig(ByteSource* bs, const char* path) {
+    if (!bs)
+        return;
+    // A new image's zeros, or a compressed image's overlay, written out
+    // while core 0 is idle; on flash: there are no zeros to write
+    // (FileSource trims), the overlay stays, and core 0 must not
+    if (work_deferrable(path)) {
+        bs->zeroInBackground(&backgroundIo_);
+        bs->recompressInBackground(&backgroundIo_);
+    }
+    if (cacheLines > 1) {
+        if (bs->setCacheLines(cacheLines, cacheWays) != 0)
+            printf("%s: no RAM for %u cache lines\n", devID.c_str(), cacheLines);
+    } else if (work_deferrable(path)) {
+        // -1: reads, or stores, stay synchronous
+        if (readAhead)
+            bs->setReadAhead(&backgroundIo_);
+        if (writeBehind != WriteBehind::IMMEDIATE)
+            bs->setWriteBehind(&backgroundIo_, writeBehind);
+    }
+}
+
+bool MZDevice::openXip(const char* path, uint32_t size, uint32_t cacheSize, bool wrap,
+                       std::unique_ptr<ByteSource>& out, bool autoIncrement, bool configured) {
+    // Only flash: is memory mapped
+    if (xipMode == XipMode::OFF || work_deferrable(path))
+        return false;
+    const bool relocate = configured && xipMode == XipMode::RELOCATE;
+    return ByteSourceFactory::from_flash_xip(path, size, cacheSize, wrap, out,
+                                             autoIncrement, relocate) == 0;
+}
+
+static int backgroundJob(void* ctx) {
+    return static_cast<CachedSource*>(ctx)->runBackground();
+}
+
+bool MZDevice::postBackground(void* self, CachedSource* src) {
+    auto* dev = static_cast<MZDevice*>(self);
+    if (work_post(dev, backgroundJob, nullptr, src, /* background = */true) != 0)
+        return false;
+    dev->backgroundPending_++;
+    return true;
+}
+
+void MZDevice::waitBackground(void* self) {
+    static_cast<MZDevice*>(self)->waitWork();
+}
+
+// Core 0's own work: it never runs alongside a handler, this device's
+// included, so the source needs no settling around it
+bool MZDevice::idleBackground(void*, bool (*run)(void*), void* arg) {
+    if (run)
+        return work_idle_add(run, arg);
+    work_idle_remove(arg);
+    return true;
+}
+
+bool MZDevice::deferWork(WorkFn run, WorkDoneFn done, void* ctx) {
+    if (work_post(this, run, done, ctx) == 0) {
+        workPending_++;
+        return true;
+    }
+    waitWork();
+    int ret = run(ctx);
+    if (done) done(ctx, ret);
+    return false;
+}
+
+bool MZDeviceManager::isRegistered(const char* devID) {
     for (uint8_t i=0; i<deviceCount; i++) {
         if (devices[i]->getDevID() == devID)
             return true;
@@ -163,58 +267,149 @@ RAM_FUNC bool MZDeviceManager::handleWrite(uint8_t port, uint8_t dt, uint8_t hig
 }
 
 // Thunks for the rare multi-listener ports: route through the aggregated
-// dispatch. Interrupt aggregation note: listen_loop calls isInterrupt() on
-// the FIRST listener only for flat dispatch; today the only interrupt
-// source (FDC) never shares a port, so this is equivalent.
+// dispatch and return whether any listener wants /INT (PORT_MULTI)
 RAM_FUNC static int multiReadThunk(MZDevice*, uint8_t port, uint8_t* dt, uint8_t high_addr) {
-    MZDeviceManager::handleRead(port, dt, high_addr);
-    return 0;
+    return MZDeviceManager::handleRead(port, dt, high_addr);
 }
 
 RAM_FUNC static int multiWriteThunk(MZDevice*, uint8_t port, uint8_t dt, uint8_t high_addr) {
-    MZDeviceManager::handleWrite(port, dt, high_addr);
+    return MZDeviceManager::handleWrite(port, dt, high_addr);
+}
+
+template <typename L>
+static uint8_t listenerFlags(const L& l) {
+    uint8_t flags = 0;
+    for (uint8_t i = 0; i < l.count; ++i) {
+        if (l.devs[i] && l.devs[i]->canInterrupt()) flags |= MZDeviceManager::PORT_IRQ;
+    }
+    if (l.count > 1) flags |= MZDeviceManager::PORT_MULTI;
+    return flags;
+}
+
+template <typename L>
+static uint8_t fsFlag(const L& l, uint8_t port, bool write) {
+    for (uint8_t i = 0; i < l.count; ++i) {
+        if (l.devs[i] && l.devs[i]->reachesFs(port, write)) return MZDeviceManager::PORT_FS;
+    }
     return 0;
 }
 
+int MZDeviceManager::reserveFlatSpare() {
+    if (!flatSpare)
+        flatSpare = new (std::nothrow) PortDispatch[MAX_PORTS];
+    return flatSpare ? 0 : -1;
+}
+
 void MZDeviceManager::buildFlatTables() {
+    PortDispatch* next = flatPorts;
+    if (flatSpare)
+        next = (flatPorts == flatTable) ? flatSpare : flatTable;
     for (uint16_t p = 0; p < MAX_PORTS; ++p) {
+        PortDispatch &d = next[p];
         auto &RL = readListeners[p];
         if (RL.count == 1) {
             // Single listener: direct dispatch (fn may be a null placeholder,
             // which keeps the port unhandled, matching v0.2.0 semantics)
-            flatReadFn[p] = RL.fns[0];
-            flatReadDev[p] = RL.devs[0];
+            d.read = RL.fns[0];
+            d.readDev = RL.devs[0];
         } else if (RL.count > 1) {
-            flatReadFn[p] = multiReadThunk;
-            flatReadDev[p] = RL.devs[0];
+            d.read = multiReadThunk;
+            d.readDev = RL.devs[0];
         } else {
-            flatReadFn[p] = nullptr;
-            flatReadDev[p] = nullptr;
+            d.read = nullptr;
+            d.readDev = nullptr;
         }
 
         auto &WL = writeListeners[p];
         if (WL.count == 1) {
-            flatWriteFn[p] = WL.fns[0];
-            flatWriteDev[p] = WL.devs[0];
+            d.write = WL.fns[0];
+            d.writeDev = WL.devs[0];
         } else if (WL.count > 1) {
-            flatWriteFn[p] = multiWriteThunk;
-            flatWriteDev[p] = WL.devs[0];
+            d.write = multiWriteThunk;
+            d.writeDev = WL.devs[0];
         } else {
-            flatWriteFn[p] = nullptr;
-            flatWriteDev[p] = nullptr;
+            d.write = nullptr;
+            d.writeDev = nullptr;
         }
 
-        flatExwait[p] = RL.needsExwaitAny || WL.needsExwaitAny;
+        // EXWAIT stays per port, as both directions share the device state
+        const uint8_t exwait = (RL.needsExwaitAny || WL.needsExwaitAny) ? PORT_EXWAIT : 0;
+        d.readFlags = exwait | listenerFlags(RL) | (exwait ? fsFlag(RL, p, false) : 0);
+        d.writeFlags = exwait | listenerFlags(WL) | (exwait ? fsFlag(WL, p, true) : 0);
+        // A staged byte survives a swap when the same handler still owns
+        // the port alone (the device will not restage it otherwise)
+        const PortDispatch &old = flatPorts[p];
+        d.staged = (next != flatPorts && RL.count == 1 &&
+                    old.read == d.read && old.readDev == d.readDev) ? old.staged : 0;
+    }
+    if (next != flatPorts) {
+        __dmb(); // entries before the pointer
+        flatPorts = next;
     }
 }
 
-MZDevice* MZDeviceManager::createDevice(const std::string& devType, const std::string& id) {
-    auto& creators = getMap();
-    auto it = creators.find(devType);
-    if (it == creators.end())
-    {
-        return nullptr;
+std::string_view MZDeviceManager::sectionDevType(const char* section) {
+    size_t end = strlen(section);
+    while (end > 0 && section[end - 1] >= '0' && section[end - 1] <= '9')
+        --end;
+    return std::string_view(section, end);
+}
+
+int MZDeviceManager::parsePortsList(const char* s, PortList& out) {
+    out.clear();
+    while (s && *s) {
+        while (*s == ',' || *s == ' ' || *s == '\t' || *s == '\r' || *s == '\n') s++;
+        if (!*s) break;
+        char* end = nullptr;
+        unsigned long num = strtoul(s, &end, 0);
+        if (end == s) break;
+        if (num <= 0xFF && !out.push_back((uint8_t)num))
+            return -1;
+        s = end;
     }
+    return 0;
+}
+
+const char* MZDeviceManager::iniKey(char* buf, size_t len, const char* section, const char* key) {
+    snprintf(buf, len, "%s:%s", section, key);
+    return buf;
+}
+
+int MZDeviceManager::resolvePorts(MZDevice* dev, dictionary* ini, const char* section,
+                                  PortList& readPorts, PortList& writePorts) {
+    char key[64];
+    // A list longer than any device has ports is a config error like a
+    // wrong count (setPortsList)
+    if (parsePortsList(iniparser_getstring(ini, iniKey(key, sizeof(key), section, "read_ports"), ""), readPorts) ||
+        parsePortsList(iniparser_getstring(ini, iniKey(key, sizeof(key), section, "write_ports"), ""), writePorts))
+        return -1;
+    if (!readPorts.empty() || !writePorts.empty())
+        return 0;
+
+    const char* base_port_str = iniparser_getstring(ini, iniKey(key, sizeof(key), section, "base_port"), "");
+    if (base_port_str && *base_port_str) {
+        // base_port provided: let device decide how to apply it
+        PortLists ports = dev->applyBasePort((uint8_t)std::strtoul(base_port_str, nullptr, 0));
+        readPorts = ports.read;
+        writePorts = ports.write;
+    } else {
+        // No config provided: use device defaults
+        readPorts = dev->getReadPorts();
+        writePorts = dev->getWritePorts();
+    }
+    return 0;
+}
+
+MZDevice* MZDeviceManager::createDevice(std::string_view devType, const char* id) {
+    const DeviceType* type = nullptr;
+    for (const DeviceType& t : deviceTypes) {
+        if (devType == t.name) {
+            type = &t;
+            break;
+        }
+    }
+    if (!type)
+        return nullptr;
 
     if (deviceCount >= MAX_MZ_DEVICES)
         return nullptr;
@@ -222,13 +417,38 @@ MZDevice* MZDeviceManager::createDevice(const std::string& devType, const std::s
     if (isRegistered(id))
         return nullptr;
 
-    MZDevice* dev = (it->second)();
+    MZDevice* dev = type->create();
     if (!dev) return nullptr; // out of RAM (nothrow creation): skip device
     dev->setDevID(id);
     devices[deviceCount++] = dev;
     return dev;
 }
 
+MZDevice* MZDeviceManager::findDevice(const char* id) {
+    for (uint8_t i = 0; i < deviceCount; i++) {
+        if (devices[i]->getDevID() == id)
+            return devices[i];
+    }
+    return nullptr;
+}
+
+int MZDeviceManager::removeDevice(MZDevice* dev) {
+    uint8_t i = 0;
+    while (i < deviceCount && devices[i] != dev)
+        i++;
+    if (!dev || i == deviceCount)
+        return E_DEVICE_NOT_REGISTERED;
+    if (dev->isEnabled()) {
+        unListenPorts(dev);
+        buildFlatTables();
+    }
+    for (; i + 1 < deviceCount; i++)
+        devices[i] = devices[i + 1];
+    devices[--deviceCount] = nullptr;
+    delete dev;
+    return 0;
+}
+
 void MZDeviceManager::flushAll() {
     for (uint8_t i=0; i<deviceCount; i++)
         devices[i]->flush();
@@ -242,7 +462,7 @@ void MZDeviceManager::softResetAll() {
 int MZDeviceManager::enableDevice(MZDevice* dev) {
     if (!dev)
         return 1;
-    if (!isRegistered(dev->getDevID()))
+    if (!isRegistered(dev->getDevID().c_str()))
         return E_DEVICE_NOT_REGISTERED;
     dev->Enable();
     listenPorts(dev);
@@ -254,7 +474,7 @@ int MZDeviceManager::enableDevice(MZDevice* dev) {
 int MZDeviceManager::disableDevice(MZDevice* dev) {
     if (!dev)
         return 1;
-    if (!isRegistered(dev->getDevID()))
+    if (!isRegistered(dev->getDevID().c_str()))
         return E_DEVICE_NOT_REGISTERED;
     dev->Disable();
     unListenPorts(dev);
@@ -263,12 +483,10 @@ int MZDeviceManager::disableDevice(MZDevice* dev) {
     return 0;
 }
 
-int MZDeviceManager::setPortsList(MZDevice* dev,
-                                  const std::vector<uint8_t>& readPorts,
-                                  const std::vector<uint8_t>& writePorts) {
+int MZDeviceManager::setPortsList(MZDevice* dev, const PortList& readPorts, const PortList& writePorts) {
     if (!dev)
         return 1;
-    if (!isRegistered(dev->getDevID()))
+    if (!isRegistered(dev->getDevID().c_str()))
         return E_DEVICE_NOT_REGISTERED;
 
     // Validate counts match device capability
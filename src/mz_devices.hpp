@@ -2,26 +2,13 @@
 
 #include <stdint.h>
 #include <string>
-#include <functional>
-#include <memory>
-#include <map>
-#include <new>
-#include <vector>
+#include <string_view>
+#include <initializer_list>
 
 #include "common.hpp"
 #include "iniparser.h"
-
-#define REGISTER_MZ_DEVICE(CLASS) \
-    MZDevice* create_##CLASS() { return new (std::nothrow) CLASS(); } \
-    namespace { \
-        struct AutoRegister_##CLASS { \
-            AutoRegister_##CLASS() { \
-                MZDeviceManager::registerClass(CLASS::getDevType(), create_##CLASS); \
-            } \
-        }; \
-        static AutoRegister_##CLASS _autoRegister_##CLASS; \
-    }
-
+#include "work_queue.hpp"
+#include "byte_source.hpp"
 
 constexpr uint8_t MAX_MZ_DEVICES = 64;
 constexpr uint16_t MAX_PORTS = 256;
@@ -38,6 +25,45 @@ constexpr uint8_t E_DEVICE_NOT_REGISTERED = 251;
 // the running machine; a halted boot is not)
 constexpr int E_DEVICE_NO_MEMORY = 250;
 
+// Fixed-capacity port list, as returned by getReadPorts()/getWritePorts()/
+// applyBasePort() and taken by setPortsList(). Lives on the stack, so
+// resolving a device's ports at boot never touches the heap.
+class PortList {
+public:
+    PortList() = default;
+    PortList(std::initializer_list<uint8_t> ports) {
+        for (uint8_t p : ports) push_back(p);
+    }
+    // `count` consecutive ports starting at `base`
+    static PortList range(uint8_t base, uint8_t count) {
+        PortList l;
+        for (uint8_t i = 0; i < count; ++i) l.push_back(base + i);
+        return l;
+    }
+
+    // false (list unchanged) once MAX_DEVICE_PORTS are in
+    bool push_back(uint8_t port) {
+        if (count_ >= MAX_DEVICE_PORTS) return false;
+        ports_[count_++] = port;
+        return true;
+    }
+    void clear() { count_ = 0; }
+    uint8_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    uint8_t operator[](uint8_t i) const { return ports_[i]; }
+    const uint8_t* begin() const { return ports_; }
+    const uint8_t* end() const { return ports_ + count_; }
+
+private:
+    uint8_t ports_[MAX_DEVICE_PORTS];
+    uint8_t count_ = 0;
+};
+
+struct PortLists {
+    PortList read;
+    PortList write;
+};
+
 class MZDevice {
 public:
     struct ReadPortMapping {
@@ -50,14 +76,24 @@ public:
         int (*fn)(MZDevice* self, uint8_t port, uint8_t dt, uint8_t high_addr);
     };
 
+    virtual ~MZDevice() = default;
     virtual int init() = 0;
     virtual int isInterrupt() = 0;
+    // Whether isInterrupt() can ever return nonzero. listen_loop() only
+    // polls isInterrupt() on ports where a listener says so.
+    virtual bool canInterrupt() const { return false; }
     virtual bool needsExwait() const = 0;
+    // Whether the handler on `port` can reach FatFS (a file image, a
+    // command that opens files). Only those wait for core 0 to hand the
+    // volume back (work_core1_enter); a handler over RAM answers however
+    // long a deferred job holds it. Asked when the dispatch tables are
+    // built, so the answer may follow readConfig().
+    virtual bool reachesFs(uint8_t /*port*/, bool /*write*/) const { return true; }
     // Each device declares its port configuration
-    virtual std::vector<uint8_t> getReadPorts() const = 0;
-    virtual std::vector<uint8_t> getWritePorts() const = 0;
+    virtual PortList getReadPorts() const = 0;
+    virtual PortList getWritePorts() const = 0;
     // Optionally override to customize how base_port remapping works
-    virtual std::pair<std::vector<uint8_t>, std::vector<uint8_t>> applyBasePort(uint8_t basePort) const;
+    virtual PortLists applyBasePort(uint8_t basePort) const;
     virtual int readConfig(dictionary *ini) = 0;
     virtual int flush() = 0;
     // Z80 reset without a Pico reboot: restore power-on REGISTER state
@@ -75,47 +111,134 @@ public:
     // listener slot on a shared port either).
     virtual bool supportedOnBoard() const { return true; }
 
+    // Cache counters of the device's file image(s), false without one
+    virtual bool cacheStats(CacheStats&) const { return false; }
+
     const ReadPortMapping* getReadMappings() const { return readMappings; }
     const WritePortMapping* getWriteMappings() const { return writeMappings; }
 
     uint8_t getReadCount() const { return readPortCount; }
     uint8_t getWriteCount() const { return writePortCount; }
 
-    std::string getDevID() const { return devID; }
-    void setDevID(const std::string& id) { devID = id; }
+    const std::string& getDevID() const { return devID; }
+    void setDevID(const char* id) { devID = id; }
     bool isEnabled() const { return enabled; }
     void Enable() { enabled = true; }
     void Disable() { enabled = false; }
+    // init() and readConfig() have succeeded (a device disabled in the
+    // ini never ran them - enabling it at runtime must)
+    bool isConfigured() const { return configured; }
+    void setConfigured() { configured = true; }
     // Helper to initialize port mappings from provided port lists
-    void initializePortMappings(const std::vector<uint8_t>& readPorts,
-                                const std::vector<uint8_t>& writePorts);
+    void initializePortMappings(const PortList& readPorts, const PortList& writePorts);
+
+    // Deferred work (work_queue.hpp): core 1 only. Jobs posted and not
+    // yet reaped; the device answers busy meanwhile and keeps its
+    // handlers off FatFS and off whatever the job works on.
+    bool workPending() const { return workPending_ != 0; }
+    // Including read-ahead fills and write-behind stores of its images
+    bool workInFlight() const { return workPending_ || backgroundPending_; }
+    // Block until this device's jobs are done: before touching FatFS or
+    // job-owned state from a handler, or before another device (or the
+    // explorer) swaps its image
+    void waitWork() { if (workInFlight()) work_wait(this); }
 
 protected:
+    // Queue `run` for core 0 and return true; `done` follows on core 1.
+    // With the queue full both run inline, after this device's earlier
+    // jobs, and it returns false.
+    bool deferWork(WorkFn run, WorkDoneFn done, void* ctx);
+
+    // Pre-staged read responses, see MZDeviceManager::stageRead
+    void stageRead(uint8_t index, uint8_t value);
+    void unstageRead(uint8_t index);
+
+    // [<id>] cache_lines / cache_ways: split a file image's cache into
+    // lines (CachedSource::setCacheLines); read_ahead (default on): fill
+    // a single-window image's next window on core 0 while the Z80 reads
+    // this one, sd: images only; flush_policy (immediate, background -
+    // the default - or lazy): when a window writes leave is stored, see
+    // WriteBehind, sd: images only. Read once by readConfig(), applied to
+    // every image the device opens at `path`; short of RAM the image
+    // keeps its plain single window. xip (on, the default; off;
+    // relocate): images on flash: read in place, see openXip(). An sd:
+    // image just created also has its zeros written out in core 0's idle
+    // time (ByteSource::zeroInBackground), and a compressed one its
+    // written blocks folded back in (recompressInBackground).
+    void readCacheConfig(dictionary* ini);
+    void applyCacheConfig(ByteSource* bs, const char* path);
+    // An image on flash: read in place from XIP flash (XipSource) when
+    // its pages follow each other; with xip=relocate and `configured`
+    // (the image the ini names, opened once at boot or on a reconfig)
+    // after moving them so. False: open it with from_file().
+    bool openXip(const char* path, uint32_t size, uint32_t cacheSize, bool wrap,
+                 std::unique_ptr<ByteSource>& out, bool autoIncrement, bool configured);
+
     ReadPortMapping readMappings[MAX_DEVICE_PORTS];
     WritePortMapping writeMappings[MAX_DEVICE_PORTS];
     uint8_t readPortCount = 0;
     uint8_t writePortCount = 0;
     std::string devID;
     bool enabled = true;
+    bool configured = false;
+    uint8_t cacheLines = 1;
+    uint8_t cacheWays = 0;
+    bool readAhead = true;
+    WriteBehind writeBehind = WriteBehind::BACKGROUND;
+    enum class XipMode : uint8_t { OFF, ON, RELOCATE };
+    XipMode xipMode = XipMode::ON;
+
+private:
+    friend void work_reap(void);
+    uint8_t workPending_ = 0;
+    uint8_t backgroundPending_ = 0;
+    static bool postBackground(void* self, CachedSource* src);
+    static void waitBackground(void* self);
+    static bool idleBackground(void* self, bool (*run)(void*), void* arg);
+    const BackgroundIo backgroundIo_{this, postBackground, waitBackground, idleBackground};
 };
 
 class MZDeviceManager {
 public:
-    using Creator = std::function<MZDevice*()>;
+    using Creator = MZDevice* (*)();
 
-    static void registerClass(const std::string& name, Creator creator) {
-        getMap()[name] = std::move(creator);
-    }
+    // One entry per device type an ini section can name, see
+    // mz_devices.cpp. A compile-time table: no registration at startup,
+    // and lookup is a handful of string compares.
+    struct DeviceType {
+        const char* name;
+        Creator create;
+    };
 
-    static MZDevice* createDevice(const std::string& devType, const std::string& id);
+    // Device type of an ini section: its name minus trailing digits
+    // ("pico_rd2" -> "pico_rd")
+    static std::string_view sectionDevType(const char* section);
+    // "section:key" into buf, for the iniparser lookups of a device
+    // section without a std::string (boot runs in the IPL race)
+    static const char* iniKey(char* buf, size_t len, const char* section, const char* key);
+    // nullptr for an unknown type, a duplicate id, a full device table or
+    // out of RAM (nothrow creation)
+    static MZDevice* createDevice(std::string_view devType, const char* id);
     static void flushAll();
     static void softResetAll();
     static int disableDevice(MZDevice* dev);
     static int enableDevice(MZDevice* dev);
+    static MZDevice* findDevice(const char* id);
+    // Registered devices in creation order, for reports
+    static uint8_t getDeviceCount() { return deviceCount; }
+    static MZDevice* getDevice(uint8_t i) { return i < deviceCount ? devices[i] : nullptr; }
+    // Unregister and delete a device (runtime reconfiguration). The
+    // caller has flushed it and waited out its deferred work.
+    static int removeDevice(MZDevice* dev);
     // Configure a device with explicit port lists
-    static int setPortsList(MZDevice* dev,
-                            const std::vector<uint8_t>& readPorts,
-                            const std::vector<uint8_t>& writePorts);
+    static int setPortsList(MZDevice* dev, const PortList& readPorts, const PortList& writePorts);
+    // Ini port list ("0xD8, 0xD9, 217"): 0, or -1 if it holds more than
+    // MAX_DEVICE_PORTS ports. Values above 0xFF are skipped.
+    static int parsePortsList(const char* s, PortList& out);
+    // A section's ports: read_ports/write_ports, else base_port through
+    // applyBasePort(), else the device defaults. -1 on a bad list.
+    static int resolvePorts(MZDevice* dev, dictionary* ini, const char* section,
+                            PortList& readPorts, PortList& writePorts);
 
     // Aggregated, multi-listener helpers for fast dispatch from listen_loop
     static inline bool portNeedsExwait(uint8_t port) { return readListeners[port].needsExwaitAny || writeListeners[port].needsExwaitAny; }
@@ -126,20 +249,67 @@ public:
     // Perform aggregated write: broadcasts to all listeners, and returns whether any device wants interrupt
     static bool handleWrite(uint8_t port, uint8_t dt, uint8_t high_addr);
 
-    // Flat fast-path dispatch tables for listen_loop. Ports with a single
-    // listener dispatch directly (v0.2.0-equivalent hot path: minimal loads
-    // before EXWAIT assertion, which is timing-critical against the Z80's
-    // /WAIT sampling); ports with multiple listeners point at a thunk into
-    // the aggregated handleRead/handleWrite. Rebuilt on any listener change.
-    static inline int (*flatReadFn[MAX_PORTS])(MZDevice*, uint8_t, uint8_t*, uint8_t) = {nullptr};
-    static inline MZDevice* flatReadDev[MAX_PORTS] = {nullptr};
-    static inline int (*flatWriteFn[MAX_PORTS])(MZDevice*, uint8_t, uint8_t, uint8_t) = {nullptr};
-    static inline MZDevice* flatWriteDev[MAX_PORTS] = {nullptr};
-    static inline bool flatExwait[MAX_PORTS] = {false};
+    using ReadFn = int (*)(MZDevice*, uint8_t, uint8_t*, uint8_t);
+    using WriteFn = int (*)(MZDevice*, uint8_t, uint8_t, uint8_t);
+
+    // PortDispatch flags, per direction
+    static constexpr uint8_t PORT_EXWAIT = 0x01; // hold /WAIT around the handler
+    static constexpr uint8_t PORT_IRQ = 0x02;    // a listener canInterrupt()
+    static constexpr uint8_t PORT_MULTI = 0x04;  // fn is the aggregating thunk,
+                                                 // its return value is the /INT state
+    static constexpr uint8_t PORT_FS = 0x08;     // EXWAIT, and a listener reachesFs()
+
+    // Flat fast-path dispatch table for listen_loop, one descriptor per
+    // port. Ports with a single listener dispatch directly (v0.2.0-
+    // equivalent hot path: minimal loads before EXWAIT assertion, which is
+    // timing-critical against the Z80's /WAIT sampling); ports with
+    // multiple listeners point at a thunk into the aggregated
+    // handleRead/handleWrite. Everything a cycle needs sits in one entry,
+    // reached from one base address. Rebuilt on any listener change.
+    //
+    // Boot builds the table in place. Runtime changes (hot_config.hpp)
+    // first reserve a second copy, then build into whichever copy is not
+    // live and publish it with one pointer store: the table listen_loop()
+    // dispatches from is never modified under it. Core 1 only.
+    struct PortDispatch {
+        ReadFn read;
+        MZDevice* readDev;
+        WriteFn write;
+        MZDevice* writeDev;
+        uint16_t staged;    // see stageRead()
+        uint8_t readFlags;
+        uint8_t writeFlags;
+    };
+    static inline PortDispatch flatTable[MAX_PORTS] = {};
+    static inline PortDispatch* flatSpare = nullptr;
+    static inline PortDispatch* flatPorts = flatTable; // the live table
     static void buildFlatTables();
+    // Allocate the second table on first use: 0, or -1 when out of RAM
+    static int reserveFlatSpare();
+
+    // /INT state after a handler ran with return value `ret`: polls the
+    // device only on ports with an interrupt-capable listener
+    static ALWAYS_INLINE bool portInterrupt(uint8_t flags, MZDevice* dev, int ret) {
+        if (!(flags & PORT_IRQ)) return false;
+        return (flags & PORT_MULTI) ? ret != 0 : dev->isInterrupt() != 0;
+    }
+
+    // Pre-staged read responses: a device whose next read on a port is
+    // already known (a streaming data port over RAM) publishes it in the
+    // port's descriptor, STAGED | value. listen_loop() then drives it
+    // without EXWAIT and runs the handler after the Z80 has moved on; the
+    // handler must advance the device and stage the following byte well
+    // within the gap to the next I/O cycle (~2us), so only memory-backed
+    // state may be staged. A consumed entry is cleared before the handler
+    // runs. Shared ports are never staged; buildFlatTables() drops all
+    // staged values.
+    static constexpr uint16_t STAGED = 0x100;
+    static inline void stageRead(uint8_t port, uint8_t value) {
+        if (readListeners[port].count == 1) flatPorts[port].staged = STAGED | value;
+    }
+    static inline void unstageRead(uint8_t port) { flatPorts[port].staged = 0; }
 
 private:
-    static std::map<std::string, Creator>& getMap() { static std::map<std::string, Creator> creators; return creators; }
     static inline MZDevice* devices[MAX_MZ_DEVICES] = {nullptr};
     static inline uint8_t deviceCount = 0;
 
@@ -159,8 +329,17 @@ private:
 
     static inline PortReadListeners readListeners[MAX_PORTS];
     static inline PortWriteListeners writeListeners[MAX_PORTS];
-    static inline bool isRegistered(std::string devString);
+    static bool isRegistered(const char* devID);
     static void listenPorts(MZDevice *dev);
     static void unListenPorts(MZDevice *dev);
     static void recomputeExwait(uint8_t port);
 };
+
+// Stage/drop the next response of this device's read mapping `index`
+inline void MZDevice::stageRead(uint8_t index, uint8_t value) {
+    MZDeviceManager::stageRead(readMappings[index].port, value);
+}
+
+inline void MZDevice::unstageRead(uint8_t index) {
+    MZDeviceManager::unstageRead(readMappings[index].port);
+}
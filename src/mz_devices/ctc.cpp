@@ -6,8 +6,6 @@
 #include "mem_snoop.hpp"
 #include "pico/time.h"
 
-REGISTER_MZ_DEVICE(CTCDevice)
-
 // Write-listener port order (positional match with writeMappings):
 // D0-D7, then the bank ports
 static constexpr uint8_t PORT_BANK_E1 = 0xE1;  // DRAM over D000-FFFF: peripherals unmapped
@@ -69,12 +67,12 @@ int CTCDevice::init() {
     return i2s_audio_register_source(this);
 }
 
-std::vector<uint8_t> CTCDevice::getReadPorts() const {
+PortList CTCDevice::getReadPorts() const {
     return {};
 }
 
-std::vector<uint8_t> CTCDevice::getWritePorts() const {
-    std::vector<uint8_t> ports;
+PortList CTCDevice::getWritePorts() const {
+    PortList ports;
     for (uint8_t i = 0; i < 8; ++i) {
         ports.push_back(CTC_PORT_BASE + i);
     }
@@ -87,7 +85,7 @@ std::vector<uint8_t> CTCDevice::getWritePorts() const {
     return ports;
 }
 
-std::pair<std::vector<uint8_t>, std::vector<uint8_t>> CTCDevice::applyBasePort(uint8_t) const {
+PortLists CTCDevice::applyBasePort(uint8_t) const {
     return {getReadPorts(), getWritePorts()};
 }
 
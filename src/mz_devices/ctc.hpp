@@ -45,10 +45,10 @@ public:
         return false;
         #endif
     }
-    std::vector<uint8_t> getReadPorts() const override;
-    std::vector<uint8_t> getWritePorts() const override;
+    PortList getReadPorts() const override;
+    PortList getWritePorts() const override;
     // Fixed machine addresses; base_port remapping makes no sense here
-    std::pair<std::vector<uint8_t>, std::vector<uint8_t>> applyBasePort(uint8_t basePort) const override;
+    PortLists applyBasePort(uint8_t basePort) const override;
     int readConfig(dictionary *ini) override;
     int flush() override { return 0; }
     // Unlike the 8253/PSG (no reset pins), the memory MAPPER resets to the
@@ -56,7 +56,6 @@ public:
     // the playhead deliberately stay untouched. The actual state lives on
     // core 0, so this only raises a flag consumed by processWrites().
     void softReset() override { bankResetPending = true; }
-    static std::string getDevType() { return CTC_ID; }
 
     RAM_FUNC static int writePort(MZDevice* self, uint8_t port, uint8_t dt, uint8_t high_addr);
     RAM_FUNC static int writeBankPort(MZDevice* self, uint8_t port, uint8_t dt, uint8_t high_addr);
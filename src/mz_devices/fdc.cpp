@@ -7,14 +7,14 @@
 
 #include <algorithm>
 #include <cstdio>
+#include <new>
 
 #include "fdc.hpp"
 #include "ff.h"
 #include "common.hpp"
 #include "file_source.hpp"
 #include "fdc_dir_source.hpp"
-
-REGISTER_MZ_DEVICE(FDCDevice)
+#include "compressed_source.hpp"
 
 // -------------------- Construction & registration --------------------
 
@@ -31,6 +31,7 @@ FDCDevice::FDCDevice() {
 }
 
 FDCDevice::~FDCDevice() {
+    delete[] track_buf;
     //for (auto& d : drive) {
      //   d.bs->flush();
         //if (d.fh.obj.fs) {
@@ -43,16 +44,16 @@ FDCDevice::~FDCDevice() {
 
 // -------------------- MZDevice overrides --------------------
 
-std::vector<uint8_t> FDCDevice::getReadPorts() const {
-    std::vector<uint8_t> ports;
+PortList FDCDevice::getReadPorts() const {
+    PortList ports;
     for (uint8_t i = 0; i < FDC_READ_PORTS; ++i) {
         ports.push_back(FDC_DEFAULT_BASE_PORT + i);
     }
     return ports;
 }
 
-std::vector<uint8_t> FDCDevice::getWritePorts() const {
-    std::vector<uint8_t> ports;
+PortList FDCDevice::getWritePorts() const {
+    PortList ports;
     for (uint8_t i = 0; i < FDC_WRITE_PORTS; ++i) {
         ports.push_back(FDC_DEFAULT_BASE_PORT + i);
     }
@@ -74,6 +75,7 @@ void FDCDevice::softReset() {
     regSECTOR = 0;
     SIDE = 0;
     buffer_pos = 0;
+    sector_data = buffer;
     COMMAND = 0;
     MOTOR = 0;
     DENSITY = 0;
@@ -87,8 +89,12 @@ void FDCDevice::softReset() {
     rt_phase = 0;
     rt_sec_idx = 0;
     rt_remaining = 0;
+    rt_pos = 0;
+    rt_buffered = false;
     reading_status_counter = 0;
     error_int = 0;
+    sector_flush = FLUSH_IDLE; // the write-back itself was drained
+    dropTrackBuffer();
 
     // Revert explorer-mounted images to the ini configuration, so a reset
     // leaves the boot order as configured (e.g. back to the menu) instead
@@ -98,6 +104,7 @@ void FDCDevice::softReset() {
         if (cfg_image[i].empty()) {
             drive[i].bs.reset(); // flushes and closes the runtime image
             drive[i].dirsrc = nullptr;
+            drive[i].index.clear();
             drive[i].TRACK = 0;
             drive[i].SECTOR = 0;
             drive[i].SIDE = 0;
@@ -123,6 +130,13 @@ int FDCDevice::readConfig(dictionary *ini) {
     // write_protected sets the default for all drives; write_protected<N>
     // overrides it per drive (N = 1..4, matching image_disk<N>)
     const int wp_all = iniparser_getboolean(ini, (getDevID() + ":write_protected").c_str(), 0);
+    readCacheConfig(ini);
+    if (iniparser_getboolean(ini, (getDevID() + ":track_buffer").c_str(), 0)) {
+        if (!track_buf)
+            track_buf = new (std::nothrow) uint8_t[FDC_TRACK_BUFFER];
+        if (!track_buf)
+            printf("%s: no RAM for the track buffer\n", getDevID().c_str());
+    }
     for (int i = 0; i < FDC_NUM_DRIVES; i++) {
         // Directory mounts: fs_disk<N> picks the synthesized filesystem
         // ("basic" or "cpm"); default auto-detects from the dir contents
@@ -143,6 +157,7 @@ int FDCDevice::readConfig(dictionary *ini) {
 }
 
 int FDCDevice::flush() {
+    storeTrackBuffer();
     for (uint8_t i=0; i<FDC_NUM_DRIVES; i++) {
         if (!drive[i].bs)
             continue;
@@ -152,6 +167,23 @@ int FDCDevice::flush() {
     return 0;
 }
 
+bool FDCDevice::cacheStats(CacheStats& out) const {
+    out = CacheStats{};
+    bool any = false;
+    for (const FDDrive& d : drive) {
+        CacheStats s;
+        if (!d.bs || d.dirsrc || !d.bs->cacheStats(s))
+            continue;
+        out.hits += s.hits;
+        out.misses += s.misses;
+        out.writebacks += s.writebacks;
+        out.prefetched += s.prefetched;
+        out.deferred += s.deferred;
+        any = true;
+    }
+    return any;
+}
+
 int FDCDevice::isInterrupt() {
     // Original behavior: if INT mode enabled and data is pending for
     bool pending = false;
@@ -178,9 +210,14 @@ int FDCDevice::isInterrupt() {
 int FDCDevice::setDriveContent(uint8_t drive_id, const char* file_path) {
     if (drive_id >= FDC_NUM_DRIVES || !file_path) return -1;
 
+    waitWork(); // a deferred write-back may still use the drive's image
     auto& d = drive[drive_id];
+    sector_data = buffer; // may point into the image going away
+    if (tb_drive == drive_id)
+        dropTrackBuffer();
     d.bs.reset(); // flushes and closes the previous image, if any
     d.dirsrc = nullptr;
+    d.index.clear();
     d.TRACK = 0;
     d.SECTOR = 0;
     d.SIDE = 0;
@@ -223,13 +260,28 @@ int FDCDevice::setDriveContent(uint8_t drive_id, const char* file_path) {
     } else {
         // 512-byte cache: writes reach FatFS in whole FAT sectors, which
         // matters on flash where every partial write still costs a full
-        // remapped page program
-        if (ByteSourceFactory::from_file(file_path, 0, 512, /* wrap = */false, d.bs) != 0) {
+        // remapped page program. An image on flash reads in place until
+        // it is first written, and then gets the same cache.
+        const int packed = ByteSourceFactory::from_compressed(file_path, 512, /* wrap = */false, d.bs);
+        if (packed < 0) {
             d.bs.reset();
             return -1;
         }
+        if (packed == 0) {
+            applyCacheConfig(d.bs.get(), file_path);
+        } else if (openXip(file_path, 0, 512, /* wrap = */false, d.bs, true,
+                           cfg_image[drive_id] == file_path)) {
+            printf("fdc: %s read in place\n", file_path);
+        } else {
+            if (ByteSourceFactory::from_file(file_path, 0, 512, /* wrap = */false, d.bs) != 0) {
+                d.bs.reset();
+                return -1;
+            }
+            applyCacheConfig(d.bs.get(), file_path);
+        }
     }
 
+    indexImage(drive_id);
     d.track_offset = getTrackOffset(drive_id, d.TRACK, d.SIDE);
     cur_image[drive_id] = file_path;
     return 1;
@@ -249,11 +301,123 @@ int FDCDevice::WriteThunk(MZDevice* dev, uint8_t port, uint8_t dt, uint8_t high_
 
 // -------------------- Private helpers (ported) --------------------
 
+// Size of track table entry i, in 0x100 units
+static inline uint8_t trackLength(unsigned i, uint8_t b) {
+    return (i == 1 && b == 0x25) ? 0x11 : b; // bugfix from original
+}
+
+bool FDCDevice::DskIndex::reserveTracks(uint16_t n) {
+    if (n <= cap) return true;
+    if (n > DSK_MAX_TRACKS) return false;
+    uint16_t want = static_cast<uint16_t>(cap + 16);
+    if (want < n) want = n;
+    if (want > DSK_MAX_TRACKS) want = DSK_MAX_TRACKS;
+    DskTrack* grown = new (std::nothrow) DskTrack[want];
+    if (!grown) return false;
+    if (tracks) std::memcpy(grown, tracks, count * sizeof(DskTrack));
+    delete[] tracks;
+    tracks = grown;
+    cap = static_cast<uint8_t>(want);
+    return true;
+}
+
+bool FDCDevice::DskIndex::reserveIds(uint16_t n) {
+    const uint32_t need = static_cast<uint32_t>(ids_used) + n;
+    if (need <= ids_cap) return true;
+    const uint32_t want = (need + 64 > 0xffff) ? need : need + 64;
+    if (want > 0xffff) return false;
+    uint8_t* grown = new (std::nothrow) uint8_t[want];
+    if (!grown) return false;
+    if (ids) std::memcpy(grown, ids, ids_used);
+    delete[] ids;
+    ids = grown;
+    ids_cap = static_cast<uint16_t>(want);
+    return true;
+}
+
+// The track table, up to its first empty entry. An image too short to
+// have one is left unindexed until WRITE TRACK lays it out.
+void FDCDevice::indexImage(uint8_t drive_id) {
+    auto& d = drive[drive_id];
+    DskIndex& x = d.index;
+    x.clear();
+    if (!d.bs || d.bs->seek(0x34) != 0) return;
+
+    uint8_t table[34];
+    uint32_t rlen = 0;
+    uint16_t n = 0;
+    uint16_t at = 1;
+    for (bool last = false; n < DSK_MAX_TRACKS && !last; ) {
+        d.bs->get(table, sizeof(table), rlen);
+        for (uint32_t j = 0; j < sizeof(table) && !last; ++j) {
+            if (j >= rlen || !table[j]) { last = true; break; }
+            if (!x.reserveTracks(static_cast<uint16_t>(n + 1))) {
+                x.clear(); // no RAM: the drive walks the image
+                return;
+            }
+            DskTrack& t = x.tracks[n];
+            t.at = at;
+            t.ids = 0;
+            t.len = trackLength(n, table[j]);
+            t.count = DSK_TRACK_UNREAD;
+            t.size = 0;
+            t.room = 0;
+            at = static_cast<uint16_t>(at + t.len);
+            x.count = static_cast<uint8_t>(++n);
+        }
+    }
+    x.end = at;
+    x.on = true;
+}
+
+// The track under the head with its sector IDs, read from its header
+// on first use; nullptr if the index does not cover it
+const FDCDevice::DskTrack* FDCDevice::indexedTrack(uint8_t drive_id) {
+    auto& d = drive[drive_id];
+    DskIndex& x = d.index;
+    const unsigned i = d.TRACK * 2u + d.SIDE;
+    if (!x.on || i >= x.count || x.tracks[i].at * 0x100 != d.track_offset) return nullptr;
+    DskTrack& t = x.tracks[i];
+    if (t.count != DSK_TRACK_UNREAD) return &t;
+
+    uint32_t rlen = 0;
+    uint8_t n = 0;
+    if (d.bs->seek(d.track_offset + 0x15) != 0) return nullptr;
+    d.bs->get(&n, 1, rlen);
+    if (rlen != 1 || n > DSK_MAX_SECTORS) return nullptr;
+    if (n > t.room) {
+        if (!x.reserveIds(n)) return nullptr;
+        t.ids = x.ids_used;
+        t.room = n;
+        x.ids_used = static_cast<uint16_t>(x.ids_used + n);
+    }
+    if (d.bs->seek(d.track_offset + 0x18) != 0) return nullptr;
+    uint8_t size = 0;
+    for (uint8_t s = 0; s < n; ++s) {
+        uint8_t desc[8];
+        d.bs->get(desc, 8, rlen);
+        if (rlen != 8) return nullptr;
+        x.ids[t.ids + s] = desc[2];
+        if (s == 0) size = desc[3];
+        else if (desc[3] != size) size = 0;
+    }
+    t.count = n;
+    t.size = size;
+    return &t;
+}
+
 int32_t FDCDevice::getTrackOffset(uint8_t drive_id, uint8_t track, uint8_t side) {
     // Based on FDC_GetTrackOffset(): seek to 0x34, sum table bytes for (track*2+side),
     // if (drive_id >= FDC_NUM_DRIVES || !drive[drive_id].fh.obj.fs) return 0;
     if (drive_id >= FDC_NUM_DRIVES || !drive[drive_id].bs) return 0;
 
+    const DskIndex& x = drive[drive_id].index;
+    if (x.on) {
+        const unsigned i = track * 2u + side;
+        if (i < x.count) return x.tracks[i].at * 0x100;
+        return i == x.count ? x.end * 0x100 : 0;
+    }
+
     uint32_t offset = 0;
     uint8_t  b = 0;
     uint32_t rlen = 0;
@@ -265,8 +429,7 @@ int32_t FDCDevice::getTrackOffset(uint8_t drive_id, uint8_t track, uint8_t side)
         drive[drive_id].bs->get(&b, 1, rlen);
         if (rlen != 1) return 0;
         if (b == 0x00) return 0;
-        if (i == 1 && b == 0x25) b = 0x11; // bugfix from original
-        offset += b * 0x100u;
+        offset += trackLength(i, b) * 0x100u;
     }
     offset += 0x100u;
     return static_cast<int32_t>(offset);
@@ -277,28 +440,38 @@ uint8_t FDCDevice::seekToSector(uint8_t drive_id, uint8_t sector) {
     auto& d = drive[drive_id];
     d.sector_size = 0;
 
-    const int32_t hdr = d.track_offset + 0x15;
-    uint32_t rlen = 0;
-    uint8_t sector_count = 0;
-
-    if (d.bs->seek(hdr) != 0) return 1;
-    d.bs->get(&sector_count, 1, rlen);
-    if (rlen != 1) return 1;
-
-    if (d.bs->seek(d.track_offset + 0x18) != 0) return 1;
-
     uint16_t acc = 0;
-    uint8_t  desc[8];
-    for (uint8_t i = 0; i < sector_count; ++i) {
-        d.bs->get(desc, 8, rlen);
-        if (rlen != 8) return 1;
-        if (sector == desc[2]) {
-            d.sector_size = static_cast<int16_t>(desc[3] * 0x100);
-            break;
+    const DskTrack* t = indexedTrack(drive_id);
+    if (t && t->size) {
+        const uint8_t* ids = d.index.ids + t->ids;
+        uint8_t i = 0;
+        while (i < t->count && ids[i] != sector) ++i;
+        if (i == t->count) return 1;
+        d.sector_size = static_cast<uint16_t>(t->size * 0x100);
+        acc = static_cast<uint16_t>(i * d.sector_size);
+    } else {
+        const int32_t hdr = d.track_offset + 0x15;
+        uint32_t rlen = 0;
+        uint8_t sector_count = 0;
+
+        if (d.bs->seek(hdr) != 0) return 1;
+        d.bs->get(&sector_count, 1, rlen);
+        if (rlen != 1) return 1;
+
+        if (d.bs->seek(d.track_offset + 0x18) != 0) return 1;
+
+        uint8_t  desc[8];
+        for (uint8_t i = 0; i < sector_count; ++i) {
+            d.bs->get(desc, 8, rlen);
+            if (rlen != 8) return 1;
+            if (sector == desc[2]) {
+                d.sector_size = static_cast<int16_t>(desc[3] * 0x100);
+                break;
+            }
+            acc += desc[3] * 0x100u;
         }
-        acc += desc[3] * 0x100u;
+        if (d.sector_size == 0) return 1;
     }
-    if (d.sector_size == 0) return 1;
 
     const int32_t data_pos = d.track_offset + acc + 0x100;
     if (d.bs->seek(data_pos) == 0) {
@@ -337,6 +510,8 @@ int FDCDevice::fdcWrite(uint8_t port, uint8_t dt, uint8_t /*high_addr*/) {
     auto drvIdx = [&]() -> uint8_t   { return static_cast<uint8_t>(MOTOR & 0x03); };
     auto curDrv = [&]() -> FDDrive& { return drive[MOTOR & 0x03]; };
 
+    if (sector_flush) settleSectorFlush();
+
     switch (off) {
     case 0: { // COMMAND / STATUS register write: process command
         if (waitForInt || error_int) { waitForInt = 0; error_int = 0; release_interrupt(); } // drop /INT on write to cmd
@@ -380,6 +555,8 @@ int FDCDevice::fdcWrite(uint8_t port, uint8_t dt, uint8_t /*high_addr*/) {
 
             MULTIBLOCK_RW = (COMMAND & 0x10) ? 0 : 1; // original inverted meaning
             if (setTrack()) { STATUS_SCRIPT = 3; return 1; }
+            if (t2 == 0x03)
+                bufferTrack(drvIdx());
 
             // sector select and seek
             if (seekToSector(drvIdx(), regSECTOR)) { STATUS_SCRIPT = 3; return 1; }
@@ -389,9 +566,7 @@ int FDCDevice::fdcWrite(uint8_t port, uint8_t dt, uint8_t /*high_addr*/) {
                 uint16_t chunk = (curDrv().sector_size < sizeof(buffer))
                                   ? curDrv().sector_size
                                   : sizeof(buffer);
-                uint32_t rlen = 0;
-                curDrv().bs->get(buffer, chunk, rlen);
-                if (rlen != chunk) { COMMAND = 0x00; regSTATUS = 0x08; return 1; }
+                if (loadChunk(chunk)) { COMMAND = 0x00; regSTATUS = 0x08; return 1; }
             }
             DATA_COUNTER = curDrv().sector_size;
             regSTATUS |= 0x01; // BUSY
@@ -433,19 +608,27 @@ int FDCDevice::fdcWrite(uint8_t port, uint8_t dt, uint8_t /*high_addr*/) {
             auto& d = curDrv();
             uint32_t rlen = 0;
             uint8_t nsec = 0;
-            if (d.bs->seek(d.track_offset + 0x15) != 0) { regSTATUS = 0x10; COMMAND = 0x00; return 1; }
-            d.bs->get(&nsec, 1, rlen);
-            if (rlen != 1 || !nsec || nsec > 29) { regSTATUS = 0x10; COMMAND = 0x00; return 1; }
-
-            // Collect the sector IDs (and size code) from the descriptors
-            if (d.bs->seek(d.track_offset + 0x18) != 0) { regSTATUS = 0x10; COMMAND = 0x00; return 1; }
             uint8_t size_code = 0;
-            for (uint8_t i = 0; i < nsec; ++i) {
-                uint8_t desc[8];
-                d.bs->get(desc, 8, rlen);
-                if (rlen != 8) { regSTATUS = 0x10; COMMAND = 0x00; return 1; }
-                buffer[8 + i] = desc[2];
-                size_code = desc[3]; // uniform per track on MZ formats
+            const DskTrack* t = indexedTrack(drvIdx());
+            if (t && t->size) {
+                nsec = t->count;
+                size_code = t->size;
+                if (!nsec) { regSTATUS = 0x10; COMMAND = 0x00; return 1; }
+                std::memcpy(buffer + 8, d.index.ids + t->ids, nsec);
+            } else {
+                if (d.bs->seek(d.track_offset + 0x15) != 0) { regSTATUS = 0x10; COMMAND = 0x00; return 1; }
+                d.bs->get(&nsec, 1, rlen);
+                if (rlen != 1 || !nsec || nsec > 29) { regSTATUS = 0x10; COMMAND = 0x00; return 1; }
+
+                // Collect the sector IDs (and size code) from the descriptors
+                if (d.bs->seek(d.track_offset + 0x18) != 0) { regSTATUS = 0x10; COMMAND = 0x00; return 1; }
+                for (uint8_t i = 0; i < nsec; ++i) {
+                    uint8_t desc[8];
+                    d.bs->get(desc, 8, rlen);
+                    if (rlen != 8) { regSTATUS = 0x10; COMMAND = 0x00; return 1; }
+                    buffer[8 + i] = desc[2];
+                    size_code = desc[3]; // uniform per track on MZ formats
+                }
             }
             buffer[4] = size_code;
             buffer[5] = nsec;
@@ -455,6 +638,8 @@ int FDCDevice::fdcWrite(uint8_t port, uint8_t dt, uint8_t /*high_addr*/) {
             if (!size_code || total > 0xFFFF) { regSTATUS = 0x10; COMMAND = 0x00; return 1; }
 
             // Sector data streams sequentially from the track's data area
+            rt_buffered = bufferTrack(drvIdx());
+            rt_pos = 0;
             if (d.bs->seek(d.track_offset + 0x100) != 0) { regSTATUS = 0x10; COMMAND = 0x00; return 1; }
 
             rt_phase = 0;
@@ -478,6 +663,9 @@ int FDCDevice::fdcWrite(uint8_t port, uint8_t dt, uint8_t /*high_addr*/) {
             if (isProtected(curDrv())) { // write protect
                 regSTATUS = 0x40; COMMAND = 0x00; error_int = 1; return 1;
             }
+            // The format rewrites the track and drops those after it
+            if (tb_drive == drvIdx())
+                dropTrackBuffer();
             write_track_stage = 0;
             write_track_counter = 0;
             DATA_COUNTER = 0;
@@ -533,7 +721,19 @@ int FDCDevice::fdcWrite(uint8_t port, uint8_t dt, uint8_t /*high_addr*/) {
         if (buffer_pos == chunk - 1) {
             uint32_t wlen = 0;
             buffer_pos = 0;
-            curDrv().bs->set(buffer, chunk, wlen);
+            ByteSource* bs = curDrv().bs.get();
+            const uint32_t pos = bs->tell();
+            if (inTrackBuffer(drvIdx(), pos, chunk)) {
+                // Into the buffered track: stored when the sector ends
+                const uint16_t at = static_cast<uint16_t>(pos - tb_start);
+                std::memcpy(track_buf + at, buffer, chunk);
+                if (tb_dirty_hi == tb_dirty_lo || at < tb_dirty_lo) tb_dirty_lo = at;
+                if (at + chunk > tb_dirty_hi) tb_dirty_hi = static_cast<uint16_t>(at + chunk);
+                bs->seek(pos + chunk);
+                wlen = chunk;
+            } else {
+                bs->set(buffer, chunk, wlen);
+            }
             if (wlen != chunk) { // write fault: terminate the command
                 DATA_COUNTER = 0; COMMAND = 0x00; STATUS_SCRIPT = 0;
                 regSTATUS = 0x20;
@@ -545,41 +745,51 @@ int FDCDevice::fdcWrite(uint8_t port, uint8_t dt, uint8_t /*high_addr*/) {
 
         // Sector finished?
         if (!DATA_COUNTER) {
-
-            curDrv().bs->flush();
-            // A directory mount reports dropped/failed physical writes
-            // (e.g. the backing medium is full) as a write fault - the
-            // guest must not believe a write that never landed
-            if (curDrv().dirsrc && curDrv().dirsrc->takeWriteError()) {
+            flush_drive = drvIdx();
+            const bool deferrable = work_deferrable(cur_image[flush_drive].c_str());
+            // flush_policy=lazy: an sd: image file keeps the sector until
+            // motor off (or reset, or the write-behind pool filling up)
+            if (deferrable && writeBehind == WriteBehind::LAZY && !curDrv().dirsrc)
+                return sectorWritten();
+            if (storeTrackBuffer() != 0) {
                 DATA_COUNTER = 0; COMMAND = 0x00; STATUS_SCRIPT = 0;
                 regSTATUS = 0x20;
                 return 1;
             }
-            if (MULTIBLOCK_RW) {
-                // advance to next sector id on track
-                regSECTOR = static_cast<uint8_t>(curDrv().SECTOR + 1);
-                if (seekToSector(drvIdx(), regSECTOR)) {
-                    regSECTOR--; STATUS_SCRIPT = 4; // RNF once, then 0x00
-                } else {
-                    DATA_COUNTER = curDrv().sector_size;
-                    buffer_pos   = 0;
-                    STATUS_SCRIPT = 2; // one BUSY then BUSY+DRQ
-                }
-            } else {
-                COMMAND = 0x00; regSTATUS = 0x00; STATUS_SCRIPT = 0;
+            if (!deferrable) {
+                curDrv().bs->flush();
+                return sectorWritten();
+            }
+            // On sd: the write-back (and a directory mount's commit) runs
+            // on core 0; the guest polls BUSY meanwhile, like a real
+            // controller writing the sector out
+            sector_flush = FLUSH_RUNNING;
+            if (!deferWork(SectorFlushJob, SectorFlushDone, this)) {
+                sector_flush = FLUSH_IDLE; // queue full: ran inline
+                return sectorWritten();
             }
+            regSTATUS = 0x01; STATUS_SCRIPT = 0; // BUSY, no DRQ
         }
         return 0;
     }
 
-    case 4: // MOTOR (drive select & motor on)
+    case 4: { // MOTOR (drive select & motor on)
+        const bool was_on = (MOTOR & 0x80) != 0;
         if (dt & 0x04) {
             MOTOR = static_cast<uint8_t>(dt & 0x83);
         } else {
             if (dt & 0x80) MOTOR = static_cast<uint8_t>(MOTOR | 0x80);
             else           MOTOR = static_cast<uint8_t>(MOTOR & 0x03);
         }
+        if (was_on && !(MOTOR & 0x80) && writeBehind == WriteBehind::LAZY) {
+            // Motor off: store what lazy write-behind holds
+            waitWork();
+            storeTrackBuffer();
+            for (auto& d : drive)
+                if (d.bs && !d.dirsrc) d.bs->flush();
+        }
         return 0;
+    }
 
     case 5: // SIDE select
         SIDE = static_cast<uint8_t>(dt & 0x01);
@@ -599,6 +809,57 @@ int FDCDevice::fdcWrite(uint8_t port, uint8_t dt, uint8_t /*high_addr*/) {
     }
 }
 
+// -------------------- WRITE SECTOR completion --------------------
+
+// The sector's data has been written back: report a failed write, then
+// either move on to the next sector of a multi-sector write or end the
+// command
+int FDCDevice::sectorWritten() {
+    auto& d = drive[flush_drive];
+    // A directory mount reports dropped/failed physical writes
+    // (e.g. the backing medium is full) as a write fault - the
+    // guest must not believe a write that never landed
+    if (d.dirsrc && d.dirsrc->takeWriteError()) {
+        DATA_COUNTER = 0; COMMAND = 0x00; STATUS_SCRIPT = 0;
+        regSTATUS = 0x20;
+        return 1;
+    }
+    if (MULTIBLOCK_RW) {
+        // advance to next sector id on track
+        regSECTOR = static_cast<uint8_t>(d.SECTOR + 1);
+        if (seekToSector(flush_drive, regSECTOR)) {
+            regSECTOR--; STATUS_SCRIPT = 4; // RNF once, then 0x00
+        } else {
+            DATA_COUNTER = d.sector_size;
+            buffer_pos   = 0;
+            STATUS_SCRIPT = 2; // one BUSY then BUSY+DRQ
+        }
+    } else {
+        COMMAND = 0x00; regSTATUS = 0x00; STATUS_SCRIPT = 0;
+    }
+    return 0;
+}
+
+// Any FDC access but a STATUS poll while the write-back runs: wait for it
+// (bounded by the one sector), then finish the sector first
+void FDCDevice::settleSectorFlush() {
+    waitWork();
+    sector_flush = FLUSH_IDLE;
+    sectorWritten();
+}
+
+// Core 0
+int FDCDevice::SectorFlushJob(void* ctx) {
+    auto* self = static_cast<FDCDevice*>(ctx);
+    return self->drive[self->flush_drive].bs->flush();
+}
+
+// Core 1, between bus cycles: only note it, the next FDC access (under
+// EXWAIT) finishes the sector
+void FDCDevice::SectorFlushDone(void* ctx, int) {
+    static_cast<FDCDevice*>(ctx)->sector_flush = FLUSH_LANDED;
+}
+
 // -------------------- WRITE TRACK (format), ported from unicard fdc.c --------------------
 //
 // The Z80 streams a raw WD1793 MFM track image through the DATA register;
@@ -643,6 +904,7 @@ int FDCDevice::writeTrackByte(uint8_t dt) {
                 if (wlen != sizeof(dsk_hdr)) return abortTrackWrite();
                 d.bs->set(buffer, 204, wlen); // zero the table, 0x34..0xff
                 if (wlen != 204) return abortTrackWrite();
+                d.index.empty();
             }
         } else if (write_track_counter > 100) {
             return abortTrackWrite(); // format never started
@@ -728,7 +990,8 @@ uint8_t FDCDevice::readTrackByte() {
         return 0xfb;                                      // data address mark
     default: { // phase 7: sector data
         uint8_t b = 0;
-        if (!d.bs || d.bs->getByte(b) != 0) b = 0xe5;     // filler on failure
+        if (rt_buffered && rt_pos < tb_len) b = track_buf[rt_pos++];
+        else if (!d.bs || d.bs->getByte(b) != 0) b = 0xe5; // filler on failure
         if (--rt_remaining == 0) { ++rt_sec_idx; rt_phase = 1; }
         return b;
     }
@@ -819,17 +1082,118 @@ int FDCDevice::finishTrackWrite() {
     d.bs->set(&b, 1, wlen);
     if (wlen != 1) { regSTATUS = 0x20; return 1; }
 
+    // The index follows the table: this track is now the last one, its
+    // IDs are read back from the header just written
+    DskIndex& x = d.index;
+    const unsigned i = regTRACK * 2u + SIDE;
+    if (x.on && i <= x.count && x.reserveTracks(static_cast<uint16_t>(i + 1))) {
+        DskTrack& t = x.tracks[i];
+        if (i == x.count) t.room = 0; // an ID slot of its own comes with the header
+        t.at = static_cast<uint16_t>(off / 0x100);
+        t.len = trackLength(i, b);
+        t.count = DSK_TRACK_UNREAD;
+        t.size = 0;
+        x.count = static_cast<uint8_t>(i + 1);
+        x.end = static_cast<uint16_t>(t.at + t.len);
+    } else {
+        x.clear();
+    }
+
     if (d.bs->flush() != 0) return 1;
     if (d.dirsrc && d.dirsrc->takeWriteError()) { regSTATUS = 0x20; return 1; }
     return 0;
 }
 
+// -------------------- Track buffer --------------------
+
+// The buffer holds the track under the drive's head, read whole if it did
+// not; false if the track does not qualify (a directory mount, an image in
+// RAM or read in place, sectors of mixed sizes, more data than the buffer)
+// and it is read from the image
+bool FDCDevice::bufferTrack(uint8_t drive_id) {
+    if (!track_buf) return false;
+    auto& d = drive[drive_id];
+    const uint32_t start = static_cast<uint32_t>(d.track_offset) + 0x100u;
+    if (tb_drive == drive_id && tb_start == start) return true;
+    if (!d.bs || d.dirsrc || d.bs->inMemory()) return false;
+
+    const DskTrack* t = indexedTrack(drive_id);
+    if (!t || !t->size || !t->count) return false;
+    const uint32_t len = static_cast<uint32_t>(t->count) * t->size * 0x100u;
+    if (len > FDC_TRACK_BUFFER || start + len > d.bs->size()) return false;
+    if (storeTrackBuffer() != 0) return false; // keeps what it could not store
+
+    // One get() of the whole track: a single read from the card
+    tb_drive = TB_NONE;
+    uint32_t rlen = 0;
+    if (d.bs->seek(start) != 0) return false;
+    d.bs->get(track_buf, len, rlen);
+    if (rlen != len) return false;
+    tb_drive = drive_id;
+    tb_start = start;
+    tb_len = static_cast<uint16_t>(len);
+    return true;
+}
+
+// Written bytes of the buffered track to the image (its cache, and from
+// there as flush_policy says)
+int FDCDevice::storeTrackBuffer() {
+    if (tb_drive == TB_NONE || tb_dirty_hi == tb_dirty_lo) return 0;
+    ByteSource* bs = drive[tb_drive].bs.get();
+    const uint32_t len = tb_dirty_hi - tb_dirty_lo;
+    uint32_t wlen = 0;
+    if (!bs || bs->seek(tb_start + tb_dirty_lo) != 0) return -1;
+    bs->set(track_buf + tb_dirty_lo, len, wlen);
+    if (wlen != len) return -1;
+    tb_dirty_lo = tb_dirty_hi = 0;
+    return 0;
+}
+
+int FDCDevice::dropTrackBuffer() {
+    const int ret = storeTrackBuffer();
+    tb_drive = TB_NONE;
+    tb_dirty_lo = tb_dirty_hi = 0;
+    return ret;
+}
+
+// The next `chunk` bytes of the sector being read, at sector_data: in
+// place when the image holds them in RAM or its cache window (nothing
+// else touches it until the next chunk), else copied into buffer
+int FDCDevice::loadChunk(uint16_t chunk) {
+    ByteSource* bs = drive[MOTOR & 0x03].bs.get();
+    const uint32_t pos = bs->tell();
+    if (inTrackBuffer(MOTOR & 0x03, pos, chunk)) {
+        sector_data = track_buf + (pos - tb_start);
+        bs->seek(pos + chunk); // fails at the image end: nothing follows
+        return 0;
+    }
+    uint32_t avail = 0;
+    const uint8_t* span = bs->acquireSpan(pos, chunk, false, avail);
+    if (span && avail == chunk) {
+        bs->releaseSpan(chunk);
+        sector_data = span;
+        return 0;
+    }
+    if (span)
+        bs->releaseSpan(0);
+    sector_data = buffer;
+    uint32_t rlen = 0;
+    bs->get(buffer, chunk, rlen);
+    return rlen == chunk ? 0 : -1;
+}
+
 int FDCDevice::fdcRead(uint8_t port, uint8_t* dt, uint8_t /*high_addr*/) {
     const uint8_t off = static_cast<uint8_t>(port - readMappings[0].port) & 0x07;
 
     auto curDrv = [&]() -> FDDrive& { return drive[MOTOR & 0x03]; };
     auto drvIdx = [&]() -> uint8_t   { return static_cast<uint8_t>(MOTOR & 0x03); };
 
+    if (sector_flush == FLUSH_RUNNING && off == 0) {
+        *dt = static_cast<uint8_t>(~0x01); // BUSY until the sector is out
+        return 0;
+    }
+    if (sector_flush) settleSectorFlush();
+
     switch (off) {
     case 0: { // STATUS register read (with STATUS_SCRIPT choreography)
         // A status read acknowledges an immediate-termination /INT (real
@@ -849,12 +1213,10 @@ int FDCDevice::fdcRead(uint8_t port, uint8_t* dt, uint8_t /*high_addr*/) {
                         if (seekToSector(drvIdx(), regSECTOR)) {
                             regSECTOR--; STATUS_SCRIPT = 4;
                         } else {
-                            uint32_t rlen = 0;
                             const uint16_t chunk = (curDrv().sector_size < sizeof(buffer))
                                                      ? curDrv().sector_size
                                                      : sizeof(buffer);
-                            curDrv().bs->get(buffer, chunk, rlen);
-                            if (rlen != chunk) {
+                            if (loadChunk(chunk)) {
                                 DATA_COUNTER = 0; COMMAND = 0x00; STATUS_SCRIPT = 0;
                                 regSTATUS = 0x08;
                                 return 1;
@@ -925,14 +1287,12 @@ int FDCDevice::fdcRead(uint8_t port, uint8_t* dt, uint8_t /*high_addr*/) {
             const uint16_t chunk = (curDrv().sector_size < sizeof(buffer))
                                      ? curDrv().sector_size
                                      : sizeof(buffer);
-            *dt = static_cast<uint8_t>(~buffer[buffer_pos]);
+            *dt = static_cast<uint8_t>(~sector_data[buffer_pos]);
             --DATA_COUNTER;
 
             if (buffer_pos == chunk - 1) {
                 buffer_pos = 0;
-                uint32_t rlen = 0;
-                curDrv().bs->get(buffer, chunk, rlen);
-                if (rlen != chunk) { // data error: terminate the command
+                if (loadChunk(chunk)) { // data error: terminate the command
                     DATA_COUNTER = 0; COMMAND = 0x00; STATUS_SCRIPT = 0;
                     regSTATUS = 0x08;
                     return 1;
@@ -949,12 +1309,10 @@ int FDCDevice::fdcRead(uint8_t port, uint8_t* dt, uint8_t /*high_addr*/) {
                     if (seekToSector(drvIdx(), regSECTOR)) {
                         regSECTOR--; STATUS_SCRIPT = 4;
                     } else {
-                        uint32_t rlen = 0;
                         const uint16_t c2 = (curDrv().sector_size < sizeof(buffer))
                                              ? curDrv().sector_size
                                              : sizeof(buffer);
-                        curDrv().bs->get(buffer, c2, rlen);
-                        if (rlen != c2) {
+                        if (loadChunk(c2)) {
                             DATA_COUNTER = 0; COMMAND = 0x00; STATUS_SCRIPT = 0;
                             regSTATUS = 0x08;
                             return 1;
@@ -30,6 +30,9 @@ constexpr const char FDC_ID[] = "fdc";
 #define FDC_READ_PORTS 4
 #define FDC_NUM_DRIVES 4
 #define FILENAME_LENGTH 32
+#define DSK_MAX_TRACKS 204   // entries of the DSK track size table, 0x34..0xff
+#define DSK_MAX_SECTORS 29   // descriptors in a track header
+#define FDC_TRACK_BUFFER 0x1200 // track_buffer: 9 x 512 or 18 x 256 bytes of data
 
 class FDCDevice final : public MZDevice {
 public:
@@ -38,28 +41,88 @@ public:
     int init() override;
     void softReset() override;
     int isInterrupt() override;
+    bool canInterrupt() const override { return true; }
     RAM_FUNC bool needsExwait() const override { return FDC_EXWAIT; }
-    std::vector<uint8_t> getReadPorts() const override;
-    std::vector<uint8_t> getWritePorts() const override;
+    PortList getReadPorts() const override;
+    PortList getWritePorts() const override;
     int readConfig(dictionary *ini) override;
     int flush() override;
-    static ALWAYS_INLINE std::string getDevType() { return FDC_ID; }
+    // File-image drives added up (a directory mount keeps its single
+    // window: its flush() commits the directory)
+    bool cacheStats(CacheStats& out) const override;
     int setDriveContent(uint8_t drive_id, const char* file_path);
 
 private:
     static int ReadThunk(MZDevice* dev, uint8_t port, uint8_t* dt, uint8_t high_addr);
     static int WriteThunk(MZDevice* dev, uint8_t port, uint8_t  dt, uint8_t high_addr);
     int32_t getTrackOffset(uint8_t drive_id, uint8_t track, uint8_t side);
+    void indexImage(uint8_t drive_id);
+    struct DskTrack;
+    const DskTrack* indexedTrack(uint8_t drive_id);
     uint8_t seekToSector(uint8_t drive_id, uint8_t sector);
     uint8_t setTrack();
     int fdcRead(uint8_t port, uint8_t* dt, uint8_t high_addr);
     int fdcWrite(uint8_t port, uint8_t  dt, uint8_t high_addr);
+    int loadChunk(uint16_t chunk);
+    int sectorWritten();
+    void settleSectorFlush();
+    static int SectorFlushJob(void* ctx);
+    static void SectorFlushDone(void* ctx, int result);
+    bool bufferTrack(uint8_t drive_id);
+    int storeTrackBuffer();
+    int dropTrackBuffer();
     int writeTrackByte(uint8_t dt);
     int finishTrackWrite();
     int abortTrackWrite();
     uint8_t readTrackByte();
 
 private:
+    // Where a DSK image's tracks and sectors are, so that a seek is a
+    // lookup rather than reads through the image. The track table is
+    // taken from the DSK header at mount (indexImage()); a track's sector
+    // IDs from its header the first time the head is on it, and again
+    // after WRITE TRACK rewrites it. A track whose sectors are not all
+    // one size, and a drive the index found no RAM for, are walked in
+    // the image as before.
+    static constexpr uint8_t DSK_TRACK_UNREAD = 0xff;
+    struct DskTrack {
+        uint16_t at;    // track header offset, in 0x100 units
+        uint16_t ids;   // its sector IDs in DskIndex::ids
+        uint8_t len;    // table entry: header and data, in 0x100 units
+        uint8_t count;  // sectors, DSK_TRACK_UNREAD until the header is read
+        uint8_t size;   // sector size in 0x100 units, 0: mixed, walk it
+        uint8_t room;   // IDs reserved at ids
+    };
+    struct DskIndex {
+        bool on{false};
+        uint8_t count{0};            // tracks up to the table's first 0 entry
+        uint8_t cap{0};
+        uint16_t end{1};             // past the last track, in 0x100 units
+        DskTrack* tracks{nullptr};
+        uint8_t* ids{nullptr};
+        uint16_t ids_used{0};
+        uint16_t ids_cap{0};
+        ~DskIndex() { clear(); }
+        void clear() {
+            delete[] tracks;
+            delete[] ids;
+            tracks = nullptr;
+            ids = nullptr;
+            on = false;
+            count = cap = 0;
+            end = 1;
+            ids_used = ids_cap = 0;
+        }
+        // WRITE TRACK on track 0 cleared the table: no tracks, RAM kept
+        void empty() {
+            on = true;
+            count = 0;
+            end = 1;
+            ids_used = 0;
+        }
+        bool reserveTracks(uint16_t n);
+        bool reserveIds(uint16_t n);
+    };
     struct FDDrive {
         std::unique_ptr<ByteSource> bs;
         FDCDirSource* dirsrc{nullptr}; // non-null when bs is a directory mount
@@ -70,6 +133,7 @@ private:
         uint16_t sector_size{0};
         uint8_t wp{0};     // per-drive write protect from config
         uint8_t fs_cfg{0}; // dir-mount filesystem: 0 auto, 1 basic, 2 cpm
+        DskIndex index;
     };
     // effective protection: ini flag or a read-only image file/medium
     static bool isProtected(const FDDrive& d) { return d.wp || (d.bs && d.bs->readOnly()); }
@@ -80,6 +144,7 @@ private:
     uint8_t SIDE{0};
     uint8_t buffer[0x100]{};
     uint16_t buffer_pos{0};
+    const uint8_t* sector_data{buffer}; // sector read chunk: buffer or the image's own
     uint8_t COMMAND{0};
     uint8_t MOTOR{0};
     uint8_t DENSITY{0};
@@ -94,8 +159,31 @@ private:
     uint8_t rt_phase{0};        // READ TRACK stream synthesis state
     uint8_t rt_sec_idx{0};
     uint16_t rt_remaining{0};
+    uint16_t rt_pos{0};         // READ TRACK from the track buffer: data bytes sent
+    bool rt_buffered{false};
     uint8_t reading_status_counter{0};
     uint8_t error_int{0}; // /INT for a command that terminated immediately
+    // WRITE SECTOR write-back deferred to core 0 (sd: images): STATUS
+    // reads BUSY while it runs, the first access after it landed
+    // finishes the sector
+    enum : uint8_t { FLUSH_IDLE, FLUSH_RUNNING, FLUSH_LANDED };
+    uint8_t sector_flush{FLUSH_IDLE};
+    uint8_t flush_drive{0};
+    // track_buffer=true: the data of one track, read whole the first time
+    // READ SECTOR or READ TRACK reaches it, then read and written in RAM;
+    // written bytes are stored at the end of each sector, or with
+    // flush_policy=lazy when the head moves to another track
+    static constexpr uint8_t TB_NONE = 0xff;
+    uint8_t* track_buf{nullptr};
+    uint8_t tb_drive{TB_NONE};  // the drive it holds a track of
+    uint32_t tb_start{0};       // image offset of its first byte
+    uint16_t tb_len{0};
+    uint16_t tb_dirty_lo{0};    // written bytes not stored yet
+    uint16_t tb_dirty_hi{0};
+    // A chunk at pos on the drive lies in the buffered track
+    bool inTrackBuffer(uint8_t drive_id, uint32_t pos, uint32_t len) const {
+        return tb_drive == drive_id && pos >= tb_start && pos + len <= tb_start + tb_len;
+    }
     int fd0disabled{-1};
     // Explorer mounts are session state: softReset() reverts each drive to
     // its ini-configured image (cfg_image), like the old full reboot did
@@ -3,10 +3,12 @@
 #include "bus.hpp"
 #include "config.hpp"
 #include "cloud_fs.hpp"
+#include "bus_stats.hpp"
+#include "boot_prof.hpp"
+#include "hot_config.hpp"
+#include "core_load.hpp"
 #include <string.h>
 
-REGISTER_MZ_DEVICE(PicoMgr)
-
 PicoMgr::PicoMgr()
     : response_command(0), idx(0), recordSize_(0), pack_(nullptr), unpack_(nullptr)
 {
@@ -34,16 +36,16 @@ int PicoMgr::init() {
     return 0;
 }
 
-std::vector<uint8_t> PicoMgr::getReadPorts() const {
-    std::vector<uint8_t> ports;
+PortList PicoMgr::getReadPorts() const {
+    PortList ports;
     for (uint8_t i = 0; i < PICO_MGR_READ_PORT_COUNT; ++i) {
         ports.push_back(PICO_MGR_DEFAULT_BASE_PORT + i);
     }
     return ports;
 }
 
-std::vector<uint8_t> PicoMgr::getWritePorts() const {
-    std::vector<uint8_t> ports;
+PortList PicoMgr::getWritePorts() const {
+    PortList ports;
     for (uint8_t i = 0; i < PICO_MGR_WRITE_PORT_COUNT; ++i) {
         ports.push_back(PICO_MGR_DEFAULT_BASE_PORT + i);
     }
@@ -107,6 +109,111 @@ bool PicoMgr::getRecord(uint16_t index, void* outRecord) const {
     return true;
 }
 
+#ifdef BUS_STATS
+// REPO_CMD_GET_BUS_STATS payload, all counts in clk_sys cycles (LE):
+//   u8 version (1), u8 bucket count, u8 bucket shift, u8 port count,
+//   u32 clk_sys kHz, then per port: u8 port, u32 cycles, u32 max latency,
+//   u32 max hold, u32 latency[buckets], u32 hold[buckets]
+// See bus_stats.hpp for the bucket layout.
+static int get_bus_stats(PicoMgr* mgr) {
+    uint8_t* p = mgr->allocateRaw(8);
+    if (!p) return -1;
+    p[0] = 1;
+    p[1] = BUS_STATS_BUCKETS;
+    p[2] = BUS_STATS_BUCKET_SHIFT;
+    p[3] = bus_stats_ports;
+    write_u32_le(p + 4, bus_stats_clock_khz());
+    for (uint8_t i = 0; i < bus_stats_ports; i++) {
+        const BusPortStats& s = bus_stats[i];
+        p = mgr->allocateRaw(13 + 8 * BUS_STATS_BUCKETS);
+        if (!p) return -1;
+        *p++ = s.port;
+        write_u32_le(p, s.count);      p += 4;
+        write_u32_le(p, s.lat_max);    p += 4;
+        write_u32_le(p, s.hold_max);   p += 4;
+        for (uint8_t b = 0; b < BUS_STATS_BUCKETS; b++, p += 4)
+            write_u32_le(p, s.lat[b]);
+        for (uint8_t b = 0; b < BUS_STATS_BUCKETS; b++, p += 4)
+            write_u32_le(p, s.hold[b]);
+    }
+    return 0;
+}
+#endif
+
+#ifdef CORE_LOAD
+// REPO_CMD_GET_CORE_LOAD payload (LE):
+//   u8 version (1), u8 task count, u8 window count, u8 flags (bit 0: core
+//   1 bus cycles counted, BUS_STATS), u32 clk_sys kHz (0 without),
+//   u32 core 1 empty polls per second at idle (the reference),
+//   per one-second window, newest first: u32 length in us, u32 core 0 us
+//   per task (CoreLoadTask order, idle first), u32 core 1 empty polls,
+//   u32 core 1 bus cycles, u32 I2S underruns
+// See core_load.hpp.
+static int get_core_load(PicoMgr* mgr) {
+    uint8_t* hdr = mgr->allocateRaw(12);
+    if (!hdr) return -1;
+    hdr[0] = 1;
+    hdr[1] = CORE_LOAD_TASKS;
+#ifdef BUS_STATS
+    hdr[3] = 1;
+    write_u32_le(hdr + 4, bus_stats_clock_khz());
+#else
+    hdr[3] = 0;
+    write_u32_le(hdr + 4, 0);
+#endif
+    write_u32_le(hdr + 8, core_load_poll_ref);
+    uint8_t count = 0;
+    uint8_t i = core_load_head;
+    for (; count < CORE_LOAD_SECONDS; count++) {
+        i = (i + CORE_LOAD_SECONDS - 1) % CORE_LOAD_SECONDS;
+        const CoreLoadWindow& w = core_load_hist[i];
+        if (!w.window_us) break;
+        uint8_t* p = mgr->allocateRaw(16 + 4 * CORE_LOAD_TASKS);
+        if (!p) return -1;
+        write_u32_le(p, w.window_us);  p += 4;
+        for (uint8_t t = 0; t < CORE_LOAD_TASKS; t++, p += 4)
+            write_u32_le(p, w.us[t]);
+        write_u32_le(p, w.polls);      p += 4;
+        write_u32_le(p, w.busy1);      p += 4;
+        write_u32_le(p, w.underruns);
+    }
+    hdr[2] = count;
+    return 0;
+}
+#endif
+
+#ifdef BOOT_PROF
+// REPO_CMD_GET_BOOT_PROF payload, times in us since reset (LE):
+//   u8 version (1), u8 phase count, u8 device count, u8 flags (bit 0:
+//   ini read from sd:), u32 listen_loop entry, u32 IPL probe time,
+//   per phase (BootPhase order): u32 start, u32 duration,
+//   per device: char id[12], u32 ports, u32 init, u32 readConfig
+static int get_boot_prof(PicoMgr* mgr) {
+    uint8_t* p = mgr->allocateRaw(12 + 8 * BOOT_PHASE_COUNT);
+    if (!p) return -1;
+    *p++ = 1;
+    *p++ = BOOT_PHASE_COUNT;
+    *p++ = boot_prof.devCount;
+    *p++ = boot_prof.iniFromSd ? 1 : 0;
+    write_u32_le(p, boot_prof.listen_us); p += 4;
+    write_u32_le(p, BOOT_PROF_IPL_US);    p += 4;
+    for (uint8_t i = 0; i < BOOT_PHASE_COUNT; i++, p += 8) {
+        write_u32_le(p, boot_prof.phase[i].start_us);
+        write_u32_le(p + 4, boot_prof.phase[i].dur_us);
+    }
+    for (uint8_t i = 0; i < boot_prof.devCount; i++) {
+        const BootDevice& d = boot_prof.dev[i];
+        p = mgr->allocateRaw(BOOT_PROF_ID_LEN + 4 * BOOT_DEV_STEPS);
+        if (!p) return -1;
+        memcpy(p, d.id, BOOT_PROF_ID_LEN);
+        p += BOOT_PROF_ID_LEN;
+        for (uint8_t s = 0; s < BOOT_DEV_STEPS; s++, p += 4)
+            write_u32_le(p, d.step_us[s]);
+    }
+    return 0;
+}
+#endif
+
 int PicoMgr::writeControl(MZDevice* self, uint8_t, uint8_t dt, uint8_t) {
     auto* mgr = static_cast<PicoMgr*>(self);
     int ret = 0;
@@ -141,6 +248,19 @@ int PicoMgr::writeControl(MZDevice* self, uint8_t, uint8_t dt, uint8_t) {
                 break;
             }
 #endif
+            // Local sd: listings and MZF loads take the same route through
+            // the deferred-work queue: up to MAX_DIR_FILES f_readdir calls
+            // or a 48KB body read would otherwise run under EXWAIT. Image
+            // mounts (.dsk, .mzq) stay inline - they reconfigure another
+            // device - as does flash: (see work_queue.hpp).
+            if (work_deferrable(path.c_str()) &&
+                (dt == REPO_CMD_LIST_DIR || mount_loads_mzf(path.c_str()))) {
+                mgr->jobListDir = dt == REPO_CMD_LIST_DIR;
+                mgr->jobPath = path;
+                mgr->response_command = PICO_MGR_RESULT_IN_PROGRESS;
+                mgr->deferWork(LocalJob, LocalDone, mgr); // inline when full
+                break;
+            }
             if (dt == REPO_CMD_LIST_DIR)
                 ret = read_directory(path.c_str(), mgr);
             else
@@ -171,15 +291,97 @@ int PicoMgr::writeControl(MZDevice* self, uint8_t, uint8_t dt, uint8_t) {
             setResponse(0);
             break;
         }
+        case REPO_CMD_GET_BUS_STATS: {
+            // Optional argument byte: 1 = clear the histograms after the
+            // snapshot, so the next call covers just the interval between
+            bool reset = len >= 1 && mgr->data[2] == 1;
+            mgr->idx = 0;
+            mgr->resetContent();
+#ifdef BUS_STATS
+            ret = get_bus_stats(mgr);
+            if (!ret && reset)
+                bus_stats_reset();
+#else
+            (void)reset;
+            mgr->setString("Bus stats not built in");
+            ret = -1;
+#endif
+            setResponse(ret);
+            break;
+        }
+        case REPO_CMD_GET_BOOT_PROF:
+            mgr->idx = 0;
+            mgr->resetContent();
+#ifdef BOOT_PROF
+            ret = get_boot_prof(mgr);
+#else
+            mgr->setString("Boot profile not built in");
+            ret = -1;
+#endif
+            setResponse(ret);
+            break;
+        case REPO_CMD_GET_CORE_LOAD:
+            mgr->idx = 0;
+            mgr->resetContent();
+#ifdef CORE_LOAD
+            ret = get_core_load(mgr);
+#else
+            mgr->setString("Core load not built in");
+            ret = -1;
+#endif
+            setResponse(ret);
+            break;
+        case REPO_CMD_RECONFIG: {
+            // Applied by listen_loop() once this cycle ends - it may change
+            // the very dispatch table this handler was called from
+            if (len == 0) return -1;
+            std::string cmd(reinterpret_cast<char*>(mgr->data + 2), len-1);
+            mgr->idx = 0;
+            mgr->resetContent();
+            ret = hot_config_submit(HOT_CONFIG_MGR, cmd.c_str(), ReconfigDone, mgr);
+            if (!ret) {
+                mgr->response_command = PICO_MGR_RESULT_IN_PROGRESS;
+                break;
+            }
+            mgr->setString(ret == -2 ? "Reconfig too long" : "Reconfig busy");
+            setResponse(ret);
+            break;
+        }
         default:
             return -1;
     }
+    mgr->restage();
     return 0;
 }
 
+// Core 0: the buffer belongs to the job until LocalDone publishes the
+// status, like an async cloud command
+int PicoMgr::LocalJob(void* ctx) {
+    auto* mgr = static_cast<PicoMgr*>(ctx);
+    return mgr->jobListDir ? read_directory(mgr->jobPath.c_str(), mgr)
+                           : mount_file(mgr->jobPath.c_str(), mgr);
+}
+
+void PicoMgr::LocalDone(void* ctx, int result) {
+    auto* mgr = static_cast<PicoMgr*>(ctx);
+    mgr->asyncComplete(result);
+    mgr->restage();
+}
+
+// Answer: the outcome as a string ("pico_rd2: ok")
+void PicoMgr::ReconfigDone(void* ctx, int result, const char* msg) {
+    auto* mgr = static_cast<PicoMgr*>(ctx);
+    mgr->setString(msg);
+    mgr->asyncComplete(result);
+    mgr->restage();
+}
+
 int PicoMgr::readControl(MZDevice* self, uint8_t, uint8_t* dt, uint8_t) {
     auto* mgr = static_cast<PicoMgr*>(self);
     *dt = mgr->response_command;
+    // An async command fills the buffer on core 0 before it publishes the
+    // status: once the Z80 sees it, the staged data byte must be fresh
+    mgr->restage();
     return 0;
 }
 
@@ -187,25 +389,29 @@ int PicoMgr::writeData(MZDevice* self, uint8_t, uint8_t dt, uint8_t) {
     auto* mgr = static_cast<PicoMgr*>(self);
     mgr->data[mgr->idx++] = dt;
     if (mgr->idx >= PICO_MGR_BUFF_SIZE) mgr->idx = 0;
+    mgr->restage();
     return 0;
 }
 
-int PicoMgr::readData(MZDevice* self, uint8_t, uint8_t* dt, uint8_t) {
+RAM_FUNC int PicoMgr::readData(MZDevice* self, uint8_t, uint8_t* dt, uint8_t) {
     auto* mgr = static_cast<PicoMgr*>(self);
     *dt = mgr->data[mgr->idx++];
     if (mgr->idx >= PICO_MGR_BUFF_SIZE) mgr->idx = 0;
+    mgr->restage();
     return 0;
 }
 
 int PicoMgr::writeAddr0(MZDevice* self, uint8_t, uint8_t dt, uint8_t) {
     auto* mgr = static_cast<PicoMgr*>(self);
     mgr->idx = (mgr->idx & 0xFF00) | dt;
+    mgr->restage();
     return 0;
 }
 
 int PicoMgr::writeAddr1(MZDevice* self, uint8_t, uint8_t dt, uint8_t) {
     auto* mgr = static_cast<PicoMgr*>(self);
     mgr->idx = (mgr->idx & 0x00FF) | (dt << 8);
+    mgr->restage();
     return 0;
 }
 
@@ -224,5 +430,6 @@ int PicoMgr::readAddr1(MZDevice* self, uint8_t, uint8_t* dt, uint8_t) {
 int PicoMgr::writeReset(MZDevice* self, uint8_t, uint8_t, uint8_t) {
     auto* mgr = static_cast<PicoMgr*>(self);
     mgr->idx = 0;
+    mgr->restage();
     return 0;
 }
@@ -40,9 +40,13 @@ public:
     uint8_t *allocateRaw(uint16_t sz);
     int  isInterrupt() override { return 0; }
     bool needsExwait() const override { return PICO_MGR_EXWAIT; }
-    std::vector<uint8_t> getReadPorts() const override;
-    std::vector<uint8_t> getWritePorts() const override;
-    static std::string getDevType() { return PICO_MGR_ID; }
+    // Commands list directories and mount images; the data and address
+    // ports only move through the buffer
+    bool reachesFs(uint8_t port, bool write) const override {
+        return write && port == getWriteMappings()[PICO_MGR_COMMAND_PORT_INDEX].port;
+    }
+    PortList getReadPorts() const override;
+    PortList getWritePorts() const override;
     int readConfig(dictionary *ini) override;
     int flush() override { return 0; }
 
@@ -50,7 +54,7 @@ public:
     static int writeControl(MZDevice* self, uint8_t port, uint8_t dt, uint8_t high_addr);
     static int readControl(MZDevice* self, uint8_t port, uint8_t* dt, uint8_t high_addr);
     static int writeData(MZDevice* self, uint8_t port, uint8_t dt, uint8_t high_addr);
-    static int readData(MZDevice* self, uint8_t port, uint8_t* dt, uint8_t high_addr);
+    RAM_FUNC static int readData(MZDevice* self, uint8_t port, uint8_t* dt, uint8_t high_addr);
     static int writeAddr0(MZDevice* self, uint8_t port, uint8_t dt, uint8_t high_addr);
     static int writeAddr1(MZDevice* self, uint8_t port, uint8_t dt, uint8_t high_addr);
     static int readAddr0(MZDevice* self, uint8_t port, uint8_t* dt, uint8_t high_addr);
@@ -75,15 +79,32 @@ public:
 
     void softReset() override {
         // An in-flight async cloud command still owns the data buffer on
-        // core 0; leave IN_PROGRESS standing - the fresh Z80 session sees
+        // core 0 (local ones were drained before the reset); leave
+        // IN_PROGRESS standing - the fresh Z80 session sees
         // busy until it completes (writeControl refuses new commands)
         if (response_command == PICO_MGR_RESULT_IN_PROGRESS) return;
         idx = 0;
         response_command = 0;
         resetContent();
+        restage();
     }
 
 private:
+    // The data port reads data[idx]: always RAM, so it is always staged
+    // (idx can be pointed past the buffer through the address ports)
+    inline void restage() {
+        if (idx < PICO_MGR_BUFF_SIZE) stageRead(PICO_MGR_DATA_PORT_INDEX, data[idx]);
+        else unstageRead(PICO_MGR_DATA_PORT_INDEX);
+    }
+
+    // Local LIST_DIR/MOUNT deferred to core 0 (see writeControl)
+    static int LocalJob(void* ctx);
+    static void LocalDone(void* ctx, int result);
+    std::string jobPath;
+    bool jobListDir{false};
+    // REPO_CMD_RECONFIG completion (core 1, from listen_loop)
+    static void ReconfigDone(void* ctx, int result, const char* msg);
+
     // Buffer and mappings
     uint8_t data[PICO_MGR_BUFF_SIZE];
     volatile uint8_t response_command; // written by core 0 on async completion
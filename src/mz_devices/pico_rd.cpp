@@ -1,11 +1,10 @@
 #include "ram_source.hpp"
 #include "device.hpp"
 #include "file_source.hpp"
+#include "compressed_source.hpp"
 #include "pico_rd.hpp"
 #include "bus.hpp"
 
-REGISTER_MZ_DEVICE(PicoRD)
-
 PicoRD::PicoRD()
 {
     readMappings[PICO_RD_CONTROL_PORT_INDEX].fn = PicoRD::readControl;
@@ -37,16 +36,16 @@ PicoRD::PicoRD()
     data = nullptr;
 }
 
-std::vector<uint8_t> PicoRD::getReadPorts() const {
-    std::vector<uint8_t> ports;
+PortList PicoRD::getReadPorts() const {
+    PortList ports;
     for (uint8_t i = 0; i < PICO_RD_READ_PORT_COUNT; ++i) {
         ports.push_back(PICO_RD_DEFAULT_BASE_PORT + i);
     }
     return ports;
 }
 
-std::vector<uint8_t> PicoRD::getWritePorts() const {
-    std::vector<uint8_t> ports;
+PortList PicoRD::getWritePorts() const {
+    PortList ports;
     for (uint8_t i = 0; i < PICO_RD_WRITE_PORT_COUNT; ++i) {
         ports.push_back(PICO_RD_DEFAULT_BASE_PORT + i);
     }
@@ -68,6 +67,7 @@ int PicoRD::readConfig(dictionary *ini) {
     if (sz) size = sz;
     if (!size && image.empty())
         size = PICO_RD_DEFAULT_SIZE;
+    readCacheConfig(ini);
     if (image.empty())
     {
         data = (uint8_t *)malloc(size);
@@ -75,26 +75,48 @@ int PicoRD::readConfig(dictionary *ini) {
           return E_DEVICE_NO_MEMORY;
         ByteSourceFactory::from_ram(data, size, bs);
     } else {
-       // Creating (or growing) a missing image zero-fills it through the
-       // filesystem - hundreds of ms on flash:, enough to lose the cold-
-       // boot IPL race (field-observed: no menu on the first boot after a
-       // format). Freeze the Z80 with EXWAIT for the duration: at this
-       // point of boot it is still in power-on reset or stalls on its
-       // first bus cycle, so the one-time cost is invisible. (DRAM
-       // refresh stalls too; harmless before the monitor has run.)
+       // A compressed image is there already, at the size it was packed
+       // at: the size asked for must not grow (recreate) it
+       const int packed = ByteSourceFactory::from_compressed(image, 128, /* wrap =*/true, bs);
+       if (packed < 0) {
+           bs.reset();
+           return E_DEVICE_NO_MEMORY;
+       }
+       if (packed == 0) {
+           size = bs->size();
+           applyCacheConfig(bs.get(), image.c_str());
+           return 0;
+       }
+       // Creating (or growing) a missing image only allocates it - the
+       // zero fill it once took was hundreds of ms, enough to lose the
+       // cold-boot IPL race (no menu on the first boot after a format) -
+       // and FileSource has it read as zeros, writing the zeros out in
+       // idle time once listen_loop() runs. On sd: core 0 still does the
+       // allocation (a FAT scan) once boot is over and the drive answers
+       // busy meanwhile; on flash: it is a few FAT sectors, done here.
        // Creation failure disables the device like any other resource
-       // shortfall - boot continues without it.
+       // shortfall - boot continues without it; a failed deferred one
+       // leaves the drive busy and reading 0xff.
        FILINFO fno;
        const bool creating =
            (f_stat(image.c_str(), &fno) != FR_OK || fno.fsize < size);
-       if (creating) set_exwait();
+       if (creating && work_deferrable(image.c_str())) {
+           pendingImage = image;
+           if (!deferWork(CreateJob, CreateDone, this) && !bs)
+               return E_DEVICE_NO_MEMORY; // ran inline and failed
+           return 0;
+       }
+       // An image on flash that is there already reads in place, and
+       // then pre-stages like a RAM one (inMemory())
+       if (!creating && openXip(image.c_str(), size, 128, /* wrap =*/true, bs, true, true))
+           return 0;
        const int ret = ByteSourceFactory::from_file(image, size, 128,
                                                     /* wrap =*/true, bs);
-       if (creating) release_exwait();
        if (ret != 0) {
            bs.reset();
            return E_DEVICE_NO_MEMORY;
        }
+       applyCacheConfig(bs.get(), image.c_str());
     }
     return 0;
 }
@@ -114,58 +136,106 @@ void PicoRD::setDriveContent(std::string content, bool in_ram) {
     */
 }
 
+int PicoRD::CreateJob(void* ctx) {
+    auto* rd = static_cast<PicoRD*>(ctx);
+    return ByteSourceFactory::from_file(rd->pendingImage, rd->size, 128,
+                                        /* wrap =*/true, rd->pendingBs);
+}
+
+// Core 1: background work is queued from here, not from the job
+void PicoRD::CreateDone(void* ctx, int result) {
+    auto* rd = static_cast<PicoRD*>(ctx);
+    if (result == 0) {
+        rd->applyCacheConfig(rd->pendingBs.get(), rd->pendingImage.c_str());
+        rd->bs = std::move(rd->pendingBs);
+    }
+    rd->pendingBs.reset();
+    rd->pendingImage.clear();
+    rd->restage();
+}
+
+bool PicoRD::cacheStats(CacheStats& out) const {
+    return bs && bs->cacheStats(out);
+}
+
 int PicoRD::flush() {
+    waitWork();
     if (!bs)
         return -1;
-    
+    settle();
     return bs->flush();
 }
 
 int PicoRD::writeControl(MZDevice* self, uint8_t, uint8_t, uint8_t) {
     auto* rd = static_cast<PicoRD*>(self);
+    if (!rd->ready())
+        return 0;
+    rd->settle();
     rd->bs->seek(0);
     rd->addr_idx = 0;
+    rd->restage();
     return 0;
 }
 
 int PicoRD::readControl(MZDevice* self, uint8_t, uint8_t* dt, uint8_t) {
     auto* rd = static_cast<PicoRD*>(self);
+    if (rd->workPending() || !rd->bs) {
+        *dt = PICO_RD_STATUS_BUSY;
+        return 0;
+    }
+    rd->settle();
     rd->bs->seek(0);
     rd->addr_idx = 0;
     *dt = 0;
+    rd->restage();
     return 0;
 }
 
 int PicoRD::writeData(MZDevice* self, uint8_t, uint8_t dt, uint8_t) {
     auto* rd = static_cast<PicoRD*>(self);
-    uint32_t wtn;
-
-    if (rd->readOnly)
-        rd->bs->next();
-    else
-        rd->bs->setByte(dt);
+    if (!rd->ready())
+        return 0;
+    if (rd->readOnly) {
+        uint8_t skipped;
+        rd->cur.read(rd->bs.get(), rd->at(), skipped);
+    } else {
+        rd->cur.write(rd->bs.get(), rd->at(), dt);
+    }
     rd->addr_idx = 0;
+    rd->restage();
     return 0;
 }
 
-int PicoRD::readData(MZDevice* self, uint8_t, uint8_t* dt, uint8_t) {
+RAM_FUNC int PicoRD::readData(MZDevice* self, uint8_t, uint8_t* dt, uint8_t) {
     auto* rd = static_cast<PicoRD*>(self);
-    uint32_t br;
-
-    rd->bs->getByte(*dt);
+    if (!rd->ready()) {
+        *dt = 0xff;
+        return 0;
+    }
+    rd->cur.read(rd->bs.get(), rd->at(), *dt);
     rd->addr_idx = 0;
+    rd->restage();
     return 0;
 }
 
 int PicoRD::writeAddr2(MZDevice* self, uint8_t, uint8_t dt, uint8_t) {
     auto* rd = static_cast<PicoRD*>(self);
+    if (!rd->ready())
+        return 0;
+    rd->settle();
     rd->bs->seek((rd->bs->tell() & 0x00FFffff) | ((uint32_t)dt << 16));
     rd->addr_idx = 0;
+    rd->restage();
     return 0;
 }
 
 int PicoRD::readAddr2(MZDevice* self, uint8_t, uint8_t* dt, uint8_t) {
     auto* rd = static_cast<PicoRD*>(self);
+    if (!rd->ready()) {
+        *dt = 0xff;
+        return 0;
+    }
+    rd->settle();
     *dt = (rd->bs->tell() >> 16) & 0xFF;
     rd->addr_idx = 0;
     return 0;
@@ -173,13 +243,22 @@ int PicoRD::readAddr2(MZDevice* self, uint8_t, uint8_t* dt, uint8_t) {
 
 int PicoRD::writeAddr1(MZDevice* self, uint8_t, uint8_t dt, uint8_t) {
     auto* rd = static_cast<PicoRD*>(self);
+    if (!rd->ready())
+        return 0;
+    rd->settle();
     rd->bs->seek((rd->bs->tell() & 0xFF00ffff) | ((uint32_t)dt << 8));
     rd->addr_idx = 0;
+    rd->restage();
     return 0;
 }
 
 int PicoRD::readAddr1(MZDevice* self, uint8_t, uint8_t* dt, uint8_t) {
     auto* rd = static_cast<PicoRD*>(self);
+    if (!rd->ready()) {
+        *dt = 0xff;
+        return 0;
+    }
+    rd->settle();
     *dt = (rd->bs->tell() >> 8) & 0xFF;
     rd->addr_idx = 0;
     return 0;
@@ -187,13 +266,22 @@ int PicoRD::readAddr1(MZDevice* self, uint8_t, uint8_t* dt, uint8_t) {
 
 int PicoRD::writeAddr0(MZDevice* self, uint8_t, uint8_t dt, uint8_t) {
     auto* rd = static_cast<PicoRD*>(self);
+    if (!rd->ready())
+        return 0;
+    rd->settle();
     rd->bs->seek((rd->bs->tell() & 0xFFFFff00) | dt);
     rd->addr_idx = 0;
+    rd->restage();
     return 0;
 }
 
 int PicoRD::readAddr0(MZDevice* self, uint8_t, uint8_t* dt, uint8_t) {
     auto* rd = static_cast<PicoRD*>(self);
+    if (!rd->ready()) {
+        *dt = 0xff;
+        return 0;
+    }
+    rd->settle();
     *dt = rd->bs->tell() & 0xFF;
     rd->addr_idx = 0;
     return 0;
@@ -201,18 +289,42 @@ int PicoRD::readAddr0(MZDevice* self, uint8_t, uint8_t* dt, uint8_t) {
 
 int PicoRD::writeAddrs(MZDevice* self, uint8_t, uint8_t dt, uint8_t) {
     auto* rd = static_cast<PicoRD*>(self);
+    if (!rd->ready())
+        return 0;
+    rd->settle();
     rd->bs->seek((rd->bs->tell() & ~(0xFF << (rd->addr_idx * 8))) | ((uint32_t)dt << (rd->addr_idx * 8)));
     rd->addr_idx++;
     if (rd->addr_idx > 2) rd->addr_idx = 0;
+    rd->restage();
     return 0;
 }
 
 int PicoRD::writeAddri(MZDevice* self, uint8_t, uint8_t dt, uint8_t) {
     auto* rd = static_cast<PicoRD*>(self);
-
+    if (!rd->ready())
+        return 0;
+    rd->settle();
     uint32_t new_index = rd->bs->tell() + dt;
     if (new_index >= rd->size) new_index -= rd->size;
     rd->bs->seek(new_index);
+    rd->restage();
     return 0;
 }
 
+
+// The data port streams bs: over a RAM image, publish the next byte so
+// listen_loop() can answer the Z80 without EXWAIT (file-backed images
+// can miss the cache, which only the EXWAIT path tolerates)
+RAM_FUNC void PicoRD::restage() {
+    if (!bs || !bs->inMemory()) {
+        // An image read in place stops being one on its first write
+        unstageRead(PICO_RD_DATA_PORT_INDEX);
+        return;
+    }
+    uint8_t next;
+    if (!cur.peek(at(), next)) {
+        settle();
+        bs->peekByte(next);
+    }
+    stageRead(PICO_RD_DATA_PORT_INDEX, next);
+}
@@ -18,6 +18,8 @@ constexpr uint8_t PICO_RD_DEFAULT_BASE_PORT = 0x45;
 constexpr const char PICO_RD_ID[] = "pico_rd";
 constexpr bool PICO_RD_EXWAIT = true;
 constexpr uint32_t PICO_RD_DEFAULT_SIZE = 65536;
+// Control port read: 0, or this while the image is still being created
+constexpr uint8_t PICO_RD_STATUS_BUSY = 0xFF;
 
 class PicoRD final : public MZDevice {
 public:
@@ -26,17 +28,18 @@ public:
     int init() override;
     int isInterrupt() override { return 0; }
     bool needsExwait() const override { return PICO_RD_EXWAIT; }
-    std::vector<uint8_t> getReadPorts() const override;
-    std::vector<uint8_t> getWritePorts() const override;
-    static std::string getDevType() { return PICO_RD_ID; }
+    bool reachesFs(uint8_t, bool) const override { return !data; } // an image file
+    PortList getReadPorts() const override;
+    PortList getWritePorts() const override;
     int readConfig(dictionary *ini) override;
     int flush() override;
+    bool cacheStats(CacheStats& out) const override;
     void setDriveContent(std::string content, bool in_ram);
 
     static int writeControl(MZDevice* self, uint8_t port, uint8_t dt, uint8_t high_addr);
     static int readControl(MZDevice* self, uint8_t port, uint8_t* dt, uint8_t high_addr);
     static int writeData(MZDevice* self, uint8_t port, uint8_t dt, uint8_t high_addr);
-    static int readData(MZDevice* self, uint8_t port, uint8_t* dt, uint8_t high_addr);
+    RAM_FUNC static int readData(MZDevice* self, uint8_t port, uint8_t* dt, uint8_t high_addr);
     static int writeAddr2(MZDevice* self, uint8_t port, uint8_t dt, uint8_t high_addr);
     static int readAddr2(MZDevice* self, uint8_t port, uint8_t* dt, uint8_t high_addr);
     static int writeAddr1(MZDevice* self, uint8_t port, uint8_t dt, uint8_t high_addr);
@@ -48,14 +51,38 @@ public:
 
     void softReset() override { // contents persist, like real RAM
         addr_idx = 0;
-        if (bs) bs->seek(0);
+        if (bs) {
+            settle();
+            bs->seek(0);
+        }
+        restage();
     }
 
 private:
+    RAM_FUNC void restage();
+    // The data ports go through cur; everything else positions bs itself
+    // once cur has handed its span back
+    RAM_FUNC void settle() { cur.sync(bs.get()); }
+    RAM_FUNC uint32_t at() const {
+        uint32_t pos = cur.active() ? cur.end() : bs->tell();
+        return (size && pos >= size) ? pos - size : pos;
+    }
+    // False while a deferred image creation runs (not a read-ahead fill:
+    // the image handles that) or after it failed: the port answers at
+    // once, a read with 0xff, a write dropped, as the control read answers
+    // busy. Waiting here would hold /WAIT for the whole FatFS allocation.
+    bool ready() const { return !workPending() && bs != nullptr; }
+    static int CreateJob(void* ctx);
+    static void CreateDone(void* ctx, int result);
+
     uint8_t* data;
     uint32_t size;
     uint8_t addr_idx;
     bool readOnly;
     std::unique_ptr<ByteSource> bs;
+    ByteCursor cur;
+    // Deferred sd: image creation, see readConfig
+    std::string pendingImage;
+    std::unique_ptr<ByteSource> pendingBs;
 };
 
@@ -3,8 +3,7 @@
 #include "iniparser.h"
 #include "file_source.hpp"
 #include "qd_dir_source.hpp"
-
-REGISTER_MZ_DEVICE(QDDevice)
+#include "compressed_source.hpp"
 
 // -------------------------------- Lifecycle --------------------------------
 
@@ -23,16 +22,16 @@ QDDevice::QDDevice() {
 
 QDDevice::~QDDevice() { close(); }
 
-std::vector<uint8_t> QDDevice::getReadPorts() const {
-    std::vector<uint8_t> ports;
+PortList QDDevice::getReadPorts() const {
+    PortList ports;
     for (uint8_t i = 0; i < QD_PORTS; ++i) {
         ports.push_back(QD_DEFAULT_BASE_PORT + i);
     }
     return ports;
 }
 
-std::vector<uint8_t> QDDevice::getWritePorts() const {
-    std::vector<uint8_t> ports;
+PortList QDDevice::getWritePorts() const {
+    PortList ports;
     for (uint8_t i = 0; i < QD_PORTS; ++i) {
         ports.push_back(QD_DEFAULT_BASE_PORT + i);
     }
@@ -84,6 +83,7 @@ int QDDevice::readConfig(dictionary *ini) {
 
     std::string image = iniparser_getstring(ini, (getDevID() + ":image").c_str(), "");
     cfgPath = image; // what a Z80 reset reverts the drive to
+    readCacheConfig(ini);
     setWriteProtected(iniparser_getboolean(ini, (getDevID() + ":write_protected").c_str(), false));
     if (!image.empty())
         setDriveContent(image);
@@ -119,7 +119,12 @@ void QDDevice::driveReset() {
     status |= QDSTS_HEAD_HOME;
 }
 
+bool QDDevice::cacheStats(CacheStats& out) const {
+    return bs && bs->cacheStats(out);
+}
+
 int QDDevice::flush() {
+    waitWork();
     if (!bs)
         return -1;
     
@@ -131,6 +136,8 @@ int QDDevice::flush() {
 void QDDevice::open(void) {
     FILINFO fno;
 
+    waitWork(); // a deferred save still writes into the old mount
+
     if (connected != QDISK_CONNECTED) {
         status = QDSTS_NO_DISC;
         return;
@@ -148,17 +155,29 @@ void QDDevice::open(void) {
         return;
 
     int ret;
+    bool xip = false;
     dirsrc = nullptr;
+    image = nullptr;
     if (fno.fattrib & AM_DIR) {
         ret = ByteSourceFactory::from_qddir(stdPath, 128, bs);
         if (ret == 0) dirsrc = static_cast<QDDirSource*>(bs.get());
     } else {
-        ret = ByteSourceFactory::from_file(stdPath, 0, 128, /* wrap = */false, bs);
+        // A compressed image is read through bs too (image stays nullptr)
+        ret = ByteSourceFactory::from_compressed(stdPath, 128, /* wrap = */false, bs);
+        if (ret == 1 && openXip(stdPath.c_str(), 0, 128, /* wrap = */false, bs, true, stdPath == cfgPath)) {
+            ret = 0; // read in place, through bs (image stays nullptr)
+            xip = true;
+        } else if (ret == 1) {
+            ret = ByteSourceFactory::from_file<false, true>(stdPath, 0, 128, bs, &image);
+        }
     }
     if (ret != 0) { // mount failed: report no disk instead of a dead drive
         bs.reset();
+        image = nullptr;
         return;
     }
+    if (!xip)
+        applyCacheConfig(bs.get(), stdPath.c_str());
 
     status = QDSTS_IMG_READY | QDSTS_HEAD_HOME;
     // Reported via CTS in channel A RR0 and enforced in testDiskIsWriteable.
@@ -169,6 +188,7 @@ void QDDevice::open(void) {
 }
 
 void QDDevice::close() {
+    waitWork();
     if (connected == QDISK_CONNECTED && (status & QDSTS_IMG_READY)) {
         if (bs && bs->flush() != 0) {
             std::fprintf(stderr, "QuickDisk: flush error\n");
@@ -190,6 +210,9 @@ uint8_t QDDevice::readByteFromDrive() {
         return 0xff;
     }
 
+    // The verify pass right after a save reads the file being closed
+    waitWork();
+
     // Keep the source in step with the head: write events on directory
     // mounts (and failed reads) move image_position without moving bs.
     // An unseekable position (past the backing store) reads as 0xff.
@@ -201,7 +224,7 @@ uint8_t QDDevice::readByteFromDrive() {
     // Past the backing store (which is smaller than QDISK_IMAGE_MAX_SIZE) or
     // on a read error the drive must deliver 0xff, as mz800emu does — a
     // garbage byte here can spuriously match the sync pair during hunt
-    if (bs->getByte(retval) != 0) retval = 0xff;
+    if ((image ? image->getByte(retval) : bs->getByte(retval)) != 0) retval = 0xff;
     image_position++;
     return retval;
 }
@@ -224,7 +247,12 @@ void QDDevice::writeByteIntoDrive(uint8_t value) {
         // files; the synthesized backing store is never written directly.
         // Clamp the position so a long format stream can't trip the RR1
         // CRC-error flag (mz800emu never advances position while formatting)
-        dirsrc->wrDataEvent(value);
+        // While the finished file is closed on core 0 the ROM is only
+        // sending the CRC trailer, which the save engine ignores anyway.
+        if (!workPending()) {
+            dirsrc->wrDataEvent(value);
+            if (dirsrc->savePending()) finishSave();
+        }
         if (image_position < QDISK_IMAGE_MAX_SIZE) image_position++;
         return;
     }
@@ -233,10 +261,28 @@ void QDDevice::writeByteIntoDrive(uint8_t value) {
         if (QDISK_IMAGE_MAX_SIZE == image_position) image_position++;
         return;
     };
-    bs->setByte(value);
+    if (image)
+        image->setByte(value);
+    else
+        bs->setByte(value);
     image_position++;
 }
 
+// A directory-mount save completes by closing the MZF file and rewriting
+// the directory listing - slow on an SD card, so sd: mounts hand it to
+// core 0 and the drive's next access that needs the mount waits for it.
+void QDDevice::finishSave() {
+    if (work_deferrable(stdPath.c_str()))
+        deferWork(SaveJob, nullptr, this); // runs inline if the queue is full
+    else
+        dirsrc->finalizeSave();
+}
+
+int QDDevice::SaveJob(void* ctx) {
+    static_cast<QDDevice*>(ctx)->dirsrc->finalizeSave();
+    return 0;
+}
+
 // -------------------------------- Registers --------------------------------
 
 int QDDevice::readByte(MZDevice* self_, uint8_t port, uint8_t *dt, uint8_t /*high_addr*/) {
@@ -307,8 +353,10 @@ int QDDevice::readByte(MZDevice* self_, uint8_t port, uint8_t *dt, uint8_t /*hig
                 // rebuilds the directory listing in natural order; the
                 // post-save verify pass never re-reads the count block, so
                 // its saved-file-last ordering survives (mz800emu rule)
-                if (self->dirsrc && self->image_position == 4)
+                if (self->dirsrc && self->image_position == 4) {
+                    self->waitWork();
                     self->dirsrc->rdCountEvent();
+                }
                 *dt = self->readByteFromDrive();
             }
             else *dt = 0xff;
@@ -367,6 +415,7 @@ int QDDevice::writeByte(MZDevice* self_, uint8_t port, uint8_t dt, uint8_t /*hig
                     if (channel->name == 'B') {
                         if ( (channel->Wreg[QDSIO_REGADDR_5] & 0x80) == 0x00 ) {
                             // Motor off: abandon an unfinished save, rewind
+                            self->waitWork();
                             if (self->dirsrc) self->dirsrc->wrAbortEvent();
                             if (self->status & QDSTS_IMG_READY) {
                                 if (self->bs->seek(0) != 0) {
@@ -388,6 +437,7 @@ int QDDevice::writeByte(MZDevice* self_, uint8_t port, uint8_t dt, uint8_t /*hig
                                 // rewriting the count block, otherwise a
                                 // header/body block begins. The next data
                                 // byte lands just past 00 16 16 A5.
+                                self->waitWork();
                                 if (self->testDiskIsWriteable())
                                     self->dirsrc->wrSyncEvent(self->image_position == 0);
                                 self->image_position = 3;
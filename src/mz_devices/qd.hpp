@@ -7,6 +7,10 @@
 #include "mz_devices.hpp"
 #include "byte_source.hpp"
 
+template<bool WRAP, bool AUTO_INCREMENT> class FileSourceImpl;
+// A file mount: no wrap, auto-increment
+using QDImageSource = FileSourceImpl<false, true>;
+
 class QDDirSource;
 
 #define QD_PORTS      4
@@ -74,11 +78,11 @@ public:
     void softReset() override;
     int isInterrupt() override;
     bool needsExwait() const override { return QD_EXWAIT; }
-    std::vector<uint8_t> getReadPorts() const override;
-    std::vector<uint8_t> getWritePorts() const override;
+    PortList getReadPorts() const override;
+    PortList getWritePorts() const override;
     int readConfig(dictionary *ini) override;
     int flush() override;
-    static std::string getDevType() { return QD_ID; }
+    bool cacheStats(CacheStats& out) const override;
 
     void open();
     void close();
@@ -103,9 +107,12 @@ private:
     bool writeProtected{false};
     std::unique_ptr<ByteSource> bs;
     QDDirSource* dirsrc{nullptr}; // non-null when bs is a directory mount
+    QDImageSource* image{nullptr}; // non-null when bs is a FileSource mount: direct calls
 
     void driveReset();
     uint8_t readByteFromDrive();
     void writeByteIntoDrive(uint8_t value);
     int testDiskIsWriteable();
+    void finishSave();
+    static int SaveJob(void* ctx);
 };
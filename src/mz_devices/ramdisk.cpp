@@ -3,11 +3,10 @@
 #include "embedded_mzf.hpp"
 #include "ram_source.hpp"
 #include "file_source.hpp"
+#include "compressed_source.hpp"
 #include "ramdisk.hpp"
 #include "bus.hpp"
 
-REGISTER_MZ_DEVICE(RamDisk)
-
 RamDisk::RamDisk()
 {
     readMappings[0].fn = RamDisk::resetCounter;
@@ -28,18 +27,18 @@ RamDisk::RamDisk()
     bs = nullptr;
 }
 
-std::vector<uint8_t> RamDisk::getReadPorts() const {
+PortList RamDisk::getReadPorts() const {
     return {0xf8, RAMDISK_DEFAULT_BASE_PORT + 1, RAMDISK_DEFAULT_BASE_PORT + 2};
 }
 
-std::vector<uint8_t> RamDisk::getWritePorts() const {
+PortList RamDisk::getWritePorts() const {
     return {RAMDISK_DEFAULT_BASE_PORT, RAMDISK_DEFAULT_BASE_PORT + 1, RAMDISK_DEFAULT_BASE_PORT + 2};
 }
 
 // Keep 0xf8 reset port fixed, shift only data interface ports
-std::pair<std::vector<uint8_t>, std::vector<uint8_t>> RamDisk::applyBasePort(uint8_t basePort) const {
-    std::vector<uint8_t> readPorts = {0xf8, static_cast<uint8_t>(basePort + 1), static_cast<uint8_t>(basePort + 2)};
-    std::vector<uint8_t> writePorts = {basePort, static_cast<uint8_t>(basePort + 1), static_cast<uint8_t>(basePort + 2)};
+PortLists RamDisk::applyBasePort(uint8_t basePort) const {
+    PortList readPorts = {0xf8, static_cast<uint8_t>(basePort + 1), static_cast<uint8_t>(basePort + 2)};
+    PortList writePorts = {basePort, static_cast<uint8_t>(basePort + 1), static_cast<uint8_t>(basePort + 2)};
     return {readPorts, writePorts};
 }
 
@@ -56,21 +55,24 @@ int RamDisk::readConfig(dictionary *ini) {
     if (sz) size = (sz + 0xffff) & 0xffff0000; // align to 65536 multiples
     if (!size)
         size = RAMDISK_DEFAULT_SIZE;
+    readCacheConfig(ini);
     if (!image.empty()) {
-        // Missing/short image: freeze the Z80 with EXWAIT while creating
-        // it - see pico_rd.cpp for the full rationale (cold-boot IPL race)
-        FILINFO fno;
-        const bool creating =
-            (f_stat(image.c_str(), &fno) != FR_OK || fno.fsize < size);
-        if (creating) set_exwait();
-        const int ret = ByteSourceFactory::from_file(image.c_str(), size, 128,
-                                                     /* wrap= */ false, bs,
+        // A compressed image keeps the size it was packed at. A missing/
+        // short one is only allocated, and reads as zeros until idle time
+        // writes them - see pico_rd.cpp (cold-boot IPL race)
+        int ret = ByteSourceFactory::from_compressed(image, 128, /* wrap= */ false, bs,
                                                      /* auto_increment= */ false);
-        if (creating) release_exwait();
+        if (ret == 0)
+            size = bs->size();
+        else if (ret == 1)
+            ret = ByteSourceFactory::from_file(image.c_str(), size, 128,
+                                               /* wrap= */ false, bs,
+                                               /* auto_increment= */ false);
         if (ret != 0) {
             bs.reset();
             return E_DEVICE_NO_MEMORY;
         }
+        applyCacheConfig(bs.get(), image.c_str());
     } else {
         data = (uint8_t *)malloc(size);
         if (!data)
@@ -80,19 +82,23 @@ int RamDisk::readConfig(dictionary *ini) {
     return 0;
 }
 
+bool RamDisk::cacheStats(CacheStats& out) const {
+    return bs && bs->cacheStats(out);
+}
+
 int RamDisk::flush() {
     if (!bs)
         return -1;
 
+    cur.sync(bs.get());
     return bs->flush();
 }
 
 RAM_FUNC int RamDisk::readData(MZDevice* self, uint8_t port, uint8_t* dt, uint8_t high_addr) {
     auto* disk = static_cast<RamDisk*>(self);
     
-    disk->bs->seek(disk->pos_);
-    int ret = disk->bs->getByte(*dt);
-    
+    int ret = disk->cur.read(disk->bs.get(), disk->pos_, *dt);
+
     // Increment with 64K page wrapping
     disk->pos_++;
     if ((disk->pos_ & 0xffff) == 0)
@@ -119,12 +125,10 @@ RAM_FUNC int RamDisk::writePageAddress(MZDevice* self, uint8_t port, uint8_t dt,
 RAM_FUNC int RamDisk::writeData(MZDevice* self, uint8_t port, uint8_t dt, uint8_t high_addr) {
     auto* disk = static_cast<RamDisk*>(self);
     
-    disk->bs->seek(disk->pos_);
-    
     int ret = 0;
     if (!disk->readOnly)
-        ret = disk->bs->setByte(dt);
-    
+        ret = disk->cur.write(disk->bs.get(), disk->pos_, dt);
+
     // Increment with 64K page wrapping
     disk->pos_++;
     if ((disk->pos_ & 0xffff) == 0)
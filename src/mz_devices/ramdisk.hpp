@@ -16,12 +16,13 @@ public:
     int init() override;
     int isInterrupt() override { return 0; };
     bool needsExwait() const override { return RAMDISK_EXWAIT; }
-    std::vector<uint8_t> getReadPorts() const override;
-    std::vector<uint8_t> getWritePorts() const override;
-    std::pair<std::vector<uint8_t>, std::vector<uint8_t>> applyBasePort(uint8_t basePort) const override;
+    bool reachesFs(uint8_t, bool) const override { return !data; } // an image file
+    PortList getReadPorts() const override;
+    PortList getWritePorts() const override;
+    PortLists applyBasePort(uint8_t basePort) const override;
     int readConfig(dictionary *ini) override;
     int flush() override;
-    static std::string getDevType() { return RAMDISK_ID; }
+    bool cacheStats(CacheStats& out) const override;
 
     RAM_FUNC static int readData(MZDevice* self, uint8_t port, uint8_t* dt, uint8_t high_addr);
     RAM_FUNC static int resetCounter(MZDevice* self, uint8_t port, uint8_t* dt, uint8_t high_addr);
@@ -52,4 +53,5 @@ private:
     uint32_t size;
     uint32_t pos_;
     std::unique_ptr<ByteSource> bs;
+    ByteCursor cur;                 // the data port's span of bs
 };
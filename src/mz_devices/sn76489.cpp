@@ -4,8 +4,6 @@
 #include "common.hpp"
 #include "i2s_audio.hpp"
 
-REGISTER_MZ_DEVICE(SN76489Device)
-
 // Core0: Audio (DMA, PIO, I2S)
 // Core1: Bus monitoring (port writes)
 
@@ -63,11 +61,11 @@ int SN76489Device::init() {
     return i2s_audio_register_source(this);
 }
 
-std::vector<uint8_t> SN76489Device::getReadPorts() const {
+PortList SN76489Device::getReadPorts() const {
     return {};
 }
 
-std::vector<uint8_t> SN76489Device::getWritePorts() const {
+PortList SN76489Device::getWritePorts() const {
     return {SN76489_PORT};
 }
 
@@ -32,11 +32,10 @@ public:
         return false;
         #endif
     }
-    std::vector<uint8_t> getReadPorts() const override;
-    std::vector<uint8_t> getWritePorts() const override;
+    PortList getReadPorts() const override;
+    PortList getWritePorts() const override;
     int readConfig(dictionary *ini) override;
     int flush() override;
-    static std::string getDevType() { return SN76489_ID; }
 
     // Port write handler
     RAM_FUNC static int writeData(MZDevice* self, uint8_t port, uint8_t dt, uint8_t high_addr);
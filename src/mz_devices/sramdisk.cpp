@@ -7,8 +7,6 @@
 #include "mzf_sram_ram_source.hpp"
 #include "sramdisk.hpp"
 
-REGISTER_MZ_DEVICE(SRamDisk)
-
 SRamDisk::SRamDisk()
 {
     readMappings[0].fn = SRamDisk::resetPort;
@@ -29,11 +27,11 @@ SRamDisk::SRamDisk()
     bs = nullptr;
 }
 
-std::vector<uint8_t> SRamDisk::getReadPorts() const {
+PortList SRamDisk::getReadPorts() const {
     return {SRAM_DEFAULT_BASE_PORT, SRAM_DEFAULT_BASE_PORT + 1};
 }
 
-std::vector<uint8_t> SRamDisk::getWritePorts() const {
+PortList SRamDisk::getWritePorts() const {
     return {SRAM_DEFAULT_BASE_PORT, SRAM_DEFAULT_BASE_PORT + 1, SRAM_DEFAULT_BASE_PORT + 2};
 }
 
@@ -75,7 +73,7 @@ int SRamDisk::loadMzf(const uint8_t* src, size_t src_size, bool in_ram) {
         readOnly = true;
     }
 
-    ByteSourceFactory::from_mzf_to_sram_ram(data, size, bs);
+    ByteSourceFactory::from_mzf_to_sram_ram(data, size, bs, &ram);
     return 0;
 }
 
@@ -88,6 +86,7 @@ int SRamDisk::setDriveContent(const std::string& content, bool in_ram) {
     } 
     else {
         readOnly = true;
+        ram = nullptr;
         ByteSourceFactory::from_mzf_to_sram_file(content.c_str(), 128, bs);
         size = SRAM_DEFAULT_SIZE;
     }
@@ -102,41 +101,74 @@ int SRamDisk::flush() {
     return bs->flush();
 }
 
-RAM_FUNC int SRamDisk::writePort(MZDevice* self, uint8_t port, uint8_t dt, uint8_t high_addr) {
-    auto* disk = static_cast<SRamDisk*>(self);
-
-    if (disk->readOnly) {
-        if (disk->allowBoot && disk->bs->tell() == 0) disk->firstByte = dt;
-        disk->bs->next();
-        return 0;
+template<class Src>
+RAM_FUNC void SRamDisk::writeTo(Src* src, uint8_t dt) {
+    if (readOnly) {
+        if (allowBoot && src->tell() == 0) firstByte = dt;
+        src->next();
+    } else if (src->tell() == 0) {
+        // don't write anything if attempting to write 0xa5 to the first byte - a hack to prevent sram detection on boot
+        if (allowBoot || dt != 0xa5) src->setByte(dt);
+    } else {
+        src->setByte(dt);
     }
+    restageFrom(src);
+}
 
-    if (disk->bs->tell() == 0) {
-        if (disk->allowBoot || dt != 0xa5) disk->bs->setByte(dt);
-        // don't write anything if attempting to write 0xa5 to the first byte - a hack to prevent sram detection on boot
-        return 0;
+template<class Src>
+RAM_FUNC void SRamDisk::readFrom(Src* src, uint8_t* dt) {
+    if (readOnly && allowBoot && src->tell() == 0 && firstByte != -1) {
+        *dt = (uint8_t)firstByte;
+        src->next();
+    } else {
+        src->getByte(*dt);
     }
+    restageFrom(src);
+}
+
+// The data port streams bs: over a memory-backed image (the embedded
+// menu/explorer, in_ram), publish the next byte so listen_loop() can
+// answer the Z80 without EXWAIT
+template<class Src>
+RAM_FUNC void SRamDisk::restageFrom(Src* src) {
+    if (!src->inMemory())
+        return;
+    uint8_t next;
+    if (readOnly && allowBoot && src->tell() == 0 && firstByte != -1)
+        next = (uint8_t)firstByte;
+    else
+        src->peekByte(next);
+    stageRead(1, next);
+}
 
-    disk->bs->setByte(dt);
+RAM_FUNC int SRamDisk::writePort(MZDevice* self, uint8_t port, uint8_t dt, uint8_t high_addr) {
+    auto* disk = static_cast<SRamDisk*>(self);
+    if (disk->ram)
+        disk->writeTo(disk->ram, dt);
+    else
+        disk->writeTo(disk->bs.get(), dt);
     return 0;
 }
 
 RAM_FUNC int SRamDisk::resetPort(MZDevice* self, uint8_t port, uint8_t* dt, uint8_t high_addr) {
     auto* disk = static_cast<SRamDisk*>(self);
     disk->bs->seek(0);
+    disk->restage();
     return 0;
 }
 
 RAM_FUNC int SRamDisk::readPort(MZDevice* self, uint8_t port, uint8_t* dt, uint8_t high_addr) {
     auto* disk = static_cast<SRamDisk*>(self);
-
-    if (disk->readOnly && disk->allowBoot && disk->bs->tell() == 0 && disk->firstByte != -1) {
-        *dt = (uint8_t)disk->firstByte;
-        disk->bs->next();
-        return 0;
-    }
-
-    disk->bs->getByte(*dt);
+    if (disk->ram)
+        disk->readFrom(disk->ram, dt);
+    else
+        disk->readFrom(disk->bs.get(), dt);
     return 0;
 }
 
+RAM_FUNC void SRamDisk::restage() {
+    if (ram)
+        restageFrom(ram);
+    else if (bs)
+        restageFrom(bs.get());
+}
@@ -5,6 +5,8 @@
 #include "mz_devices.hpp"
 #include "common.hpp"
 
+class Mzf2SramRamSource;
+
 constexpr uint16_t SRAM_DEFAULT_SIZE = 32768;
 constexpr uint8_t SRAM_DEFAULT_BASE_PORT = 0xf8;
 constexpr const char SRAM_ID[] = "sramdisk";
@@ -16,12 +18,12 @@ public:
     int init() override;
     int isInterrupt() override { return 0; };
     bool needsExwait() const override { return SRAM_EXWAIT; }
-    std::vector<uint8_t> getReadPorts() const override;
-    std::vector<uint8_t> getWritePorts() const override;
+    bool reachesFs(uint8_t, bool) const override { return !ram; } // an MZF file
+    PortList getReadPorts() const override;
+    PortList getWritePorts() const override;
     int readConfig(dictionary *ini) override;
     int flush() override;
     int setDriveContent(const std::string &content, bool in_ram);
-    static std::string getDevType() { return SRAM_ID; }
 
     RAM_FUNC static int readPort(MZDevice* self, uint8_t port, uint8_t* dt, uint8_t high_addr);
     RAM_FUNC static int writePort(MZDevice* self, uint8_t port, uint8_t dt, uint8_t high_addr);
@@ -30,9 +32,17 @@ public:
     void softReset() override { // mounted boot image persists
         firstByte = -1;
         if (bs) bs->seek(0);
+        restage();
     }
 
 private:
+    RAM_FUNC void restage();
+    // The data port's work, instantiated for the RAM image (direct calls
+    // into Mzf2SramRamSource) and for any other mount (virtual ones)
+    template<class Src> RAM_FUNC void readFrom(Src* src, uint8_t* dt);
+    template<class Src> RAM_FUNC void writeTo(Src* src, uint8_t dt);
+    template<class Src> RAM_FUNC void restageFrom(Src* src);
+
     uint8_t* data;
     int firstByte;
     bool allowBoot;
@@ -40,4 +50,5 @@ private:
     uint16_t size;
     int loadMzf(const uint8_t* src, size_t src_size, bool in_ram);
     std::unique_ptr<ByteSource> bs;
+    Mzf2SramRamSource* ram = nullptr; // bs, if it is a RAM image
 };
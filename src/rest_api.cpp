@@ -2,6 +2,7 @@
 
 #include "rest_api.hpp"
 
+#include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 #include <strings.h>
@@ -10,6 +11,12 @@
 #include "pico/stdlib.h"
 #include "lwip/tcp.h"
 
+#include "bus_stats.hpp"
+#include "boot_prof.hpp"
+#include "hot_config.hpp"
+#include "core_load.hpp"
+#include "disk_cache.h"
+
 
 #ifndef REST_API_PORT
 #define REST_API_PORT 8080
@@ -118,6 +125,182 @@ static err_t rest_send_response(RestConn *conn, const char *status, const char *
     return ERR_OK;
 }
 
+// Status body parts, bounded by the lwIP heap (MEM_SIZE): tcp_write
+// copies the body into it
+#ifdef BUS_STATS
+#define REST_STATUS_BUS_SIZE 2560
+#else
+#define REST_STATUS_BUS_SIZE 0
+#endif
+#ifdef BOOT_PROF
+#define REST_STATUS_BOOT_SIZE 1024
+#else
+#define REST_STATUS_BOOT_SIZE 0
+#endif
+#ifdef CORE_LOAD
+#define REST_STATUS_LOAD_SIZE 768
+#else
+#define REST_STATUS_LOAD_SIZE 0
+#endif
+#if DISK_CACHE_BLOCKS
+#define REST_STATUS_DISK_SIZE 256
+#else
+#define REST_STATUS_DISK_SIZE 0
+#endif
+
+#if defined(BUS_STATS) || defined(BOOT_PROF) || defined(CORE_LOAD) || DISK_CACHE_BLOCKS
+__attribute__((format(printf, 4, 5)))
+static void buf_append(char *out, size_t cap, size_t *n, const char *fmt, ...) {
+    if (*n >= cap) return;
+    va_list ap;
+    va_start(ap, fmt);
+    int w = vsnprintf(out + *n, cap - *n, fmt, ap);
+    va_end(ap);
+    if (w > 0) *n += (size_t)w;
+}
+#endif
+
+#ifdef BUS_STATS
+static void append_hist(char *out, size_t cap, size_t *n, const char *name, const uint32_t *hist) {
+    int last = BUS_STATS_BUCKETS - 1;
+    while (last > 0 && hist[last] == 0) last--;
+    buf_append(out, cap, n, ",\"%s\":[", name);
+    for (int b = 0; b <= last; b++)
+        buf_append(out, cap, n, b ? ",%lu" : "%lu", (unsigned long)hist[b]);
+    buf_append(out, cap, n, "]");
+}
+
+// Appends ",\"bus\":{...}" to a status body: per active port the cycle
+// count, worst latency/hold in ns and both histograms, trimmed after the
+// last non-empty bucket (see bus_stats.hpp for the bucket layout)
+static size_t append_bus_stats(char *out, size_t cap) {
+    const uint32_t khz = bus_stats_clock_khz();
+    size_t n = 0;
+    bool first = true;
+    bool truncated = false;
+
+    buf_append(out, cap, &n, ",\"bus\":{\"clk_khz\":%lu,\"bucket0_cycles\":%u,\"ports\":[",
+               (unsigned long)khz, 1u << BUS_STATS_BUCKET_SHIFT);
+    for (uint8_t i = 0; i < bus_stats_ports; i++) {
+        const BusPortStats *s = &bus_stats[i];
+        if (!s->count) continue;
+        size_t mark = n;
+        buf_append(out, cap, &n, "%s{\"port\":%u,\"count\":%lu,\"lat_max_ns\":%lu,\"hold_max_ns\":%lu",
+                   first ? "" : ",", s->port, (unsigned long)s->count,
+                   (unsigned long)((uint64_t)s->lat_max * 1000000u / khz),
+                   (unsigned long)((uint64_t)s->hold_max * 1000000u / khz));
+        append_hist(out, cap, &n, "lat", s->lat);
+        append_hist(out, cap, &n, "hold", s->hold);
+        buf_append(out, cap, &n, "}");
+        // Keep room for the closing brackets; drop a port that didn't fit
+        if (n + 24 >= cap) {
+            n = mark;
+            truncated = true;
+            break;
+        }
+        first = false;
+    }
+    buf_append(out, cap, &n, "],\"truncated\":%s}", truncated ? "true" : "false");
+    return n < cap ? n : cap - 1;
+}
+#endif
+
+#ifdef BOOT_PROF
+// Appends ",\"boot\":{...}": listen_loop entry and its margin to the IPL
+// probe, [start, duration] per phase and the per-device steps, all in us
+// since reset (see boot_prof.hpp)
+static size_t append_boot_prof(char *out, size_t cap) {
+    size_t n = 0;
+    const BootProfile *b = &boot_prof;
+    buf_append(out, cap, &n, ",\"boot\":{\"listen_us\":%lu,\"ipl_us\":%lu,\"margin_us\":%ld,\"ini\":\"%s\",\"phases\":{",
+               (unsigned long)b->listen_us, (unsigned long)BOOT_PROF_IPL_US,
+               (long)BOOT_PROF_IPL_US - (long)b->listen_us, b->iniFromSd ? "sd" : "flash");
+    for (uint8_t i = 0; i < BOOT_PHASE_COUNT; i++)
+        buf_append(out, cap, &n, "%s\"%s\":[%lu,%lu]", i ? "," : "", boot_prof_phase_name(i),
+                   (unsigned long)b->phase[i].start_us, (unsigned long)b->phase[i].dur_us);
+    buf_append(out, cap, &n, "},\"devices\":[");
+    for (uint8_t i = 0; i < b->devCount; i++) {
+        const BootDevice *d = &b->dev[i];
+        buf_append(out, cap, &n, "%s{\"id\":\"%.*s\",\"ports\":%lu,\"init\":%lu,\"config\":%lu}",
+                   i ? "," : "", BOOT_PROF_ID_LEN, d->id,
+                   (unsigned long)d->step_us[BOOT_DEV_PORTS], (unsigned long)d->step_us[BOOT_DEV_INIT],
+                   (unsigned long)d->step_us[BOOT_DEV_CONFIG]);
+    }
+    buf_append(out, cap, &n, "]}");
+    return n < cap ? n : cap - 1;
+}
+#endif
+
+#ifdef CORE_LOAD
+static uint32_t permille(uint64_t part, uint64_t whole) {
+    return whole ? (uint32_t)(part * 1000 / whole) : 0;
+}
+
+// One window sum as {"busy":..,<task>:..} for core 0 and {"busy":..}
+// (plus "bus" with BUS_STATS) for core 1, in percent
+static void append_load_window(char *out, size_t cap, size_t *n, const char *name, const CoreLoadWindow &w) {
+    uint32_t busy = permille(w.window_us - w.us[CORE_LOAD_IDLE], w.window_us);
+    buf_append(out, cap, n, "\"%s\":{\"core0\":{\"busy\":%lu.%lu", name,
+               (unsigned long)busy / 10, (unsigned long)busy % 10);
+    for (uint8_t t = CORE_LOAD_IDLE + 1; t < CORE_LOAD_TASKS; t++) {
+        uint32_t pm = permille(w.us[t], w.window_us);
+        buf_append(out, cap, n, ",\"%s\":%lu.%lu", core_load_task_name(t),
+                   (unsigned long)pm / 10, (unsigned long)pm % 10);
+    }
+    busy = core_load_core1_permille(w);
+    buf_append(out, cap, n, "},\"core1\":{\"busy\":%lu.%lu",
+               (unsigned long)busy / 10, (unsigned long)busy % 10);
+#ifdef BUS_STATS
+    busy = permille(w.busy1, (uint64_t)w.window_us * bus_stats_clock_khz() / 1000);
+    buf_append(out, cap, n, ",\"bus\":%lu.%lu", (unsigned long)busy / 10, (unsigned long)busy % 10);
+#endif
+    buf_append(out, cap, n, "},\"underruns\":%lu}", (unsigned long)w.underruns);
+}
+
+// Appends ",\"load\":{...}": busy shares over the last second and the
+// last ten, then per second (newest first) core 0 busy, core 1 busy and
+// I2S underruns, to line spikes up with dropouts (see core_load.hpp)
+static size_t append_core_load(char *out, size_t cap) {
+    size_t n = 0;
+    CoreLoadWindow w;
+    buf_append(out, cap, &n, ",\"load\":{");
+    core_load_sum(1, w);
+    append_load_window(out, cap, &n, "1s", w);
+    buf_append(out, cap, &n, ",");
+    core_load_sum(CORE_LOAD_SECONDS, w);
+    append_load_window(out, cap, &n, "10s", w);
+    buf_append(out, cap, &n, ",\"seconds\":[");
+    uint8_t i = core_load_head;
+    for (uint8_t k = 0; k < CORE_LOAD_SECONDS; k++) {
+        i = (i + CORE_LOAD_SECONDS - 1) % CORE_LOAD_SECONDS;
+        const CoreLoadWindow &s = core_load_hist[i];
+        if (!s.window_us) break;
+        buf_append(out, cap, &n, "%s[%lu,%lu,%lu]", k ? "," : "",
+                   (unsigned long)permille(s.window_us - s.us[CORE_LOAD_IDLE], s.window_us) / 10,
+                   (unsigned long)core_load_core1_permille(s) / 10, (unsigned long)s.underruns);
+    }
+    buf_append(out, cap, &n, "]}");
+    return n < cap ? n : cap - 1;
+}
+#endif
+
+#if DISK_CACHE_BLOCKS
+static size_t append_disk_cache(char *out, size_t cap) {
+    static const char *const names[DISK_CACHE_DRIVES] = { "flash", "sd" };
+    size_t n = 0;
+    buf_append(out, cap, &n, ",\"disk_cache\":{\"sectors\":%d", DISK_CACHE_BLOCKS);
+    for (uint8_t pdrv = 0; pdrv < DISK_CACHE_DRIVES; pdrv++) {
+        DiskCacheStats s;
+        disk_cache_get_stats(pdrv, &s);
+        buf_append(out, cap, &n, ",\"%s\":{\"hits\":%lu,\"misses\":%lu,\"fat_hits\":%lu,\"evictions\":%lu}",
+                   names[pdrv], (unsigned long)s.hits, (unsigned long)s.misses,
+                   (unsigned long)s.meta_hits, (unsigned long)s.evictions);
+    }
+    buf_append(out, cap, &n, "}");
+    return n < cap ? n : cap - 1;
+}
+#endif
+
 static void rest_handle_command(const char *cmd) {
     if (!cmd) return;
     strncpy(g_last_cmd, cmd, sizeof(g_last_cmd) - 1);
@@ -170,9 +353,23 @@ static void rest_parse_and_handle(RestConn *conn) {
     }
 
     if (strcasecmp(method, "GET") == 0 && strncmp(uri, "/api/status", 11) == 0) {
-        char body_json[96];
+        static char body_json[96 + REST_STATUS_BUS_SIZE + REST_STATUS_BOOT_SIZE + REST_STATUS_LOAD_SIZE +
+                              REST_STATUS_DISK_SIZE];
         uint32_t ms = to_ms_since_boot(get_absolute_time());
-        snprintf(body_json, sizeof(body_json), "{\"status\":\"ok\",\"uptime_ms\":%lu}", (unsigned long)ms);
+        int n = snprintf(body_json, sizeof(body_json), "{\"status\":\"ok\",\"uptime_ms\":%lu", (unsigned long)ms);
+#ifdef BOOT_PROF
+        n += (int)append_boot_prof(body_json + n, REST_STATUS_BOOT_SIZE);
+#endif
+#ifdef BUS_STATS
+        n += (int)append_bus_stats(body_json + n, REST_STATUS_BUS_SIZE);
+#endif
+#ifdef CORE_LOAD
+        n += (int)append_core_load(body_json + n, REST_STATUS_LOAD_SIZE);
+#endif
+#if DISK_CACHE_BLOCKS
+        n += (int)append_disk_cache(body_json + n, REST_STATUS_DISK_SIZE);
+#endif
+        snprintf(body_json + n, sizeof(body_json) - n, "}");
         rest_send_response(conn, "200 OK", "application/json", body_json);
         return;
     }
@@ -222,6 +419,47 @@ static void rest_parse_and_handle(RestConn *conn) {
         return;
     }
 
+    // Runtime device reconfiguration (hot_config.hpp): POST queues one
+    // command for core 1, GET reports how the last one went
+    if (is_post && strncmp(uri, "/api/reconfig", 13) == 0) {
+        char cmd[HOT_CONFIG_CMD_LEN];
+        if (body_len >= sizeof(cmd)) {
+            rest_send_response(conn, "400 Bad Request", "application/json", "{\"error\":\"command too long\"}");
+            return;
+        }
+        memcpy(cmd, body, body_len);
+        cmd[body_len] = '\0';
+        if (cmd[0] == '\0') {
+            rest_send_response(conn, "400 Bad Request", "application/json", "{\"error\":\"missing command\"}");
+            return;
+        }
+        if (hot_config_submit(HOT_CONFIG_REST, cmd, nullptr, nullptr)) {
+            rest_send_response(conn, "409 Conflict", "application/json", "{\"error\":\"busy\"}");
+            return;
+        }
+        rest_send_response(conn, "202 Accepted", "application/json", "{\"queued\":true}");
+        return;
+    }
+
+    if (strcasecmp(method, "GET") == 0 && strncmp(uri, "/api/reconfig", 13) == 0) {
+        static const char *const states[] = {"idle", "queued", "done"};
+        const HotConfigSlot &s = hot_config_slot[HOT_CONFIG_REST];
+        uint8_t state = s.state;
+        char msg[HOT_CONFIG_MSG_LEN];
+        size_t m = 0;
+        // Quotes and backslashes would break the JSON string
+        if (state == HOT_CONFIG_DONE) {
+            for (const char *c = s.msg; *c && m + 1 < sizeof(msg); ++c)
+                if (*c != '"' && *c != '\\') msg[m++] = *c;
+        }
+        msg[m] = '\0';
+        char body_json[HOT_CONFIG_MSG_LEN + 64];
+        snprintf(body_json, sizeof(body_json), "{\"state\":\"%s\",\"result\":%d,\"message\":\"%s\"}",
+                 states[state], state == HOT_CONFIG_DONE ? s.result : 0, msg);
+        rest_send_response(conn, "200 OK", "application/json", body_json);
+        return;
+    }
+
     rest_send_response(conn, "404 Not Found", "application/json", "{\"error\":\"not found\"}");
 }
 
@@ -257,7 +495,9 @@ static err_t rest_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t er
     pbuf_free(p);
 
     if (!conn->responded) {
+        uint8_t task = core_load_enter(CORE_LOAD_REST);
         rest_parse_and_handle(conn);
+        core_load_enter(task);
         if (conn->responded) {
             rest_close_conn(conn);
         }
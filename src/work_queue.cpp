@@ -0,0 +1,207 @@
+#include <strings.h>
+
+#include "pico/stdlib.h"
+
+#include "work_queue.hpp"
+#include "mz_devices.hpp"
+#include "core_load.hpp"
+
+struct WorkJob {
+    MZDevice* owner;
+    WorkFn run;
+    WorkDoneFn done;
+    void* ctx;
+    int result;
+    bool background;
+};
+
+static WorkJob work_ring[WORK_QUEUE_SIZE];
+volatile uint32_t work_head = 0;
+volatile uint32_t work_done = 0;
+uint32_t work_reaped = 0;
+Core1Events core1_events = {};
+
+volatile uintptr_t work_core1 = 0;
+volatile bool work_core0_fs = false;
+MZDevice* volatile work_core0_owner = nullptr;
+// Core 0 is inside a job (read by its own reset IRQ)
+static volatile bool work_running = false;
+
+struct IdleJob {
+    IdleFn volatile run;    // nullptr: free
+    void* volatile ctx;
+};
+
+static IdleJob work_idle[WORK_IDLE_SLOTS];
+// Core 0 is in a round of this slot + 1 (0: none)
+static volatile uint32_t work_idle_running = 0;
+static uint32_t work_idle_next = 0;     // core 0 only: round-robin
+
+bool work_fs_claim(MZDevice* owner) {
+    work_core0_owner = owner;
+    __dmb();
+    work_core0_fs = true;
+    __dmb();
+    uintptr_t c1 = work_core1;
+    if (c1 && (!owner || c1 != (uintptr_t)owner)) {
+        work_core0_fs = false;
+        return false;
+    }
+    return true;
+}
+
+void work_fs_release(void) {
+    __dmb();
+    work_core0_fs = false;
+}
+
+int work_post(MZDevice* owner, WorkFn run, WorkDoneFn done, void* ctx,
+              bool background) {
+    uint32_t head = work_head;
+    if (head - work_reaped >= WORK_QUEUE_SIZE)
+        return -1;
+    WorkJob& j = work_ring[head & (WORK_QUEUE_SIZE - 1)];
+    j.owner = owner;
+    j.run = run;
+    j.done = done;
+    j.ctx = ctx;
+    j.result = 0;
+    j.background = background;
+    __dmb();
+    work_head = head + 1;
+    return 0;
+}
+
+// A round of the next idle job, if core 1 is out of every handler. The
+// slot is re-read once marked running: work_idle_remove() clears it
+// first and then waits for the mark to go.
+static void work_poll_idle(void) {
+    for (uint32_t n = 0; n < WORK_IDLE_SLOTS; n++) {
+        const uint32_t slot = work_idle_next++ % WORK_IDLE_SLOTS;
+        if (!work_idle[slot].run)
+            continue;
+        if (!work_fs_claim(nullptr))
+            return;
+        work_idle_running = slot + 1;
+        __dmb();
+        IdleFn run = work_idle[slot].run;
+        void* ctx = work_idle[slot].ctx;
+        if (run) {
+            uint8_t task = core_load_enter(CORE_LOAD_WORK);
+            if (!run(ctx))
+                work_idle[slot].run = nullptr;
+            core_load_enter(task);
+        }
+        __dmb();
+        work_idle_running = 0;
+        work_fs_release();
+        return;
+    }
+}
+
+bool work_idle_add(IdleFn run, void* ctx) {
+    for (uint32_t slot = 0; slot < WORK_IDLE_SLOTS; slot++) {
+        if (work_idle[slot].run)
+            continue;
+        work_idle[slot].ctx = ctx;
+        __dmb();
+        work_idle[slot].run = run;
+        return true;
+    }
+    return false;
+}
+
+void work_idle_remove(void* ctx) {
+    for (uint32_t slot = 0; slot < WORK_IDLE_SLOTS; slot++) {
+        if (!work_idle[slot].run || work_idle[slot].ctx != ctx)
+            continue;
+        work_idle[slot].run = nullptr;
+        __dmb();
+        while (work_idle_running == slot + 1)
+            tight_loop_contents();
+    }
+}
+
+void work_poll(void) {
+    uint32_t i = work_done;
+    if (i == work_head) {
+        work_poll_idle();
+        return;
+    }
+    __dmb();
+    WorkJob& j = work_ring[i & (WORK_QUEUE_SIZE - 1)];
+    // A background job claims the volume as core 0's own: its device's
+    // handlers do not answer busy for it, and those of another drive of
+    // the same device would reach FatFS alongside it
+    if (!work_fs_claim(j.background ? nullptr : j.owner))
+        return;
+    uint8_t task = core_load_enter(CORE_LOAD_WORK);
+    work_running = true;
+    j.result = j.run(j.ctx);
+    work_running = false;
+    work_fs_release();
+    core_load_enter(task);
+    work_done = i + 1;
+    core1_event_raise(CORE1_EV_WORK);
+}
+
+void work_reap(void) {
+    uint32_t done = work_done;
+    __dmb();
+    while (work_reaped != done) {
+        WorkJob& j = work_ring[work_reaped & (WORK_QUEUE_SIZE - 1)];
+        if (j.done)
+            j.done(j.ctx, j.result);
+        if (j.owner) {
+            if (j.background)
+                j.owner->backgroundPending_--;
+            else
+                j.owner->workPending_--;
+        }
+        work_reaped++;
+    }
+}
+
+// One round of waiting on core 0. The host build has no second core: the
+// waiter runs the queue itself.
+static inline void work_wait_step(void) {
+    #ifdef MZPICO_HOST
+    work_poll();
+    #endif
+    tight_loop_contents();
+    if (work_completed())
+        work_reap();
+}
+
+void work_drain(void) {
+    while (work_reaped != work_head)
+        work_wait_step();
+}
+
+// Core 1, from a handler: leave the FatFS handover while waiting (core 0
+// would otherwise back off from the very job being waited for), then
+// resume as the handler that was running
+void work_wait(MZDevice* dev) {
+    uintptr_t state = work_core1;
+    work_core1_leave();
+    while (dev->workInFlight())
+        work_wait_step();
+    if (state)
+        work_core1_enter(state == 1 ? nullptr : (MZDevice*)state);
+}
+
+void work_run_pending(void) {
+    if (work_running)
+        return;
+    uint32_t i = work_done;
+    while (i != work_head) {
+        WorkJob& j = work_ring[i & (WORK_QUEUE_SIZE - 1)];
+        j.result = j.run(j.ctx);
+        work_done = ++i;
+    }
+    core1_event_raise(CORE1_EV_WORK);
+}
+
+bool work_deferrable(const char* path) {
+    return path && strncasecmp(path, "sd:", 3) == 0;
+}
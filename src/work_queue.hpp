@@ -0,0 +1,148 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+#include "common.hpp"
+
+class MZDevice;
+
+// Deferred work: slow FatFS operations that core 1 hands to core 0, so a
+// bus handler returns in bounded time however slow the SD card is.
+//
+// Core 1 posts a job into a single-producer/single-consumer ring; core 0
+// runs one job per poll of its main loop (work_poll) and publishes the
+// result; core 1 runs the job's completion callback from listen_loop()
+// between bus cycles (work_reap). A device with work in flight reports
+// busy through its own status registers (MZDevice::deferWork).
+//
+// FatFS is not reentrant (FF_FS_REENTRANT=0) and core 1 handlers use it
+// from inside EXWAIT-held cycles, so the volume is handed over between
+// the cores: core 1 marks itself busy around every EXWAIT handler that
+// can reach FatFS (PORT_FS, MZDevice::reachesFs; a handler over RAM
+// never waits) and around boot and the soft-reset flush, core 0 claims
+// the volume only while core 1 is idle and core 1 holds its next such
+// cycle until core 0 is done. The one exception is the job's own device: its handlers run
+// alongside its job, and must then touch neither FatFS nor anything the
+// job owns - they answer busy from register state instead. Background
+// jobs, which leave their device ready, have no such exception.
+//
+// Only sd: work is deferred (work_deferrable): a flash: write from core 0
+// locks core 1 out mid-bus-cycle (flash_fs.c), so flash work stays inline
+// under EXWAIT.
+
+constexpr uint32_t WORK_QUEUE_SIZE = 8; // power of 2
+
+// Runs on core 0: FatFS allowed. The return value goes to the callback.
+typedef int (*WorkFn)(void* ctx);
+// Runs on core 1 between bus cycles: keep it short (record the result;
+// anything needing FatFS belongs in the device's next handler)
+typedef void (*WorkDoneFn)(void* ctx, int result);
+
+// Core 1 state for the FatFS handover: 0 idle, else the device whose
+// handler runs (1: none in particular - boot, soft reset, shared ports)
+extern volatile uintptr_t work_core1;
+extern volatile bool work_core0_fs;
+extern MZDevice* volatile work_core0_owner;
+
+// Core 1: about to run code that may use FatFS, on behalf of `dev`
+ALWAYS_INLINE void work_core1_enter(MZDevice* dev) {
+    work_core1 = dev ? (uintptr_t)dev : 1;
+    __dmb();
+    while (work_core0_fs && (!dev || work_core0_owner != dev))
+        tight_loop_contents();
+}
+
+ALWAYS_INLINE void work_core1_leave(void) {
+    __dmb();
+    work_core1 = 0;
+}
+
+// Core 0: claim the FatFS volume for work owned by `owner` (nullptr:
+// core 0's own, e.g. the bus trace writer). Fails (try again next poll)
+// while core 1 is inside a handler of any other device.
+bool work_fs_claim(MZDevice* owner);
+void work_fs_release(void);
+
+// Core 1: queue `run` on core 0; -1 when the ring is full. A background
+// job (read-ahead, write-behind) is waited for like any other but does not make its
+// device busy (MZDevice::workPending), and holds the volume against the
+// handlers of its own device too.
+int work_post(MZDevice* owner, WorkFn run, WorkDoneFn done, void* ctx,
+              bool background = false);
+
+// Core 0 main loop: run the oldest queued job, if the volume is free
+void work_poll(void);
+
+extern volatile uint32_t work_head;     // posted, written by core 1
+extern volatile uint32_t work_done;     // completed, written by core 0
+extern uint32_t work_reaped;            // callbacks run, core 1 only
+
+ALWAYS_INLINE bool work_completed(void) {
+    return work_done != work_reaped;
+}
+
+// What listen_loop()'s idle branch has to do, tested with one load per
+// empty poll: a byte per event, each set with a plain store by whoever
+// raises it (the M0+ has no atomic read-modify-write across cores).
+// Core 1 clears a byte before it handles the event, so one raised while
+// it does is seen on the next poll; a spare wake-up finds nothing to do.
+enum : uint8_t {
+    CORE1_EV_WORK,          // a job completed (work_reap)
+    CORE1_EV_HOT_CONFIG,    // a command was queued (hot_config_apply)
+    CORE1_EV_SOFT_RESET,    // the Z80 reset line fired
+};
+union Core1Events {
+    volatile uint32_t any;
+    volatile uint8_t ev[4];
+};
+extern Core1Events core1_events;
+
+ALWAYS_INLINE void core1_event_raise(uint8_t ev) {
+    __dmb(); // what the event is about before the event
+    core1_events.ev[ev] = 1;
+}
+
+// Core 1: take `ev` if raised
+ALWAYS_INLINE bool core1_event_take(uint8_t ev) {
+    if (!core1_events.ev[ev])
+        return false;
+    core1_events.ev[ev] = 0;
+    __dmb();
+    return true;
+}
+
+// Core 1: run the completion callbacks of finished jobs
+void work_reap(void);
+
+// Core 1, usually from `dev`'s handler (MZDevice::waitWork): wait until
+// the device's jobs have completed and been reaped
+void work_wait(MZDevice* dev);
+
+// Core 1: wait until every job posted so far has completed and been
+// reaped (Z80 soft reset: the flush must see the deferred writes)
+void work_drain(void);
+
+// Idle work: a job core 0 runs in short rounds, one per poll that finds
+// the queue empty and core 1 outside every handler (as core 0's own work,
+// work_fs_claim(nullptr)), until it returns false. Core 1 entering a
+// handler waits out a round in progress, so a round never overlaps one;
+// keep rounds to a few ms. For work nothing waits on - writing out the
+// zeros of a new image.
+constexpr uint32_t WORK_IDLE_SLOTS = 4;
+typedef bool (*IdleFn)(void* ctx);
+
+// Core 1: run `run` whenever core 0 is idle; false if every slot is taken
+bool work_idle_add(IdleFn run, void* ctx);
+// Core 1: stop running the job of `ctx`, waiting out a round in progress
+void work_idle_remove(void* ctx);
+
+// Core 0 Z80-reset IRQ, escape hatch: run the jobs core 0 has not
+// started yet inline, ahead of the final flush. Skipped if the IRQ
+// interrupted a running job (the volume is mid-operation).
+void work_run_pending(void);
+
+// Whether work on `path` may go to core 0 (sd: volume only)
+bool work_deferrable(const char* path);